@@ -0,0 +1,98 @@
+//							-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef ASIOSERVICEPOOL_H
+#define ASIOSERVICEPOOL_H
+
+// Boost headers must come before wx headers on Windows, see LibSocketAsio.cpp
+#include <boost/asio/io_service.hpp>
+
+#include <wx/thread.h>	// Needed for wxMutex
+
+#include <vector>
+
+
+/**
+ * The io_services of the Asio thread pool, one for each thread.
+ *
+ * A socket is bound to one of them for its whole life, so all its handlers
+ * run on the same thread and its strand is never contended by other threads.
+ * New sockets are spread over the io_services round robin.
+ * Before CAsioService has started there is just one io_service, used by
+ * sockets created early and by the synchronous sockets of amulecmd.
+ */
+class CAsioServicePool
+{
+public:
+	CAsioServicePool() : m_next(0) {}
+
+	~CAsioServicePool()
+	{
+		for (size_t i = 0; i < m_services.size(); i++) {
+			delete m_services[i];
+		}
+	}
+
+	// Returns the io_service for a new socket
+	boost::asio::io_service & Get()
+	{
+		wxMutexLocker lock(m_lock);
+		if (m_services.empty()) {
+			m_services.push_back(new boost::asio::io_service);
+		}
+		return * m_services[m_next++ % m_services.size()];
+	}
+
+	// Returns the io_service run by thread 'index'
+	boost::asio::io_service & GetByIndex(size_t index)
+	{
+		wxMutexLocker lock(m_lock);
+		while (m_services.size() <= index) {
+			m_services.push_back(new boost::asio::io_service);
+		}
+		return * m_services[index];
+	}
+
+	void Stop()
+	{
+		wxMutexLocker lock(m_lock);
+		for (size_t i = 0; i < m_services.size(); i++) {
+			m_services[i]->stop();
+		}
+	}
+
+private:
+	//@{
+	//! Neither copyable nor assignable.
+	CAsioServicePool(const CAsioServicePool&);
+	CAsioServicePool& operator=(const CAsioServicePool&);
+	//@}
+
+	std::vector<boost::asio::io_service *> m_services;
+	size_t	m_next;
+	wxMutex	m_lock;
+};
+
+#endif // ASIOSERVICEPOOL_H
+// File_checked_for_headers
@@ -0,0 +1,223 @@
+//							-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+/**
+ * @file
+ *
+ * Minimal atomic primitives.
+ *
+ * wxWidgets 2.8 has no atomics and boost is optional, so the few places
+ * that need lock-free publication or counters use these wrappers around
+ * the compiler intrinsics instead.
+ */
+
+#include <wx/thread.h>	// Needed for wxThread::Yield
+
+#if defined(_MSC_VER)
+#	include <windows.h>	// Needed for MemoryBarrier and the Interlocked* functions
+#endif
+
+
+/** Full memory barrier. */
+inline void AtomicFence()
+{
+#if defined(__GNUC__)
+	__sync_synchronize();
+#elif defined(_MSC_VER)
+	MemoryBarrier();
+#else
+#	error "No memory barrier available for this compiler."
+#endif
+}
+
+
+/** Atomically adds 'value' to 'target' and returns the new value. */
+template <typename TYPE>
+inline TYPE AtomicAdd(volatile TYPE& target, TYPE value)
+{
+#if defined(__GNUC__)
+	return __sync_add_and_fetch(&target, value);
+#else
+	return InterlockedExchangeAdd(reinterpret_cast<volatile long*>(&target), value) + value;
+#endif
+}
+
+
+#if defined(_MSC_VER)
+/** 64 bit variant of AtomicAdd, InterlockedExchangeAdd only handles longs. */
+inline unsigned __int64 AtomicAdd(volatile unsigned __int64& target, unsigned __int64 value)
+{
+	return InterlockedExchangeAdd64(reinterpret_cast<volatile __int64*>(&target), (__int64)value) + value;
+}
+#endif
+
+
+/**
+ * A pointer that can be read without locking while it is being replaced
+ * by another thread.
+ *
+ * Store() publishes an object only after all writes that built it are
+ * visible, so a reader that sees the new pointer also sees the finished
+ * object. Reclaiming the old object is the owner's business.
+ */
+template <typename TYPE>
+class CAtomicPointer
+{
+public:
+	CAtomicPointer(TYPE* ptr = 0)
+		: m_ptr(ptr)
+	{}
+
+	/**
+	 * Returns the current pointer.
+	 *
+	 * Readers only dereference the returned pointer, so the data dependency
+	 * orders their reads on every supported CPU and only the compiler has
+	 * to be kept from reordering; this keeps Load() as cheap as a plain read.
+	 */
+	TYPE* Load() const
+	{
+		TYPE* ptr = m_ptr;
+#if defined(__GNUC__)
+		__asm__ __volatile__("" ::: "memory");
+#elif defined(_MSC_VER)
+		_ReadWriteBarrier();
+#endif
+		return ptr;
+	}
+
+	/** Publishes a new pointer. */
+	void Store(TYPE* ptr)
+	{
+		AtomicFence();
+		m_ptr = ptr;
+		AtomicFence();
+	}
+
+	/** Publishes a new pointer and returns the previous one. */
+	TYPE* Exchange(TYPE* ptr)
+	{
+		AtomicFence();
+#if defined(__GNUC__)
+		TYPE* old = __sync_lock_test_and_set(&m_ptr, ptr);
+#else
+		TYPE* old = static_cast<TYPE*>(InterlockedExchangePointer(reinterpret_cast<void* volatile*>(&m_ptr), ptr));
+#endif
+		AtomicFence();
+		return old;
+	}
+
+private:
+	//@{
+	//! Neither copyable nor assignable.
+	CAtomicPointer(const CAtomicPointer<TYPE>&);
+	CAtomicPointer<TYPE>& operator=(const CAtomicPointer<TYPE>&);
+	//@}
+
+	TYPE* volatile m_ptr;
+};
+
+
+/**
+ * Tells the single writer of a CAtomicPointer when the object it replaced
+ * is no longer used by any reader.
+ *
+ * Readers enter before they load the pointer and leave when they are done
+ * with the object. Wait() starts a new period and returns once every reader
+ * counted in the previous one has left. A reader only counts itself in the
+ * period that is still current after it registered, retrying otherwise, so
+ * a reader that loaded the old pointer is counted in a period that the
+ * Wait() after Exchange() waits for, and the old object can be freed then.
+ * Readers entering in the new period don't delay Wait(), so it returns
+ * after the longest running read at most.
+ */
+class CGracePeriod
+{
+public:
+	CGracePeriod()
+		: m_period(0)
+	{
+		m_readers[0] = m_readers[1] = 0;
+	}
+
+	/** Marks a reader for the lifetime of the object. */
+	class CReader
+	{
+	public:
+		CReader(CGracePeriod& gracePeriod)
+			: m_gracePeriod(gracePeriod)
+		{
+			for (;;) {
+				m_period = m_gracePeriod.m_period & 1;
+				// Full barrier, the period is read again and the pointer
+				// loaded after this
+				AtomicAdd(m_gracePeriod.m_readers[m_period], 1u);
+				// If Wait() started a new period meanwhile, it may have
+				// found this slot empty already and will not wait for us.
+				if ((m_gracePeriod.m_period & 1) == m_period) {
+					break;
+				}
+				AtomicAdd(m_gracePeriod.m_readers[m_period], ~0u);
+			}
+		}
+
+		~CReader()
+		{
+			AtomicAdd(m_gracePeriod.m_readers[m_period], ~0u);
+		}
+
+	private:
+		CGracePeriod&	m_gracePeriod;
+		unsigned	m_period;
+	};
+
+	/** Waits for the readers that may still use a replaced object. */
+	void Wait()
+	{
+		unsigned previous = m_period & 1;
+		AtomicFence();
+		m_period = m_period + 1;
+		AtomicFence();
+		while (m_readers[previous] != 0) {
+			wxThread::Yield();
+		}
+		AtomicFence();
+	}
+
+private:
+	//@{
+	//! Neither copyable nor assignable.
+	CGracePeriod(const CGracePeriod&);
+	CGracePeriod& operator=(const CGracePeriod&);
+	//@}
+
+	volatile unsigned	m_period;
+	volatile unsigned	m_readers[2];
+};
+
+#endif // ATOMIC_H
+// File_checked_for_headers
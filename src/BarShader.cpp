@@ -25,6 +25,7 @@
 
 #include <wx/dc.h>
 #include <wx/image.h>
+#include <wx/bitmap.h>
 #include "BarShader.h"		// Interface declarations.
 #include <cstring>		// Needed for std::memcpy
 
@@ -36,6 +37,8 @@ const double Pi = 3.14159265358979323846264338328;
 
 #define HALF(X) (((X) + 1) / 2)
 #define DEFAULT_DEPTH 10
+// Fixed point value of a 3D modifier of 1.0
+#define MODIFIER_ONE 65536
 
 CBarShader::CBarShader(unsigned height, unsigned width)
 : m_Width( width ),
@@ -113,9 +116,9 @@ void CBarShader::BuildModifiers()
 	double base = piOverDepth * ((depth / 2.0) - 1);
 	double increment = piOverDepth / (count - 1);
 
-	m_Modifiers = new double[count];
+	m_Modifiers = new uint32[count];
 	for (unsigned i = 0; i < count; i++)
-		m_Modifiers[i] = (double)(sin(base + i * increment));
+		m_Modifiers[i] = (uint32)(sin(base + i * increment) * MODIFIER_ONE + .5);
 }
 
 
@@ -136,22 +139,23 @@ void CBarShader::FillRange(uint64 start, uint64 end, const CMuleColour& colour)
 		end = m_FileSize;
 	}
 
-	unsigned firstPixel = start * m_Width / m_FileSize;
-	unsigned lastPixel  = end   * m_Width / m_FileSize;
+	// Positions in 1/256 pixels
+	uint64 startPos = (start * m_Width << 8) / m_FileSize;
+	uint64 endPos   = (end   * m_Width << 8) / m_FileSize;
+
+	unsigned firstPixel = startPos >> 8;
+	unsigned lastPixel  = endPos >> 8;
 	if (lastPixel == m_Width) {
 		lastPixel--;
 	}
 
-	double f_Width = m_Width;
-	// calculate how much of this pixels is to be covered with the fill
-	double firstCovered = firstPixel + 1 - start * f_Width / m_FileSize;
-	double lastCovered  = end * f_Width / m_FileSize - lastPixel;
 	// all inside one pixel ?
 	if (firstPixel == lastPixel) {
-		m_Content[firstPixel].BlendWith(colour, firstCovered + lastCovered - 1.0);
+		m_Content[firstPixel].BlendWith(colour, (uint32)(endPos - startPos));
 	} else {
-		m_Content[firstPixel].BlendWith(colour, firstCovered);
-		m_Content[lastPixel].BlendWith(colour, lastCovered);
+		// calculate how much of this pixels is to be covered with the fill
+		m_Content[firstPixel].BlendWith(colour, (uint32)(((uint64)(firstPixel + 1) << 8) - startPos));
+		m_Content[lastPixel].BlendWith(colour, (uint32)(endPos - ((uint64)lastPixel << 8)));
 		// fill pixels between (if any)
 		for (unsigned i = firstPixel + 1; i < lastPixel; i++) {
 			m_Content[i] = colour;
@@ -197,9 +201,9 @@ void CBarShader::Draw( wxDC* dc, int iLeft, int iTop, bool bFlat )
 		unsigned idx = 0;
 		for (unsigned y = 0; y < Max; y++) {
 			for (unsigned x = 0; x < m_Width; x++) {
-				unsigned cRed   = (unsigned)(m_Content[x].Red()   * m_Modifiers[y] + .5f);
-				unsigned cGreen = (unsigned)(m_Content[x].Green() * m_Modifiers[y] + .5f);
-				unsigned cBlue  = (unsigned)(m_Content[x].Blue()  * m_Modifiers[y] + .5f);
+				unsigned cRed   = (m_Content[x].Red()   * m_Modifiers[y] + MODIFIER_ONE / 2) / MODIFIER_ONE;
+				unsigned cGreen = (m_Content[x].Green() * m_Modifiers[y] + MODIFIER_ONE / 2) / MODIFIER_ONE;
+				unsigned cBlue  = (m_Content[x].Blue()  * m_Modifiers[y] + MODIFIER_ONE / 2) / MODIFIER_ONE;
 				cRed   = std::min(255u, cRed);
 				cGreen = std::min(255u, cGreen);
 				cBlue  = std::min(255u, cBlue);
@@ -218,4 +222,43 @@ void CBarShader::Draw( wxDC* dc, int iLeft, int iTop, bool bFlat )
 	wxBitmap bitmap(image);
 	dc->DrawBitmap(bitmap, iLeft, iTop);
 }
+
+
+CBarCache::CBarCache()
+	: m_bitmap(NULL),
+	  m_valid(false),
+	  m_version(0),
+	  m_state(0),
+	  m_flat(false),
+	  m_depth(0)
+{
+}
+
+
+CBarCache::~CBarCache()
+{
+	delete m_bitmap;
+}
+
+
+bool CBarCache::NeedsRedraw(uint32 version, uint32 state, int width, int height, bool flat, unsigned depth)
+{
+	if (m_bitmap == NULL) {
+		m_bitmap = new wxBitmap(width, height);
+	} else if (m_bitmap->GetWidth() != width || m_bitmap->GetHeight() != height) {
+		// Only recreate if the size has changed
+		m_bitmap->Create(width, height);
+	} else if (m_valid && m_version == version && m_state == state
+			&& m_flat == flat && m_depth == depth) {
+		return false;
+	}
+
+	m_valid = true;
+	m_version = version;
+	m_state = state;
+	m_flat = flat;
+	m_depth = depth;
+
+	return true;
+}
 // File_checked_for_headers
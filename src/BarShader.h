@@ -31,6 +31,7 @@
 
 class wxRect;
 class wxDC;
+class wxBitmap;
 
 /**
  * The barshader class is responsible for drawing the chunk-based progress bars used in aMule.
@@ -144,8 +145,8 @@ private:
 	unsigned	m_Height;
 	//! The virtual filesize assosiated with the bar
 	uint64	m_FileSize;
-	//! Pointer to array of modifers used to create 3D effect. Size is (m_Height+1)/2 when set.
-	double*	m_Modifiers;
+	//! Pointer to array of modifers used to create 3D effect, in 1/65536ths. Size is (m_Height+1)/2 when set.
+	uint32*	m_Modifiers;
 	//! The current 3d level
 	uint16	m_used3dlevel;
 
@@ -153,5 +154,59 @@ private:
 	std::vector<CMuleColour> m_Content;
 };
 
+
+
+/**
+ * A status bar drawn into a bitmap, kept until it shows something else.
+ *
+ * The owner sums up what the bar shows in a version number and a state
+ * value, for example the bar version of a file and its status. The bar
+ * is only drawn again when one of these, the size or the style changes.
+ */
+class CBarCache
+{
+public:
+	CBarCache();
+	~CBarCache();
+
+	/**
+	 * Checks if the bitmap must be drawn again.
+	 *
+	 * @param version Changes whenever the content of the bar changes.
+	 * @param state Any other values the bar depends on.
+	 * @param width The width of the bar.
+	 * @param height The height of the bar.
+	 * @param flat True if the bar is drawn flat.
+	 * @param depth The 3D-depth of the bar.
+	 * @return True if the bitmap must be drawn.
+	 *
+	 * The bitmap has the given size afterwards, and the bar is expected
+	 * to be drawn into it if true is returned.
+	 */
+	bool NeedsRedraw(uint32 version, uint32 state, int width, int height, bool flat, unsigned depth);
+
+	/**
+	 * Returns the bitmap, which is created by NeedsRedraw().
+	 */
+	wxBitmap& GetBitmap() { return *m_bitmap; }
+
+	/**
+	 * Makes the next call to NeedsRedraw() return true.
+	 */
+	void Invalidate() { m_valid = false; }
+
+private:
+	// Not copyable, the bitmap is owned
+	CBarCache(const CBarCache&);
+	CBarCache& operator=(const CBarCache&);
+
+	wxBitmap*	m_bitmap;
+	bool		m_valid;
+	uint32		m_version;
+	uint32		m_state;
+	bool		m_flat;
+	unsigned	m_depth;
+};
+
 #endif
 // File_checked_for_headers
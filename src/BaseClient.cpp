@@ -42,10 +42,9 @@
 
 #include <tags/ClientTags.h>
 
-#include <zlib.h>		// Needed for inflateEnd
-
 #include <common/Format.h>	// Needed for CFormat
 
+#include "InflatePool.h"		// Needed for CInflatePool
 #include "SearchList.h"		// Needed for CSearchList
 #include "DownloadQueue.h"	// Needed for CDownloadQueue
 #include "UploadQueue.h"	// Needed for CUploadQueue
@@ -74,6 +73,7 @@
 #include "ClientUDPSocket.h"
 #include "Logger.h"
 #include "DataToText.h"		// Needed for GetSoftName()
+#include "OtherFunctions.h"	// Needed for ListMemoryUsage
 #include "GuiEvents.h"		// Needed for Notify_
 #include "ServerList.h"		// For CServerList
 
@@ -155,9 +155,8 @@ void CUpDownClient::Init()
 #endif
 	m_bAddNextConnect = false;
 	credits = NULL;
-	m_byChatstate = MS_NONE;
+	m_messageData = NULL;
 	m_nKadState = KS_NONE;
-	m_nChatCaptchaState = CA_NONE;
 	m_cShowDR = 0;
 	m_reqfile = NULL;	 // No file required yet
 	m_nTransferredUp = 0;
@@ -205,7 +204,6 @@ void CUpDownClient::Init()
 	m_bIsHybrid = false;
 	m_bIsML = false;
 	m_Friend = NULL;
-	m_iRating = 0;
 	m_nCurSessionUp = 0;
 	m_clientSoft=SO_UNKNOWN;
 
@@ -285,11 +283,6 @@ void CUpDownClient::Init()
 	m_dwDirectCallbackTimeout = 0;
 
 	m_hasbeenobfuscatinglately = false;
-
-	m_cCaptchasSent = 0;
-	m_cMessagesReceived = 0;
-	m_cMessagesSent = 0;
-
 }
 
 
@@ -324,6 +317,8 @@ CUpDownClient::~CUpDownClient()
 
 	DeleteContents(m_WaitingPackets_list);
 
+	delete m_messageData;
+
 	// Allow detection of deleted clients that didn't go through Safe_Delete
 	m_clientState = CS_DYING;
 }
@@ -433,9 +428,9 @@ void CUpDownClient::Safe_Delete()
 		m_Friend = NULL;
 	}
 
-	if (m_iRating>0 || !m_strComment.IsEmpty()) {
-		m_iRating = 0;
-		m_strComment.Clear();
+	if (GetFileRating() > 0 || !GetFileComment().IsEmpty()) {
+		m_messageData->rating = 0;
+		m_messageData->comment.Clear();
 		if (m_reqfile) {
 			m_reqfile->UpdateFileRatingCommentAvail();
 		}
@@ -1185,21 +1180,22 @@ void CUpDownClient::ProcessMuleCommentPacket(const byte* pachPacket, uint32 nSiz
 
 	const CMemFile data(pachPacket, nSize);
 
+	MessageData& messageData = GetMessageData();
 	uint8 rating = data.ReadUInt8();
 	if (rating > 5) {
 		AddDebugLogLineN( logClient, wxString(wxT("Invalid Rating for file '")) << m_clientFilename << wxT("' received: ") << rating);
-		m_iRating = 0;
+		messageData.rating = 0;
 	} else {
-		m_iRating = rating;
-		AddDebugLogLineN( logClient, wxString(wxT("Rating for file '")) << m_clientFilename << wxT("' received: ") << m_iRating);
+		messageData.rating = rating;
+		AddDebugLogLineN( logClient, wxString(wxT("Rating for file '")) << m_clientFilename << wxT("' received: ") << messageData.rating);
 	}
 
 	// The comment is unicoded, with a uin32 len and safe read
 	// (won't break if string size is < than advertised len)
 	// Truncated to MAXFILECOMMENTLEN size
-	m_strComment = data.ReadString((GetUnicodeSupport() != utf8strNone), 4 /* bytes (it's a uint32)*/, true).Left(MAXFILECOMMENTLEN);
+	messageData.comment = data.ReadString((GetUnicodeSupport() != utf8strNone), 4 /* bytes (it's a uint32)*/, true).Left(MAXFILECOMMENTLEN);
 
-	AddDebugLogLineN( logClient, wxString(wxT("Description for file '")) << m_clientFilename << wxT("' received: ") << m_strComment);
+	AddDebugLogLineN( logClient, wxString(wxT("Description for file '")) << m_clientFilename << wxT("' received: ") << messageData.comment);
 
 	// Update file rating
 	m_reqfile->UpdateFileRatingCommentAvail();
@@ -1234,10 +1230,7 @@ void CUpDownClient::ClearDownloadBlockRequests()
 
 			delete pending->block;
 			// Not always allocated
-			if (pending->zStream){
-				inflateEnd(pending->zStream);
-				delete pending->zStream;
-			}
+			CInflatePool::Release(pending->zStream);
 
 			delete pending;
 		}
@@ -1349,7 +1342,7 @@ bool CUpDownClient::Disconnected(const wxString& DEBUG_ONLY(strReason), bool bFr
 	// We keep chat partners in any case
 	if (GetChatState() != MS_NONE) {
 		bDelete = false;
-		m_pendingMessage.Clear();
+		m_messageData->pendingMessage.Clear();
 		Notify_ChatConnResult(false,GUI_ID(GetIP(),GetUserPort()),wxEmptyString);
 	}
 
@@ -1681,11 +1674,11 @@ void CUpDownClient::ConnectionEstablished()
 
 	if (GetChatState() == MS_CHATTING) {
 		bool result = true;
-		if (!m_pendingMessage.IsEmpty()) {
-			result = SendChatMessage(m_pendingMessage);
+		if (!m_messageData->pendingMessage.IsEmpty()) {
+			result = SendChatMessage(m_messageData->pendingMessage);
 		}
-		Notify_ChatConnResult(result,GUI_ID(GetIP(),GetUserPort()),m_pendingMessage);
-		m_pendingMessage.Clear();
+		Notify_ChatConnResult(result,GUI_ID(GetIP(),GetUserPort()),m_messageData->pendingMessage);
+		m_messageData->pendingMessage.Clear();
 	}
 
 	switch(GetDownloadState()) {
@@ -1776,19 +1769,22 @@ void CUpDownClient::ReGetClientSoft()
 		return;
 	}
 
+	// Built here and interned at the end, most clients get the same few strings
+	wxString softString;
+	wxString verString = m_clientVerString.Get();
 	int iHashType = GetHashType();
 	wxString clientModString;
 	if (iHashType == SO_EMULE) {
 
 		m_clientSoft = m_byCompatibleClient;
-		m_clientSoftString = GetSoftName(m_clientSoft);
+		softString = GetSoftName(m_clientSoft);
 		// Special issues:
 		if(!GetClientModString().IsEmpty() && (m_clientSoft != SO_EMULE)) {
-			m_clientSoftString = GetClientModString();
+			softString = GetClientModString();
 		}
 		// Isn't xMule annoying?
 		if ((m_clientSoft == SO_LXMULE) && (GetMuleVersion() > 0x26) && (GetMuleVersion() != 0x99)) {
-			m_clientSoftString += CFormat(_(" (Fake eMule version %#x)")) % GetMuleVersion();
+			softString += CFormat(_(" (Fake eMule version %#x)")) % GetMuleVersion();
 		}
 		if ((m_clientSoft == SO_EMULE) &&
 			(
@@ -1799,19 +1795,19 @@ void CUpDownClient::ReGetClientSoft()
 			// FAKE eMule -a newer xMule faking is ident.
 			m_clientSoft = SO_LXMULE;
 			if (GetClientModString().IsEmpty() == false) {
-				m_clientSoftString = GetClientModString() + _(" (Fake eMule)");
+				softString = GetClientModString() + _(" (Fake eMule)");
 			} else {
-				m_clientSoftString = _("xMule (Fake eMule)"); // don't use GetSoftName, it's not lmule.
+				softString = _("xMule (Fake eMule)"); // don't use GetSoftName, it's not lmule.
 			}
 		}
 		// Now, what if we don't know this SO_ID?
-		if (m_clientSoftString.IsEmpty()) {
+		if (softString.IsEmpty()) {
 			if(m_bIsML) {
 				m_clientSoft = SO_MLDONKEY;
-				m_clientSoftString = GetSoftName(m_clientSoft);
+				softString = GetSoftName(m_clientSoft);
 			} else if (m_bIsHybrid) {
 				m_clientSoft = SO_EDONKEYHYBRID;
-				m_clientSoftString = GetSoftName(m_clientSoft);
+				softString = GetSoftName(m_clientSoft);
 			} else if (m_byCompatibleClient != 0) {
 				m_clientSoft = SO_COMPAT_UNK;
 				#ifdef __DEBUG__
@@ -1823,13 +1819,13 @@ void CUpDownClient::ReGetClientSoft()
 					AddLogLineNS(CFormat(wxT("Compatible client found with ET_COMPATIBLECLIENT of %x")) % m_byCompatibleClient);
 				}
 				#endif
-				m_clientSoftString = CFormat(wxT("%s(%#x)")) % GetSoftName(m_clientSoft) % m_byCompatibleClient;
+				softString = CFormat(wxT("%s(%#x)")) % GetSoftName(m_clientSoft) % m_byCompatibleClient;
 			} else {
 				// If we step here, it might mean 2 things:
 				// a eMule
 				// a Compat Client that has sent no MuleInfo packet yet.
 				m_clientSoft = SO_EMULE;
-				m_clientSoftString = wxT("eMule");
+				softString = wxT("eMule");
 			}
 		}
 
@@ -1840,14 +1836,14 @@ void CUpDownClient::ReGetClientSoft()
 			m_nClientVersion = MAKE_CLIENT_VERSION(0,nClientMinVersion,0);
 			switch (m_clientSoft) {
 				case SO_AMULE:
-					m_clientVerString = CFormat(_("1.x (based on eMule v0.%u)")) % nClientMinVersion;
+					verString = CFormat(_("1.x (based on eMule v0.%u)")) % nClientMinVersion;
 					break;
 				case SO_LPHANT:
-					m_clientVerString = wxT("< v0.05");
+					verString = wxT("< v0.05");
 					break;
 				default:
 					clientModString = GetClientModString();
-					m_clientVerString = CFormat(wxT("v0.%u")) % nClientMinVersion;
+					verString = CFormat(wxT("v0.%u")) % nClientMinVersion;
 					break;
 			}
 		} else {
@@ -1869,23 +1865,23 @@ void CUpDownClient::ReGetClientSoft()
 					// eMule+ developers, so I think they're slowly getting smarter.
 					// They are based on our implementation, so we use the same format
 					// for the version string.
-					m_clientVerString = CFormat(wxT("v%u.%u.%u")) % nClientMajVersion % nClientMinVersion % nClientUpVersion;
+					verString = CFormat(wxT("v%u.%u.%u")) % nClientMajVersion % nClientMinVersion % nClientUpVersion;
 					break;
 				case SO_LPHANT:
-					m_clientVerString = CFormat(wxT(" v%u.%.2u%c")) % (nClientMajVersion-1) % nClientMinVersion % ('a' + nClientUpVersion);
+					verString = CFormat(wxT(" v%u.%.2u%c")) % (nClientMajVersion-1) % nClientMinVersion % ('a' + nClientUpVersion);
 					break;
 				case SO_EMULEPLUS:
-					m_clientVerString = CFormat(wxT("v%u")) % nClientMajVersion;
+					verString = CFormat(wxT("v%u")) % nClientMajVersion;
 					if(nClientMinVersion != 0) {
-						m_clientVerString += CFormat(wxT(".%u")) % nClientMinVersion;
+						verString += CFormat(wxT(".%u")) % nClientMinVersion;
 					}
 					if(nClientUpVersion != 0) {
-						m_clientVerString += CFormat(wxT("%c")) % ('a' + nClientUpVersion - 1);
+						verString += CFormat(wxT("%c")) % ('a' + nClientUpVersion - 1);
 					}
 					break;
 				default:
 					clientModString = GetClientModString();
-					m_clientVerString = CFormat(wxT("v%u.%u%c")) % nClientMajVersion % nClientMinVersion % ('a' + nClientUpVersion);
+					verString = CFormat(wxT("v%u.%u%c")) % nClientMajVersion % nClientMinVersion % ('a' + nClientUpVersion);
 					break;
 			}
 		}
@@ -1897,7 +1893,7 @@ void CUpDownClient::ReGetClientSoft()
 		// 501		50.1
 
 		m_clientSoft = SO_EDONKEYHYBRID;
-		m_clientSoftString = GetSoftName(m_clientSoft);
+		softString = GetSoftName(m_clientSoft);
 
 		uint32 nClientMajVersion;
 		uint32 nClientMinVersion;
@@ -1933,34 +1929,36 @@ void CUpDownClient::ReGetClientSoft()
 		}
 		m_nClientVersion = MAKE_CLIENT_VERSION(nClientMajVersion, nClientMinVersion, nClientUpVersion);
 		if (nClientUpVersion) {
-			m_clientVerString = CFormat(wxT("v%u.%u.%u")) % nClientMajVersion % nClientMinVersion % nClientUpVersion;
+			verString = CFormat(wxT("v%u.%u.%u")) % nClientMajVersion % nClientMinVersion % nClientUpVersion;
 		} else {
-			m_clientVerString = CFormat(wxT("v%u.%u")) % nClientMajVersion % nClientMinVersion;
+			verString = CFormat(wxT("v%u.%u")) % nClientMajVersion % nClientMinVersion;
 		}
 	} else if (m_bIsML || (iHashType == SO_MLDONKEY)) {
 		m_clientSoft = SO_MLDONKEY;
-		m_clientSoftString = GetSoftName(m_clientSoft);
+		softString = GetSoftName(m_clientSoft);
 		uint32 nClientMinVersion = m_nClientVersion;
 		m_nClientVersion = MAKE_CLIENT_VERSION(0, nClientMinVersion, 0);
-		m_clientVerString = CFormat(wxT("v0.%u")) % nClientMinVersion;
+		verString = CFormat(wxT("v0.%u")) % nClientMinVersion;
 	} else if (iHashType == SO_OLDEMULE) {
 		m_clientSoft = SO_OLDEMULE;
-		m_clientSoftString = GetSoftName(m_clientSoft);
+		softString = GetSoftName(m_clientSoft);
 		uint32 nClientMinVersion = m_nClientVersion;
 		m_nClientVersion = MAKE_CLIENT_VERSION(0, nClientMinVersion, 0);
-		m_clientVerString = CFormat(wxT("v0.%u")) % nClientMinVersion;
+		verString = CFormat(wxT("v0.%u")) % nClientMinVersion;
 	} else {
 		m_clientSoft = SO_EDONKEY;
-		m_clientSoftString = GetSoftName(m_clientSoft);
+		softString = GetSoftName(m_clientSoft);
 		m_nClientVersion *= 10;
-		m_clientVerString = CFormat(wxT("v%u.%u")) % (m_nClientVersion / 100000) % ((m_nClientVersion / 1000) % 100);
+		verString = CFormat(wxT("v%u.%u")) % (m_nClientVersion / 100000) % ((m_nClientVersion / 1000) % 100);
 	}
 
-	m_clientVersionString = m_clientVerString;
+	m_clientVersionString = verString;
 	if (!clientModString.IsEmpty()) {
-		m_clientVerString += wxT(" - ") + clientModString;
+		verString += wxT(" - ") + clientModString;
 	}
-	m_fullClientVerString = m_clientSoftString + wxT(" ") + m_clientVerString;
+	m_clientSoftString = softString;
+	m_clientVerString = verString;
+	m_fullClientVerString = softString + wxT(" ") + verString;
 
 	UpdateStats();
 }
@@ -1999,8 +1997,10 @@ void CUpDownClient::ResetFileStatusInfo()
 
 	m_bCompleteSource = false;
 	m_dwLastAskedTime = 0;
-	m_iRating = 0;
-	m_strComment.Clear();
+	if (m_messageData) {
+		m_messageData->rating = 0;
+		m_messageData->comment.Clear();
+	}
 
 	if (m_pReqFileAICHHash != NULL) {
 		delete m_pReqFileAICHHash;
@@ -2103,15 +2103,24 @@ void CUpDownClient::SendSignaturePacket()
 		}
 	}
 	//end v2
-	byte achBuffer[250];
 
-	uint8 siglen = theApp->clientcredits->CreateSignature(credits, achBuffer,  250, ChallengeIP, byChaIPKind );
-	wxCHECK2(siglen != 0, return);
+	// The signature is created on a worker thread and sent by SendSignature()
+	m_SecureIdentState = IS_ALLREQUESTSSEND;
+	theApp->clientcredits->QueueSignature(this, credits, ChallengeIP, byChaIPKind);
+}
+
+
+void CUpDownClient::SendSignature(const byte* signature, uint8 siglen, uint8 byChaIPKind)
+{
+	// The client may have disconnected while the signature was created
+	if (m_socket == NULL) {
+		return;
+	}
 
 	CMemFile data;
 	data.WriteUInt8(siglen);
-	data.Write(achBuffer, siglen);
-	if (bUseV2) {
+	data.Write(signature, siglen);
+	if (byChaIPKind != 0) {
 		data.WriteUInt8(byChaIPKind);
 	}
 
@@ -2120,7 +2129,6 @@ void CUpDownClient::SendSignaturePacket()
 	theStats::AddUpOverheadOther(packet->GetPacketSize());
 	AddDebugLogLineN( logLocalClient, wxT("Local Client: OP_SIGNATURE to ") + GetFullIP() );
 	SendPacket(packet,true,true);
-	m_SecureIdentState = IS_ALLREQUESTSSEND;
 }
 
 
@@ -2205,15 +2213,22 @@ void CUpDownClient::ProcessSignaturePacket(const byte* pachPacket, uint32 nSize)
 		return;
 	}
 
+	m_dwLastSignatureIP = GetIP();
+
+	// The signature is checked on a worker thread, the result is stored
+	// in the credits and reported to OnIdentVerified()
+	theApp->clientcredits->QueueVerifyIdent(this, credits, pachPacket+1, pachPacket[0], GetIP(), byChaIPKind);
+}
+
+
+void CUpDownClient::OnIdentVerified(bool verified, uint8 byChaIPKind)
+{
 	// cppcheck-suppress duplicateBranch
-	if (theApp->clientcredits->VerifyIdent(credits, pachPacket+1, pachPacket[0], GetIP(), byChaIPKind ) ) {
-		// result is saved in function above
+	if (verified) {
 		AddDebugLogLineN( logClient, CFormat( wxT("'%s' has passed the secure identification, V2 State: %i") ) % GetUserName() % byChaIPKind );
 	} else {
 		AddDebugLogLineN( logClient, CFormat( wxT("'%s' has failed the secure identification, V2 State: %i") ) % GetUserName() % byChaIPKind );
 	}
-
-	m_dwLastSignatureIP = GetIP();
 }
 
 void CUpDownClient::SendSecIdentStatePacket()
@@ -2310,12 +2325,12 @@ wxString CUpDownClient::GetClientFullInfo()
 	}
 
 	return CFormat( wxT("Client %s on IP:Port %s:%d using %s %s %s") )
-		% ( m_Username.IsEmpty() ? wxString(_("Unknown")) : m_Username )
+		% ( m_Username.IsEmpty() ? wxString(_("Unknown")) : m_Username.Get() )
 		% GetFullIP()
 		% GetUserPort()
-		% m_clientSoftString
-		% m_clientVerString
-		% m_strModVersion;
+		% m_clientSoftString.Get()
+		% m_clientVerString.Get()
+		% m_strModVersion.Get();
 }
 #endif
 
@@ -2326,10 +2341,10 @@ wxString CUpDownClient::GetClientShortInfo()
 	}
 
 	return CFormat( wxT("'%s' (%s %s %s)") )
-		% ( m_Username.IsEmpty() ? wxString(_("Unknown")) : m_Username )
-		% m_clientSoftString
-		% m_clientVerString
-		% m_strModVersion;
+		% ( m_Username.IsEmpty() ? wxString(_("Unknown")) : m_Username.Get() )
+		% m_clientSoftString.Get()
+		% m_clientVerString.Get()
+		% m_strModVersion.Get();
 }
 
 
@@ -2481,14 +2496,56 @@ uint8 CUpDownClient::GetSecureIdentState()
 }
 
 
+CUpDownClient::MessageData& CUpDownClient::GetMessageData()
+{
+	if (m_messageData == NULL) {
+		m_messageData = new MessageData;
+	}
+	return *m_messageData;
+}
+
+
+const wxString& CUpDownClient::GetFileComment() const
+{
+	static const wxString noComment;
+	return m_messageData ? m_messageData->comment : noComment;
+}
+
+
+void CUpDownClient::AddMemoryUsage(uint64& client, uint64& upload, uint64& download) const
+{
+	client += sizeof(CUpDownClient) + m_clientFilename.Length() * sizeof(wxChar);
+	if (m_messageData) {
+		client += sizeof(MessageData) + sizeof(wxChar) * (m_messageData->comment.Length()
+			+ m_messageData->captchaChallenge.Length() + m_messageData->captchaPendingMsg.Length()
+			+ m_messageData->pendingMessage.Length());
+	}
+	client += ListMemoryUsage(m_WaitingPackets_list);
+	for (std::list<CPacket*>::const_iterator it = m_WaitingPackets_list.begin(); it != m_WaitingPackets_list.end(); ++it) {
+		client += sizeof(CPacket) + (*it)->GetPacketSize();
+	}
+
+	upload += ListMemoryUsage(m_BlockRequests_queue) + ListMemoryUsage(m_DoneBlocks_list)
+		+ (m_BlockRequests_queue.size() + m_DoneBlocks_list.size()) * sizeof(Requested_Block_Struct)
+		+ ListMemoryUsage(m_AvarageUDR_list) + m_upPartStatus.GetAllocatedSize();
+
+	// Blocks move from the download list to the pending list, each is in one of them
+	download += ListMemoryUsage(m_PendingBlocks_list) + ListMemoryUsage(m_DownloadBlocks_list)
+		+ m_PendingBlocks_list.size() * sizeof(Pending_Block_Struct)
+		+ (m_PendingBlocks_list.size() + m_DownloadBlocks_list.size()) * sizeof(Requested_Block_Struct)
+		+ TreeMemoryUsage(m_A4AF_list) + m_downPartStatus.GetAllocatedSize();
+}
+
+
 bool CUpDownClient::SendChatMessage(const wxString& message)
 {
+	MessageData& messageData = GetMessageData();
 	if (GetChatCaptchaState() == CA_CAPTCHARECV) {
-		m_nChatCaptchaState = CA_SOLUTIONSENT;
+		messageData.captchaState = CA_SOLUTIONSENT;
 	} else if (GetChatCaptchaState() == CA_SOLUTIONSENT) {
 		wxFAIL; // we responsed to a captcha but didn't heard from the client afterwards - hopefully its just lag and this message will get through
 	} else {
-		m_nChatCaptchaState = CA_ACCEPTING;
+		messageData.captchaState = CA_ACCEPTING;
 	}
 
 	SetSpammer(false);
@@ -2496,13 +2553,13 @@ bool CUpDownClient::SendChatMessage(const wxString& message)
 	// Already connecting?
 	if (GetChatState() == MS_CONNECTING) {
 		// Queue all messages till we're able to send them (or discard them)
-		if (!m_pendingMessage.IsEmpty()) {
-			m_pendingMessage += wxT("\n");
+		if (!messageData.pendingMessage.IsEmpty()) {
+			messageData.pendingMessage += wxT("\n");
 		} else {
 			// There must be a message to send
 			// - except if we got disconnected. No need to assert therefore.
 		}
-		m_pendingMessage += message;
+		messageData.pendingMessage += message;
 		return false;
 	}
 	if (IsConnected()) {
@@ -2517,7 +2574,7 @@ bool CUpDownClient::SendChatMessage(const wxString& message)
 		SendPacket(packet, true, true);
 		return true;
 	} else {
-		m_pendingMessage = message;
+		messageData.pendingMessage = message;
 		SetChatState(MS_CONNECTING);
 		// True to ignore "Too Many Connections"
 		TryToConnect(true);
@@ -2667,7 +2724,7 @@ void CUpDownClient::ProcessCaptchaRequest(CMemFile* data)
 
 			if (imgCaptcha.IsOk() && imgCaptcha.GetHeight() > 10 && imgCaptcha.GetHeight() < 50
 				&& imgCaptcha.GetWidth() > 10 && imgCaptcha.GetWidth() < 150 ) {
-				m_nChatCaptchaState = CA_CAPTCHARECV;
+				GetMessageData().captchaState = CA_CAPTCHARECV;
 				CCaptchaDialog * dialog = new CCaptchaDialog(theApp->amuledlg, imgCaptcha, id);
 				dialog->Show();
 
@@ -2688,10 +2745,12 @@ void CUpDownClient::ProcessCaptchaReqRes(uint8 nStatus)
 	if (GetChatCaptchaState() == CA_SOLUTIONSENT && GetChatState() != MS_NONE
 		&& theApp->amuledlg->m_chatwnd->IsIdValid(id)) {
 		wxASSERT( nStatus < 3 );
-		m_nChatCaptchaState = CA_NONE;
+		m_messageData->captchaState = CA_NONE;
 		theApp->amuledlg->m_chatwnd->ShowCaptchaResult(id, nStatus == 0);
 	} else {
-		m_nChatCaptchaState = CA_NONE;
+		if (m_messageData) {
+			m_messageData->captchaState = CA_NONE;
+		}
 		AddDebugLogLineN(logClient, CFormat(wxT("Received captcha result from client, but not accepting it at this time (%s)")) % GetFullIP());
 	}
 }
@@ -2705,6 +2764,7 @@ void CUpDownClient::ProcessChatMessage(wxString message)
 
 	// advanced spamfilter check
 	if (thePrefs::IsChatCaptchaEnabled() && !IsFriend()) {
+		MessageData& messageData = GetMessageData();
 		// captcha checks outrank any further checks - if the captcha has been solved, we assume it's not spam
 		// first check if we need to send a captcha request to this client
 		if (GetMessagesSent() == 0 && GetMessagesReceived() == 0 && GetChatCaptchaState() != CA_CAPTCHASOLVED) {
@@ -2713,19 +2773,19 @@ void CUpDownClient::ProcessChatMessage(wxString message)
 				// we also aren't currently expecting a captcha response
 				if (m_fSupportsCaptcha) {
 					// and he supports captcha, so send him one and store the message (without showing for now)
-					if (m_cCaptchasSent < 3) {	// no more than 3 tries
-						m_strCaptchaPendingMsg = message;
+					if (messageData.captchasSent < 3) {	// no more than 3 tries
+						messageData.captchaPendingMsg = message;
 						wxMemoryOutputStream memstr;
 						memstr.PutC(0); // no tags, for future use
 						CCaptchaGenerator captcha(4);
 						if (captcha.WriteCaptchaImage(memstr)){
-							m_strCaptchaChallenge = captcha.GetCaptchaText();
-							m_nChatCaptchaState = CA_CHALLENGESENT;
-							m_cCaptchasSent++;
+							messageData.captchaChallenge = captcha.GetCaptchaText();
+							messageData.captchaState = CA_CHALLENGESENT;
+							messageData.captchasSent++;
 							CMemFile fileAnswer((byte*) memstr.GetOutputStreamBuffer()->GetBufferStart(), memstr.GetLength());
 							CPacket* packet = new CPacket(fileAnswer, OP_EMULEPROT, OP_CHATCAPTCHAREQ);
 							theStats::AddUpOverheadOther(packet->GetPacketSize());
-							AddLogLineN(CFormat(wxT("sent Captcha %s (%d)")) % m_strCaptchaChallenge % packet->GetPacketSize());
+							AddLogLineN(CFormat(wxT("sent Captcha %s (%d)")) % messageData.captchaChallenge % packet->GetPacketSize());
 							SafeSendPacket(packet);
 						} else {
 							wxFAIL;
@@ -2734,8 +2794,8 @@ void CUpDownClient::ProcessChatMessage(wxString message)
 				} else {
 					// client doesn't support captchas, but we require them, tell him that it's not going to work out
 					// with an answer message (will not be shown and doesn't count as sent message)
-					if (m_cCaptchasSent < 1) {	// don't send this notifier more than once
-						m_cCaptchasSent++;
+					if (messageData.captchasSent < 1) {	// don't send this notifier more than once
+						messageData.captchasSent++;
 						// always sent in english
 						SendChatMessage(wxT("In order to avoid spam messages, this user requires you to solve a captcha before you can send a message to him. However your client does not supports captchas, so you will not be able to chat with this user."));
 						AddDebugLogLineN(logClient, CFormat(wxT("Received message from client not supporting captchas, filtered and sent notifier (%s)")) % GetClientFullInfo());
@@ -2746,15 +2806,15 @@ void CUpDownClient::ProcessChatMessage(wxString message)
 				return;
 			} else { // (GetChatCaptchaState() == CA_CHALLENGESENT)
 				// this message must be the answer to the captcha request we sent him, let's verify
-				wxASSERT( !m_strCaptchaChallenge.IsEmpty() );
-				if (m_strCaptchaChallenge.CmpNoCase(message.Trim().Right(std::min(message.Length(), m_strCaptchaChallenge.Length()))) == 0) {
+				wxASSERT( !messageData.captchaChallenge.IsEmpty() );
+				if (messageData.captchaChallenge.CmpNoCase(message.Trim().Right(std::min(message.Length(), messageData.captchaChallenge.Length()))) == 0) {
 					// allright
 					AddDebugLogLineN(logClient, CFormat(wxT("Captcha solved, showing withheld message (%s)")) % GetClientFullInfo());
-					m_nChatCaptchaState = CA_CAPTCHASOLVED; // this state isn't persitent, but the messagecounter will be used to determine later if the captcha has been solved
+					messageData.captchaState = CA_CAPTCHASOLVED; // this state isn't persitent, but the messagecounter will be used to determine later if the captcha has been solved
 					// replace captchaanswer with withheld message and show it
-					message = m_strCaptchaPendingMsg;
-					m_cCaptchasSent = 0;
-					m_strCaptchaChallenge.Clear();
+					message = messageData.captchaPendingMsg;
+					messageData.captchasSent = 0;
+					messageData.captchaChallenge.Clear();
 					CPacket* packet = new CPacket(OP_CHATCAPTCHARES, 1, OP_EMULEPROT, false);
 					byte statusResponse = 0; // status response
 					packet->CopyToDataBuffer(0, &statusResponse, 1);
@@ -2762,11 +2822,11 @@ void CUpDownClient::ProcessChatMessage(wxString message)
 					SafeSendPacket(packet);
 				} else { // wrong, cleanup and ignore
 					AddDebugLogLineN(logClient, CFormat(wxT("Captcha answer failed (%s)")) % GetClientFullInfo());
-					m_nChatCaptchaState = CA_NONE;
-					m_strCaptchaChallenge.Clear();
-					m_strCaptchaPendingMsg.Clear();
+					messageData.captchaState = CA_NONE;
+					messageData.captchaChallenge.Clear();
+					messageData.captchaPendingMsg.Clear();
 					CPacket* packet = new CPacket(OP_CHATCAPTCHARES, 1, OP_EMULEPROT, false);
-					byte statusResponse = (m_cCaptchasSent < 3) ? 1 : 2; // status response
+					byte statusResponse = (messageData.captchasSent < 3) ? 1 : 2; // status response
 					packet->CopyToDataBuffer(0, &statusResponse, 1);
 					theStats::AddUpOverheadOther(packet->GetPacketSize());
 					SafeSendPacket(packet);
@@ -0,0 +1,59 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#include "Types.h"			// Needed for uint8 and uint32
+#include <wx/debug.h>			// Needed for wxASSERT and wxFAIL
+#include <cstring>			// Needed for memset and memcpy
+#include "BitVector.h"			// Interface declarations
+
+#include <protocol/ed2k/Constants.h>	// Needed for MAX_FILE_SIZE and PARTSIZE
+
+
+const uint8 BitVector::s_posMask[] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+const uint8 BitVector::s_negMask[] = {0xFE, 0xFD, 0xFB, 0xF7, 0xEF, 0xDF, 0xBF, 0x7F};
+
+namespace {
+	// Enough for one bit per part of the largest file
+	const uint32 UNIFORM_BUFFER_SIZE = (MAX_FILE_SIZE / PARTSIZE + 1 + 7) / 8;
+
+	struct UniformBuffers {
+		UniformBuffers()
+		{
+			memset(zeros, 0, sizeof(zeros));
+			memset(ones, 0xFF, sizeof(ones));
+		}
+
+		uint8 zeros[UNIFORM_BUFFER_SIZE];
+		uint8 ones[UNIFORM_BUFFER_SIZE];
+	};
+}
+
+const uint8* BitVector::GetUniformBuffer(bool value, uint32 WXUNUSED_UNLESS_DEBUG(bytes))
+{
+	static const UniformBuffers buffers;
+	wxASSERT(bytes <= UNIFORM_BUFFER_SIZE);
+	return value ? buffers.ones : buffers.zeros;
+}
+
+// File_checked_for_headers
@@ -29,6 +29,10 @@
 //
 // Packed bit vector
 //
+// As long as all bits have the same value no storage is allocated. Most
+// sources have either all parts or none of them, so only few of the part
+// status vectors ever need it.
+//
 class BitVector {
 public:
 	BitVector()
@@ -36,6 +40,7 @@ public:
 		m_bits	= 0;
 		m_bytes = 0;
 		m_allTrue = 0;
+		m_fill = false;
 		m_vector = NULL;
 	}
 
@@ -54,6 +59,9 @@ public:
 			wxFAIL;
 			return false;
 		}
+		if (m_vector == NULL) {
+			return m_fill;
+		}
 		return (m_vector[idx / 8] & s_posMask[idx & 7]) != 0;
 	}
 
@@ -64,6 +72,12 @@ public:
 			wxFAIL;
 			return;
 		}
+		if (m_vector == NULL) {
+			if (value == m_fill) {
+				return;
+			}
+			Allocate();
+		}
 		uint32 bidx = idx / 8;
 		if (value) {
 			m_vector[bidx] = m_vector[bidx] | s_posMask[idx & 7];
@@ -83,6 +97,7 @@ public:
 		m_bits	= 0;
 		m_bytes = 0;
 		m_allTrue = 0;
+		m_fill = false;
 		delete[] m_vector;
 		m_vector = NULL;
 	}
@@ -100,8 +115,8 @@ public:
 			m_bytes++;
 		}
 		delete[] m_vector;
-		m_vector = new uint8[m_bytes];
-		memset(m_vector, value ? 0xFF : 0, m_bytes);
+		m_vector = NULL;
+		m_fill = value;
 		m_allTrue = value ? 1 : 0;
 	}
 
@@ -131,22 +146,53 @@ public:
 	}
 
 	// set all bits to true
-	void SetAllTrue() { if (m_bytes) { memset(m_vector, 0xFF, m_bytes); } }
+	void SetAllTrue()
+	{
+		if (m_bytes) {
+			delete[] m_vector;
+			m_vector = NULL;
+			m_fill = true;
+			m_allTrue = 1;
+		}
+	}
+
+	// bytes allocated for the bits
+	uint32 GetAllocatedSize() const { return m_vector ? m_bytes : 0; }
 
 	// handling of the internal buffer (for EC)
 	// get size
 	uint32 SizeBuffer() const { return m_bytes; }
 	// get buffer
-	const void* GetBuffer() const { return m_vector; }
+	const void* GetBuffer() const { return m_vector ? m_vector : GetUniformBuffer(m_fill, m_bytes); }
 	// set buffer
-	void SetBuffer(const void* src) { memcpy(m_vector, src, m_bytes); m_allTrue = 2; }
+	void SetBuffer(const void* src)
+	{
+		if (m_bytes) {
+			if (m_vector == NULL) {
+				Allocate();
+			}
+			memcpy(m_vector, src, m_bytes);
+			m_allTrue = 2;
+		}
+	}
 
 private:
+	// allocates the storage, with all bits set to m_fill
+	void Allocate()
+	{
+		m_vector = new uint8[m_bytes];
+		memset(m_vector, m_fill ? 0xFF : 0, m_bytes);
+	}
+
+	// shared buffer of at least 'bytes' bytes, all 0xFF or all 0, implemented in BitVector.cpp
+	static const uint8* GetUniformBuffer(bool value, uint32 bytes);
+
 	uint32	m_bits;			// number of bits
 	uint32	m_bytes;		// number of bytes in the vector
-	uint8 *	m_vector;		// the storage
+	uint8 *	m_vector;		// the storage, NULL while all bits are m_fill
+	bool	m_fill;			// value of all bits without storage
 	mutable uint8 m_allTrue;// All true ? 0: no  1: yes  2: don't know
-	static const uint8 s_posMask[]; // = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80}; implemented in OtherFunctions.cpp
+	static const uint8 s_posMask[]; // = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80}; implemented in BitVector.cpp
 	static const uint8 s_negMask[]; // = {0xFE, 0xFD, 0xFB, 0xF7, 0xEF, 0xDF, 0xBF, 0x7F};
 };
 
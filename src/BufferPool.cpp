@@ -0,0 +1,225 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#include "BufferPool.h"		// Interface declarations
+
+#include <wx/thread.h>		// Needed for wxMutex
+
+#include <cstdlib>		// Needed for malloc, realloc and free
+#include <cstring>		// Needed for memcpy
+#include <new>			// Needed for std::bad_alloc
+#include <vector>
+
+
+const size_t CBufferPool::MaxPooledSize;
+
+namespace {
+
+// Sizes grow by a factor of four from 256 bytes up to MaxPooledSize.
+// Upload packets (10 kB plus headers) fall into the 16 kB class.
+const unsigned ClassCount = 6;
+// Marks buffers that were not taken from a size class.
+const unsigned Unpooled = ClassCount;
+// Bytes each free list may hold at most.
+const size_t MaxFreeBytes = 512 * 1024;
+
+
+// Placed in front of every buffer. The union pads it to a size that keeps
+// the data at the alignment malloc() guarantees.
+union BufferHeader {
+	struct {
+		size_t		capacity;
+		unsigned	sizeClass;
+	} info;
+	double	alignDouble;
+	uint64	alignInt;
+	void*	alignPtr;
+};
+
+
+struct SizeClass {
+	SizeClass()
+		: allocations(0),
+		  reused(0),
+		  maxFree(0)
+	{}
+
+	wxMutex			mutex;
+	std::vector<byte*>	freeList;
+	uint64			allocations;
+	uint64			reused;
+	size_t			maxFree;
+};
+
+
+size_t ClassSize(unsigned sizeClass)
+{
+	return (size_t)256 << (2 * sizeClass);
+}
+
+
+// Never destroyed, buffers may still be freed by static destructors.
+SizeClass* GetClasses()
+{
+	static SizeClass* classes = NULL;
+	if (classes == NULL) {
+		classes = new SizeClass[ClassCount + 1];
+		for (unsigned i = 0; i < ClassCount; ++i) {
+			size_t maxFree = MaxFreeBytes / ClassSize(i);
+			classes[i].maxFree = maxFree < 2 ? 2 : maxFree;
+		}
+	}
+	return classes;
+}
+
+// Creates the pool before main() runs and any threads exist.
+SizeClass* const s_classes = GetClasses();
+
+
+BufferHeader* HeaderOf(const byte* buffer)
+{
+	return reinterpret_cast<BufferHeader*>(const_cast<byte*>(buffer)) - 1;
+}
+
+
+byte* NewBuffer(size_t capacity, unsigned sizeClass)
+{
+	BufferHeader* header = static_cast<BufferHeader*>(malloc(sizeof(BufferHeader) + capacity));
+	if (header == NULL) {
+		throw std::bad_alloc();
+	}
+	header->info.capacity = capacity;
+	header->info.sizeClass = sizeClass;
+	return reinterpret_cast<byte*>(header + 1);
+}
+
+}
+
+
+byte* CBufferPool::Allocate(size_t size)
+{
+	SizeClass* classes = GetClasses();
+
+	if (size > MaxPooledSize) {
+		{
+			wxMutexLocker lock(classes[Unpooled].mutex);
+			classes[Unpooled].allocations++;
+		}
+		return NewBuffer(size, Unpooled);
+	}
+
+	unsigned sizeClass = 0;
+	while (ClassSize(sizeClass) < size) {
+		sizeClass++;
+	}
+
+	SizeClass& pool = classes[sizeClass];
+	{
+		wxMutexLocker lock(pool.mutex);
+		pool.allocations++;
+		if (!pool.freeList.empty()) {
+			byte* buffer = pool.freeList.back();
+			pool.freeList.pop_back();
+			pool.reused++;
+			return buffer;
+		}
+	}
+
+	return NewBuffer(ClassSize(sizeClass), sizeClass);
+}
+
+
+byte* CBufferPool::Reallocate(byte* buffer, size_t size, size_t used)
+{
+	if (buffer == NULL) {
+		return Allocate(size);
+	}
+
+	BufferHeader* header = HeaderOf(buffer);
+	if (size <= header->info.capacity) {
+		return buffer;
+	}
+
+	if (header->info.sizeClass == Unpooled) {
+		// Growing a large buffer, realloc() may avoid the copy.
+		BufferHeader* newHeader = static_cast<BufferHeader*>(realloc(header, sizeof(BufferHeader) + size));
+		if (newHeader == NULL) {
+			throw std::bad_alloc();
+		}
+		newHeader->info.capacity = size;
+		return reinterpret_cast<byte*>(newHeader + 1);
+	}
+
+	byte* newBuffer = Allocate(size);
+	memcpy(newBuffer, buffer, used < size ? used : size);
+	Free(buffer);
+	return newBuffer;
+}
+
+
+void CBufferPool::Free(byte* buffer)
+{
+	if (buffer == NULL) {
+		return;
+	}
+
+	BufferHeader* header = HeaderOf(buffer);
+	if (header->info.sizeClass != Unpooled) {
+		SizeClass& pool = GetClasses()[header->info.sizeClass];
+		wxMutexLocker lock(pool.mutex);
+		if (pool.freeList.size() < pool.maxFree) {
+			pool.freeList.push_back(buffer);
+			return;
+		}
+	}
+
+	free(header);
+}
+
+
+size_t CBufferPool::GetCapacity(const byte* buffer)
+{
+	return buffer ? HeaderOf(buffer)->info.capacity : 0;
+}
+
+
+void CBufferPool::GetStats(Stats& stats)
+{
+	SizeClass* classes = GetClasses();
+
+	stats.allocations = 0;
+	stats.reused = 0;
+	stats.pooledBytes = 0;
+	for (unsigned i = 0; i < ClassCount; ++i) {
+		wxMutexLocker lock(classes[i].mutex);
+		stats.allocations += classes[i].allocations;
+		stats.reused += classes[i].reused;
+		stats.pooledBytes += (uint64)classes[i].freeList.size() * ClassSize(i);
+	}
+
+	wxMutexLocker lock(classes[Unpooled].mutex);
+	stats.unpooled = classes[Unpooled].allocations;
+	stats.allocations += stats.unpooled;
+}
+// File_checked_for_headers
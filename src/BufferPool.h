@@ -0,0 +1,98 @@
+//							-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include "Types.h"	// Needed for byte and uint64
+
+#include <cstddef>	// Needed for size_t
+
+
+/**
+ * Pool of packet-sized memory buffers.
+ *
+ * Sockets, packets and memfiles allocate and free a buffer for nearly
+ * every packet. Requests up to MaxPooledSize are rounded up to one of a
+ * few size classes, and freed buffers are kept on a per-class free list
+ * for reuse instead of going back to the heap. Each free list is bounded,
+ * so a burst of traffic does not pin memory forever. Larger requests are
+ * passed straight to the heap.
+ *
+ * Every size class has its own lock, so threads allocating different
+ * sizes (like the upload thread and the socket threads) do not contend.
+ *
+ * Buffers obtained here must be released with Free(), never with delete[]
+ * or free().
+ */
+class CBufferPool
+{
+public:
+	//! Requests larger than this are not pooled.
+	static const size_t MaxPooledSize = 256 * 1024;
+
+	/**
+	 * Returns a buffer of at least 'size' bytes. The contents are undefined.
+	 */
+	static byte*	Allocate(size_t size);
+
+	/**
+	 * Resizes a buffer, keeping its contents up to the smaller size.
+	 *
+	 * @param buffer A buffer from Allocate(), or NULL.
+	 * @param size The new minimum size.
+	 * @param used The number of bytes in use that must be kept.
+	 * @return The buffer, which may have moved.
+	 */
+	static byte*	Reallocate(byte* buffer, size_t size, size_t used);
+
+	/**
+	 * Returns a buffer to the pool. NULL is ignored.
+	 */
+	static void	Free(byte* buffer);
+
+	/**
+	 * Returns the usable size of a buffer, which may be larger than
+	 * the size it was requested with.
+	 */
+	static size_t	GetCapacity(const byte* buffer);
+
+	//! Allocation counters for the statistics.
+	struct Stats {
+		//! Number of buffers handed out.
+		uint64	allocations;
+		//! Number of buffers handed out from a free list.
+		uint64	reused;
+		//! Number of requests too large for the pool.
+		uint64	unpooled;
+		//! Bytes currently held on the free lists.
+		uint64	pooledBytes;
+	};
+
+	/** Returns the current counters. */
+	static void	GetStats(Stats& stats);
+};
+
+#endif // BUFFERPOOL_H
+// File_checked_for_headers
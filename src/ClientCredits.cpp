@@ -41,6 +41,9 @@ CreditStruct::CreditStruct()
 }
 
 
+const uint32 CClientCredits::NoFileSlot;
+
+
 CClientCredits::CClientCredits(CreditStruct* in_credits)
 {
 	m_pCredits = in_credits;
@@ -48,6 +51,8 @@ CClientCredits::CClientCredits(CreditStruct* in_credits)
 	m_dwUnSecureWaitTime = 0;
 	m_dwSecureWaitTime = 0;
 	m_dwWaitTimeIP = 0;
+	m_fileSlot = NoFileSlot;
+	m_dirty = false;
 }
 
 
@@ -60,6 +65,8 @@ CClientCredits::CClientCredits(const CMD4Hash& key)
 	m_dwUnSecureWaitTime = ::GetTickCount();
 	m_dwSecureWaitTime = ::GetTickCount();
 	m_dwWaitTimeIP = 0;
+	m_fileSlot = NoFileSlot;
+	m_dirty = true;
 }
 
 
@@ -85,6 +92,7 @@ void CClientCredits::AddDownloaded(uint32 bytes, uint32 dwForIP, bool cryptoavai
 	}
 
 	m_pCredits->downloaded += bytes;
+	m_dirty = true;
 }
 
 
@@ -104,6 +112,7 @@ void CClientCredits::AddUploaded(uint32 bytes, uint32 dwForIP, bool cryptoavail)
 	}
 
 	m_pCredits->uploaded += bytes;
+	m_dirty = true;
 }
 
 
@@ -164,7 +173,11 @@ float CClientCredits::GetScoreRatio(uint32 dwForIP, bool cryptoavail)
 
 void CClientCredits::SetLastSeen()
 {
-	m_pCredits->nLastSeen = time(NULL);
+	uint32 now = time(NULL);
+	if (m_pCredits->nLastSeen != now) {
+		m_pCredits->nLastSeen = now;
+		m_dirty = true;
+	}
 }
 
 
@@ -200,6 +213,7 @@ void CClientCredits::Verified(uint32 dwForIP)
 			m_pCredits->uploaded = 1;
 			AddDebugLogLineN( logCredits, wxT("Credits deleted due to new SecureIdent") );
 		}
+		m_dirty = true;
 	}
 	m_identState = IS_IDENTIFIED;
 }
@@ -85,6 +85,15 @@ public:
 	EIdentState GetIdentState() const { return m_identState; }
 	void	SetIdentState(EIdentState state) { m_identState = state; }
 
+	//! Marks records that have not been written to clients.met yet.
+	static const uint32 NoFileSlot = 0xFFFFFFFF;
+	//! Returns the position of the record in clients.met.
+	uint32	GetFileSlot() const			{ return m_fileSlot; }
+	void	SetFileSlot(uint32 slot)		{ m_fileSlot = slot; }
+	//! Returns true if the record changed since it was last saved.
+	bool	IsDirty() const				{ return m_dirty; }
+	void	SetDirty(bool dirty)			{ m_dirty = dirty; }
+
 private:
 	EIdentState		m_identState;
 	void			InitalizeIdent();
@@ -95,6 +104,8 @@ private:
 	uint32			m_dwSecureWaitTime;
 	uint32			m_dwUnSecureWaitTime;
 	uint32			m_dwWaitTimeIP;			   // client IP assigned to the waittime
+	uint32			m_fileSlot;
+	bool			m_dirty;
 };
 
 #endif // CLIENTCREDITS_H
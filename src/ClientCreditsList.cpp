@@ -37,16 +37,35 @@
 #include "ClientCredits.h"	// Needed for CClientCredits
 #include "amule.h"		// Needed for theApp
 #include "CFile.h"		// Needed for CFile
+#include "MemFile.h"		// Needed for CMemFile
 #include "Logger.h"		// Needed for Add(Debug)LogLine
 #include "CryptoPP_Inc.h"	// Needed for Crypto functions
+#include "updownclient.h"	// Needed for CUpDownClient
+#include "InternalEvents.h"	// Needed for CMuleInternalEvent
+#include "MuleThread.h"		// Needed for CMuleThread
+
+#include <algorithm>		// Needed for std::min, std::max and std::sort
 
 
 #define CLIENTS_MET_FILENAME		wxT("clients.met")
 #define CLIENTS_MET_BAK_FILENAME	wxT("clients.met.bak")
+#define CLIENTS_MET_JOURNAL_FILENAME	wxT("clients.met.journal")
 #define CRYPTKEY_FILENAME		wxT("cryptkey.dat")
 
+// The version byte and the number of records
+#define CREDITFILE_HEADER_SIZE		5
+// Size of a record in clients.met, see WriteCreditRecord()
+#define CREDITFILE_RECORD_SIZE		(16 + 5 * 4 + 2 + 1 + MAXPUBKEYSIZE)
+// The version byte and the record counts before and after the change
+#define CREDITJOURNAL_HEADER_SIZE	9
+
 
 CClientCreditsList::CClientCreditsList()
+	: m_fileSlots(0),
+	  m_deadSlots(0),
+	  m_rewriteFile(true),
+	  m_stopWorkers(false),
+	  m_noWorkers(false)
 {
 	m_nLastSaved = ::GetTickCount();
 	LoadList();
@@ -57,6 +76,7 @@ CClientCreditsList::CClientCreditsList()
 
 CClientCreditsList::~CClientCreditsList()
 {
+	StopWorkers();
 	DeleteContents(m_mapClients);
 	delete static_cast<CryptoPP::RSASSA_PKCS1v15_SHA_Signer *>(m_pSignkey);
 }
@@ -64,19 +84,38 @@ CClientCreditsList::~CClientCreditsList()
 
 void CClientCreditsList::LoadList()
 {
-	CFile file;
 	CPath fileName = CPath(thePrefs::GetConfigDir() + CLIENTS_MET_FILENAME);
 
+	// Until a valid file has been read, the next save writes a new one.
+	m_rewriteFile = true;
+	m_fileSlots = 0;
+	m_deadSlots = 0;
+
 	if (!fileName.FileExists()) {
 		return;
 	}
 
+	ReplayJournal();
+
 	try {
-		file.Open(fileName, CFile::read);
+		// The records are parsed from memory after a single read.
+		std::vector<byte> buffer;
+		{
+			CFile file(fileName, CFile::read);
+			if (!file.IsOpened()) {
+				AddDebugLogLineC( logCredits, wxT("Failed to load creditfile") );
+				return;
+			}
+			buffer.resize(file.GetLength());
+			if (buffer.empty()) {
+				return;
+			}
+			file.Read(&buffer[0], buffer.size());
+		}
+		CMemFile file(&buffer[0], buffer.size());
 
 		if (file.ReadUInt8() != CREDITFILE_VERSION) {
 			AddDebugLogLineC( logCredits, wxT("Creditfile is outdated and will be replaced") );
-			file.Close();
 			return;
 		}
 
@@ -87,7 +126,7 @@ void CClientCreditsList::LoadList()
 		if (bakFileName.FileExists()) {
 			// Ok, the backup exist, get the size
 			CFile hBakFile(bakFileName);
-			if ( hBakFile.GetLength() > file.GetLength()) {
+			if ( hBakFile.GetLength() > buffer.size()) {
 				// the size of the backup was larger then the
 				// org. file, something is wrong here, don't
 				// overwrite old backup..
@@ -99,23 +138,22 @@ void CClientCreditsList::LoadList()
 
 		//else: the backup doesn't exist, create it
 		if (bCreateBackup) {
-			file.Close(); // close the file before copying
 			if (!CPath::CloneFile(fileName, bakFileName, true)) {
 				AddDebugLogLineC(logCredits,
 					CFormat(wxT("Could not create backup file '%s'")) % fileName);
 			}
-			// reopen file
-			if (!file.Open(fileName, CFile::read)) {
-				AddDebugLogLineC( logCredits,
-					wxT("Failed to load creditfile") );
-				return;
-			}
-
-			file.Seek(1);
 		}
 
 
 		uint32 count = file.ReadUInt32();
+		uint32 available = (buffer.size() - CREDITFILE_HEADER_SIZE) / CREDITFILE_RECORD_SIZE;
+		bool bComplete = true;
+		if (count > available) {
+			// A save was interrupted, keep what is there.
+			AddDebugLogLineC(logCredits, CFormat(wxT("Creditfile is truncated, %u of %u clients can be read")) % available % count);
+			count = available;
+			bComplete = false;
+		}
 
 		const uint32 dwExpired = time(NULL) - 12960000; // today - 150 day
 		uint32 cDeleted = 0;
@@ -151,11 +189,25 @@ void CClientCreditsList::LoadList()
 				continue;
 			}
 
+			if (m_mapClients.find(newcstruct->key) != m_mapClients.end()) {
+				// Should not happen, the slot is reused on the next rewrite.
+				delete newcstruct;
+				m_deadSlots++;
+				continue;
+			}
+
 			CClientCredits* newcredits = new CClientCredits(newcstruct);
+			newcredits->SetFileSlot(i);
 			m_mapClients[newcredits->GetKey()] = newcredits;
 		}
 
-		AddLogLineN(CFormat(wxPLURAL("Creditfile loaded, %u client is known", "Creditfile loaded, %u clients are known", count - cDeleted)) % (count - cDeleted));
+		// Expired records stay in the file until it is rewritten.
+		m_fileSlots = count;
+		m_deadSlots += cDeleted;
+		m_rewriteFile = !bComplete;
+
+		uint32 cLoaded = count - m_deadSlots;
+		AddLogLineN(CFormat(wxPLURAL("Creditfile loaded, %u client is known", "Creditfile loaded, %u clients are known", cLoaded)) % cLoaded);
 
 		if (cDeleted) {
 			AddLogLineN(CFormat(wxPLURAL(" - Credits expired for %u client!", " - Credits expired for %u clients!", cDeleted)) % cDeleted);
@@ -168,54 +220,314 @@ void CClientCreditsList::LoadList()
 
 void CClientCreditsList::SaveList()
 {
-	AddDebugLogLineN( logCredits, wxT("Saved Credit list"));
 	m_nLastSaved = ::GetTickCount();
 
-	wxString name(thePrefs::GetConfigDir() + CLIENTS_MET_FILENAME);
-	CFile file;
+	// Records are updated in place. The whole file is only written when
+	// it does not exist yet, is damaged or holds too many expired records.
+	bool bSaved = false;
+	if (!m_rewriteFile && m_deadSlots <= m_fileSlots / 4) {
+		bSaved = SaveChanges();
+	}
+	if (!bSaved) {
+		SaveFull();
+	}
+}
+
+
+namespace {
+
+// Writes a record in the clients.met format, CREDITFILE_RECORD_SIZE bytes
+void WriteCreditRecord(CFileDataIO& file, const CreditStruct* cstruct)
+{
+	file.WriteHash(cstruct->key);
+	file.WriteUInt32(static_cast<uint32>(cstruct->uploaded));
+	file.WriteUInt32(static_cast<uint32>(cstruct->downloaded));
+	file.WriteUInt32(cstruct->nLastSeen);
+	file.WriteUInt32(static_cast<uint32>(cstruct->uploaded >> 32));
+	file.WriteUInt32(static_cast<uint32>(cstruct->downloaded >> 32));
+	file.WriteUInt16(cstruct->nReserved3);
+	file.WriteUInt8(cstruct->nKeySize);
+	// Doesn't matter if this saves garbage, will be fixed on load.
+	file.Write(cstruct->abySecureIdent, MAXPUBKEYSIZE);
+}
+
+
+// Only clients we exchanged data with are saved
+bool IsCreditWorthSaving(const CClientCredits* credits)
+{
+	return credits->GetUploadedTotal() || credits->GetDownloadedTotal();
+}
+
+
+// A changed record and the slot it goes to
+typedef std::pair<uint32, CClientCredits*> CreditSlot;
+
+struct SCompareFileSlots
+{
+	bool operator()(const CreditSlot& a, const CreditSlot& b) const
+	{
+		return a.first < b.first;
+	}
+};
+
+
+/**
+ * Writes the records of a journal into clients.met.
+ *
+ * The journal holds its header followed by runs of records, each run
+ * starting with its first slot and its number of records. Writing it
+ * twice gives the same file, so an interrupted replay can be repeated.
+ */
+void ApplyCreditJournal(CFile& file, const CMemFile& journal)
+{
+	journal.Seek(1);
+	journal.ReadUInt32();
+	uint32 nSlots = journal.ReadUInt32();
+
+	while (journal.GetAvailable() > 0) {
+		uint32 first = journal.ReadUInt32();
+		uint32 count = journal.ReadUInt32();
+		uint64 length = (uint64)count * CREDITFILE_RECORD_SIZE;
+		if (first + (uint64)count > nSlots || (uint64)journal.GetAvailable() < length) {
+			throw CIOFailureException(wxT("Invalid run in the credit journal"));
+		}
+		file.Seek(CREDITFILE_HEADER_SIZE + (uint64)first * CREDITFILE_RECORD_SIZE);
+		file.Write(journal.GetRawBuffer() + journal.GetPosition(), length);
+		journal.Seek(length, wxFromCurrent);
+	}
+
+	// The count goes last, so appended records only count once written.
+	file.Flush();
+	file.Seek(1);
+	file.WriteUInt32(nSlots);
+	file.Flush();
+}
+
+}
+
 
-	if ( !file.Create(name, true) ) {
-		AddDebugLogLineC( logCredits, wxT("Failed to create creditfile") );
+void CClientCreditsList::ReplayJournal()
+{
+	CPath journalName = CPath(thePrefs::GetConfigDir() + CLIENTS_MET_JOURNAL_FILENAME);
+	if (!journalName.FileExists()) {
 		return;
 	}
 
-	if ( file.Open(name, CFile::write) ) {
-		try {
-			uint32 count = 0;
-
-			file.WriteUInt8( CREDITFILE_VERSION );
-			// Temporary place-holder for number of stucts
-			file.WriteUInt32( 0 );
-
-			ClientMap::iterator it = m_mapClients.begin();
-			for ( ; it != m_mapClients.end(); ++it ) {
-				CClientCredits* cur_credit = it->second;
-
-				if ( cur_credit->GetUploadedTotal() || cur_credit->GetDownloadedTotal() ) {
-					const CreditStruct* const cstruct = cur_credit->GetDataStruct();
-					file.WriteHash(cstruct->key);
-					file.WriteUInt32(static_cast<uint32>(cstruct->uploaded));
-					file.WriteUInt32(static_cast<uint32>(cstruct->downloaded));
-					file.WriteUInt32(cstruct->nLastSeen);
-					file.WriteUInt32(static_cast<uint32>(cstruct->uploaded >> 32));
-					file.WriteUInt32(static_cast<uint32>(cstruct->downloaded >> 32));
-					file.WriteUInt16(cstruct->nReserved3);
-					file.WriteUInt8(cstruct->nKeySize);
-					// Doesn't matter if this saves garbage, will be fixed on load.
-					file.Write(cstruct->abySecureIdent, MAXPUBKEYSIZE);
-					count++;
+	// The journal only shows up once it is complete, see SaveChanges().
+	// Until it is removed, the records it holds may be torn in clients.met.
+	CPath fileName = CPath(thePrefs::GetConfigDir() + CLIENTS_MET_FILENAME);
+	try {
+		std::vector<byte> buffer;
+		{
+			CFile file(journalName, CFile::read);
+			if (!file.IsOpened()) {
+				return;
+			}
+			buffer.resize(file.GetLength());
+			if (!buffer.empty()) {
+				file.Read(&buffer[0], buffer.size());
+			}
+		}
+
+		if (buffer.size() >= CREDITJOURNAL_HEADER_SIZE) {
+			CMemFile journal(&buffer[0], buffer.size());
+			uint8 version = journal.ReadUInt8();
+			uint32 oldSlots = journal.ReadUInt32();
+			uint32 newSlots = journal.ReadUInt32();
+
+			CFile file(fileName, CFile::read_write);
+			if (version == CREDITFILE_VERSION && file.IsOpened()
+				&& file.GetLength() >= CREDITFILE_HEADER_SIZE + (uint64)oldSlots * CREDITFILE_RECORD_SIZE
+				&& file.ReadUInt8() == CREDITFILE_VERSION) {
+				// The count is either still the old one or already updated
+				uint32 count = file.ReadUInt32();
+				if (count == oldSlots || count == newSlots) {
+					ApplyCreditJournal(file, journal);
+					AddDebugLogLineN(logCredits, wxT("Replayed the journal of clients.met"));
 				}
 			}
+		}
+	} catch (const CSafeIOException& e) {
+		AddDebugLogLineC(logCredits, wxT("IO error while replaying the journal of clients.met: ") + e.what());
+	}
 
-			// Write the actual number of structs
-			file.Seek( 1 );
-			file.WriteUInt32( count );
-		} catch (const CIOFailureException& e) {
-			AddDebugLogLineC(logCredits, wxT("IO failure while saving clients.met: ") + e.what());
+	if (!CPath::RemoveFile(journalName)) {
+		AddDebugLogLineC(logCredits, wxT("Failed to remove the journal of clients.met"));
+	}
+}
+
+
+bool CClientCreditsList::SaveChanges()
+{
+	// Slots of new records are only assigned once they are written
+	std::vector<CreditSlot> changed;
+	uint32 nSlots = m_fileSlots;
+
+	ClientMap::iterator it = m_mapClients.begin();
+	for ( ; it != m_mapClients.end(); ++it ) {
+		CClientCredits* cur_credit = it->second;
+		if (cur_credit->IsDirty() && IsCreditWorthSaving(cur_credit)) {
+			uint32 slot = cur_credit->GetFileSlot();
+			if (slot == CClientCredits::NoFileSlot) {
+				// New records are appended
+				slot = nSlots++;
+			}
+			changed.push_back(CreditSlot(slot, cur_credit));
 		}
-	} else {
-		AddDebugLogLineC(logCredits, wxT("Failed to open existing creditfile!"));
 	}
+
+	if (changed.empty()) {
+		return true;
+	}
+
+	std::sort(changed.begin(), changed.end(), SCompareFileSlots());
+
+	CPath fileName = CPath(thePrefs::GetConfigDir() + CLIENTS_MET_FILENAME);
+	CPath journalName = CPath(thePrefs::GetConfigDir() + CLIENTS_MET_JOURNAL_FILENAME);
+	try {
+		CFile file;
+		if (!fileName.FileExists() || !file.Open(fileName, CFile::read_write)) {
+			return false;
+		}
+		// Don't write into a file that was changed behind our back
+		if (file.GetLength() != CREDITFILE_HEADER_SIZE + (uint64)m_fileSlots * CREDITFILE_RECORD_SIZE
+			|| file.ReadUInt8() != CREDITFILE_VERSION || file.ReadUInt32() != m_fileSlots) {
+			AddDebugLogLineN(logCredits, wxT("Creditfile was modified, rewriting it"));
+			return false;
+		}
+
+		// The records go into a journal first, which only replaces its
+		// temporary file once it is complete. A save interrupted while
+		// writing clients.met is finished by ReplayJournal() on the next
+		// start, so no torn record is ever read.
+		CMemFile journal(64 * 1024);
+		journal.WriteUInt8(CREDITFILE_VERSION);
+		journal.WriteUInt32(m_fileSlots);
+		journal.WriteUInt32(nSlots);
+
+		// Records in consecutive slots form a run.
+		for (size_t i = 0; i < changed.size(); ) {
+			uint32 first = changed[i].first;
+			uint64 countPos = journal.GetPosition() + 4;
+			journal.WriteUInt32(first);
+			journal.WriteUInt32(0);
+			size_t j = i;
+			do {
+				WriteCreditRecord(journal, changed[j].second->GetDataStruct());
+				j++;
+			} while (j < changed.size() && changed[j].first == first + (j - i));
+
+			uint64 end = journal.GetPosition();
+			journal.Seek(countPos);
+			journal.WriteUInt32(j - i);
+			journal.Seek(end);
+			i = j;
+		}
+
+		CFile journalFile;
+		if (!journalFile.Open(journalName, CFile::write_safe)) {
+			return false;
+		}
+		journalFile.Write(journal.GetRawBuffer(), journal.GetLength());
+		journalFile.Flush();
+		if (!journalFile.Close()) {
+			return false;
+		}
+
+		ApplyCreditJournal(file, journal);
+	} catch (const CSafeIOException& e) {
+		AddDebugLogLineC(logCredits, wxT("IO failure while saving clients.met: ") + e.what());
+		return false;
+	}
+
+	if (!CPath::RemoveFile(journalName)) {
+		// Replaying it again on the next start does no harm
+		AddDebugLogLineN(logCredits, wxT("Failed to remove the journal of clients.met"));
+	}
+
+	m_fileSlots = nSlots;
+	for (size_t i = 0; i < changed.size(); ++i) {
+		changed[i].second->SetFileSlot(changed[i].first);
+		changed[i].second->SetDirty(false);
+	}
+
+	AddDebugLogLineN(logCredits, CFormat(wxT("Saved %u changed credits")) % changed.size());
+	return true;
+}
+
+
+void CClientCreditsList::SaveFull()
+{
+	CPath fileName = CPath(thePrefs::GetConfigDir() + CLIENTS_MET_FILENAME);
+
+	try {
+		// Written to a temporary file, which replaces clients.met on Close().
+		CFile file;
+		if (!file.Open(fileName, CFile::write_safe)) {
+			AddDebugLogLineC( logCredits, wxT("Failed to create creditfile") );
+			return;
+		}
+
+		uint32 count = 0;
+		CMemFile buffer(64 * 1024);
+		buffer.WriteUInt8( CREDITFILE_VERSION );
+		// Temporary place-holder for number of stucts
+		buffer.WriteUInt32( 0 );
+
+		ClientMap::iterator it = m_mapClients.begin();
+		for ( ; it != m_mapClients.end(); ++it ) {
+			CClientCredits* cur_credit = it->second;
+
+			if (IsCreditWorthSaving(cur_credit)) {
+				WriteCreditRecord(buffer, cur_credit->GetDataStruct());
+				count++;
+
+				if (buffer.GetLength() >= 1024 * 1024) {
+					file.Write(buffer.GetRawBuffer(), buffer.GetLength());
+					buffer.SetLength(0);
+				}
+			}
+		}
+		file.Write(buffer.GetRawBuffer(), buffer.GetLength());
+
+		// Write the actual number of structs
+		file.Seek( 1 );
+		file.WriteUInt32( count );
+		file.Flush();
+
+		if (!file.Close()) {
+			AddDebugLogLineC(logCredits, wxT("Failed to replace creditfile"));
+			return;
+		}
+	} catch (const CSafeIOException& e) {
+		AddDebugLogLineC(logCredits, wxT("IO failure while saving clients.met: ") + e.what());
+		return;
+	}
+
+	// A journal left by a failed SaveChanges() belongs to the old file
+	CPath journalName = CPath(thePrefs::GetConfigDir() + CLIENTS_MET_JOURNAL_FILENAME);
+	if (journalName.FileExists()) {
+		CPath::RemoveFile(journalName);
+	}
+
+	// The records now sit in the order of the map.
+	uint32 slot = 0;
+	ClientMap::iterator it = m_mapClients.begin();
+	for ( ; it != m_mapClients.end(); ++it ) {
+		CClientCredits* cur_credit = it->second;
+		if (IsCreditWorthSaving(cur_credit)) {
+			cur_credit->SetFileSlot(slot++);
+			cur_credit->SetDirty(false);
+		} else {
+			cur_credit->SetFileSlot(CClientCredits::NoFileSlot);
+		}
+	}
+
+	m_fileSlots = slot;
+	m_deadSlots = 0;
+	m_rewriteFile = false;
+
+	AddDebugLogLineN( logCredits, wxT("Saved Credit list"));
 }
 
 
@@ -326,6 +638,61 @@ void CClientCreditsList::InitalizeCrypting()
 }
 
 
+uint8 CClientCreditsList::CreateSignedData(byte* buffer, const byte* key, uint8 keyLen, uint32 challenge, uint32 ChallengeIP, uint8 byChaIPKind) const
+{
+	wxASSERT(keyLen <= MAXPUBKEYSIZE);
+	memcpy(buffer, key, keyLen);
+	// 4 additional bytes random data send from the verifying client
+	wxASSERT ( challenge != 0 );
+	PokeUInt32(buffer + keyLen, challenge);
+
+	// v2 security improvments (not supported by 29b, not used as default by 29c)
+	if (byChaIPKind != 0) {
+		PokeUInt32(buffer + keyLen + 4, ChallengeIP);
+		PokeUInt8(buffer + keyLen + 4 + 4, byChaIPKind);
+		return keyLen + 4 + 5;
+	}
+
+	return keyLen + 4;
+}
+
+
+uint32 CClientCreditsList::GetChallengeIP(uint8 byChaIPKind, uint32 dwForIP) const
+{
+	switch (byChaIPKind) {
+		case CRYPT_CIP_LOCALCLIENT:
+			return dwForIP;
+		case CRYPT_CIP_REMOTECLIENT:
+			// Ignore local ip...
+			if (!theApp->GetPublicIP(true)) {
+				if (::IsLowID(theApp->GetED2KID())){
+					AddDebugLogLineN(logCredits, wxT("Warning: Maybe SecureHash Ident fails because LocalIP is unknown"));
+					// Fallback to local ip...
+					return theApp->GetPublicIP();
+				} else {
+					return theApp->GetED2KID();
+				}
+			} else {
+				return theApp->GetPublicIP();
+			}
+		case CRYPT_CIP_NONECLIENT: // maybe not supported in future versions
+		default:
+			return 0;
+	}
+}
+
+
+void CClientCreditsList::SetIdentResult(CClientCredits* pTarget, bool verified, uint32 dwForIP)
+{
+	if (!verified) {
+		if (pTarget->GetIdentState() == IS_IDNEEDED)
+			pTarget->SetIdentState(IS_IDFAILED);
+	} else {
+		pTarget->Verified(dwForIP);
+	}
+}
+
+
 uint8 CClientCreditsList::CreateSignature(CClientCredits* pTarget, byte* pachOutput, uint8 nMaxSize, uint32 ChallengeIP, uint8 byChaIPKind, void* sigkey)
 {
 	CryptoPP::RSASSA_PKCS1v15_SHA_Signer* signer =
@@ -346,20 +713,10 @@ uint8 CClientCreditsList::CreateSignature(CClientCredits* pTarget, byte* pachOut
 		CryptoPP::SecByteBlock sbbSignature(signer->SignatureLength());
 		CryptoPP::AutoSeededX917RNG<CryptoPP::DES_EDE3> rng;
 		byte abyBuffer[MAXPUBKEYSIZE+9];
-		uint32 keylen = pTarget->GetSecIDKeyLen();
-		memcpy(abyBuffer,pTarget->GetSecureIdent(),keylen);
-		// 4 additional bytes random data send from this client
-		uint32 challenge = pTarget->m_dwCryptRndChallengeFrom;
-		wxASSERT ( challenge != 0 );
-		PokeUInt32(abyBuffer+keylen,challenge);
-
-		uint16 ChIpLen = 0;
-		if ( byChaIPKind != 0){
-			ChIpLen = 5;
-			PokeUInt32(abyBuffer+keylen+4, ChallengeIP);
-			PokeUInt8(abyBuffer+keylen+4+4,byChaIPKind);
-		}
-		signer->SignMessage(rng, abyBuffer ,keylen+4+ChIpLen , sbbSignature.begin());
+		uint8 nDataLen = CreateSignedData(abyBuffer, pTarget->GetSecureIdent(), pTarget->GetSecIDKeyLen(),
+			pTarget->m_dwCryptRndChallengeFrom, ChallengeIP, byChaIPKind);
+
+		signer->SignMessage(rng, abyBuffer, nDataLen, sbbSignature.begin());
 		CryptoPP::ArraySink asink(pachOutput, nMaxSize);
 		asink.Put(sbbSignature.begin(), sbbSignature.size());
 
@@ -383,61 +740,285 @@ bool CClientCreditsList::VerifyIdent(CClientCredits* pTarget, const byte* pachSi
 	}
 	bool bResult;
 	try {
-		CryptoPP::StringSource ss_Pubkey((byte*)pTarget->GetSecureIdent(),pTarget->GetSecIDKeyLen(),true,0);
-		CryptoPP::RSASSA_PKCS1v15_SHA_Verifier pubkey(ss_Pubkey);
-		// 4 additional bytes random data send from this client +5 bytes v2
 		byte abyBuffer[MAXPUBKEYSIZE+9];
-		memcpy(abyBuffer,m_abyMyPublicKey,m_nMyPublicKeyLen);
-		uint32 challenge = pTarget->m_dwCryptRndChallengeFor;
-		wxASSERT ( challenge != 0 );
-		PokeUInt32(abyBuffer+m_nMyPublicKeyLen, challenge);
-
-		// v2 security improvments (not supported by 29b, not used as default by 29c)
-		uint8 nChIpSize = 0;
-		if (byChaIPKind != 0){
-			nChIpSize = 5;
-			uint32 ChallengeIP = 0;
-			switch (byChaIPKind) {
-				case CRYPT_CIP_LOCALCLIENT:
-					ChallengeIP = dwForIP;
-					break;
-				case CRYPT_CIP_REMOTECLIENT:
-					// Ignore local ip...
-					if (!theApp->GetPublicIP(true)) {
-						if (::IsLowID(theApp->GetED2KID())){
-							AddDebugLogLineN(logCredits, wxT("Warning: Maybe SecureHash Ident fails because LocalIP is unknown"));
-							// Fallback to local ip...
-							ChallengeIP = theApp->GetPublicIP();
-						} else {
-							ChallengeIP = theApp->GetED2KID();
-						}
-					} else {
-						ChallengeIP = theApp->GetPublicIP();
-					}
-					break;
-				case CRYPT_CIP_NONECLIENT: // maybe not supported in future versions
-					ChallengeIP = 0;
-					break;
-			}
-			PokeUInt32(abyBuffer+m_nMyPublicKeyLen+4, ChallengeIP);
-			PokeUInt8(abyBuffer+m_nMyPublicKeyLen+4+4, byChaIPKind);
-		}
-		//v2 end
+		uint8 nDataLen = CreateSignedData(abyBuffer, m_abyMyPublicKey, m_nMyPublicKeyLen,
+			pTarget->m_dwCryptRndChallengeFor, GetChallengeIP(byChaIPKind, dwForIP), byChaIPKind);
 
-		bResult = pubkey.VerifyMessage(abyBuffer, m_nMyPublicKeyLen+4+nChIpSize, pachSignature, nInputSize);
+		bResult = m_verifiers.Verify(pTarget->GetKey(), pTarget->GetSecureIdent(), pTarget->GetSecIDKeyLen(),
+			abyBuffer, nDataLen, pachSignature, nInputSize);
 	} catch (const CryptoPP::Exception& e) {
 		AddDebugLogLineC(logCredits, wxString(wxT("Error while verifying identity: ")) + wxString(char2unicode(e.what())));
 		bResult = false;
 	}
 
-	if (!bResult){
-		if (pTarget->GetIdentState() == IS_IDNEEDED)
-			pTarget->SetIdentState(IS_IDFAILED);
+	SetIdentResult(pTarget, bResult, dwForIP);
+
+	return bResult;
+}
+
+
+/**
+ * A signature to create or check on a worker thread.
+ *
+ * Everything the worker needs is copied into the job on the core thread,
+ * so the worker never touches the client or its credits.
+ */
+class CSecIdentJob
+{
+public:
+	enum EType {
+		//! Sign the public key of the client.
+		Sign,
+		//! Check the signature the client sent.
+		Verify
+	};
+
+	CSecIdentJob(EType type, CUpDownClient* client, CClientCredits* credits)
+		: m_type(type),
+		  m_client(CCLIENTREF(client, wxT("CSecIdentJob"))),
+		  m_credits(credits),
+		  m_userHash(credits->GetKey()),
+		  m_challenge(0),
+		  m_forIP(0),
+		  m_chaIPKind(0),
+		  m_dataLen(0),
+		  m_keyLen(0),
+		  m_signatureLen(0),
+		  m_result(false)
+	{}
+
+	EType		m_type;
+	//! The client, only used on the core thread.
+	CClientRef	m_client;
+	//! The credits of the client, only used on the core thread.
+	CClientCredits*	m_credits;
+	//! The user hash of the client, used to find its public key.
+	CMD4Hash	m_userHash;
+	//! The challenge the signature is made for.
+	uint32		m_challenge;
+	//! The IP of the client when the signature was received.
+	uint32		m_forIP;
+	uint8		m_chaIPKind;
+	//! The signed data.
+	byte		m_data[MAXPUBKEYSIZE+9];
+	uint8		m_dataLen;
+	//! The public key of the client, used when checking.
+	byte		m_key[MAXPUBKEYSIZE];
+	uint8		m_keyLen;
+	//! The signature, created or to be checked.
+	byte		m_signature[250];
+	uint8		m_signatureLen;
+	//! True if the signature was created or found valid.
+	bool		m_result;
+};
+
+
+/**
+ * Worker thread for secure ident jobs.
+ *
+ * RSA operations are CPU bound, so unlike the tasks of the
+ * CThreadScheduler several jobs may run at once. Each thread has
+ * its own copy of the signer and its own random generator, since
+ * CryptoPP objects must not be shared between threads.
+ */
+class CSecIdentThread : public CMuleThread
+{
+public:
+	CSecIdentThread(CClientCreditsList* owner)
+		: CMuleThread(wxTHREAD_JOINABLE),
+		  m_owner(owner)
+	{}
+
+protected:
+	void* Entry()
+	{
+		CryptoPP::RSASSA_PKCS1v15_SHA_Signer signer(*static_cast<CryptoPP::RSASSA_PKCS1v15_SHA_Signer *>(m_owner->m_pSignkey));
+		CryptoPP::AutoSeededX917RNG<CryptoPP::DES_EDE3> rng;
+		CryptoPP::RandomNumberGenerator* pRng = &rng;
+
+		while (CSecIdentJob* job = m_owner->WaitForJob()) {
+			m_owner->RunJob(job, &signer, pRng);
+
+			CMuleInternalEvent evt(wxEVT_CORE_SECIDENT_DONE);
+			evt.SetClientData(job);
+			wxPostEvent(wxTheApp, evt);
+		}
+
+		return NULL;
+	}
+
+private:
+	CClientCreditsList* m_owner;
+};
+
+
+void CClientCreditsList::RunJob(CSecIdentJob* job, void* signer, void* rng)
+{
+	try {
+		if (job->m_type == CSecIdentJob::Sign) {
+			CryptoPP::RSASSA_PKCS1v15_SHA_Signer* pSigner = static_cast<CryptoPP::RSASSA_PKCS1v15_SHA_Signer *>(signer);
+			CryptoPP::SecByteBlock sbbSignature(pSigner->SignatureLength());
+			pSigner->SignMessage(*static_cast<CryptoPP::RandomNumberGenerator *>(rng), job->m_data, job->m_dataLen, sbbSignature.begin());
+
+			CryptoPP::ArraySink asink(job->m_signature, sizeof(job->m_signature));
+			asink.Put(sbbSignature.begin(), sbbSignature.size());
+			job->m_signatureLen = asink.TotalPutLength();
+			job->m_result = job->m_signatureLen != 0;
+		} else {
+			job->m_result = m_verifiers.Verify(job->m_userHash, job->m_key, job->m_keyLen,
+				job->m_data, job->m_dataLen, job->m_signature, job->m_signatureLen);
+		}
+	} catch (const CryptoPP::Exception& e) {
+		if (job->m_type == CSecIdentJob::Sign) {
+			AddDebugLogLineC(logCredits, wxString(wxT("Error while creating signature: ")) + wxString(char2unicode(e.what())));
+		} else {
+			AddDebugLogLineC(logCredits, wxString(wxT("Error while verifying identity: ")) + wxString(char2unicode(e.what())));
+		}
+		job->m_result = false;
+	}
+}
+
+
+void CClientCreditsList::QueueSignature(CUpDownClient* client, CClientCredits* pTarget, uint32 ChallengeIP, uint8 byChaIPKind)
+{
+	wxASSERT( pTarget );
+
+	if (!CryptoAvailable() || pTarget->GetSecIDKeyLen() == 0) {
+		return;
+	}
+
+	CSecIdentJob* job = new CSecIdentJob(CSecIdentJob::Sign, client, pTarget);
+	job->m_challenge = pTarget->m_dwCryptRndChallengeFrom;
+	job->m_chaIPKind = byChaIPKind;
+	job->m_dataLen = CreateSignedData(job->m_data, pTarget->GetSecureIdent(), pTarget->GetSecIDKeyLen(),
+		job->m_challenge, ChallengeIP, byChaIPKind);
+	AddJob(job);
+}
+
+
+void CClientCreditsList::QueueVerifyIdent(CUpDownClient* client, CClientCredits* pTarget, const byte* pachSignature, uint8 nInputSize, uint32 dwForIP, uint8 byChaIPKind)
+{
+	wxASSERT( pTarget );
+	wxASSERT( pachSignature );
+
+	if (!CryptoAvailable()) {
+		pTarget->SetIdentState(IS_NOTAVAILABLE);
+		return;
+	}
+
+	CSecIdentJob* job = new CSecIdentJob(CSecIdentJob::Verify, client, pTarget);
+	job->m_challenge = pTarget->m_dwCryptRndChallengeFor;
+	job->m_forIP = dwForIP;
+	job->m_chaIPKind = byChaIPKind;
+	job->m_dataLen = CreateSignedData(job->m_data, m_abyMyPublicKey, m_nMyPublicKeyLen,
+		job->m_challenge, GetChallengeIP(byChaIPKind, dwForIP), byChaIPKind);
+	job->m_keyLen = pTarget->GetSecIDKeyLen();
+	memcpy(job->m_key, pTarget->GetSecureIdent(), job->m_keyLen);
+	job->m_signatureLen = std::min<size_t>(nInputSize, sizeof(job->m_signature));
+	memcpy(job->m_signature, pachSignature, job->m_signatureLen);
+	AddJob(job);
+}
+
+
+void CClientCreditsList::OnSecIdentJobDone(CSecIdentJob* job)
+{
+	CUpDownClient* client = job->m_client.GetClientChecked();
+
+	if (job->m_type == CSecIdentJob::Sign) {
+		// A signature for an old challenge would be rejected, a new one is on its way.
+		if (client && job->m_result && job->m_challenge == job->m_credits->m_dwCryptRndChallengeFrom) {
+			client->SendSignature(job->m_signature, job->m_signatureLen, job->m_chaIPKind);
+		}
 	} else {
-		pTarget->Verified(dwForIP);
+		// The credits outlive the client, so the result is kept either way.
+		SetIdentResult(job->m_credits, job->m_result, job->m_forIP);
+		if (client) {
+			client->OnIdentVerified(job->m_result, job->m_chaIPKind);
+		}
 	}
 
-	return bResult;
+	delete job;
+}
+
+
+void CClientCreditsList::AddJob(CSecIdentJob* job)
+{
+	if (StartWorkers()) {
+		wxMutexLocker lock(m_jobLock);
+		m_jobs.push_back(job);
+		m_jobSignal.Post();
+	} else {
+		CryptoPP::AutoSeededX917RNG<CryptoPP::DES_EDE3> rng;
+		CryptoPP::RandomNumberGenerator* pRng = &rng;
+		RunJob(job, m_pSignkey, pRng);
+		OnSecIdentJobDone(job);
+	}
+}
+
+
+bool CClientCreditsList::StartWorkers()
+{
+	if (!m_workers.empty() || m_noWorkers) {
+		return !m_noWorkers;
+	}
+
+	int count = wxThread::GetCPUCount();
+	count = std::max(1, std::min(count, 4));
+
+	for (int i = 0; i < count; ++i) {
+		CMuleThread* thread = new CSecIdentThread(this);
+		if (thread->Create() != wxTHREAD_NO_ERROR || thread->Run() != wxTHREAD_NO_ERROR) {
+			delete thread;
+			break;
+		}
+		m_workers.push_back(thread);
+	}
+
+	if (m_workers.empty()) {
+		AddDebugLogLineC(logCredits, wxT("Failed to start the secure ident threads, signatures are handled by the main thread"));
+		m_noWorkers = true;
+	} else {
+		AddDebugLogLineN(logCredits, CFormat(wxT("Started %u secure ident threads")) % m_workers.size());
+	}
+
+	return !m_noWorkers;
+}
+
+
+CSecIdentJob* CClientCreditsList::WaitForJob()
+{
+	m_jobSignal.Wait();
+
+	wxMutexLocker lock(m_jobLock);
+	if (m_stopWorkers || m_jobs.empty()) {
+		return NULL;
+	}
+
+	CSecIdentJob* job = m_jobs.front();
+	m_jobs.pop_front();
+	return job;
+}
+
+
+void CClientCreditsList::StopWorkers()
+{
+	{
+		wxMutexLocker lock(m_jobLock);
+		m_stopWorkers = true;
+	}
+
+	for (size_t i = 0; i < m_workers.size(); ++i) {
+		m_jobSignal.Post();
+	}
+	for (size_t i = 0; i < m_workers.size(); ++i) {
+		m_workers[i]->Stop();
+		delete m_workers[i];
+	}
+	m_workers.clear();
+
+	// Jobs already done are still waiting in the event queue and are leaked,
+	// but the application is exiting anyway.
+	DeleteContents(m_jobs);
 }
 
 
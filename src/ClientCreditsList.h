@@ -26,11 +26,17 @@
 #ifndef CLIENTCREDITSLIST_H
 #define CLIENTCREDITSLIST_H
 
-#include "MD4Hash.h"	// Needed for CMD4Hash
+#include "MD4Hash.h"		// Needed for CMD4Hash
+#include "RSAVerifierCache.h"	// Needed for CRSAVerifierCache
 
+#include <deque>
 #include <map>
+#include <vector>
 
 class CClientCredits;
+class CUpDownClient;
+class CSecIdentJob;
+class CMuleThread;
 
 class CClientCreditsList
 {
@@ -42,6 +48,29 @@ public:
 	uint8	CreateSignature(CClientCredits* pTarget, byte* pachOutput, uint8 nMaxSize, uint32 ChallengeIP, uint8 byChaIPKind, void* sigkey = NULL);
 	bool	VerifyIdent(CClientCredits* pTarget, const byte* pachSignature, uint8 nInputSize, uint32 dwForIP, uint8 byChaIPKind);
 
+	/**
+	 * Creates a signature for the client on a worker thread.
+	 *
+	 * When done, CUpDownClient::SendSignature() is called on the core
+	 * thread, unless the client has been deleted or sent a new challenge
+	 * in the meantime.
+	 */
+	void	QueueSignature(CUpDownClient* client, CClientCredits* pTarget, uint32 ChallengeIP, uint8 byChaIPKind);
+
+	/**
+	 * Checks the signature of a client on a worker thread.
+	 *
+	 * When done, the ident state of the credits is updated and
+	 * CUpDownClient::OnIdentVerified() is called on the core thread.
+	 */
+	void	QueueVerifyIdent(CUpDownClient* client, CClientCredits* pTarget, const byte* pachSignature, uint8 nInputSize, uint32 dwForIP, uint8 byChaIPKind);
+
+	/** Handles the completion event of a queued signature or check. */
+	void	OnSecIdentJobDone(CSecIdentJob* job);
+
+	/** Returns the counters of the public key cache. */
+	void	GetVerifierStats(CRSAVerifierCache::Stats& stats) const	{ m_verifiers.GetStats(stats); }
+
 	CClientCredits* GetCredit(const CMD4Hash& key);
 	void	Process();
 	uint8	GetPubKeyLen() const			{return m_nMyPublicKeyLen;}
@@ -56,13 +85,62 @@ protected:
 	bool	Debug_CheckCrypting();
 #endif
 private:
+	/** Writes the changed records into clients.met, returning false on failure. */
+	bool	SaveChanges();
+	/** Replaces clients.met with a file of all records. */
+	void	SaveFull();
+	/** Finishes a save of SaveChanges() that was interrupted. */
+	void	ReplayJournal();
+
+	/** Writes the data signed for a secure ident to 'buffer', returning its length. */
+	uint8	CreateSignedData(byte* buffer, const byte* key, uint8 keyLen, uint32 challenge, uint32 ChallengeIP, uint8 byChaIPKind) const;
+	/** Returns the IP a client had to sign for the given challenge kind. */
+	uint32	GetChallengeIP(uint8 byChaIPKind, uint32 dwForIP) const;
+	/** Stores the result of checking a signature in the credits. */
+	void	SetIdentResult(CClientCredits* pTarget, bool verified, uint32 dwForIP);
+
+	/** Carries out a queued job, 'signer' and 'rng' belong to the calling thread. */
+	void	RunJob(CSecIdentJob* job, void* signer, void* rng);
+	/** Queues a job, or runs it right away if there are no worker threads. */
+	void	AddJob(CSecIdentJob* job);
+	/** Starts the worker threads if not done yet, returning false on failure. */
+	bool	StartWorkers();
+	/** Waits for the next job, returns NULL when the workers should exit. */
+	CSecIdentJob* WaitForJob();
+	/** Stops the worker threads and drops the jobs not yet started. */
+	void	StopWorkers();
+
+	friend class CSecIdentThread;
+
 	typedef std::map<CMD4Hash, CClientCredits*> ClientMap;
 	ClientMap	m_mapClients;
 	uint32		m_nLastSaved;
+	//! Number of records in clients.met, including expired ones.
+	uint32		m_fileSlots;
+	//! Number of records in clients.met that are no longer used.
+	uint32		m_deadSlots;
+	//! Set if clients.met must be written from scratch on the next save.
+	bool		m_rewriteFile;
 	// A void* to avoid having to include the large CryptoPP.h file
 	void*		m_pSignkey;
 	byte		m_abyMyPublicKey[80];
 	uint8		m_nMyPublicKeyLen;
+
+	//! Parsed public keys of other clients.
+	CRSAVerifierCache	m_verifiers;
+
+	//! Threads creating and checking signatures.
+	std::vector<CMuleThread*>	m_workers;
+	//! Jobs waiting for a worker.
+	std::deque<CSecIdentJob*>	m_jobs;
+	//! Protects m_jobs and m_stopWorkers.
+	wxMutex		m_jobLock;
+	//! Posted once per queued job and once per worker on shutdown.
+	wxSemaphore	m_jobSignal;
+	//! Set when the workers should exit.
+	bool		m_stopWorkers;
+	//! Set if starting the workers failed, jobs are then run directly.
+	bool		m_noWorkers;
 };
 
 #endif // CLIENTCREDITSLIST_H
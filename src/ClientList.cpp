@@ -42,6 +42,7 @@
 #include "Logger.h"
 #include "GuiEvents.h"		// Needed for Notify_*
 #include "Packet.h"
+#include "OtherFunctions.h"	// Needed for TreeMemoryUsage
 
 #include <common/Format.h>
 
@@ -803,6 +804,22 @@ const CClientList::IDMap& CClientList::GetClientList()
 }
 
 
+void CClientList::GetMemoryStats(MemoryStats& stats) const
+{
+	stats.clients = m_clientList.size();
+	stats.clientBytes = 0;
+	stats.uploadBytes = 0;
+	stats.downloadBytes = 0;
+	for (IDMap::const_iterator it = m_clientList.begin(); it != m_clientList.end(); ++it) {
+		it->second.GetClient()->AddMemoryUsage(stats.clientBytes, stats.uploadBytes, stats.downloadBytes);
+	}
+
+	stats.listBytes = TreeMemoryUsage(m_clientList) + TreeMemoryUsage(m_ipList) + TreeMemoryUsage(m_hashList)
+		+ TreeMemoryUsage(m_bannedList) + TreeMemoryUsage(m_trackedClientsList) + TreeMemoryUsage(m_KadSources)
+		+ m_trackedClientsList.size() * sizeof(CDeletedClient);
+}
+
+
 void CClientList::AddDeadSource(const CUpDownClient* client)
 {
 	m_deadSources.AddDeadSource( client );
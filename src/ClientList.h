@@ -300,6 +300,31 @@ public:
 	const IDMap& GetClientList();
 
 
+	//! Estimated memory used by the clients and the lists of clients.
+	struct MemoryStats {
+		//! Number of clients.
+		uint32	clients;
+		//! The clients, their chat state and waiting packets.
+		uint64	clientBytes;
+		//! Upload block requests and part status.
+		uint64	uploadBytes;
+		//! Download block requests, part status and A4AF files.
+		uint64	downloadBytes;
+		//! The maps and sets of this list.
+		uint64	listBytes;
+	};
+
+	/**
+	 * Estimates the memory used by the clients.
+	 *
+	 * @param stats Filled with the estimates.
+	 *
+	 * Visits every client, so it's meant for the statistics, not for
+	 * frequent calls.
+	 */
+	void	GetMemoryStats(MemoryStats& stats) const;
+
+
 	/**
 	 * Adds a source to the list of dead sources.
 	 *
@@ -130,6 +130,7 @@ uint8				WRAPC(GetDownloadState)
 CFriend*			WRAPC(GetFriend)
 bool				WRAPC(GetFriendSlot)
 wxString			WRAPC(GetFullIP)
+uint32				WRAPC(GetFullUserIP)
 uint32				WRAPC(GetIP)
 uint16				WRAPC(GetKadPort)
 float				WRAPC(GetKBpsDown)
@@ -156,6 +157,7 @@ const CKnownFile*	WRAPC(GetUploadFile)
 uint16				WRAPC(GetUploadQueueWaitingPosition)
 uint8				WRAPC(GetUploadState)
 size_t				WRAPC(GetUpPartCount)
+const BitVector&	WRAPC(GetUpPartStatus)
 uint32				WRAPC(GetUserIDHybrid)
 const wxString&		WRAPC(GetUserName)
 uint16_t			WRAPC(GetUserPort)
@@ -127,6 +127,7 @@ public:
 	CFriend*			GetFriend() const;
 	bool				GetFriendSlot() const;
 	wxString			GetFullIP() const;
+	uint32				GetFullUserIP() const;
 	uint16				GetKadPort() const;
 	float				GetKBpsDown() const;
 	uint32				GetIP() const;
@@ -155,6 +156,7 @@ public:
 	uint16				GetUploadQueueWaitingPosition() const;
 	uint8				GetUploadState() const;
 	size_t				GetUpPartCount() const;
+	const BitVector&	GetUpPartStatus() const;
 	const CMD4Hash&		GetUserHash() const;
 	uint32				GetUserIDHybrid() const;
 	const wxString&		GetUserName() const;
@@ -45,18 +45,131 @@
 #include "ClientList.h"			// Needed for clientlist (buddy support)
 #include "ClientTCPSocket.h"	// Needed for CClientTCPSocket
 #include "MemFile.h"			// Needed for CMemFile
+#include "NetworkFunctions.h"	// Needed for IsLanIP
 #include "Logger.h"
+#include "BufferPool.h"			// Needed for CBufferPool
+#include "InternalEvents.h"		// Needed for CMuleInternalEvent
+#include "MuleThread.h"			// Needed for CMuleThread
 #include "kademlia/kademlia/Kademlia.h"
+#include "kademlia/net/KademliaUDPListener.h"
 #include "kademlia/utils/KadUDPKey.h"
 #include <zlib.h>
 #include "EncryptedDatagramSocket.h"
 
+#include <algorithm>			// Needed for std::min and std::max
+
+// Received datagrams waiting for a worker, further ones are dropped
+static const size_t MAX_QUEUED_DATAGRAMS = 4096;
+
+
+/**
+ * A datagram received on the client UDP socket.
+ *
+ * Everything a worker needs to decode it is copied in on the core thread,
+ * so workers never touch the Kad or client state. What a worker finds out
+ * about a Kad packet is kept here for the core thread to act on.
+ */
+class CClientUDPDatagram
+{
+public:
+	CClientUDPDatagram(uint32 ip, uint16 port, const byte* data, size_t length)
+		: m_ip(ip),
+		  m_port(port),
+		  m_buffer(CBufferPool::Allocate(length)),
+		  m_length(length),
+		  m_hasKadID(false),
+		  m_kadLANMode(false),
+		  m_packet(NULL),
+		  m_packetLen(0),
+		  m_receiverVerifyKey(0),
+		  m_senderVerifyKey(0),
+		  m_validReceiverKey(false),
+		  m_kadPacket(NULL),
+		  m_kadPacketLen(0),
+		  m_kadContact(false),
+		  m_kadVerdict(Kademlia::CPacketTracking::InRequestAllowed),
+		  m_kadRequest(NULL)
+	{
+		memcpy(m_buffer, data, length);
+	}
+
+	~CClientUDPDatagram()
+	{
+		delete m_kadRequest;
+		CBufferPool::Free(m_buffer);
+	}
+
+	uint32		m_ip;
+	uint16		m_port;
+	//! The datagram as received, decrypted in place.
+	byte*		m_buffer;
+	size_t		m_length;
+	//! The crypt value of our Kad ID when the datagram was received.
+	uint8		m_kadIDKey[16];
+	bool		m_hasKadID;
+	//! True if a LAN sender is exempt from the Kad flood protection.
+	bool		m_kadLANMode;
+	//! The decrypted packet, which lies within m_buffer.
+	byte*		m_packet;
+	int		m_packetLen;
+	//! A packed Kad packet after unpacking, empty if that failed.
+	std::vector<uint8_t>	m_unpacked;
+	uint32_t	m_receiverVerifyKey;
+	uint32_t	m_senderVerifyKey;
+	//! True if the receiver key of a Kad packet is the one we gave to the sender.
+	bool		m_validReceiverKey;
+	//! The Kad packet to handle, unpacked if needed, or NULL.
+	const uint8_t*	m_kadPacket;
+	uint32_t	m_kadPacketLen;
+	//! True if the Kad packet counts as a contact, see CKademlia::PacketsReceived().
+	bool		m_kadContact;
+	//! The decision of the Kad flood protection.
+	Kademlia::CPacketTracking::InRequestVerdict	m_kadVerdict;
+	//! A Kad request parsed in advance, or NULL.
+	Kademlia::CKadParsedRequest*	m_kadRequest;
+
+private:
+	CClientUDPDatagram(const CClientUDPDatagram&);
+	CClientUDPDatagram& operator=(const CClientUDPDatagram&);
+};
+
+
+/**
+ * Worker thread decoding received datagrams.
+ */
+class CUDPDecodeThread : public CMuleThread
+{
+public:
+	CUDPDecodeThread(CClientUDPSocket* owner)
+		: CMuleThread(wxTHREAD_JOINABLE),
+		  m_owner(owner)
+	{}
+
+protected:
+	void* Entry()
+	{
+		while (CClientUDPDatagram* datagram = m_owner->WaitForDatagram()) {
+			CClientUDPSocket::DecodeDatagram(datagram);
+			m_owner->AddDecoded(datagram);
+		}
+
+		return NULL;
+	}
+
+private:
+	CClientUDPSocket* m_owner;
+};
+
+
 //
 // CClientUDPSocket -- Extended eMule UDP socket
 //
 
 CClientUDPSocket::CClientUDPSocket(const amuleIPV4Address& address, const CProxyData* ProxyData)
-	: CMuleUDPSocket(wxT("Client UDP-Socket"), ID_CLIENTUDPSOCKET_EVENT, address, ProxyData)
+	: CMuleUDPSocket(wxT("Client UDP-Socket"), ID_CLIENTUDPSOCKET_EVENT, address, ProxyData),
+	  m_decodedPosted(false),
+	  m_stopWorkers(false),
+	  m_noWorkers(false)
 {
 	if (!thePrefs::IsUDPDisabled()) {
 		Open();
@@ -64,6 +177,12 @@ CClientUDPSocket::CClientUDPSocket(const amuleIPV4Address& address, const CProxy
 }
 
 
+CClientUDPSocket::~CClientUDPSocket()
+{
+	StopWorkers();
+}
+
+
 void CClientUDPSocket::OnReceive(int errorCode)
 {
 	CMuleUDPSocket::OnReceive(errorCode);
@@ -79,10 +198,111 @@ void CClientUDPSocket::OnPacketReceived(uint32 ip, uint16 port, byte* buffer, si
 {
 	wxCHECK_RET(length >= 2, wxT("Invalid packet."));
 
-	uint8_t *decryptedBuffer;
-	uint32_t receiverVerifyKey;
-	uint32_t senderVerifyKey;
-	int packetLen = CEncryptedDatagramSocket::DecryptReceivedClient(buffer, length, &decryptedBuffer, ip, &receiverVerifyKey, &senderVerifyKey);
+	CClientUDPDatagram* datagram = new CClientUDPDatagram(ip, port, buffer, length);
+	if (Kademlia::CKademlia::GetPrefs()) {
+		Kademlia::CKademlia::GetPrefs()->GetKadID().StoreCryptValue(datagram->m_kadIDKey);
+		datagram->m_hasKadID = true;
+		datagram->m_kadLANMode = ::IsLanIP(ip) && Kademlia::CKademlia::IsRunningInLANMode();
+	}
+
+	if (!StartWorkers()) {
+		DecodeDatagram(datagram);
+		if (datagram->m_kadContact) {
+			Kademlia::CKademlia::PacketsReceived();
+		}
+		ProcessDatagram(datagram, theApp->GetPublicIP(false));
+		delete datagram;
+		return;
+	}
+
+	bool queued = false;
+	{
+		wxMutexLocker lock(m_queueLock);
+		if (m_received.size() < MAX_QUEUED_DATAGRAMS) {
+			m_received.push_back(datagram);
+			queued = true;
+		}
+	}
+
+	if (queued) {
+		m_receivedSignal.Post();
+	} else {
+		AddDebugLogLineN(logClientUDP, wxT("Dropped a received datagram, the decoding threads are behind"));
+		delete datagram;
+	}
+}
+
+
+void CClientUDPSocket::DecodeDatagram(CClientUDPDatagram* datagram)
+{
+	datagram->m_packetLen = CEncryptedDatagramSocket::DecryptReceivedClient(datagram->m_buffer, datagram->m_length,
+		&datagram->m_packet, datagram->m_ip, datagram->m_hasKadID ? datagram->m_kadIDKey : NULL,
+		&datagram->m_receiverVerifyKey, &datagram->m_senderVerifyKey);
+
+	const int packetLen = datagram->m_packetLen;
+	const uint8_t protocol = datagram->m_packet[0];
+	if (packetLen < 2 || (protocol != OP_KADEMLIAHEADER && protocol != OP_KADEMLIAPACKEDPROT)) {
+		return;
+	}
+
+	datagram->m_validReceiverKey = (Kademlia::CPrefs::GetUDPVerifyKey(datagram->m_ip) == datagram->m_receiverVerifyKey);
+
+	if (protocol == OP_KADEMLIAPACKEDPROT) {
+		uint32_t newSize = packetLen * 10 + 300; // Should be enough...
+		std::vector<uint8_t>& unpack = datagram->m_unpacked;
+		unpack.resize(newSize);
+		uLongf unpackedsize = newSize - 2;
+		if (uncompress(&(unpack[2]), &unpackedsize, datagram->m_packet + 2, packetLen - 2) == Z_OK) {
+			unpack[0] = OP_KADEMLIAHEADER;
+			unpack[1] = datagram->m_packet[1];
+			unpack.resize(unpackedsize + 2);
+			datagram->m_kadPacket = &(unpack[0]);
+			datagram->m_kadPacketLen = unpack.size();
+		} else {
+			unpack.clear();
+		}
+	} else {
+		datagram->m_kadPacket = datagram->m_packet;
+		datagram->m_kadPacketLen = packetLen;
+	}
+
+	// Unencrypted packets from port 53 are dropped, see CKademliaUDPListener::ProcessPacket()
+	if (datagram->m_kadPacket == NULL || !datagram->m_hasKadID || (datagram->m_port == 53 && datagram->m_senderVerifyKey == 0)) {
+		return;
+	}
+	datagram->m_kadContact = true;
+
+	// The flood check and parsing the costly requests don't need the core thread
+	const uint32_t kadIP = wxUINT32_SWAP_ALWAYS(datagram->m_ip);
+	datagram->m_kadVerdict = Kademlia::CPacketTracking::CheckInRequest(kadIP, datagram->m_kadPacket[1], datagram->m_kadLANMode);
+	if (datagram->m_kadVerdict == Kademlia::CPacketTracking::InRequestAllowed) {
+		try {
+			datagram->m_kadRequest = Kademlia::CKademliaUDPListener::ParseRequest(datagram->m_kadPacket, datagram->m_kadPacketLen, kadIP, datagram->m_port);
+		} catch (const wxString& DEBUG_ONLY(e)) {
+			AddDebugLogLineN(logClientKadUDP, wxT("Error while parsing Kad packet: ") + e);
+			datagram->m_kadVerdict = Kademlia::CPacketTracking::InRequestDropped;
+		} catch (const CInvalidPacket& DEBUG_ONLY(e)) {
+			AddDebugLogLineN(logClientKadUDP, wxT("Invalid Kad packet encountered: ") + e.what());
+			datagram->m_kadVerdict = Kademlia::CPacketTracking::InRequestDropped;
+		} catch (const CEOFException& DEBUG_ONLY(e)) {
+			AddDebugLogLineN(logClientKadUDP, wxT("Malformed packet encountered while parsing Kad packet: ") + e.what());
+			datagram->m_kadVerdict = Kademlia::CPacketTracking::InRequestDropped;
+		}
+	}
+}
+
+
+void CClientUDPSocket::ProcessDatagram(CClientUDPDatagram* datagram, uint32 publicIP)
+{
+	const uint32 ip = datagram->m_ip;
+	const uint16 port = datagram->m_port;
+	const size_t length = datagram->m_length;
+	const int packetLen = datagram->m_packetLen;
+	byte* const decryptedBuffer = datagram->m_packet;
+
+	if (static_cast<size_t>(packetLen) < length) {
+		theStats::AddDownOverheadCrypt(length - packetLen);
+	}
 
 	uint8_t protocol = decryptedBuffer[0];
 	uint8_t opcode	 = decryptedBuffer[1];
@@ -95,31 +315,23 @@ void CClientUDPSocket::OnPacketReceived(uint32 ip, uint16 port, byte* buffer, si
 					break;
 
 				case OP_KADEMLIAHEADER:
-					theStats::AddDownOverheadKad(length);
-					if (packetLen >= 2) {
-						Kademlia::CKademlia::ProcessPacket(decryptedBuffer, packetLen, wxUINT32_SWAP_ALWAYS(ip), port, (Kademlia::CPrefs::GetUDPVerifyKey(ip) == receiverVerifyKey), Kademlia::CKadUDPKey(senderVerifyKey, theApp->GetPublicIP(false)));
-					} else {
-						throw wxString(wxT("Kad packet too short"));
-					}
-					break;
-
 				case OP_KADEMLIAPACKEDPROT:
 					theStats::AddDownOverheadKad(length);
-					if (packetLen >= 2) {
-						uint32_t newSize = packetLen * 10 + 300; // Should be enough...
-						std::vector<uint8_t> unpack(newSize);
-						uLongf unpackedsize = newSize - 2;
-						uint16_t result = uncompress(&(unpack[2]), &unpackedsize, decryptedBuffer + 2, packetLen - 2);
-						if (result == Z_OK) {
-							AddDebugLogLineN(logClientKadUDP, wxT("Correctly uncompressed Kademlia packet"));
-							unpack[0] = OP_KADEMLIAHEADER;
-							unpack[1] = opcode;
-							Kademlia::CKademlia::ProcessPacket(&(unpack[0]), unpackedsize + 2, wxUINT32_SWAP_ALWAYS(ip), port, (Kademlia::CPrefs::GetUDPVerifyKey(ip) == receiverVerifyKey), Kademlia::CKadUDPKey(senderVerifyKey, theApp->GetPublicIP(false)));
-						} else {
+					if (packetLen < 2) {
+						throw wxString(protocol == OP_KADEMLIAHEADER ? wxT("Kad packet too short") : wxT("Kad packet (compressed) too short"));
+					}
+					if (protocol == OP_KADEMLIAPACKEDPROT) {
+						if (datagram->m_kadPacket == NULL) {
 							AddDebugLogLineN(logClientKadUDP, wxT("Failed to uncompress Kademlia packet"));
+							break;
 						}
-					} else {
-						throw wxString(wxT("Kad packet (compressed) too short"));
+						AddDebugLogLineN(logClientKadUDP, wxT("Correctly uncompressed Kademlia packet"));
+					}
+					// The flood check was done by DecodeDatagram()
+					if (datagram->m_kadVerdict == Kademlia::CPacketTracking::InRequestBanned) {
+						theApp->clientlist->AddBannedClient(ip);
+					} else if (datagram->m_kadVerdict == Kademlia::CPacketTracking::InRequestAllowed) {
+						Kademlia::CKademlia::ProcessPacket(datagram->m_kadPacket, datagram->m_kadPacketLen, wxUINT32_SWAP_ALWAYS(ip), port, datagram->m_validReceiverKey, Kademlia::CKadUDPKey(datagram->m_senderVerifyKey, publicIP), datagram->m_kadRequest);
 					}
 					break;
 
@@ -137,6 +349,114 @@ void CClientUDPSocket::OnPacketReceived(uint32 ip, uint16 port, byte* buffer, si
 }
 
 
+void CClientUDPSocket::ProcessDecoded()
+{
+	std::vector<CClientUDPDatagram*> decoded;
+	{
+		wxMutexLocker lock(m_queueLock);
+		decoded.swap(m_decoded);
+		m_decodedPosted = false;
+	}
+
+	// What is the same for all datagrams is done once for the batch
+	for (std::vector<CClientUDPDatagram*>::iterator it = decoded.begin(); it != decoded.end(); ++it) {
+		if ((*it)->m_kadContact) {
+			Kademlia::CKademlia::PacketsReceived();
+			break;
+		}
+	}
+	const uint32 publicIP = theApp->GetPublicIP(false);
+
+	for (std::vector<CClientUDPDatagram*>::iterator it = decoded.begin(); it != decoded.end(); ++it) {
+		ProcessDatagram(*it, publicIP);
+		delete *it;
+	}
+}
+
+
+bool CClientUDPSocket::StartWorkers()
+{
+	if (!m_workers.empty() || m_noWorkers) {
+		return !m_noWorkers;
+	}
+
+	int count = wxThread::GetCPUCount();
+	count = std::max(1, std::min(count, 4));
+
+	for (int i = 0; i < count; ++i) {
+		CMuleThread* thread = new CUDPDecodeThread(this);
+		if (thread->Create() != wxTHREAD_NO_ERROR || thread->Run() != wxTHREAD_NO_ERROR) {
+			delete thread;
+			break;
+		}
+		m_workers.push_back(thread);
+	}
+
+	if (m_workers.empty()) {
+		AddDebugLogLineC(logClientUDP, wxT("Failed to start the UDP decoding threads, datagrams are decoded by the main thread"));
+		m_noWorkers = true;
+	} else {
+		AddDebugLogLineN(logClientUDP, CFormat(wxT("Started %u UDP decoding threads")) % m_workers.size());
+	}
+
+	return !m_noWorkers;
+}
+
+
+CClientUDPDatagram* CClientUDPSocket::WaitForDatagram()
+{
+	m_receivedSignal.Wait();
+
+	wxMutexLocker lock(m_queueLock);
+	if (m_stopWorkers || m_received.empty()) {
+		return NULL;
+	}
+
+	CClientUDPDatagram* datagram = m_received.front();
+	m_received.pop_front();
+	return datagram;
+}
+
+
+void CClientUDPSocket::AddDecoded(CClientUDPDatagram* datagram)
+{
+	bool post = false;
+	{
+		wxMutexLocker lock(m_queueLock);
+		m_decoded.push_back(datagram);
+		// One event for all datagrams decoded until the core thread gets to them
+		post = !m_decodedPosted;
+		m_decodedPosted = true;
+	}
+
+	if (post) {
+		CMuleInternalEvent evt(wxEVT_CORE_UDP_DECODED);
+		wxPostEvent(wxTheApp, evt);
+	}
+}
+
+
+void CClientUDPSocket::StopWorkers()
+{
+	{
+		wxMutexLocker lock(m_queueLock);
+		m_stopWorkers = true;
+	}
+
+	for (size_t i = 0; i < m_workers.size(); ++i) {
+		m_receivedSignal.Post();
+	}
+	for (size_t i = 0; i < m_workers.size(); ++i) {
+		m_workers[i]->Stop();
+		delete m_workers[i];
+	}
+	m_workers.clear();
+
+	DeleteContents(m_received);
+	DeleteContents(m_decoded);
+}
+
+
 void CClientUDPSocket::ProcessPacket(byte* packet, int16 size, int8 opcode, uint32 host, uint16 port)
 {
 	switch (opcode) {
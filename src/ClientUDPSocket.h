@@ -28,10 +28,36 @@
 
 #include "MuleUDPSocket.h"
 
+#include <wx/thread.h>		// Needed for wxMutex and wxSemaphore
+
+#include <deque>
+#include <vector>
+
+class CClientUDPDatagram;
+class CMuleThread;
+
+/**
+ * The UDP socket for eMule extended and Kad packets.
+ *
+ * Received datagrams are decrypted, checked and unpacked by a few worker
+ * threads. The decoded datagrams are handed back to the core thread in
+ * batches, where the packet handlers run as before. If no worker thread
+ * can be started, datagrams are decoded on the core thread.
+ *
+ * The workers also run the Kad flood check and parse the search and
+ * publish requests into owned structs (see CKadParsedRequest). The core
+ * thread then only applies them to the routing table and the indexes,
+ * which have no locks, and does what all datagrams of a batch share
+ * once per batch.
+ */
 class CClientUDPSocket : public CMuleUDPSocket
 {
 public:
 	CClientUDPSocket(const amuleIPV4Address &address, const CProxyData *ProxyData = NULL);
+	~CClientUDPSocket();
+
+	/** Handles the datagrams decoded since the last call, on the core thread. */
+	void	ProcessDecoded();
 
 protected:
 	void	OnReceive(int errorCode);
@@ -39,6 +65,39 @@ protected:
 private:
 	void	OnPacketReceived(uint32 ip, uint16 port, byte* buffer, size_t length);
 	void	ProcessPacket(byte* packet, int16 size, int8 opcode, uint32 host, uint16 port);
+
+	/** Decrypts, unpacks and checks a datagram, safe to call from any thread. */
+	static void	DecodeDatagram(CClientUDPDatagram* datagram);
+	/** Passes a decoded datagram to the packet handlers. */
+	void	ProcessDatagram(CClientUDPDatagram* datagram, uint32 publicIP);
+
+	/** Starts the worker threads if not done yet, returning false on failure. */
+	bool	StartWorkers();
+	/** Waits for the next datagram, returns NULL when the workers should exit. */
+	CClientUDPDatagram* WaitForDatagram();
+	/** Queues a decoded datagram for the core thread. */
+	void	AddDecoded(CClientUDPDatagram* datagram);
+	/** Stops the worker threads and drops the datagrams not yet handled. */
+	void	StopWorkers();
+
+	friend class CUDPDecodeThread;
+
+	//! Threads decoding received datagrams.
+	std::vector<CMuleThread*>	m_workers;
+	//! Datagrams waiting for a worker.
+	std::deque<CClientUDPDatagram*>	m_received;
+	//! Decoded datagrams waiting for the core thread.
+	std::vector<CClientUDPDatagram*>	m_decoded;
+	//! Protects m_received, m_decoded, m_decodedPosted and m_stopWorkers.
+	wxMutex		m_queueLock;
+	//! Posted once per received datagram and once per worker on shutdown.
+	wxSemaphore	m_receivedSignal;
+	//! Set while an event for m_decoded is on its way to the core thread.
+	bool		m_decodedPosted;
+	//! Set when the workers should exit.
+	bool		m_stopWorkers;
+	//! Set if starting the workers failed, datagrams are then decoded directly.
+	bool		m_noWorkers;
 };
 
 #endif // CLIENTUDPSOCKET_H
@@ -0,0 +1,194 @@
+//							-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef DEADLINEQUEUE_H
+#define DEADLINEQUEUE_H
+
+#include "HashMap.h"	// Needed for CHashMap
+
+#include <vector>
+
+
+/**
+ * Keys ordered by a deadline, the earliest first.
+ *
+ * A binary min-heap with the position of every key in a hash table, so the
+ * deadline of any key can be changed, or the key removed, in O(log n).
+ * Keys with the same deadline come out in no particular order.
+ */
+template <typename KEY, typename HASH = CIntegerHash>
+class CDeadlineQueue
+{
+public:
+	/** Sets the deadline of a key, adding the key if it is not queued. */
+	void Set(const KEY& key, uint32 deadline)
+	{
+		uint32* pos = m_positions.Lookup(key);
+		if (pos == NULL) {
+			m_positions[key] = m_heap.size();
+			m_heap.push_back(Entry(key, deadline));
+			SiftUp(m_heap.size() - 1);
+		} else {
+			size_t index = *pos;
+			uint32 old = m_heap[index].deadline;
+			m_heap[index].deadline = deadline;
+			if (deadline < old) {
+				SiftUp(index);
+			} else {
+				SiftDown(index);
+			}
+		}
+	}
+
+	/** Removes a key, returning false if it was not queued. */
+	bool Remove(const KEY& key)
+	{
+		const uint32* pos = m_positions.Lookup(key);
+		if (pos == NULL) {
+			return false;
+		}
+
+		size_t index = *pos;
+		m_positions.erase(key);
+		if (index + 1 < m_heap.size()) {
+			m_heap[index] = m_heap.back();
+			m_heap.pop_back();
+			*m_positions.Lookup(m_heap[index].key) = index;
+			if (index > 0 && m_heap[index].deadline < m_heap[(index - 1) / 2].deadline) {
+				SiftUp(index);
+			} else {
+				SiftDown(index);
+			}
+		} else {
+			m_heap.pop_back();
+		}
+		return true;
+	}
+
+	/** Returns true if the key is queued, and its deadline in 'deadline'. */
+	bool GetDeadline(const KEY& key, uint32& deadline) const
+	{
+		const uint32* pos = m_positions.Lookup(key);
+		if (pos) {
+			deadline = m_heap[*pos].deadline;
+		}
+		return pos != NULL;
+	}
+
+	/** The key with the earliest deadline. The queue must not be empty. */
+	const KEY& GetFirst() const		{ return m_heap.front().key; }
+	/** The earliest deadline. The queue must not be empty. */
+	uint32 GetFirstDeadline() const		{ return m_heap.front().deadline; }
+
+	/** Returns the number of keys with a deadline of 'now' or earlier. */
+	size_t CountDue(uint32 now) const
+	{
+		// Only the subtrees with a due root can hold due keys.
+		size_t count = 0;
+		std::vector<size_t> pending;
+		if (!m_heap.empty()) {
+			pending.push_back(0);
+		}
+		while (!pending.empty()) {
+			size_t index = pending.back();
+			pending.pop_back();
+			if (m_heap[index].deadline <= now) {
+				count++;
+				if (2 * index + 1 < m_heap.size()) {
+					pending.push_back(2 * index + 1);
+				}
+				if (2 * index + 2 < m_heap.size()) {
+					pending.push_back(2 * index + 2);
+				}
+			}
+		}
+		return count;
+	}
+
+	size_t size() const	{ return m_heap.size(); }
+	bool empty() const	{ return m_heap.empty(); }
+
+	/** Removes all keys. */
+	void clear()
+	{
+		m_heap.clear();
+		m_positions.clear();
+	}
+
+private:
+	struct Entry {
+		Entry() : deadline(0) {}
+		Entry(const KEY& k, uint32 d) : key(k), deadline(d) {}
+
+		KEY	key;
+		uint32	deadline;
+	};
+
+	void SiftUp(size_t index)
+	{
+		Entry entry = m_heap[index];
+		while (index > 0) {
+			size_t parent = (index - 1) / 2;
+			if (!(entry.deadline < m_heap[parent].deadline)) {
+				break;
+			}
+			Place(index, m_heap[parent]);
+			index = parent;
+		}
+		Place(index, entry);
+	}
+
+	void SiftDown(size_t index)
+	{
+		Entry entry = m_heap[index];
+		for (;;) {
+			size_t child = 2 * index + 1;
+			if (child >= m_heap.size()) {
+				break;
+			}
+			if (child + 1 < m_heap.size() && m_heap[child + 1].deadline < m_heap[child].deadline) {
+				child++;
+			}
+			if (!(m_heap[child].deadline < entry.deadline)) {
+				break;
+			}
+			Place(index, m_heap[child]);
+			index = child;
+		}
+		Place(index, entry);
+	}
+
+	void Place(size_t index, const Entry& entry)
+	{
+		m_heap[index] = entry;
+		*m_positions.Lookup(entry.key) = index;
+	}
+
+	std::vector<Entry>	m_heap;
+	//! Positions in m_heap, by key.
+	CHashMap<KEY, uint32, HASH>	m_positions;
+};
+
+#endif // DEADLINEQUEUE_H
+// File_checked_for_headers
@@ -35,6 +35,7 @@
 #include <zlib.h>
 #include <cmath>		// Needed for std:exp
 
+#include "BufferPool.h"		// Needed for CBufferPool
 #include "ClientCredits.h"	// Needed for CClientCredits
 #include "ClientUDPSocket.h"	// Needed for CClientUDPSocket
 #include "DownloadQueue.h"	// Needed for CDownloadQueue
@@ -49,6 +50,7 @@
 #include "Statistics.h"		// Needed for theStats
 #include "Logger.h"
 #include "GuiEvents.h"		// Needed for Notify_*
+#include "InflatePool.h"	// Needed for CInflatePool
 #include "UploadQueue.h"	// Needed for CUploadQueue
 
 
@@ -934,18 +936,17 @@ void CUpDownClient::ProcessBlockPacket(const byte* packet, uint32 size, bool pac
 				} else {
 					// Packed
 					wxASSERT( (long int)size > 0 );
-					// Create space to store unzipped data, the size is
-					// only an initial guess, will be resized in unzip()
-					// if not big enough
-					lenUnzipped = (size * 2);
-					// Don't get too big
-					if (lenUnzipped > (BLOCKSIZE + 300)) {
-						lenUnzipped = (BLOCKSIZE + 300);
+					// The rest of the block is the most a packet may unzip to.
+					// One byte more shows a packet unzipping past the block.
+					uint64 lenBlock = cur_block->block->EndOffset - cur_block->block->StartOffset + 1;
+					lenUnzipped = 1;
+					if (cur_block->totalUnzipped < lenBlock) {
+						lenUnzipped += (uint32)(lenBlock - cur_block->totalUnzipped);
 					}
-					byte *unzipped = new byte[lenUnzipped];
+					byte *unzipped = CBufferPool::Allocate(lenUnzipped);
 
 					// Try to unzip the packet
-					int result = unzip(cur_block, (byte*)(packet + header_size), (size - header_size), &unzipped, &lenUnzipped);
+					int result = unzip(cur_block, (byte*)(packet + header_size), (size - header_size), unzipped, &lenUnzipped);
 
 					// no block can be uncompressed to >2GB, 'lenUnzipped' is obviously erroneous.
 					if (result == Z_OK && ((int)lenUnzipped >= 0)) {
@@ -986,11 +987,8 @@ void CUpDownClient::ProcessBlockPacket(const byte* packet, uint32 size, bool pac
 
 						// If we had an zstream error, there is no chance that we could recover from it nor that we
 						// could use the current zstream (which is in error state) any longer.
-						if (cur_block->zStream){
-							inflateEnd(cur_block->zStream);
-							delete cur_block->zStream;
-							cur_block->zStream = NULL;
-						}
+						CInflatePool::Release(cur_block->zStream);
+						cur_block->zStream = NULL;
 
 						// Although we can't further use the current zstream, there is no need to disconnect the sending
 						// client because the next zstream (a series of 10K-blocks which build a 180K-block) could be
@@ -998,7 +996,7 @@ void CUpDownClient::ProcessBlockPacket(const byte* packet, uint32 size, bool pac
 						cur_block->fZStreamError = 1;
 						cur_block->totalUnzipped = 0; // bluecow's fix
 					}
-					delete [] unzipped;
+					CBufferPool::Free(unzipped);
 				}
 				// These checks only need to be done if any data was written
 				if (lenWritten > 0) {
@@ -1021,10 +1019,7 @@ void CUpDownClient::ProcessBlockPacket(const byte* packet, uint32 size, bool pac
 						m_reqfile->RemoveBlockFromList(cur_block->block->StartOffset, cur_block->block->EndOffset);
 						delete cur_block->block;
 						// Not always allocated
-						if (cur_block->zStream) {
-							inflateEnd(cur_block->zStream);
-							delete cur_block->zStream;
-						}
+						CInflatePool::Release(cur_block->zStream);
 						delete cur_block;
 						m_PendingBlocks_list.erase(it);
 
@@ -1046,98 +1041,24 @@ void CUpDownClient::ProcessBlockPacket(const byte* packet, uint32 size, bool pac
 	}
 }
 
-int CUpDownClient::unzip(Pending_Block_Struct *block, byte *zipped, uint32 lenZipped, byte **unzipped, uint32 *lenUnzipped, int iRecursion)
+int CUpDownClient::unzip(Pending_Block_Struct *block, byte *zipped, uint32 lenZipped, byte *unzipped, uint32 *lenUnzipped)
 {
-	int err = Z_DATA_ERROR;
-
-	// Save some typing
-	z_stream *zS = block->zStream;
-
-	// Is this the first time this block has been unzipped
-	if (zS == NULL) {
-		// Create stream
-		block->zStream = new z_stream;
-		zS = block->zStream;
-
-		// Initialise stream values
-		zS->zalloc = (alloc_func)0;
-		zS->zfree = (free_func)0;
-		zS->opaque = (voidpf)0;
-
-		// Set output data streams, do this here to avoid overwriting on recursive calls
-		zS->next_out = (*unzipped);
-		zS->avail_out = (*lenUnzipped);
-
-		// Initialise the z_stream
-		err = inflateInit(zS);
-		if (err != Z_OK) {
-			return err;
-		}
-	}
+	int err = CInflatePool::Unzip(block->zStream, block->totalUnzipped, zipped, lenZipped, unzipped, lenUnzipped);
 
-	// Use whatever input is provided
-	zS->next_in  = zipped;
-	zS->avail_in = lenZipped;
-
-	// Only set the output if not being called recursively
-	if (iRecursion == 0) {
-		zS->next_out = (*unzipped);
-		zS->avail_out = (*lenUnzipped);
-	}
-
-	// Try to unzip the data
-	err = inflate(zS, Z_SYNC_FLUSH);
-
-	// Is zip finished reading all currently available input and writing
-	// all generated output
-	if (err == Z_STREAM_END) {
-		// Finish up
-		err = inflateEnd(zS);
-		if (err != Z_OK) {
-			return err;
-		}
-
-		// Got a good result, set the size to the amount unzipped in this call
-		//  (including all recursive calls)
-		(*lenUnzipped) = (zS->total_out - block->totalUnzipped);
-		block->totalUnzipped = zS->total_out;
-	} else if ((err == Z_OK) && (zS->avail_out == 0) && (zS->avail_in != 0)) {
-
-		// Output array was not big enough,
-		// call recursively until there is enough space
-
-		// What size should we try next
-		uint32 newLength = (*lenUnzipped) *= 2;
-		if (newLength == 0) {
-			newLength = lenZipped * 2;
-		}
-		// Copy any data that was successfully unzipped to new array
-		byte *temp = new byte[newLength];
-		wxASSERT( zS->total_out - block->totalUnzipped <= newLength );
-		memcpy(temp, (*unzipped), (zS->total_out - block->totalUnzipped));
-		delete [] (*unzipped);
-		(*unzipped) = temp;
-		(*lenUnzipped) = newLength;
-
-		// Position stream output to correct place in new array
-		zS->next_out = (*unzipped) + (zS->total_out - block->totalUnzipped);
-		zS->avail_out = (*lenUnzipped) - (zS->total_out - block->totalUnzipped);
-
-		// Try again
-		err = unzip(block, zS->next_in, zS->avail_in, unzipped, lenUnzipped, iRecursion + 1);
-	} else if ((err == Z_OK) && (zS->avail_in == 0)) {
-		// All available input has been processed, everything ok.
-		// Set the size to the amount unzipped in this call
-		// (including all recursive calls)
-		(*lenUnzipped) = (zS->total_out - block->totalUnzipped);
-		block->totalUnzipped = zS->total_out;
-	} else {
+	if (err == Z_BUF_ERROR) {
+		// The output buffer holds the rest of the block, so there is more
+		// data than the block has room for.
+		AddDebugLogLineN(logZLib,
+			CFormat(wxT("Compressed packet unzips past the end of its block in file '%s'"))
+				% (m_reqfile ? m_reqfile->GetFileName() : CPath(wxT("?"))));
+		err = Z_DATA_ERROR;
+	} else if (err != Z_OK && err != Z_STREAM_ERROR && err != Z_MEM_ERROR) {
 		// Should not get here unless input data is corrupt
 		wxString strZipError;
 
-		if ( zS->msg ) {
-			strZipError = CFormat(wxT(" %d '%s'")) % err % wxString::FromAscii(zS->msg);
-		} else if (err != Z_OK) {
+		if (block->zStream && block->zStream->msg) {
+			strZipError = CFormat(wxT(" %d '%s'")) % err % wxString::FromAscii(block->zStream->msg);
+		} else {
 			strZipError = CFormat(wxT(" %d")) % err;
 		}
 
@@ -1146,10 +1067,6 @@ int CUpDownClient::unzip(Pending_Block_Struct *block, byte *zipped, uint32 lenZi
 				% strZipError % (m_reqfile ? m_reqfile->GetFileName() : CPath(wxT("?"))));
 	}
 
-	if (err != Z_OK) {
-		(*lenUnzipped) = 0;
-	}
-
 	return err;
 }
 
@@ -31,7 +31,7 @@
 #include <common/Format.h>	// Needed for CFormat
 #include "amule.h"		// Needed for theApp
 #include "amuleDlg.h"		// Needed for CamuleDlg
-#include "BarShader.h"		// Needed for CBarShader
+#include "BarShader.h"		// Needed for CBarShader and CBarCache
 #include "CommentDialogLst.h"	// Needed for CCommentDialogLst
 #include "DataToText.h"		// Needed for PriorityToStr
 #include "DownloadQueue.h"
@@ -52,15 +52,9 @@ class CPartFile;
 struct FileCtrlItem_Struct
 {
 	FileCtrlItem_Struct()
-		: dwUpdated(0),
-		  status(NULL),
-		  m_fileValue(NULL)
+		: m_fileValue(NULL)
 	{ }
 
-	~FileCtrlItem_Struct() {
-		delete status;
-	}
-
 	CPartFile* GetFile() const {
 		return m_fileValue;
 	}
@@ -69,8 +63,7 @@ struct FileCtrlItem_Struct
 		m_fileValue = file;
 	}
 
-	uint32		dwUpdated;
-	wxBitmap*	status;
+	CBarCache	statusBar;
 
 private:
 	CPartFile*			m_fileValue;
@@ -261,8 +254,6 @@ void CDownloadListCtrl::UpdateItem(const void* toupdate)
 
 		if ( index > -1 ) {
 			if ( show ) {
-				item->dwUpdated = 0;
-
 				// Only update visible lines
 				if ( index >= first && index <= last) {
 					RefreshItem( index );
@@ -972,22 +963,18 @@ void CDownloadListCtrl::DrawFileItem( wxDC* dc, int nColumn, const wxRect& rect,
 				int iHeight = rect.GetHeight() - 2;
 
 				// DO NOT DRAW IT ALL THE TIME
-				uint32 dwTicks = GetTickCount();
+				// Besides the bar version, the bar depends on the status of the file.
+				uint32 state = file->GetStatus() | (file->IsStopped() << 8)
+							| (file->GetHashingProgress() << 16);
+				bool bFlat = thePrefs::UseFlatBar();
 
 				wxMemoryDC cdcStatus;
 
-				if (item->dwUpdated < dwTicks || file->GetHashingProgress() > 0
-						|| !item->status || iWidth != item->status->GetWidth()) {
-					if ( item->status == NULL) {
-						item->status = new wxBitmap(iWidth, iHeight);
-					} else if ( item->status->GetWidth() != iWidth ) {
-						// Only recreate if the size has changed
-						item->status->Create(iWidth, iHeight);
-					}
-
-					cdcStatus.SelectObject( *item->status );
+				if (item->statusBar.NeedsRedraw(file->GetBarVersion(), state,
+						iWidth, iHeight, bFlat, thePrefs::Get3DDepth())) {
+					cdcStatus.SelectObject( item->statusBar.GetBitmap() );
 
-					if ( thePrefs::UseFlatBar() ) {
+					if ( bFlat ) {
 						DrawFileStatusBar( file, &cdcStatus,
 							wxRect(0, 0, iWidth, iHeight), true);
 					} else {
@@ -999,10 +986,8 @@ void CDownloadListCtrl::DrawFileItem( wxDC* dc, int nColumn, const wxRect& rect,
 						cdcStatus.SetBrush( *wxTRANSPARENT_BRUSH );
 						cdcStatus.DrawRectangle( 0, 0, iWidth, iHeight );
 					}
-
-					item->dwUpdated = dwTicks + 5000; // Plus five seconds
 				} else {
-					cdcStatus.SelectObject( *item->status );
+					cdcStatus.SelectObject( item->statusBar.GetBitmap() );
 				}
 
 				dc->Blit( rect.GetX(), rect.GetY() + 1, iWidth, iHeight, &cdcStatus, 0, 0);
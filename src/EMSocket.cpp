@@ -29,18 +29,27 @@
 #include <protocol/Protocols.h>
 #include <protocol/ed2k/Constants.h>
 
+#include "BufferPool.h"	// Needed for CBufferPool
 #include "Packet.h"		// Needed for CPacket
 #include "amule.h"
 #include "GetTickCount.h"
 #include "UploadBandwidthThrottler.h"
 #include "Logger.h"
 #include "Preferences.h"
-#include "ScopedPtr.h"
+
+#include <algorithm>	// Needed for std::max
 
 
 const uint32 MAX_PACKET_SIZE = 2000000;
 
-// cppcheck-suppress uninitMemberVar CEMSocket::pendingHeader
+// Size of the reads from the socket. Packets larger than this are read
+// into a buffer of their own size.
+const uint32 RECEIVE_BUFFER_SIZE = 64 * 1024;
+
+// Incomplete packets up to this size are kept in a buffer of their own
+// size between reads, rather than in a whole receive buffer.
+const uint32 RECEIVE_LEFTOVER_SIZE = 16 * 1024;
+
 CEMSocket::CEMSocket(const CProxyData *ProxyData)
 	: CEncryptedStreamSocket(MULE_SOCKET_NOWAIT, ProxyData)
 {
@@ -65,12 +74,11 @@ CEMSocket::CEMSocket(const CProxyData *ProxyData)
 	downloadLimitEnable = false;
 	pendingOnReceive = false;
 
-	// Download partial header
-	pendingHeaderSize = 0;
-
-	// Download partial packet
-	pendingPacket = NULL;
-	pendingPacketSize = 0;
+	// Received data
+	m_receiveBuffer = NULL;
+	m_receiveStart = 0;
+	m_receiveEnd = 0;
+	m_receiving = false;
 
 	// Upload control
 	sendbuffer = NULL;
@@ -141,16 +149,17 @@ void CEMSocket::ClearQueues()
 	downloadLimitEnable = false;
 	pendingOnReceive = false;
 
-	// Download partial header
-	pendingHeaderSize = 0;
-
-	// Download partial packet
-	delete[] pendingPacket;
-	pendingPacket = NULL;
-	pendingPacketSize = 0;
+	// Received data. While OnReceive() processes a packet, the packet
+	// still points into the buffer, so only OnReceive() may free it then.
+	m_receiveStart = 0;
+	m_receiveEnd = 0;
+	if (!m_receiving) {
+		CBufferPool::Free(m_receiveBuffer);
+		m_receiveBuffer = NULL;
+	}
 
 	// Upload control
-	delete[] sendbuffer;
+	CBufferPool::Free(sendbuffer);
 	sendbuffer = NULL;
 	sendblen = 0;
 	sent = 0;
@@ -190,7 +199,58 @@ void CEMSocket::OnReceive(int nErrorCode)
 		byConnected = ES_CONNECTED; // ES_DISCONNECTED, ES_NOTCONNECTED, ES_CONNECTED
 	}
 
+	// Packets point into the receive buffer while they are processed,
+	// which must not be moved by a nested call.
+	if (m_receiving) {
+		pendingOnReceive = true;
+		return;
+	}
+
+	m_receiving = true;
+	ReceivePackets();
+	m_receiving = false;
+
+	// Only keep the buffer while a packet is incomplete
+	if (m_receiveStart == m_receiveEnd) {
+		CBufferPool::Free(m_receiveBuffer);
+		m_receiveBuffer = NULL;
+		m_receiveStart = 0;
+		m_receiveEnd = 0;
+	} else {
+		ShrinkReceiveBuffer();
+	}
+}
+
+
+/**
+ * Moves a small incomplete packet into a buffer that just fits it, so
+ * sockets waiting for the rest of a packet don't each hold a whole
+ * receive buffer. The next read gets a full sized buffer again.
+ */
+void CEMSocket::ShrinkReceiveBuffer()
+{
+	const uint32 pending = m_receiveEnd - m_receiveStart;
+	if (pending > RECEIVE_LEFTOVER_SIZE || CBufferPool::GetCapacity(m_receiveBuffer) <= RECEIVE_LEFTOVER_SIZE) {
+		return;
+	}
+
+	byte* buffer = CBufferPool::Allocate(pending);
+	memcpy(buffer, m_receiveBuffer + m_receiveStart, pending);
+	CBufferPool::Free(m_receiveBuffer);
+	m_receiveBuffer = buffer;
+	m_receiveStart = 0;
+	m_receiveEnd = pending;
+}
+
+
+/**
+ * Reads as much as is available, up to the download limit, and processes
+ * every complete packet in the buffer after each read.
+ */
+void CEMSocket::ReceivePackets()
+{
 	uint32 ret;
+	uint32 readMax;
 	do {
 		// CPU load improvement
 		if (downloadLimitEnable && downloadLimit == 0){
@@ -198,36 +258,14 @@ void CEMSocket::OnReceive(int nErrorCode)
 			return;
 		}
 
-		uint32 readMax;
-		byte *buf;
-		if (pendingHeaderSize < PACKET_HEADER_SIZE) {
-			delete[] pendingPacket;
-			pendingPacket = NULL;
-			buf = pendingHeader + pendingHeaderSize;
-			readMax = PACKET_HEADER_SIZE - pendingHeaderSize;
-		} else if (pendingPacket == NULL) {
-			pendingPacketSize = 0;
-			readMax = CPacket::GetPacketSizeFromHeader(pendingHeader);
-			if (readMax > MAX_PACKET_SIZE) {
-				pendingHeaderSize = 0;
-				OnError(ERR_TOOBIG);
-				return;
-			}
-			pendingPacket = new byte[readMax + 1];
-			buf = pendingPacket;
-		} else {
-			buf = pendingPacket + pendingPacketSize;
-			readMax = CPacket::GetPacketSizeFromHeader(pendingHeader) - pendingPacketSize;
-		}
-
+		readMax = PrepareReceiveBuffer();
 		if (downloadLimitEnable && readMax > downloadLimit) {
 			readMax = downloadLimit;
 		}
 
-		ret = 0;
-		if (readMax) {
+		{
 			wxMutexLocker lock(m_sendLocker);
-			ret = Read(buf, readMax);
+			ret = Read(m_receiveBuffer + m_receiveEnd, readMax);
 			if (BlocksRead()) {
 				pendingOnReceive = true;
 				return;
@@ -251,35 +289,82 @@ void CEMSocket::OnReceive(int nErrorCode)
 		// Detect if the socket's buffer is empty (or the size did match...)
 		pendingOnReceive = (ret == readMax);
 
-		if (pendingHeaderSize >= PACKET_HEADER_SIZE) {
-			pendingPacketSize += ret;
-			if (pendingPacketSize >= CPacket::GetPacketSizeFromHeader(pendingHeader)) {
-				CScopedPtr<CPacket> packet(new CPacket(pendingHeader, pendingPacket));
-				pendingPacket = NULL;
-				pendingPacketSize = 0;
-				pendingHeaderSize = 0;
-
-				// Bugfix We still need to check for a valid protocol
-				// Remark: the default eMule v0.26b had removed this test......
-				switch (packet->GetProtocol()){
-					case OP_EDONKEYPROT:
-					case OP_PACKEDPROT:
-					case OP_EMULEPROT:
-					case OP_ED2KV2HEADER:
-					case OP_ED2KV2PACKEDPROT:
-						break;
-					default:
-						OnError(ERR_WRONGHEADER);
-						return;
-				}
+		m_receiveEnd += ret;
 
-				// Process packet
-				PacketReceived(packet.get());
+		while (m_receiveEnd - m_receiveStart >= PACKET_HEADER_SIZE) {
+			byte* header = m_receiveBuffer + m_receiveStart;
+			uint32 packetSize = CPacket::GetPacketSizeFromHeader(header);
+			if (packetSize > MAX_PACKET_SIZE) {
+				m_receiveStart = 0;
+				m_receiveEnd = 0;
+				OnError(ERR_TOOBIG);
+				return;
+			}
+			if (m_receiveEnd - m_receiveStart - PACKET_HEADER_SIZE < packetSize) {
+				break;
+			}
+
+			// Consumed before processing, which may clear the queues
+			m_receiveStart += PACKET_HEADER_SIZE + packetSize;
+			CPacket packet(header, header + PACKET_HEADER_SIZE);
+
+			// Bugfix We still need to check for a valid protocol
+			// Remark: the default eMule v0.26b had removed this test......
+			switch (packet.GetProtocol()){
+				case OP_EDONKEYPROT:
+				case OP_PACKEDPROT:
+				case OP_EMULEPROT:
+				case OP_ED2KV2HEADER:
+				case OP_ED2KV2PACKEDPROT:
+					break;
+				default:
+					OnError(ERR_WRONGHEADER);
+					return;
+			}
+
+			// Process packet
+			PacketReceived(&packet);
+
+			if (byConnected == ES_DISCONNECTED) {
+				return;
 			}
-		} else {
-			pendingHeaderSize += ret;
 		}
-	} while (ret && pendingHeaderSize >= PACKET_HEADER_SIZE);
+	} while (pendingOnReceive);
+}
+
+
+/**
+ * Makes room at the end of the receive buffer for the next read.
+ *
+ * @return The number of bytes that can be read.
+ */
+uint32 CEMSocket::PrepareReceiveBuffer()
+{
+	const uint32 pending = m_receiveEnd - m_receiveStart;
+
+	// An incomplete packet larger than a normal read must fit as a whole
+	size_t needed = RECEIVE_BUFFER_SIZE;
+	if (pending >= PACKET_HEADER_SIZE) {
+		needed = std::max<size_t>(needed, PACKET_HEADER_SIZE + CPacket::GetPacketSizeFromHeader(m_receiveBuffer + m_receiveStart));
+	}
+
+	if (m_receiveBuffer == NULL) {
+		m_receiveBuffer = CBufferPool::Allocate(needed);
+		m_receiveStart = 0;
+		m_receiveEnd = 0;
+	} else {
+		if (m_receiveStart > 0) {
+			// Move the incomplete packet to the front
+			memmove(m_receiveBuffer, m_receiveBuffer + m_receiveStart, pending);
+			m_receiveStart = 0;
+			m_receiveEnd = pending;
+		}
+		if (CBufferPool::GetCapacity(m_receiveBuffer) < needed) {
+			m_receiveBuffer = CBufferPool::Reallocate(m_receiveBuffer, needed, m_receiveEnd);
+		}
+	}
+
+	return (uint32)CBufferPool::GetCapacity(m_receiveBuffer) - m_receiveEnd;
 }
 
 
@@ -597,7 +682,7 @@ SocketSentBytes CEMSocket::Send(uint32 maxNumberOfBytesToSend, uint32 minFragSiz
 			if (sent == sendblen){
 				// we are done sending the current packet. Delete it and set
 				// sendbuffer to NULL so a new packet can be fetched.
-				delete[] sendbuffer;
+				CBufferPool::Free(sendbuffer);
 				sendbuffer = NULL;
 				sendblen = 0;
 
@@ -89,6 +89,9 @@ protected:
 private:
     virtual SocketSentBytes Send(uint32 maxNumberOfBytesToSend, uint32 minFragSize, bool onlyAllowedToSendControlPacket);
 	void	ClearQueues();
+	void	ReceivePackets();
+	uint32	PrepareReceiveBuffer();
+	void	ShrinkReceiveBuffer();
 
     uint32	GetNextFragSize(uint32 current, uint32 minFragSize);
     bool    HasSent() { return m_hasSent; }
@@ -98,13 +101,12 @@ private:
 	bool	downloadLimitEnable;
 	bool	pendingOnReceive;
 
-	// Download partial header
-	byte	pendingHeader[PACKET_HEADER_SIZE];
-	uint32	pendingHeaderSize;
-
-	// Download partial packet
-	byte*	pendingPacket;
-	uint32  pendingPacketSize;
+	// Received data. Complete packets are processed in place, from
+	// m_receiveStart, the rest waits for the next read.
+	byte*	m_receiveBuffer;
+	uint32	m_receiveStart;
+	uint32	m_receiveEnd;
+	bool	m_receiving;
 
 	// Upload control
 	byte*	sendbuffer;
@@ -95,10 +95,12 @@
 #include "Logger.h"
 #include "Preferences.h"
 #include "RC4Encrypt.h"
+#include "BufferPool.h"
 #include "./kademlia/kademlia/Prefs.h"
 #include "./kademlia/kademlia/Kademlia.h"
 #include "RandomFunctions.h"
 #include "Statistics.h"
+#include "ShardedCounter.h"	// Needed for CShardedCounter
 
 #include <protocol/Protocols.h>
 #include <common/MD5Sum.h>
@@ -113,6 +115,87 @@
 #define	MAGICVALUE_UDP_SERVERCLIENT			0xA5
 #define	MAGICVALUE_UDP_CLIENTSERVER			0x6B
 
+namespace {
+
+// The keys tried by DecryptReceivedClient, in marker bit order
+enum ClientKeyType {
+	KeyKadID = 0,
+	KeyUserHash = 1,
+	KeyReceiverKey = 2,
+	KeyTypeCount
+};
+
+
+/**
+ * Remembers, per sender IP, which key type decrypted the last packet, so
+ * the right key is usually tried first regardless of the marker bits,
+ * which older clients set at random.
+ *
+ * The table is direct mapped and read and written by all UDP decode
+ * threads without locking. A slot is a single aligned 32 bit word holding
+ * the IP (minus its two lowest bits) and the key type plus one, so a read
+ * never sees a torn entry. A colliding or stale entry only makes the
+ * first try fail, the other keys are still tried.
+ */
+class CKeyTypePredictor
+{
+public:
+	CKeyTypePredictor()
+	{
+		for (unsigned i = 0; i < Slots; ++i) {
+			m_slots[i] = 0;
+		}
+	}
+
+	// Returns the key type that last worked for this IP, or KeyTypeCount if unknown.
+	unsigned Predict(uint32_t ip) const
+	{
+		uint32_t entry = m_slots[Slot(ip)];
+		if ((entry & ~3u) != (ip & ~3u) || (entry & 3u) == 0) {
+			return KeyTypeCount;
+		}
+		return (entry & 3u) - 1;
+	}
+
+	// Records the key type that decrypted a packet from this IP.
+	void Set(uint32_t ip, unsigned keyType)
+	{
+		uint32_t entry = (ip & ~3u) | (keyType + 1);
+		volatile uint32_t& slot = m_slots[Slot(ip)];
+		if (slot != entry) {
+			slot = entry;
+		}
+	}
+
+private:
+	static const unsigned Slots = 4096;
+
+	static unsigned Slot(uint32_t ip)
+	{
+		return ((ip * 2654435761u) >> 20) & (Slots - 1);
+	}
+
+	volatile uint32_t	m_slots[Slots];
+};
+
+CKeyTypePredictor	s_keyTypes;
+
+// Counters for GetDecryptStats
+CShardedCounter		s_keysTried;
+CShardedCounter		s_decrypted;
+CShardedCounter		s_firstTry;
+
+}
+
+
+void CEncryptedDatagramSocket::GetDecryptStats(DecryptStats& stats)
+{
+	stats.keysTried = s_keysTried.GetValue();
+	stats.decrypted = s_decrypted.GetValue();
+	stats.firstTry = s_firstTry.GetValue();
+}
+
+
 CEncryptedDatagramSocket::CEncryptedDatagramSocket(amuleIPV4Address &address, muleSocketFlags flags, const CProxyData *proxyData)
 	: CDatagramSocketProxy(address, flags, proxyData)
 {}
@@ -120,7 +203,7 @@ CEncryptedDatagramSocket::CEncryptedDatagramSocket(amuleIPV4Address &address, mu
 CEncryptedDatagramSocket::~CEncryptedDatagramSocket()
 {}
 
-int CEncryptedDatagramSocket::DecryptReceivedClient(uint8_t *bufIn, int bufLen, uint8_t **bufOut, uint32_t ip, uint32_t *receiverVerifyKey, uint32_t *senderVerifyKey)
+int CEncryptedDatagramSocket::DecryptReceivedClient(uint8_t *bufIn, int bufLen, uint8_t **bufOut, uint32_t ip, const uint8_t *kadIDKey, uint32_t *receiverVerifyKey, uint32_t *senderVerifyKey)
 {
 	int result = bufLen;
 	*bufOut = bufIn;
@@ -156,54 +239,61 @@ int CEncryptedDatagramSocket::DecryptReceivedClient(uint8_t *bufIn, int bufLen,
 	// see the header for marker bits explanation
 	uint8_t currentTry = ((bufIn[0] & 0x03) == 3) ? 1 : (bufIn[0] & 0x03);
 	uint8_t tries;
-	if (Kademlia::CKademlia::GetPrefs() == NULL) {
+	if (kadIDKey == NULL) {
 		// if kad never run, no point in checking anything except for ed2k encryption
 		tries = 1;
 		currentTry = 1;
 	} else {
 		tries = 3;
+		// the key that worked for this sender last time is a better guess than the marker bits
+		unsigned predicted = s_keyTypes.Predict(ip);
+		if (predicted != KeyTypeCount) {
+			currentTry = predicted;
+		}
 	}
+	const uint8_t firstTry = currentTry;
+	uint8_t usedTry;
 	bool kad = false;
 	do {
 		receivebuffer.FullReset();
 		tries--;
-		MD5Sum md5;
+		uint8_t keyData[23];	// the longest key material, see the ed2k key below
+		unsigned keyLen = 0;
 
-		if (currentTry == 0) {
+		if (currentTry == KeyKadID) {
 			// kad packet with NodeID as key
 			kad = true;
-			if (Kademlia::CKademlia::GetPrefs()) {
-				uint8_t keyData[18];
-				Kademlia::CKademlia::GetPrefs()->GetKadID().StoreCryptValue((uint8_t *)&keyData);
+			if (kadIDKey) {
+				memcpy(keyData, kadIDKey, 16);
 				memcpy(keyData + 16, bufIn + 1, 2); // random key part sent from remote client
-				md5.Calculate(keyData, sizeof(keyData));
+				keyLen = 18;
 			}
-		} else if (currentTry == 1) {
+		} else if (currentTry == KeyUserHash) {
 			// ed2k packet
 			kad = false;
-			uint8_t keyData[23];
 			md4cpy(keyData, thePrefs::GetUserHash().GetHash());
 			keyData[20] = MAGICVALUE_UDP;
 			PokeUInt32(keyData + 16, ip);
 			memcpy(keyData + 21, bufIn + 1, 2); // random key part sent from remote client
-			md5.Calculate(keyData, sizeof(keyData));
-		} else if (currentTry == 2) {
+			keyLen = 23;
+		} else if (currentTry == KeyReceiverKey) {
 			// kad packet with ReceiverKey as key
 			kad = true;
-			if (Kademlia::CKademlia::GetPrefs()) {
-				uint8_t keyData[6];
+			if (kadIDKey) {
 				PokeUInt32(keyData, Kademlia::CPrefs::GetUDPVerifyKey(ip));
 				memcpy(keyData + 4, bufIn + 1, 2); // random key part sent from remote client
-				md5.Calculate(keyData, sizeof(keyData));
+				keyLen = 6;
 			}
 		} else {
 			wxFAIL;
 		}
 
-		receivebuffer.SetKey(md5, true);
+		receivebuffer.SetKey(keyLen ? MD5Sum(keyData, keyLen) : MD5Sum(), true);
+		s_keysTried.Add(1);
 		receivebuffer.RC4Crypt(bufIn + 3, (uint8_t*)&value, sizeof(value));
 		ENDIAN_SWAP_I_32(value);
 
+		usedTry = currentTry;
 		currentTry = (currentTry + 1) % 3;
 	} while (value != MAGICVALUE_UDP_SYNC_CLIENT && tries > 0); // try to decrypt as ed2k as well as kad packet if needed (max 3 rounds)
 
@@ -249,7 +339,11 @@ int CEncryptedDatagramSocket::DecryptReceivedClient(uint8_t *bufIn, int bufLen,
 		*bufOut = bufIn + (bufLen - result);
 
 		receivebuffer.RC4Crypt((uint8_t*)*bufOut, (uint8_t*)*bufOut, result);
-		theStats::AddDownOverheadCrypt(bufLen - result);
+		s_keyTypes.Set(ip, usedTry);
+		s_decrypted.Add(1);
+		if (usedTry == firstTry) {
+			s_firstTry.Add(1);
+		}
 		return result; // done
 	} else {
 		//DebugLogWarning(_T("Obfuscated packet expected but magicvalue mismatch on UDP packet from clientIP: %s"), ipstr(dwIP));
@@ -271,7 +365,7 @@ int CEncryptedDatagramSocket::EncryptSendClient(uint8_t **buf, int bufLen, const
 	uint8_t padLen = 0;			// padding disabled for UDP currently
 	const uint32_t cryptHeaderLen = padLen + CRYPT_HEADER_WITHOUTPADDING + (kad ? 8 : 0);
 	uint32_t cryptedLen = bufLen + cryptHeaderLen;
-	uint8_t *cryptedBuffer = new uint8_t[cryptedLen];
+	uint8_t *cryptedBuffer = CBufferPool::Allocate(cryptedLen);
 	bool kadRecvKeyUsed = false;
 
 	uint16_t randomKeyPart = GetRandomUint16();
@@ -294,7 +388,7 @@ int CEncryptedDatagramSocket::EncryptSendClient(uint8_t **buf, int bufLen, const
 			//DEBUG_ONLY( DebugLog(_T("Creating obfuscated Kad packet encrypted by Hash/NodeID %s"), md4str(pachClientHashOrKadID)) );
 		}
 		else {
-			delete [] cryptedBuffer;
+			CBufferPool::Free(cryptedBuffer);
 			wxFAIL;
 			return bufLen;
 		}
@@ -367,7 +461,7 @@ int CEncryptedDatagramSocket::EncryptSendClient(uint8_t **buf, int bufLen, const
 	}
 
 	sendbuffer.RC4Crypt(*buf, cryptedBuffer + cryptHeaderLen, bufLen);
-	delete [] *buf;
+	CBufferPool::Free(*buf);
 	*buf = cryptedBuffer;
 
 	theStats::AddUpOverheadCrypt(cryptedLen - bufLen);
@@ -463,7 +557,7 @@ int CEncryptedDatagramSocket::EncryptSendServer(uint8_t** ppbyBuf, int nBufLen,
 
 	uint8_t byPadLen = 0;			// padding disabled for UDP currently
 	uint32_t nCryptedLen = nBufLen + byPadLen + CRYPT_HEADER_WITHOUTPADDING;
-	uint8_t* pachCryptedBuffer = new uint8_t[nCryptedLen];
+	uint8_t* pachCryptedBuffer = CBufferPool::Allocate(nCryptedLen);
 
 	pachCryptedBuffer[0] = bySemiRandomNotProtocolMarker;
 	PokeUInt16(pachCryptedBuffer + 1, nRandomKeyPart);
@@ -478,7 +572,7 @@ int CEncryptedDatagramSocket::EncryptSendServer(uint8_t** ppbyBuf, int nBufLen,
 		sendbuffer.RC4Crypt((uint8_t*)&byRand, pachCryptedBuffer + CRYPT_HEADER_WITHOUTPADDING + j, 1);
 	}
 	sendbuffer.RC4Crypt(*ppbyBuf, pachCryptedBuffer + CRYPT_HEADER_WITHOUTPADDING + byPadLen, nBufLen);
-	delete[] *ppbyBuf;
+	CBufferPool::Free(*ppbyBuf);
 	*ppbyBuf = pachCryptedBuffer;
 
 	theStats::AddUpOverheadCrypt(nCryptedLen - nBufLen);
@@ -36,12 +36,31 @@ public:
 	virtual ~CEncryptedDatagramSocket();
 
 // TODO: Make protected once the UDP socket is again its own class.
-	static int DecryptReceivedClient(uint8_t *bufIn, int bufLen, uint8_t **bufOut, uint32_t ip, uint32_t *receiverVerifyKey, uint32_t *senderVerifyKey);
+	// Safe to call from any thread. kadIDKey is the crypt value of our Kad ID
+	// (see CUInt128::StoreCryptValue), or NULL if Kad never ran. Unlike the
+	// other functions it does not count the overhead, which is bufLen minus
+	// the returned length.
+	static int DecryptReceivedClient(uint8_t *bufIn, int bufLen, uint8_t **bufOut, uint32_t ip, const uint8_t *kadIDKey, uint32_t *receiverVerifyKey, uint32_t *senderVerifyKey);
+	// The Encrypt functions replace the buffer, it must come from CBufferPool.
 	static int EncryptSendClient(uint8_t **buf, int bufLen, const uint8_t *clientHashOrKadID, bool kad, uint32_t receiverVerifyKey, uint32_t senderVerifyKey);
 
 	static int DecryptReceivedServer(uint8_t* pbyBufIn, int nBufLen, uint8_t** ppbyBufOut, uint32_t dwBaseKey, uint32_t dbgIP);
 	static int EncryptSendServer(uint8_t** ppbyBuf, int nBufLen, uint32_t dwBaseKey);
 
+	//! Counters of DecryptReceivedClient.
+	struct DecryptStats {
+		DecryptStats() : keysTried(0), decrypted(0), firstTry(0) {}
+
+		//! Keys set up, one per decryption try.
+		uint64	keysTried;
+		//! Packets successfully decrypted.
+		uint64	decrypted;
+		//! Packets decrypted with the first key tried.
+		uint64	firstTry;
+	};
+
+	static void GetDecryptStats(DecryptStats& stats);
+
 };
 
 #endif
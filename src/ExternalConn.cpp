@@ -642,10 +642,12 @@ static CECPacket *Get_EC_Response_GetSharedFiles(const CECPacket *request, CFile
 
 	encoders.UpdateEncoders();
 
-	for (uint32 i = 0; i < theApp->sharedfiles->GetFileCount(); ++i) {
-		const CKnownFile *cur_file = theApp->sharedfiles->GetFileByIndex(i);
+	std::vector<CKnownFile*> shares;
+	theApp->sharedfiles->CopyFileList(shares);
+	for (uint32 i = 0; i < shares.size(); ++i) {
+		const CKnownFile *cur_file = shares[i];
 
-		if ( !cur_file || (!queryitems.empty() && !queryitems.count(cur_file->ECID())) ) {
+		if ( !queryitems.empty() && !queryitems.count(cur_file->ECID()) ) {
 			continue;
 		}
 
@@ -1431,7 +1433,7 @@ CECPacket *CECServerSocket::ProcessRequest2(const CECPacket *request)
 			response = Get_EC_Response_PartFile_Cmd(request);
 			break;
 		case EC_OP_SHAREDFILES_RELOAD:
-			theApp->sharedfiles->Reload();
+			theApp->sharedfiles->Reload(true);
 			response = new CECPacket(EC_OP_NOOP);
 			break;
 		case EC_OP_SHARED_SET_PRIO:
@@ -1977,8 +1979,10 @@ CECPacket *ECPartFileMsgSource::GetNextPacket()
  */
 ECKnownFileMsgSource::ECKnownFileMsgSource()
 {
-	for (unsigned int i = 0; i < theApp->sharedfiles->GetFileCount(); i++) {
-		const CKnownFile *cur_file = theApp->sharedfiles->GetFileByIndex(i);
+	std::vector<CKnownFile*> shares;
+	theApp->sharedfiles->CopyFileList(shares);
+	for (unsigned int i = 0; i < shares.size(); i++) {
+		const CKnownFile *cur_file = shares[i];
 		KNOWNFILE_STATUS status = { true, false, false, true, cur_file };
 		m_dirty_status[cur_file->GetFileHash()] = status;
 	}
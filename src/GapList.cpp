@@ -30,9 +30,7 @@
 #include "Logger.h"
 #include <common/Format.h>
 
-#if defined(_MSC_VER) && (_MSC_VER >= 1800) 
-#include <algorithm> // for std::min and std::max 
-#endif
+#include <algorithm> // for std::min and std::max
 
 void CGapList::Init(uint64 fileSize, bool isEmpty)
 {
@@ -59,6 +57,23 @@ void CGapList::Init(uint64 fileSize, bool isEmpty)
 }
 
 
+size_t CGapList::FirstEndingFrom(uint64 pos) const
+{
+	// binary search, ends are sorted
+	size_t imin = 0;
+	size_t imax = m_gaplist.size();
+	while (imin < imax) {
+		size_t i = (imin + imax) / 2;
+		if (m_gaplist[i].end < pos) {
+			imin = i + 1;
+		} else {
+			imax = i;
+		}
+	}
+	return imin;
+}
+
+
 void CGapList::AddGap(uint64 gapstart, uint64 gapend)
 {
 	if (!ArgCheck(gapstart, gapend)) {
@@ -75,43 +90,26 @@ void CGapList::AddGap(uint64 gapstart, uint64 gapend)
 	// total gap size has to be recalculated
 	m_totalGapSizeValid = false;
 
-	// find a place to start:
 	// first gap which ends >= our gap start - 1
 	// (-1 so we can join adjacent gaps)
-	iterator it = m_gaplist.lower_bound(gapstart > 0 ? gapstart - 1 : 0);
-	while (it != m_gaplist.end()) {
-		iterator it2 = it++;
-		uint64 curGapStart = it2->second;
-		uint64 curGapEnd   = it2->first;
-
-		if (curGapStart >= gapstart && curGapEnd <= gapend) {
-			// this gap is inside the new gap - delete
-			m_gaplist.erase(it2);
-		} else if (curGapStart >= gapstart && curGapStart <= gapend + 1) {
-			// head of this gap is in the new gap, or this gap is
-			// directly behind the new gap - extend limit and delete
-			gapend = curGapEnd;
-			m_gaplist.erase(it2);
-		} else if (curGapEnd <= gapend && curGapEnd >= gapstart - 1) {
-			// tail of this gap is in the new gap, or this gap is
-			// directly before the new gap - extend limit and delete
-			gapstart = curGapStart;
-			m_gaplist.erase(it2);
-		} else if (curGapStart <= gapstart && curGapEnd >= gapend) {
-			// new gap is already inside this gap - return
-			return;
-		// now all cases of overlap are ruled out
-		} else if (curGapStart > gapstart) {
-			// this gap is the first behind the new gap -> insert before it
-			it = it2;
-			break;
-		}
+	size_t first = FirstEndingFrom(gapstart > 0 ? gapstart - 1 : 0);
+	// behind the last gap which starts <= our gap end + 1
+	size_t last = first;
+	while (last < m_gaplist.size() && m_gaplist[last].start <= gapend + 1) {
+		last++;
 	}
-	// for fastest insertion point to the element AFTER which we want to insert
-	if (it != m_gaplist.begin()) {
-		--it;
+
+	if (first == last) {
+		// no overlapping or adjacent gaps - insert
+		Gap gap = { gapstart, gapend };
+		m_gaplist.insert(m_gaplist.begin() + first, gap);
+	} else {
+		// join all overlapping and adjacent gaps into the first one
+		Gap& gap = m_gaplist[first];
+		gap.start = std::min(gap.start, gapstart);
+		gap.end = std::max(m_gaplist[last - 1].end, gapend);
+		m_gaplist.erase(m_gaplist.begin() + first + 1, m_gaplist.begin() + last);
 	}
-	m_gaplist.insert(it, std::pair<uint64,uint64>(gapend, gapstart));
 }
 
 void CGapList::AddGap(uint16 part)
@@ -142,57 +140,34 @@ void CGapList::FillGap(uint64 partstart, uint64 partend)
 	// also total gap size
 	m_totalGapSizeValid = false;
 
-	// find a place to start:
 	// first gap which ends >= our part start
-	iterator it = m_gaplist.lower_bound(partstart);
-	while (it != m_gaplist.end()) {
-		iterator it2 = it++;
-		uint64 curGapStart = it2->second;
-		uint64 curGapEnd   = it2->first;
+	size_t first = FirstEndingFrom(partstart);
+	// behind the last gap which starts <= our part end
+	size_t last = first;
+	while (last < m_gaplist.size() && m_gaplist[last].start <= partend) {
+		last++;
+	}
+	if (first == last) {
+		// nothing to fill
+		return;
+	}
 
-		if (curGapStart >= partstart) {
-			if (curGapEnd <= partend) {
-				// our part fills this gap completly
-				m_gaplist.erase(it2);
-			} else if (curGapStart <= partend) {
-				// lower part of this gap is in the part - shrink gap:
-				//   (this is the most common case: curGapStart == partstart && curGapEnd > partend)
-				it2->second = partend + 1;
-				// end of our part was in the gap: we're done
-				break;
-			} else {
-				// gap starts behind our part end: we're done
-				break;
-			}
-		} else {
-			// curGapStart < partstart
-			if (curGapEnd > partend) {
-				// our part is completely enclosed by the gap
-				// cut it in two, leaving our part out:
-				// shrink the gap so it becomes the second gap
-				it2->second = partend + 1;
-				// insert new first gap
-				iterator it3(it2);
-				if (it3 != m_gaplist.begin()) {
-					--it3;
-				}
-				m_gaplist.insert(it3, std::pair<uint64,uint64>(partstart - 1, curGapStart));
-				// we're done
-				break;
-			} else if (curGapEnd >= partstart) {
-				// upper part of this gap is in the part - shrink gap:
-				// insert shorter gap
-				iterator it3(it2);
-				if (it3 != m_gaplist.begin()) {
-					--it3;
-				}
-				m_gaplist.insert(it3, std::pair<uint64,uint64>(partstart - 1, curGapStart));
-				// and delete the old one
-				m_gaplist.erase(it2);
-			}
-			// else: gap is before our part start (should not happen)
+	const Gap head = m_gaplist[first];
+	const Gap tail = m_gaplist[last - 1];
+	// Gaps that stick out of our part are shortened, the rest is removed.
+	if (head.start < partstart) {
+		m_gaplist[first++].end = partstart - 1;
+	}
+	if (tail.end > partend) {
+		Gap gap = { partend + 1, tail.end };
+		if (first == last) {
+			// our part is completely enclosed by the gap: cut it in two
+			m_gaplist.insert(m_gaplist.begin() + last, gap);
+			return;
 		}
+		m_gaplist[--last] = gap;
 	}
+	m_gaplist.erase(m_gaplist.begin() + first, m_gaplist.begin() + last);
 }
 
 void CGapList::FillGap(uint16 part)
@@ -215,7 +190,7 @@ uint64 CGapList::GetGapSize()
 
 		ListType::const_iterator it = m_gaplist.begin();
 		for (; it != m_gaplist.end(); ++it) {
-			m_totalGapSize += it->first - it->second + 1;
+			m_totalGapSize += it->end - it->start + 1;
 		}
 	}
 	return m_totalGapSize;
@@ -229,10 +204,10 @@ uint32 CGapList::GetGapSize(uint16 part) const
 
 	// find a place to start:
 	// first gap which ends >= our gap start
-	ListType::const_iterator it = m_gaplist.lower_bound(uRangeStart);
+	ListType::const_iterator it = m_gaplist.begin() + FirstEndingFrom(uRangeStart);
 	for (; it != m_gaplist.end(); ++it) {
-		uint64 curGapStart = it->second;
-		uint64 curGapEnd   = it->first;
+		uint64 curGapStart = it->start;
+		uint64 curGapEnd   = it->end;
 
 		if (curGapStart <= uRangeStart && curGapEnd >= uRangeEnd) {
 			// total range is in this gap
@@ -262,24 +237,10 @@ bool CGapList::IsComplete(uint64 gapstart, uint64 gapend) const
 		return false;
 	}
 
-	// find a place to start:
-	// first gap which ends >= our gap start
-	ListType::const_iterator it = m_gaplist.lower_bound(gapstart);
-	for (; it != m_gaplist.end(); ++it) {
-		uint64 curGapStart = it->second;
-		uint64 curGapEnd   = it->first;
-
-		if (  (curGapStart >= gapstart    && curGapEnd   <= gapend)
-			||(curGapStart >= gapstart    && curGapStart <= gapend)
-			||(curGapEnd   <= gapend      && curGapEnd   >= gapstart)
-			||(gapstart    >= curGapStart && gapend      <= curGapEnd)) {
-			return false;
-		}
-		if (curGapStart > gapend) {
-			break;
-		}
-	}
-	return true;
+	// The first gap which ends >= our gap start is the only one
+	// that can overlap our range.
+	size_t first = FirstEndingFrom(gapstart);
+	return first == m_gaplist.size() || m_gaplist[first].start > gapend;
 }
 
 bool CGapList::IsComplete(uint16 part)
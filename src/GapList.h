@@ -25,14 +25,21 @@
 #ifndef GAPLIST_H
 #define GAPLIST_H
 
-#include <map>
+#include <vector>
 
 class CGapList {
 private:
 	// The internal gap list:
-	// Each gap is stored as a map entry.
-	// The first (key) is the end, the second (value) the start.
-	typedef std::map<uint64,uint64> ListType;
+	// Gaps are stored as a vector of extents, sorted by their start.
+	// Gaps never overlap or touch, so the ends are sorted as well.
+	// Even heavily fragmented files have at most a few thousand gaps, so
+	// the occasional memmove on insertion costs less than the allocation
+	// and pointer chasing of a tree node per gap.
+	struct Gap {
+		uint64 start;
+		uint64 end;
+	};
+	typedef std::vector<Gap> ListType;
 	typedef ListType::iterator iterator;
 	ListType m_gaplist;
 	// size of the part file the list belongs to
@@ -58,6 +65,8 @@ private:
 	uint32 GetPartSize(uint16 part) const { return part == m_iPartCount - 1 ? m_sizeLastPart : PARTSIZE; }
 	// check arguments, clip end, false: error
 	inline bool ArgCheck(uint64 gapstart, uint64 &gapend) const;
+	// index of the first gap which ends at or after pos
+	size_t FirstEndingFrom(uint64 pos) const;
 public:
 	// construct
 	CGapList() { Init(0, false); } // NO MORE uninitialized variables >:(
@@ -99,13 +108,16 @@ public:
 		bool operator != (const const_iterator& it) const { return m_it != it.m_it; }
 		const_iterator& operator ++ () { ++ m_it; return *this; }
 		// get start of gap pointed to
-		uint64 start() const { return (* m_it).second; }
+		uint64 start() const { return m_it->start; }
 		// get end of gap pointed to
-		uint64 end() const { return (* m_it).first; }
+		uint64 end() const { return m_it->end; }
 	};
 	// begin/end iterators for looping
 	const_iterator begin() const { return const_iterator(m_gaplist.begin()); }
 	const_iterator end() const { return const_iterator(m_gaplist.end()); }
+	// iterator to the first gap which ends at or after pos, to skip
+	// the gaps in front of a range of interest
+	const_iterator FindFirstGap(uint64 pos) const { return const_iterator(m_gaplist.begin() + FirstEndingFrom(pos)); }
 
 };
 
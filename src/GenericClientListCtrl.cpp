@@ -29,14 +29,13 @@
 #include <common/Format.h>	// Needed for CFormat
 #include "amule.h"		// Needed for theApp
 #include "amuleDlg.h"		// Needed for CamuleDlg
-#include "BarShader.h"		// Needed for CBarShader
+#include "BarShader.h"		// Needed for CBarShader and CBarCache
 #include "BitVector.h"
 #include "ClientDetailDialog.h"	// Needed for CClientDetailDialog
 #include "ChatWnd.h"		// Needed for CChatWnd
 #include "CommentDialogLst.h"	// Needed for CCommentDialogLst
 #include "DataToText.h"		// Needed for PriorityToStr
 #include "FileDetailDialog.h"	// Needed for CFileDetailDialog
-#include "GetTickCount.h"	// Needed for GetTickCount
 #include "GuiEvents.h"		// Needed for CoreNotify_*
 #ifdef ENABLE_IP2COUNTRY
 	#include "IP2Country.h"	// Needed for IP2Country
@@ -53,16 +52,10 @@
 struct ClientCtrlItem_Struct
 {
 	ClientCtrlItem_Struct()
-		: dwUpdated(0),
-		  status(NULL),
-		  m_owner(NULL),
+		: m_owner(NULL),
 		  m_type(UNAVAILABLE_SOURCE)
 	{ }
 
-	~ClientCtrlItem_Struct() {
-		delete status;
-	}
-
 	SourceItemType GetType() const {
 		return m_type;
 	}
@@ -84,8 +77,10 @@ struct ClientCtrlItem_Struct
 
 	void SetType(SourceItemType type) { m_type = type; }
 
-	uint32		dwUpdated;
-	wxBitmap*	status;
+	//! The parts of the requested file the client has
+	CBarCache	statusBar;
+	//! The parts of the uploaded file the client has
+	CBarCache	availableBar;
 
 private:
 	CKnownFile*		m_owner;
@@ -249,12 +244,12 @@ void CGenericClientListCtrl::AddSource(CKnownFile* owner, const CClientRef& sour
 			} else {
 				cur_item->SetContents(owner, source, type);
 			}
-			cur_item->dwUpdated = 0;
+			cur_item->statusBar.Invalidate();
 			bFound = true;
 		} else if ( type == AVAILABLE_SOURCE ) {
 			// The state 'Available' is exclusive
 			cur_item->SetContents(cur_item->GetOwner(), source, A4AF_SOURCE);
-			cur_item->dwUpdated = 0;
+			cur_item->statusBar.Invalidate();
 		}
 	}
 
@@ -338,7 +333,7 @@ void CGenericClientListCtrl::UpdateItem(uint32 toupdate, SourceItemType type)
 				item->SetType(type);
 			}
 
-			item->dwUpdated = 0;
+			item->statusBar.Invalidate();
 
 			// Only update visible lines
 			if ( index >= first && index <= last) {
@@ -837,7 +832,7 @@ void CGenericClientListCtrl::DrawClientItem(wxDC* dc, int nColumn, const wxRect&
 #ifdef ENABLE_IP2COUNTRY
 				if (theApp->amuledlg->m_IP2Country->IsEnabled() && thePrefs::IsGeoIPEnabled()) {
 					// Draw the flag. Size can't be precached.
-					const CountryData& countrydata = theApp->amuledlg->m_IP2Country->GetCountryData(client.GetFullIP());
+					const CountryData& countrydata = theApp->amuledlg->m_IP2Country->GetCountryData(client.GetFullUserIP());
 
 					realY = point.y + (rect.GetHeight() - countrydata.Flag.GetHeight())/2 + 1 /* floor() */;
 
@@ -896,23 +891,16 @@ void CGenericClientListCtrl::DrawClientItem(wxDC* dc, int nColumn, const wxRect&
 				dc->SetClippingRegion(rect.GetX(), rect.GetY() + 1, iWidth, iHeight);
 
 				if ( item->GetType() != A4AF_SOURCE ) {
-					uint32 dwTicks = GetTickCount();
+					CPartFile* reqfile = client.GetRequestFile();
+					bool bFlat = thePrefs::UseFlatBar();
 
 					wxMemoryDC cdcStatus;
 
-					if ( item->dwUpdated < dwTicks || !item->status ||
-							iWidth != item->status->GetWidth() ) {
-
-						if (item->status == NULL) {
-							item->status = new wxBitmap(iWidth, iHeight);
-						} else if ( item->status->GetWidth() != iWidth ) {
-							// Only recreate if size has changed
-							item->status->Create(iWidth, iHeight);
-						}
-
-						cdcStatus.SelectObject(*(item->status));
+					if (item->statusBar.NeedsRedraw(reqfile ? reqfile->GetBarVersion() : 0,
+							GetSourceBarState(client), iWidth, iHeight, bFlat, thePrefs::Get3DDepth())) {
+						cdcStatus.SelectObject(item->statusBar.GetBitmap());
 
-						if ( thePrefs::UseFlatBar() ) {
+						if ( bFlat ) {
 							DrawSourceStatusBar( client, &cdcStatus,
 								wxRect(0, 0, iWidth, iHeight), true);
 						} else {
@@ -924,11 +912,8 @@ void CGenericClientListCtrl::DrawClientItem(wxDC* dc, int nColumn, const wxRect&
 							cdcStatus.SetBrush( *wxTRANSPARENT_BRUSH );
 							cdcStatus.DrawRectangle( 0, 0, iWidth, iHeight );
 						}
-
-						// Plus ten seconds
-						item->dwUpdated = dwTicks + 10000;
 					} else {
-						cdcStatus.SelectObject(*(item->status));
+						cdcStatus.SelectObject(item->statusBar.GetBitmap());
 					}
 
 					dc->Blit(rect.GetX(), rect.GetY() + 1, iWidth, iHeight, &cdcStatus, 0, 0);
@@ -962,7 +947,7 @@ void CGenericClientListCtrl::DrawClientItem(wxDC* dc, int nColumn, const wxRect&
 
 		case ColumnUserAvailable: {
 				if ( client.GetUpPartCount() ) {
-					DrawStatusBar( client, dc, rect );
+					DrawStatusBar( client, item->availableBar, dc, rect );
 				}
 				break;
 			}
@@ -1297,6 +1282,35 @@ void CGenericClientListCtrl::ShowSourcesCount( int diff )
 	}
 }
 
+// Adds a value to a FNV-1a hash
+static inline uint32 HashValue(uint32 hash, uint32 value)
+{
+	return (hash ^ value) * 16777619u;
+}
+
+
+// Sums up the parts a client has. A collision only delays the update of a bar.
+static uint32 HashPartStatus(const BitVector& partStatus)
+{
+	uint32 hash = HashValue(2166136261u, partStatus.size());
+	for (uint32 i = 0; i < partStatus.size(); ++i) {
+		hash = HashValue(hash, partStatus.get(i));
+	}
+	return hash;
+}
+
+
+uint32 CGenericClientListCtrl::GetSourceBarState(const CClientRef& source)
+{
+	uint32 state = HashPartStatus(source.GetPartStatus());
+	state = HashValue(state, source.GetDownloadState() == DS_DOWNLOADING
+						? source.GetLastDownloadingPart() : 0xffff);
+	state = HashValue(state, source.GetNextRequestedPart());
+	state = HashValue(state, source.GetRequestFile() ? source.GetRequestFile()->IsStopped() : 2);
+	return state;
+}
+
+
 static const CMuleColour crBoth(0, 192, 0);
 static const CMuleColour crFlatBoth(0, 150, 0);
 
@@ -1374,54 +1388,63 @@ static const CMuleColour crFlatUnavailable(224, 224, 224);
 static const CMuleColour crAvailable(104, 104, 104);
 static const CMuleColour crFlatAvailable(0, 0, 0);
 
-void CGenericClientListCtrl::DrawStatusBar( const CClientRef& client, wxDC* dc, const wxRect& rect1 ) const
+void CGenericClientListCtrl::DrawStatusBar( const CClientRef& client, CBarCache& cache, wxDC* dc, const wxRect& rect1 ) const
 {
 	wxRect rect = rect1;
 	rect.y		+= 1;
 	rect.height	-= 2;
 
-	wxPen   old_pen   = dc->GetPen();
-	wxBrush old_brush = dc->GetBrush();
-	bool bFlat = thePrefs::UseFlatBar();
-
-	wxRect barRect = rect;
-	if (!bFlat) { // round bar has a black border, the bar itself is 1 pixel less on each border
-		barRect.x ++;
-		barRect.y ++;
-		barRect.height -= 2;
-		barRect.width -= 2;
+	if (rect.width <= 0 || rect.height <= 0) {
+		return;
 	}
-	static CBarShader s_StatusBar(16);
 
-	uint32 partCount = client.GetUpPartCount();
+	bool bFlat = thePrefs::UseFlatBar();
+	wxMemoryDC cdcStatus;
+
+	if (cache.NeedsRedraw(0, HashPartStatus(client.GetUpPartStatus()),
+			rect.width, rect.height, bFlat, thePrefs::Get3DDepth())) {
+		cdcStatus.SelectObject(cache.GetBitmap());
+
+		wxRect barRect(0, 0, rect.width, rect.height);
+		if (!bFlat) { // round bar has a black border, the bar itself is 1 pixel less on each border
+			barRect.x ++;
+			barRect.y ++;
+			barRect.height -= 2;
+			barRect.width -= 2;
+		}
+		static CBarShader s_StatusBar(16);
+
+		uint32 partCount = client.GetUpPartCount();
 
-	// Seems the partfile in the client object is not necessarily valid when bar is drawn for the first time.
-	// Keep it simple and make all parts same size.
-	s_StatusBar.SetFileSize(partCount * PARTSIZE);
-	s_StatusBar.SetHeight(barRect.height);
-	s_StatusBar.SetWidth(barRect.width);
-	s_StatusBar.Set3dDepth( thePrefs::Get3DDepth() );
+		// Seems the partfile in the client object is not necessarily valid when bar is drawn for the first time.
+		// Keep it simple and make all parts same size.
+		s_StatusBar.SetFileSize(partCount * PARTSIZE);
+		s_StatusBar.SetHeight(barRect.height);
+		s_StatusBar.SetWidth(barRect.width);
+		s_StatusBar.Set3dDepth( thePrefs::Get3DDepth() );
 
-	uint64 uEnd = 0;
-	for ( uint64 i = 0; i < partCount; i++ ) {
-		uint64 uStart = PARTSIZE * i;
-		uEnd = uStart + PARTSIZE - 1;
+		uint64 uEnd = 0;
+		for ( uint64 i = 0; i < partCount; i++ ) {
+			uint64 uStart = PARTSIZE * i;
+			uEnd = uStart + PARTSIZE - 1;
 
-		s_StatusBar.FillRange(uStart, uEnd, client.IsUpPartAvailable(i) ? (bFlat ? crFlatAvailable : crAvailable) : (bFlat ? crFlatUnavailable : crUnavailable));
-	}
-	// fill the rest (if partStatus is empty)
-	s_StatusBar.FillRange(uEnd + 1, partCount * PARTSIZE - 1, bFlat ? crFlatUnavailable : crUnavailable);
-	s_StatusBar.Draw(dc, barRect.x, barRect.y, bFlat);
-
-	if (!bFlat) {
-		// Draw black border
-		dc->SetPen( *wxBLACK_PEN );
-		dc->SetBrush( *wxTRANSPARENT_BRUSH );
-		dc->DrawRectangle(rect);
+			s_StatusBar.FillRange(uStart, uEnd, client.IsUpPartAvailable(i) ? (bFlat ? crFlatAvailable : crAvailable) : (bFlat ? crFlatUnavailable : crUnavailable));
+		}
+		// fill the rest (if partStatus is empty)
+		s_StatusBar.FillRange(uEnd + 1, partCount * PARTSIZE - 1, bFlat ? crFlatUnavailable : crUnavailable);
+		s_StatusBar.Draw(&cdcStatus, barRect.x, barRect.y, bFlat);
+
+		if (!bFlat) {
+			// Draw black border
+			cdcStatus.SetPen( *wxBLACK_PEN );
+			cdcStatus.SetBrush( *wxTRANSPARENT_BRUSH );
+			cdcStatus.DrawRectangle(0, 0, rect.width, rect.height);
+		}
+	} else {
+		cdcStatus.SelectObject(cache.GetBitmap());
 	}
 
-	dc->SetPen( old_pen );
-	dc->SetBrush( old_brush );
+	dc->Blit(rect.x, rect.y, rect.width, rect.height, &cdcStatus, 0, 0);
 }
 
 // File_checked_for_headers
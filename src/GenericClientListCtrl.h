@@ -36,6 +36,7 @@
 
 class CPartFile;
 class CClientRef;
+class CBarCache;
 class wxBitmap;
 class wxRect;
 class wxDC;
@@ -185,9 +186,16 @@ private:
 	void	DrawSourceStatusBar( const CClientRef& source, wxDC* dc, const wxRect& rect, bool  bFlat) const;
 
 	/**
-	  * Draaws the file parts bar for a client.
+	 * Returns a value that changes when the download status bar of a
+	 * client changes, apart from the chunks of the requested file.
+	 */
+	static uint32	GetSourceBarState( const CClientRef& source );
+
+	/**
+	  * Draaws the file parts bar for a client, using the bitmap in 'cache'
+	  * as long as the parts are the same.
 	  */
-	void	DrawStatusBar( const CClientRef& client, wxDC* dc, const wxRect& rect1 ) const;
+	void	DrawStatusBar( const CClientRef& client, CBarCache& cache, wxDC* dc, const wxRect& rect1 ) const;
 
 	/**
 	 * @see CMuleListCtrl::GetTTSText
@@ -55,6 +55,7 @@
 #endif
 
 #ifndef CLIENT_GUI
+#	include "SharedFileList.h"
 #	include "UploadQueue.h"
 #	include "EMSocket.h"
 #	include "ListenSocket.h"
@@ -702,6 +703,7 @@ namespace MuleNotify
 	void KnownFile_Comment_Set(CKnownFile* file, wxString comment, int8 rating)
 	{
 		file->SetFileCommentRating(comment, rating);
+		theApp->sharedfiles->RepublishNotes(file);
 		SharedFilesUpdateItem(file);
 	}
 
@@ -445,6 +445,26 @@ namespace MuleNotify
 	inline void DoNotifyAlways(void (*func)(A1A, A2A, A3A), A1B arg1, A2B arg2, A3B arg3) {
 		HandleNotificationAlways(CMuleNotifier3<A1A, A2A, A3A>(func, arg1, arg2, arg3));
 	}
+
+	/**
+	 * Like HandleNotificationAlways, but notifications are queued and the
+	 * main thread gets one event for everything queued since it last looked.
+	 * Used for the socket events, which can arrive at a high rate from the
+	 * network threads. Notifications are executed in the order queued.
+	 */
+	void HandleNotificationBatched(const CMuleNotiferBase& ntf);
+
+	/** Executes all notifications queued by HandleNotificationBatched. */
+	void ProcessBatchedNotifications();
+
+	template <typename A1A, typename A1B>
+	inline void DoNotifyBatched(void (*func)(A1A), A1B arg1) {
+		HandleNotificationBatched(CMuleNotifier1<A1A>(func, arg1));
+	}
+	template <typename A1A, typename A1B, typename A2A, typename A2B>
+	inline void DoNotifyBatched(void (*func)(A1A, A2A), A1B arg1, A2B arg2) {
+		HandleNotificationBatched(CMuleNotifier2<A1A, A2A>(func, arg1, arg2));
+	}
 }
 
 
@@ -579,16 +599,16 @@ typedef void (wxEvtHandler::*MuleNotifyEventFunction)(CMuleGUIEvent&);
 // core internal notifications
 //
 
-// ASIO sockets
-#define CoreNotify_LibSocketConnect(ptr, val)		MuleNotify::DoNotifyAlways(&MuleNotify::LibSocketConnect, ptr, val)
-#define CoreNotify_LibSocketSend(ptr, val)			MuleNotify::DoNotifyAlways(&MuleNotify::LibSocketSend, ptr, val)
-#define CoreNotify_LibSocketReceive(ptr, val)		MuleNotify::DoNotifyAlways(&MuleNotify::LibSocketReceive, ptr, val)
-#define CoreNotify_LibSocketLost(ptr)				MuleNotify::DoNotifyAlways(&MuleNotify::LibSocketLost, ptr)
-#define CoreNotify_LibSocketDestroy(ptr)			MuleNotify::DoNotifyAlways(&MuleNotify::LibSocketDestroy, ptr)
-#define CoreNotify_ServerTCPAccept(ptr)				MuleNotify::DoNotifyAlways(&MuleNotify::ServerTCPAccept, ptr)
-#define CoreNotify_UDPSocketSend(ptr)				MuleNotify::DoNotifyAlways(&MuleNotify::UDPSocketSend, ptr)
-#define CoreNotify_UDPSocketReceive(ptr)			MuleNotify::DoNotifyAlways(&MuleNotify::UDPSocketReceive, ptr)
-#define CoreNotify_ProxySocketEvent(ptr, val)		MuleNotify::DoNotifyAlways(&MuleNotify::ProxySocketEvent, ptr, val)
+// ASIO sockets, handed to the core in batches
+#define CoreNotify_LibSocketConnect(ptr, val)		MuleNotify::DoNotifyBatched(&MuleNotify::LibSocketConnect, ptr, val)
+#define CoreNotify_LibSocketSend(ptr, val)			MuleNotify::DoNotifyBatched(&MuleNotify::LibSocketSend, ptr, val)
+#define CoreNotify_LibSocketReceive(ptr, val)		MuleNotify::DoNotifyBatched(&MuleNotify::LibSocketReceive, ptr, val)
+#define CoreNotify_LibSocketLost(ptr)				MuleNotify::DoNotifyBatched(&MuleNotify::LibSocketLost, ptr)
+#define CoreNotify_LibSocketDestroy(ptr)			MuleNotify::DoNotifyBatched(&MuleNotify::LibSocketDestroy, ptr)
+#define CoreNotify_ServerTCPAccept(ptr)				MuleNotify::DoNotifyBatched(&MuleNotify::ServerTCPAccept, ptr)
+#define CoreNotify_UDPSocketSend(ptr)				MuleNotify::DoNotifyBatched(&MuleNotify::UDPSocketSend, ptr)
+#define CoreNotify_UDPSocketReceive(ptr)			MuleNotify::DoNotifyBatched(&MuleNotify::UDPSocketReceive, ptr)
+#define CoreNotify_ProxySocketEvent(ptr, val)		MuleNotify::DoNotifyBatched(&MuleNotify::ProxySocketEvent, ptr, val)
 
 
 //
@@ -0,0 +1,80 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2004-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+//
+// The batched socket notifications. They are kept apart from the rest of
+// GuiEvents.cpp, so they can be linked without the core, like by the Asio
+// benchmark. HandleNotificationAlways comes from the program using them.
+//
+
+#include "GuiEvents.h"
+
+#include <wx/thread.h>		// Needed for wxMutex
+
+#include <vector>
+
+
+namespace MuleNotify
+{
+
+	// Notifications waiting for ProcessBatchedNotifications
+	static std::vector<CMuleNotiferBase*> s_batchedNotifications;
+	// Set while an event for the queued notifications is on its way
+	static bool s_batchPosted = false;
+	static wxMutex s_batchLock;
+
+	void HandleNotificationBatched(const CMuleNotiferBase& ntf)
+	{
+		CMuleNotiferBase* copy = ntf.Clone();
+		bool post;
+		{
+			wxMutexLocker lock(s_batchLock);
+			s_batchedNotifications.push_back(copy);
+			post = !s_batchPosted;
+			s_batchPosted = true;
+		}
+		if (post) {
+			HandleNotificationAlways(CMuleNotifier0(&ProcessBatchedNotifications));
+		}
+	}
+
+
+	void ProcessBatchedNotifications()
+	{
+		std::vector<CMuleNotiferBase*> batch;
+		{
+			wxMutexLocker lock(s_batchLock);
+			batch.swap(s_batchedNotifications);
+			s_batchPosted = false;
+		}
+
+		for (size_t i = 0; i < batch.size(); ++i) {
+			batch[i]->Notify();
+			delete batch[i];
+		}
+	}
+
+}
+
+// File_checked_for_headers
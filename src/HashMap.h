@@ -0,0 +1,209 @@
+//							-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef HASHMAP_H
+#define HASHMAP_H
+
+#include "Types.h"	// Needed for uint32 and uint64
+
+#include <cstddef>	// Needed for size_t
+#include <vector>
+
+
+/**
+ * Folds an integer key into 32 bits for CHashMap.
+ */
+struct CIntegerHash
+{
+	uint32 operator()(uint64 key) const
+	{
+		return static_cast<uint32>(key) ^ static_cast<uint32>(key >> 32);
+	}
+};
+
+
+/**
+ * Hash table with open addressing, for maps that are looked up far more
+ * often than they are iterated, and that can grow large.
+ *
+ * HASH must return a 32 bit value for a key, which does not have to be
+ * well distributed. KEY and VALUE must be default constructible and
+ * assignable, erased values are overwritten with a default constructed one.
+ *
+ * Pointers and references to values stay valid only until the next
+ * insertion or removal.
+ */
+template <typename KEY, typename VALUE, typename HASH = CIntegerHash>
+class CHashMap
+{
+public:
+	CHashMap()
+		: m_count(0)
+	{
+		Rehash(MinBits);
+	}
+
+	/**
+	 * Returns the value of a key, or NULL if there is none.
+	 */
+	VALUE* Lookup(const KEY& key)
+	{
+		size_t index;
+		return FindSlot(key, index) ? &m_slots[index].value : NULL;
+	}
+
+	const VALUE* Lookup(const KEY& key) const
+	{
+		size_t index;
+		return FindSlot(key, index) ? &m_slots[index].value : NULL;
+	}
+
+	/**
+	 * Returns the value of a key, adding a default constructed one if needed.
+	 */
+	VALUE& operator[](const KEY& key)
+	{
+		size_t index;
+		if (FindSlot(key, index)) {
+			return m_slots[index].value;
+		}
+
+		// Keep at least half of the slots free, probes stay short.
+		if ((m_count + 1) * 2 > m_slots.size()) {
+			Rehash(m_bits + 1);
+			FindSlot(key, index);
+		}
+
+		Slot& slot = m_slots[index];
+		slot.key = key;
+		slot.used = true;
+		m_count++;
+
+		return slot.value;
+	}
+
+	/**
+	 * Removes a key, returning false if it was not present.
+	 */
+	bool erase(const KEY& key)
+	{
+		size_t index;
+		if (!FindSlot(key, index)) {
+			return false;
+		}
+
+		// Move following entries up, so no lookup has to skip a hole.
+		size_t mask = m_slots.size() - 1;
+		size_t next = index;
+		for (;;) {
+			next = (next + 1) & mask;
+			if (!m_slots[next].used) {
+				break;
+			}
+			size_t home = GetHome(m_slots[next].key);
+			// Can the entry move to 'index', without passing its home slot?
+			if (((next - home) & mask) >= ((next - index) & mask)) {
+				m_slots[index] = m_slots[next];
+				index = next;
+			}
+		}
+		m_slots[index] = Slot();
+		m_count--;
+
+		// Give memory back after a flood of keys has expired
+		if (m_bits > MinBits && m_count * 8 < m_slots.size()) {
+			Rehash(m_bits - 1);
+		}
+
+		return true;
+	}
+
+	/** Returns the number of keys. */
+	size_t size() const	{ return m_count; }
+
+	/** Returns true if there are no keys. */
+	bool empty() const	{ return m_count == 0; }
+
+	/** Removes all keys. */
+	void clear()
+	{
+		std::vector<Slot>(static_cast<size_t>(1) << MinBits).swap(m_slots);
+		m_bits = MinBits;
+		m_count = 0;
+	}
+
+private:
+	enum { MinBits = 4 };
+
+	struct Slot {
+		Slot() : key(), value(), used(false) {}
+
+		KEY	key;
+		VALUE	value;
+		bool	used;
+	};
+
+	// Fibonacci hashing, the top bits of the product are the best mixed.
+	size_t GetHome(const KEY& key) const
+	{
+		return (HASH()(key) * 2654435769u) >> (32 - m_bits);
+	}
+
+	// Returns true if the key was found, 'index' is its slot or the free slot it belongs to.
+	bool FindSlot(const KEY& key, size_t& index) const
+	{
+		size_t mask = m_slots.size() - 1;
+		index = GetHome(key);
+		while (m_slots[index].used) {
+			if (m_slots[index].key == key) {
+				return true;
+			}
+			index = (index + 1) & mask;
+		}
+		return false;
+	}
+
+	void Rehash(unsigned bits)
+	{
+		std::vector<Slot> old(static_cast<size_t>(1) << bits);
+		old.swap(m_slots);
+		m_bits = bits;
+
+		for (size_t i = 0; i < old.size(); ++i) {
+			if (old[i].used) {
+				size_t index;
+				FindSlot(old[i].key, index);
+				m_slots[index] = old[i];
+			}
+		}
+	}
+
+	std::vector<Slot>	m_slots;
+	size_t			m_count;
+	//! The number of slots is 2^m_bits.
+	unsigned		m_bits;
+};
+
+#endif // HASHMAP_H
+// File_checked_for_headers
@@ -64,11 +64,14 @@
 #include <common/Format.h>		// For CFormat()
 #include "common/FileFunctions.h"	// For UnpackArchive
 #include <common/StringFunctions.h>	// For unicode2char()
+#include "NetworkFunctions.h"		// For StringIPtoUint32()
 #include "pixmaps/flags_xpm/CountryFlags.h"
 
 #include <wx/intl.h>
 #include <wx/image.h>
 
+#include <algorithm>			// For std::upper_bound
+
 #include <GeoIP.h>
 #include "IP2Country.h"
 
@@ -77,6 +80,7 @@ CIP2Country::CIP2Country(const wxString& configDir)
 	m_geoip = NULL;
 	m_DataBaseName = wxT("GeoIP.dat");
 	m_DataBasePath = configDir + m_DataBaseName;
+	ClearCache();
 }
 
 void CIP2Country::Enable()
@@ -93,6 +97,9 @@ void CIP2Country::Enable()
 	}
 
 	m_geoip = GeoIP_open(unicode2char(m_DataBasePath), GEOIP_STANDARD);
+	if (m_geoip) {
+		LoadRanges();
+	}
 }
 
 void CIP2Country::Update()
@@ -109,6 +116,11 @@ void CIP2Country::Disable()
 		GeoIP_delete(m_geoip);
 		m_geoip = NULL;
 	}
+
+	std::vector<uint32>().swap(m_rangeStarts);
+	std::vector<uint16>().swap(m_rangeIds);
+	m_countryById.clear();
+	ClearCache();
 }
 
 void CIP2Country::DownloadFinished(uint32 result)
@@ -185,23 +197,69 @@ CIP2Country::~CIP2Country()
 }
 
 
-const CountryData& CIP2Country::GetCountryData(const wxString &ip)
+void CIP2Country::LoadRanges()
 {
-	// Should prevent the crash if the GeoIP database does not exists
-	if (m_geoip == NULL) {
-		CountryDataMap::iterator it = m_CountryDataMap.find(wxString(wxT("unknown")));
-		it->second.Name = wxT("?");
-		return it->second;
+	// Walk the database tree from the lowest to the highest IP. Each lookup
+	// reports the netmask of the record it hit, which gives the end of the
+	// current range, so this takes one lookup per record of the database.
+	// Neighbouring records of the same country are merged.
+	if (GeoIP_database_edition(m_geoip) == GEOIP_COUNTRY_EDITION) {
+		uint32 ip = 0;
+		for (;;) {
+			int id = GeoIP_id_by_ipnum(m_geoip, ip);
+			int netmask = GeoIP_last_netmask(m_geoip);
+			if (id < 0 || netmask < 1 || netmask > 32) {
+				// Something is wrong with the database, use plain lookups.
+				m_rangeStarts.clear();
+				m_rangeIds.clear();
+				break;
+			}
+			if (m_rangeIds.empty() || m_rangeIds.back() != id) {
+				m_rangeStarts.push_back(ip);
+				m_rangeIds.push_back(id);
+			}
+			// A shift by 32 bits is undefined, so a /32 record is its own end.
+			uint32 last = (netmask == 32) ? ip : ip | (0xFFFFFFFFu >> netmask);
+			if (last == 0xFFFFFFFF) {
+				break;
+			}
+			ip = last + 1;
+		}
+	}
+
+	// Resolve the country record of each id once.
+	uint16 maxId = 0;
+	for (size_t i = 0; i < m_rangeIds.size(); ++i) {
+		maxId = std::max(maxId, m_rangeIds[i]);
+	}
+	m_countryById.resize(maxId + 1);
+	for (uint16 id = 0; id <= maxId; ++id) {
+		m_countryById[id] = &GetCountryByCode(id ? GeoIP_code_by_id(id) : NULL);
 	}
 
+	// Trim the vectors to their final size.
+	std::vector<uint32>(m_rangeStarts).swap(m_rangeStarts);
+	std::vector<uint16>(m_rangeIds).swap(m_rangeIds);
+
+	AddDebugLogLineN(logGeneral, CFormat(wxT("Loaded %d GeoIP ranges.")) % m_rangeStarts.size());
+}
+
+
+void CIP2Country::ClearCache()
+{
+	for (int i = 0; i < CACHE_SIZE; ++i) {
+		m_cache[i].ip = 0;
+		m_cache[i].country = NULL;
+	}
+}
+
+
+const CountryData& CIP2Country::GetCountryByCode(const char* code)
+{
 	// wxString::MakeLower() fails miserably in Turkish localization with their dotted/non-dotted 'i's
 	// So fall back to some good ole C string processing.
 	std::string strCode;
-	const char * c = GeoIP_country_code_by_addr(m_geoip, unicode2char(ip));
-	if (!c) {
-		c = "unknown";
-	}
-	for ( ; *c; c++) {
+	for (const char* c = code ? code : ""; *c; c++) {
 		strCode += ((*c >= 'A' && *c <= 'Z') ? *c + 'a' - 'A' : *c);
 	}
 
@@ -209,19 +267,56 @@ const CountryData& CIP2Country::GetCountryData(const wxString &ip)
 
 	CountryDataMap::iterator it = m_CountryDataMap.find(CCode);
 	if (it == m_CountryDataMap.end()) {
-		// Show the code and ?? flag
-		it = m_CountryDataMap.find(wxString(wxT("unknown")));
-		wxASSERT(it != m_CountryDataMap.end());
-		if (CCode.IsEmpty()) {
-			it->second.Name = wxT("?");
-		} else{
-			it->second.Name = CCode;
-		}
+		// Add a record showing the code (or ? if there is none) and the ?? flag,
+		// so each code gets a record of its own that stays unchanged.
+		CountryDataMap::iterator unknown = m_CountryDataMap.find(wxString(wxT("unknown")));
+		wxASSERT(unknown != m_CountryDataMap.end());
+		CountryData countrydata;
+		countrydata.Name = CCode.IsEmpty() ? wxString(wxT("?")) : CCode;
+		countrydata.Flag = unknown->second.Flag;
+		it = m_CountryDataMap.insert(CountryDataMap::value_type(CCode, countrydata)).first;
 	}
 
 	return it->second;
 }
 
+
+const CountryData& CIP2Country::LookupCountry(uint32 ip)
+{
+	if (m_rangeStarts.empty()) {
+		// No range table, ask the database.
+		return GetCountryByCode(GeoIP_country_code_by_ipnum(m_geoip, ip));
+	}
+
+	// The range table always starts at 0, so there is a range before the upper bound.
+	std::vector<uint32>::const_iterator it = std::upper_bound(m_rangeStarts.begin(), m_rangeStarts.end(), ip);
+	return *m_countryById[m_rangeIds[it - m_rangeStarts.begin() - 1]];
+}
+
+
+const CountryData& CIP2Country::GetCountryData(uint32 ip)
+{
+	// Should prevent the crash if the GeoIP database does not exists
+	if (m_geoip == NULL) {
+		return GetCountryByCode(NULL);
+	}
+
+	CacheEntry& entry = m_cache[(ip * 2654435761u) >> 22];
+	if (entry.country == NULL || entry.ip != ip) {
+		entry.ip = ip;
+		// GeoIP wants the IP in host order
+		entry.country = &LookupCountry(wxUINT32_SWAP_ALWAYS(ip));
+	}
+
+	return *entry.country;
+}
+
+
+const CountryData& CIP2Country::GetCountryData(const wxString &ip)
+{
+	return GetCountryData(StringIPtoUint32(ip));
+}
+
 #else
 
 #include "IP2Country.h"
@@ -235,6 +330,12 @@ CIP2Country::~CIP2Country() {}
 void CIP2Country::Enable() {}
 void CIP2Country::DownloadFinished(uint32) {}
 
+const CountryData& CIP2Country::GetCountryData(uint32)
+{
+	static CountryData dummy;
+	return dummy;
+}
+
 const CountryData& CIP2Country::GetCountryData(const wxString &)
 {
 	static CountryData dummy;
@@ -46,6 +46,7 @@
 #include "Types.h"	// Needed for uint8, uint16 and uint32
 
 #include <map>
+#include <vector>
 
 #include <wx/image.h>
 #include <wx/string.h>
@@ -64,6 +65,15 @@ class CIP2Country {
 public:
 	CIP2Country(const wxString& configDir);
 	~CIP2Country();
+
+	/**
+	 * Returns the country of an IP.
+	 *
+	 * @param ip The IP in anti-host order, as returned by GetIP().
+	 *
+	 * The returned record stays valid until the object is destroyed.
+	 */
+	const CountryData& GetCountryData(uint32 ip);
 	const CountryData& GetCountryData(const wxString& ip);
 	void Enable();
 	void Disable();
@@ -77,7 +87,26 @@ private:
 	wxString m_DataBaseName;
 	wxString m_DataBasePath;
 
+	//! First IP (host order) of each range of the database, ascending.
+	std::vector<uint32> m_rangeStarts;
+	//! GeoIP country id of each range.
+	std::vector<uint16> m_rangeIds;
+	//! Country record of each GeoIP country id.
+	std::vector<const CountryData*> m_countryById;
+
+	//! Recently looked up IPs, indexed by a hash of the IP.
+	struct CacheEntry {
+		uint32 ip;
+		const CountryData* country;
+	};
+	enum { CACHE_SIZE = 1024 };
+	CacheEntry m_cache[CACHE_SIZE];
+
 	void LoadFlags();
+	void LoadRanges();
+	void ClearCache();
+	const CountryData& GetCountryByCode(const char* code);
+	const CountryData& LookupCountry(uint32 ip);
 };
 
 #endif // IP2COUNTRY_H
@@ -27,6 +27,7 @@
 #include <wx/ffile.h>
 
 #include "IPFilter.h"			// Interface declarations.
+#include "IPFilterTable.h"		// Needed for CIPFilterTable
 #include "IPFilterScanner.h"	// Interface for flexer
 #include "Preferences.h"		// Needed for thePrefs
 #include "amule.h"			// Needed for theApp
@@ -44,6 +45,12 @@
 #include "RangeMap.h"			// Needed for CRangeMap
 #include "ServerConnect.h"		// Needed for ConnectToAnyServer()
 #include "DownloadQueue.h"		// Needed for theApp->downloadqueue
+#include "MemFile.h"			// Needed for CMemFile
+#include "FileArea.h"			// Needed for CFileArea
+#include "FileAutoClose.h"		// Needed for CFileAutoClose
+#include "ArchSpecific.h"		// Needed for PeekUInt32
+#include <common/MD5Sum.h>		// Needed for MD5Sum
+#include <common/DataFileVersion.h>	// Needed for IPFILTERCACHE_VERSION
 
 
 ////////////////////////////////////////////////////////////
@@ -59,14 +66,10 @@ DEFINE_EVENT_TYPE(MULE_EVT_IPFILTER_LOADED)
 class CIPFilterEvent : public wxEvent
 {
 public:
-	CIPFilterEvent(CIPFilter::RangeIPs rangeIPs, CIPFilter::RangeLengths rangeLengths, CIPFilter::RangeNames rangeNames)
-		: wxEvent(-1, MULE_EVT_IPFILTER_LOADED)
+	CIPFilterEvent(CIPFilterTable* table)
+		: wxEvent(-1, MULE_EVT_IPFILTER_LOADED),
+		  m_table(table)
 	{
-		// Physically copy the vectors, this will hopefully resize them back to their needed capacity.
-		m_rangeIPs = rangeIPs;
-		m_rangeLengths = rangeLengths;
-		// This one is usually empty, and should always be swapped, not copied.
-		std::swap(m_rangeNames, rangeNames);
 	}
 
 	/** @see wxEvent::Clone */
@@ -74,9 +77,8 @@ public:
 		return new CIPFilterEvent(*this);
 	}
 
-	CIPFilter::RangeIPs m_rangeIPs;
-	CIPFilter::RangeLengths m_rangeLengths;
-	CIPFilter::RangeNames m_rangeNames;
+	//! The new filter. Ownership passes to the CIPFilter handling the event.
+	CIPFilterTable* m_table;
 };
 
 
@@ -110,94 +112,227 @@ public:
 private:
 	void Entry()
 	{
+#ifdef __DEBUG__
+		m_storeDescriptions = theLogger.IsEnabled(logIPFilter);
+#endif
+		// The key hashes all source files, so it is created once for
+		// loading and for saving the cache.
+		CMemFile cacheKey;
+		const bool haveCacheKey = CreateCacheKey(cacheKey);
+
+		// Range descriptions are not cached, so ignore the cache while they are wanted.
+		if (!m_storeDescriptions && haveCacheKey && LoadFromCache(cacheKey)) {
+			return;
+		}
+
 		AddLogLineN(_("Loading IP filters 'ipfilter.dat' and 'ipfilter_static.dat'."));
 		if ( !LoadFromFile(thePrefs::GetConfigDir() + wxT("ipfilter.dat")) &&
 		     thePrefs::UseIPFilterSystem() ) {
 			// Load from system wide IP filter file
-			wxStandardPathsBase &spb(wxStandardPaths::Get());
-#ifdef __WINDOWS__
-			wxString dataDir(spb.GetPluginsDir());
-#elif defined(__WXMAC__)
-			wxString dataDir(spb.GetDataDir());
-#else
-			wxString dataDir(spb.GetDataDir().BeforeLast(wxT('/')) + wxT("/amule"));
-#endif
-			wxString systemwideFile(JoinPaths(dataDir,wxT("ipfilter.dat")));
-			LoadFromFile(systemwideFile);
+			LoadFromFile(GetSystemwideFile());
 		}
 
 
 		LoadFromFile(thePrefs::GetConfigDir() + wxT("ipfilter_static.dat"));
 
 		uint8 accessLevel = thePrefs::GetIPFilterLevel();
-		uint32 size = m_result.size();
-		// Reserve a little more so we don't have to resize the vector later.
-		// (Map ranges can exist that have to be stored in several parts.)
-		// Extra memory will be freed in the end.
-		m_rangeIPs.reserve(size + 1000);
-		m_rangeLengths.reserve(size + 1000);
-		if (m_storeDescriptions) {
-			m_rangeNames.reserve(size + 1000);
-		}
+		CIPFilterTable* table = new CIPFilterTable(m_storeDescriptions);
+		// Adjacent map entries differ only in their access level, so blocked
+		// neighbours are merged into a single range of the table.
+		uint32 blockStart = 0;
+		uint32 blockEnd = 0;
+		bool inBlock = false;
 		for (IPMap::iterator it = m_result.begin(); it != m_result.end(); ++it) {
-			if (it->AccessLevel < accessLevel) {
-				// Calculate range "length"
-				// (which is included-end - start and thus length - 1)
-				// Encoding:
-				// 0      - 0x7fff	same
-				// 0x8000 - 0xffff	0xfff	- 0x07ffffff
-				// that means: remove msb, shift left by 12 bit, add 0xfff
-				// so it can cover 8 consecutive class A nets
-				// larger ranges (or theoretical ranges with uneven ends) have to be split
-				uint32 startIP = it.keyStart();
-				uint32 realLength = it.keyEnd() - it.keyStart() + 1;
+			if (it->AccessLevel >= accessLevel) {
+				continue;
+			}
+			if (inBlock && it.keyStart() == blockEnd + 1 && !m_storeDescriptions) {
+				blockEnd = it.keyEnd();
+				continue;
+			}
+			if (inBlock) {
+				table->AddRange(blockStart, blockEnd, m_lastDescription);
+			}
+			blockStart = it.keyStart();
+			blockEnd = it.keyEnd();
+			inBlock = true;
 #ifdef __DEBUG__
-				std::string * descp = 0;
+			if (m_storeDescriptions) {
+				// std::string has no ref counting, so swap it
+				std::swap(m_lastDescription, it->Description);
+			}
 #endif
-				while (realLength) {
-					m_rangeIPs.push_back(startIP);
-					uint32 curLength = realLength;
-					uint16 pushLength;
-					if (realLength <= 0x8000) {
-						pushLength = realLength - 1;
-					} else {
-						if (curLength >= 0x08000000) {
-							// range to big, limit
-							curLength = 0x08000000;
-						} else {
-							// cut off LSBs
-							curLength &= 0x07FFF000;
-						}
-						pushLength = ((curLength - 1) >> 12) | 0x8000;
-					}
-					m_rangeLengths.push_back(pushLength);
-#ifdef __DEBUG__
-					if (m_storeDescriptions) {
-						// std::string has no ref counting, so swap it
-						// (it's used so we need half the space than wxString with wide chars)
-						if (descp) {
-							// we split the range so we have to duplicate it
-							m_rangeNames.push_back(*descp);
-						} else {
-							// push back empty string and swap
-							m_rangeNames.push_back(std::string());
-							descp = & * m_rangeNames.rbegin();
-							std::swap(*descp, it->Description);
-						}
-					}
+		}
+		if (inBlock) {
+			table->AddRange(blockStart, blockEnd, m_lastDescription);
+		}
+		table->Finish();
+
+		AddDebugLogLineN(logIPFilter, CFormat(wxT("Ranges in map: %d  blocked ranges in table: %d")) % m_result.size() % table->GetRangeCount());
+
+		if (haveCacheKey && !TestDestroy()) {
+			SaveToCache(*table, cacheKey);
+		}
+
+		CIPFilterEvent evt(table);
+		wxPostEvent(m_owner, evt);
+	}
+
+	/**
+	 * Returns the path of the ipfilter.dat shipped with aMule.
+	 */
+	static wxString GetSystemwideFile()
+	{
+		wxStandardPathsBase &spb(wxStandardPaths::Get());
+#ifdef __WINDOWS__
+		wxString dataDir(spb.GetPluginsDir());
+#elif defined(__WXMAC__)
+		wxString dataDir(spb.GetDataDir());
+#else
+		wxString dataDir(spb.GetDataDir().BeforeLast(wxT('/')) + wxT("/amule"));
 #endif
-					realLength -= curLength;
-					startIP += curLength;
-				}
+		return JoinPaths(dataDir, wxT("ipfilter.dat"));
+	}
+
+	/**
+	 * Returns the path of the compiled filter cache.
+	 */
+	static CPath GetCacheFile()
+	{
+		return CPath(thePrefs::GetConfigDir() + wxT("ipfilter.cache"));
+	}
+
+	/**
+	 * Appends the size, modification time and MD5 hash of a source file to a cache key.
+	 */
+	static void AddFileToKey(CMemFile& key, const wxString& filename)
+	{
+		key.WriteString(filename, utf8strRaw);
+
+		const CPath path(filename);
+		CFileAutoClose file;
+		if (!path.FileExists() || !file.Open(path)) {
+			key.WriteUInt64(0);
+			return;
+		}
+
+		uint64 length = file.GetLength();
+		key.WriteUInt64(length);
+		key.WriteUInt64(CPath::GetModificationTime(path));
+		if (length) {
+			CFileArea area;
+			area.ReadAt(file, 0, length);
+			MD5Sum hash(area.GetBuffer(), length);
+			area.Close();
+			area.CheckError();
+			key.Write(hash.GetRawHash(), 16);
+		}
+	}
+
+	/**
+	 * Creates the key identifying the filter built from the current
+	 * source files and preferences.
+	 *
+	 * @return False if a source file could not be read.
+	 */
+	static bool CreateCacheKey(CMemFile& key)
+	{
+		try {
+			key.WriteUInt8(thePrefs::GetIPFilterLevel());
+			key.WriteUInt8(thePrefs::UseIPFilterSystem());
+			AddFileToKey(key, thePrefs::GetConfigDir() + wxT("ipfilter.dat"));
+			if (thePrefs::UseIPFilterSystem()) {
+				AddFileToKey(key, GetSystemwideFile());
 			}
+			AddFileToKey(key, thePrefs::GetConfigDir() + wxT("ipfilter_static.dat"));
+			return true;
+		} catch (const CSafeIOException& e) {
+			AddDebugLogLineC(logIPFilter, wxT("Failed to create the IP filter cache key: ") + e.what());
 		}
-		// Numbers are probably different:
-		// - ranges from map that are not blocked because of their level are not added to the table
-		// - some ranges from the map have to be split for the table
-		AddDebugLogLineN(logIPFilter, CFormat(wxT("Ranges in map: %d  blocked ranges in table: %d")) % size % m_rangeIPs.size());
 
-		CIPFilterEvent evt(m_rangeIPs, m_rangeLengths, m_rangeNames);
-		wxPostEvent(m_owner, evt);
+		return false;
+	}
+
+	/**
+	 * Loads the compiled filter from the cache, if it was created from
+	 * the current source files.
+	 *
+	 * @param key The key of the current source files.
+	 * @return True if the filter was loaded and posted to the owner.
+	 */
+	bool LoadFromCache(const CMemFile& key)
+	{
+		const CPath path = GetCacheFile();
+		if (!path.FileExists()) {
+			return false;
+		}
+
+		try {
+			CFileAutoClose file;
+			if (!file.Open(path)) {
+				return false;
+			}
+			// File layout: version, key length, key, table
+			const uint64 headerLength = 1 + 4 + key.GetLength();
+			const uint64 length = file.GetLength();
+			if (length <= headerLength) {
+				return false;
+			}
+
+			CFileArea area;
+			area.ReadAt(file, 0, length);
+			const byte* buffer = area.GetBuffer();
+			if (buffer[0] != IPFILTERCACHE_VERSION || PeekUInt32(buffer + 1) != key.GetLength()
+			    || memcmp(buffer + 5, key.GetRawBuffer(), key.GetLength()) != 0) {
+				AddDebugLogLineN(logIPFilter, wxT("IP filter cache is outdated."));
+				return false;
+			}
+
+			CIPFilterTable* table = new CIPFilterTable();
+			bool valid = table->ReadFrom(buffer + headerLength, length - headerLength);
+			area.Close();
+			area.CheckError();
+			if (!valid) {
+				delete table;
+				AddDebugLogLineN(logIPFilter, wxT("IP filter cache is corrupt."));
+				return false;
+			}
+
+			AddLogLineN(CFormat(wxPLURAL("Loaded %u IP-range from the IP filter cache.", "Loaded %u IP-ranges from the IP filter cache.", table->GetRangeCount())) % table->GetRangeCount());
+			CIPFilterEvent evt(table);
+			wxPostEvent(m_owner, evt);
+			return true;
+		} catch (const CSafeIOException& e) {
+			AddDebugLogLineC(logIPFilter, wxT("Failed to read the IP filter cache: ") + e.what());
+		}
+
+		return false;
+	}
+
+	/**
+	 * Writes the compiled filter to the cache, so the next load can skip parsing.
+	 *
+	 * @param key The key of the source files the filter was built from.
+	 */
+	void SaveToCache(const CIPFilterTable& table, const CMemFile& key)
+	{
+		try {
+			CMemFile data(0x40000);
+			data.WriteUInt8(IPFILTERCACHE_VERSION);
+			data.WriteUInt32(key.GetLength());
+			data.Write(key.GetRawBuffer(), key.GetLength());
+			table.WriteTo(data);
+
+			// write_safe writes to a temporary file and renames it on close,
+			// so a crash never leaves a half-written cache behind.
+			CFile file;
+			if (file.Open(GetCacheFile(), CFile::write_safe)) {
+				file.Write(data.GetRawBuffer(), data.GetLength());
+				file.Close();
+			}
+		} catch (const CSafeIOException& e) {
+			AddDebugLogLineC(logIPFilter, wxT("Failed to write the IP filter cache: ") + e.what());
+		}
 	}
 
 	/**
@@ -224,11 +359,8 @@ private:
 	typedef CRangeMap<rangeObject, uint32> IPMap;
 
 	bool m_storeDescriptions;
-
-	// the generated filter
-	CIPFilter::RangeIPs m_rangeIPs;
-	CIPFilter::RangeLengths m_rangeLengths;
-	CIPFilter::RangeNames m_rangeNames;
+	// Description of the range being added to the table
+	std::string m_lastDescription;
 
 	wxEvtHandler*		m_owner;
 	// temporary map for filter generation
@@ -282,10 +414,6 @@ private:
 			return 0;
 		}
 
-#ifdef __DEBUG__
-		m_storeDescriptions = theLogger.IsEnabled(logIPFilter);
-#endif
-
 		const wxChar* ipfilter_files[] = {
 			wxT("ipfilter.dat"),
 			wxT("guardian.p2p"),
@@ -401,6 +529,14 @@ CIPFilter::CIPFilter() :
 }
 
 
+CIPFilter::~CIPFilter()
+{
+	CIPFilterTable* table = m_table.Exchange(NULL);
+	m_tableReaders.Wait();
+	delete table;
+}
+
+
 void CIPFilter::Reload()
 {
 	// We keep the current filter till the new one has been loaded.
@@ -410,9 +546,10 @@ void CIPFilter::Reload()
 
 uint32 CIPFilter::BanCount() const
 {
-	wxMutexLocker lock(m_mutex);
+	CGracePeriod::CReader reader(m_tableReaders);
+	const CIPFilterTable* table = m_table.Load();
 
-	return m_rangeIPs.size();
+	return table ? table->GetRangeCount() : 0;
 }
 
 
@@ -432,36 +569,18 @@ bool CIPFilter::IsFiltered(uint32 IPTest, bool isServer)
 		}
 		return true;
 	}
-	wxMutexLocker lock(m_mutex);
-	// The IP needs to be in host order
-	uint32 ip = wxUINT32_SWAP_ALWAYS(IPTest);
-	int imin = 0;
-	int imax = m_rangeIPs.size() - 1;
-	int i;
-	bool found = false;
-	while (imin <= imax) {
-		i = (imin + imax) / 2;
-		uint32 curIP = m_rangeIPs[i];
-		if (curIP <= ip) {
-			uint32 curLength = m_rangeLengths[i];
-			if (curLength >= 0x8000) {
-				curLength = ((curLength & 0x7fff) << 12) + 0xfff;
-			}
-			if (curIP + curLength >= ip) {
-				found = true;
-				break;
-			}
-		}
-		if (curIP > ip) {
-			imax = i - 1;
-		} else {
-			imin = i + 1;
-		}
+	CGracePeriod::CReader reader(m_tableReaders);
+	const CIPFilterTable* table = m_table.Load();
+	if (!table) {
+		return false;
 	}
-	if (found) {
+	// The IP needs to be in host order
+	uint32 range = table->Find(wxUINT32_SWAP_ALWAYS(IPTest));
+	if (range != CIPFilterTable::NotFound) {
+		const std::string& name = table->GetRangeName(range);
 		AddDebugLogLineN(logIPFilter, CFormat(wxT("Filtered IP %s%s")) % Uint32toStringIP(IPTest)
-			% (i < (int)m_rangeNames.size() ? (wxT(" (") + wxString(char2unicode(m_rangeNames[i].c_str())) + wxT(")"))
-											: wxString(wxEmptyString)));
+			% (!name.empty() ? (wxT(" (") + wxString(char2unicode(name.c_str())) + wxT(")"))
+							: wxString(wxEmptyString)));
 		if (isServer) {
 			theStats::AddFilteredServer();
 		} else {
@@ -521,13 +640,13 @@ void CIPFilter::DownloadFinished(uint32 result)
 
 void CIPFilter::OnIPFilterEvent(CIPFilterEvent& evt)
 {
-	{
-		wxMutexLocker lock(m_mutex);
-		std::swap(m_rangeIPs, evt.m_rangeIPs);
-		std::swap(m_rangeLengths, evt.m_rangeLengths);
-		std::swap(m_rangeNames, evt.m_rangeNames);
-		m_ready = true;
-	}
+	// Lookups on other threads may still read the previous table for a
+	// few microseconds.
+	CIPFilterTable* previous = m_table.Exchange(evt.m_table);
+	m_tableReaders.Wait();
+	delete previous;
+	m_ready = true;
+
 	if (theApp->IsOnShutDown()) {
 		return;
 	}
@@ -29,8 +29,10 @@
 #include <wx/event.h>	// Needed for wxEvent
 
 #include "Types.h"	// Needed for uint8, uint16 and uint32
+#include "Atomic.h"	// Needed for CAtomicPointer and CGracePeriod
 
 class CIPFilterEvent;
+class CIPFilterTable;
 
 /**
  * This class represents a list of IPs that should not be accepted
@@ -41,7 +43,12 @@ class CIPFilterEvent;
  * format and the AntiP2P format, read from either text files or text
  * files compressed with the zip compression format.
  *
- * This class is thread-safe.
+ * This class is thread-safe. Lookups do not lock: the loaded filter is
+ * compiled into an immutable CIPFilterTable, which is replaced as a
+ * whole when the filter is reloaded.
+ *
+ * The compiled filter is also saved to 'ipfilter.cache', and the text
+ * files are only parsed again once they or the filter level changed.
  */
 class CIPFilter : public wxEvtHandler
 {
@@ -51,6 +58,11 @@ public:
 	 */
 	CIPFilter();
 
+	/**
+	 * Destructor.
+	 */
+	~CIPFilter();
+
 	/**
 	 * Checks if a IP is filtered with the current list and AccessLevel.
 	 *
@@ -78,7 +90,8 @@ public:
 	 * @param A valid URL.
 	 *
 	 * Once the file has been downloaded, the ipfilter.dat file
-	 * will be replaced with the new file and Reload will be called.
+	 * will be replaced with the new file and Reload will be called,
+	 * which also rebuilds the cache.
 	 */
 	void	Update(const wxString& strURL);
 
@@ -106,18 +119,10 @@ private:
 	//! The URL from which the IP filter was downloaded
 	wxString m_URL;
 
-	// The IP ranges
-	typedef std::vector<uint32> RangeIPs;
-	RangeIPs m_rangeIPs;
-	typedef std::vector<uint16> RangeLengths;
-	RangeLengths m_rangeLengths;
-	// Name for each range. This usually stays empty for memory reasons,
-	// except if IP-Filter debugging is active.
-	typedef std::vector<std::string> RangeNames;
-	RangeNames m_rangeNames;
-
-	//! Mutex used to ensure thread-safety of this class
-	mutable wxMutex	m_mutex;
+	//! The current filter, read without locking.
+	CAtomicPointer<CIPFilterTable> m_table;
+	//! Readers of m_table, a replaced filter is freed once they are done with it.
+	mutable CGracePeriod m_tableReaders;
 
 	// false if loading (on startup only)
 	bool m_ready;
@@ -0,0 +1,159 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#include "IPFilterTable.h"	// Interface declarations
+
+#include <common/MuleDebug.h>	// Needed for MULE_VALIDATE_PARAMS
+
+#include "ArchSpecific.h"	// Needed for PeekUInt32
+#include "SafeFile.h"		// Needed for CFileDataIO
+
+
+// One entry per /16 plus the end marker
+static const uint32 IndexSize = 0x10000 + 1;
+
+const uint32 CIPFilterTable::NotFound;
+
+
+CIPFilterTable::CIPFilterTable(bool storeNames)
+	: m_index(IndexSize, 0),
+	  m_rangeCount(0),
+	  m_storeNames(storeNames),
+	  m_nextBlock(0)
+{
+}
+
+
+void CIPFilterTable::AddRange(uint32 start, uint32 end, const std::string& name)
+{
+	MULE_VALIDATE_PARAMS(start <= end, wxT("Not a valid range."));
+	if (!m_runs.empty()) {
+		// The last run always lies in the block before m_nextBlock
+		const uint32 lastIP = ((m_nextBlock - 1) << 16) | m_runs.back().end;
+		MULE_VALIDATE_PARAMS(start > lastIP, wxT("Ranges must be ascending and not overlap."));
+	}
+
+	const uint32 firstBlock = start >> 16;
+	const uint32 lastBlock = end >> 16;
+	for (uint32 block = firstBlock; block <= lastBlock; ++block) {
+		// Blocks without ranges get empty runs, this one starts here
+		while (m_nextBlock <= block) {
+			m_index[m_nextBlock++] = m_runs.size();
+		}
+
+		Run run;
+		run.start = (block == firstBlock) ? (start & 0xFFFF) : 0;
+		run.end = (block == lastBlock) ? (end & 0xFFFF) : 0xFFFF;
+		m_runs.push_back(run);
+
+		if (m_storeNames) {
+			m_runRanges.push_back(m_rangeCount);
+		}
+	}
+
+	if (m_storeNames) {
+		m_rangeNames.push_back(name);
+	}
+	m_rangeCount++;
+}
+
+
+void CIPFilterTable::Finish()
+{
+	while (m_nextBlock < IndexSize) {
+		m_index[m_nextBlock++] = m_runs.size();
+	}
+
+	// Trim the vectors to their final size.
+	std::vector<Run>(m_runs).swap(m_runs);
+	std::vector<uint32>(m_runRanges).swap(m_runRanges);
+}
+
+
+const std::string& CIPFilterTable::GetRangeName(uint32 id) const
+{
+	static const std::string empty;
+
+	if (id < m_runRanges.size()) {
+		return m_rangeNames[m_runRanges[id]];
+	}
+
+	return empty;
+}
+
+
+void CIPFilterTable::WriteTo(CFileDataIO& file) const
+{
+	file.WriteUInt32(m_rangeCount);
+	file.WriteUInt32(m_runs.size());
+	for (uint32 i = 0; i < IndexSize; ++i) {
+		file.WriteUInt32(m_index[i]);
+	}
+	for (uint32 i = 0; i < m_runs.size(); ++i) {
+		file.WriteUInt16(m_runs[i].start);
+		file.WriteUInt16(m_runs[i].end);
+	}
+}
+
+
+bool CIPFilterTable::ReadFrom(const byte* buffer, size_t length)
+{
+	MULE_VALIDATE_STATE(m_runs.empty(), wxT("Table is not empty."));
+
+	if (length < 8 + IndexSize * 4) {
+		return false;
+	}
+	const uint32 rangeCount = PeekUInt32(buffer);
+	const uint32 runCount = PeekUInt32(buffer + 4);
+	buffer += 8;
+	if (length != 8 + IndexSize * 4 + (uint64)runCount * 4) {
+		return false;
+	}
+
+	// Check the index before using it, a corrupt one would make Find() read
+	// past the end of the runs.
+	uint32 last = 0;
+	for (uint32 i = 0; i < IndexSize; ++i, buffer += 4) {
+		uint32 offset = PeekUInt32(buffer);
+		if (offset < last || offset > runCount) {
+			return false;
+		}
+		m_index[i] = last = offset;
+	}
+	if (m_index[0] != 0 || last != runCount) {
+		return false;
+	}
+
+	m_runs.resize(runCount);
+	for (uint32 i = 0; i < runCount; ++i, buffer += 4) {
+		m_runs[i].start = PeekUInt16(buffer);
+		m_runs[i].end = PeekUInt16(buffer + 2);
+	}
+
+	m_rangeCount = rangeCount;
+	m_nextBlock = IndexSize;
+
+	return true;
+}
+// File_checked_for_headers
@@ -0,0 +1,157 @@
+//							-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef IPFILTERTABLE_H
+#define IPFILTERTABLE_H
+
+#include <string>
+#include <vector>
+
+#include "Types.h"	// Needed for uint16 and uint32
+
+class CFileDataIO;
+
+/**
+ * Compiled, read-only form of the IP filter.
+ *
+ * The blocked ranges are split at /16 boundaries. A first-level table
+ * indexed by the upper 16 bits of an IP points to the sorted run of
+ * (start, end) pairs of the lower 16 bits that fall into that /16, so a
+ * lookup touches the index entry and a short binary search over a few
+ * 4-byte runs instead of the whole range list.
+ *
+ * A table is filled with AddRange() and Finish() by the thread that
+ * loads the filter. After that it is never modified and can be queried
+ * from any number of threads without locking.
+ */
+class CIPFilterTable
+{
+public:
+	//! Returned by Find() for IPs that are not in any range.
+	static const uint32 NotFound = 0xFFFFFFFF;
+
+	/**
+	 * Constructor.
+	 *
+	 * @param storeNames Keep the range descriptions for GetRangeName().
+	 */
+	CIPFilterTable(bool storeNames = false);
+
+	/**
+	 * Appends a blocked range.
+	 *
+	 * @param start First IP of the range, in host order.
+	 * @param end Last IP of the range (inclusive), in host order.
+	 * @param name Description of the range, ignored unless names are stored.
+	 *
+	 * Ranges must be added in ascending order and may not overlap.
+	 */
+	void	AddRange(uint32 start, uint32 end, const std::string& name = std::string());
+
+	/**
+	 * Completes the first-level table. Must be called once after the last
+	 * AddRange() and before the table is queried.
+	 */
+	void	Finish();
+
+	/**
+	 * Looks up an IP.
+	 *
+	 * @param ip The IP in host order.
+	 * @return An identifier of the matching range for GetRangeName(), or NotFound.
+	 */
+	uint32	Find(uint32 ip) const
+	{
+		const uint32 first = m_index[ip >> 16];
+		const uint32 last = m_index[(ip >> 16) + 1];
+		if (first == last) {
+			return NotFound;
+		}
+		const uint16 low = ip & 0xFFFF;
+		// Find the last run starting at or before 'low'.
+		uint32 imin = first;
+		uint32 imax = last;
+		while (imax - imin > 1) {
+			uint32 i = (imin + imax) / 2;
+			if (m_runs[i].start <= low) {
+				imin = i;
+			} else {
+				imax = i;
+			}
+		}
+		const Run& run = m_runs[imin];
+		if (run.start <= low && low <= run.end) {
+			return imin;
+		}
+		return NotFound;
+	}
+
+	/** Returns the number of ranges in the table. */
+	uint32	GetRangeCount() const	{ return m_rangeCount; }
+
+	/**
+	 * Returns the description of a range found by Find(), or an empty
+	 * string if descriptions were not stored.
+	 */
+	const std::string& GetRangeName(uint32 id) const;
+
+	/**
+	 * Writes the compiled table. Range descriptions are not written.
+	 */
+	void	WriteTo(CFileDataIO& file) const;
+
+	/**
+	 * Loads a table written by WriteTo() from a memory buffer.
+	 *
+	 * @return False if the buffer does not contain a valid table.
+	 *
+	 * The table must be empty, and Finish() must not be called afterwards.
+	 */
+	bool	ReadFrom(const byte* buffer, size_t length);
+
+private:
+	//! Part of a range that lies within a single /16.
+	struct Run {
+		uint16	start;
+		uint16	end;
+	};
+
+	//! Offset of the first run of each /16 in m_runs, plus an end marker.
+	std::vector<uint32> m_index;
+	//! All runs, ordered by IP.
+	std::vector<Run> m_runs;
+	//! Range number of each run. Only filled when names are stored.
+	std::vector<uint32> m_runRanges;
+	//! Range descriptions. Usually empty except if IP-Filter debugging is active.
+	std::vector<std::string> m_rangeNames;
+	//! Number of ranges added.
+	uint32	m_rangeCount;
+	//! Whether range descriptions are kept.
+	bool	m_storeNames;
+	//! The next entry of m_index that has not been filled yet.
+	uint32	m_nextBlock;
+};
+
+#endif // IPFILTERTABLE_H
+// File_checked_for_headers
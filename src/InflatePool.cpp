@@ -0,0 +1,167 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+
+#include "InflatePool.h"	// Interface declarations
+
+#include <wx/thread.h>		// Needed for wxMutex
+
+#include <zlib.h>
+#include <vector>
+
+
+namespace {
+
+// More than enough for the blocks downloaded at once by all sources
+const size_t MaxIdleStreams = 64;
+
+
+struct StreamPool {
+	StreamPool()
+		: acquired(0),
+		  reused(0)
+	{}
+
+	wxMutex			mutex;
+	std::vector<z_stream*>	idle;
+	uint64			acquired;
+	uint64			reused;
+};
+
+
+// Never destroyed, streams may still be released by static destructors.
+StreamPool& GetPool()
+{
+	static StreamPool* pool = new StreamPool;
+	return *pool;
+}
+
+// Creates the pool before main() runs and any threads exist.
+StreamPool& s_pool = GetPool();
+
+}
+
+
+z_stream* CInflatePool::Acquire()
+{
+	StreamPool& pool = GetPool();
+	{
+		wxMutexLocker lock(pool.mutex);
+		pool.acquired++;
+		if (!pool.idle.empty()) {
+			z_stream* stream = pool.idle.back();
+			pool.idle.pop_back();
+			pool.reused++;
+			return stream;
+		}
+	}
+
+	z_stream* stream = new z_stream;
+	stream->zalloc = Z_NULL;
+	stream->zfree = Z_NULL;
+	stream->opaque = Z_NULL;
+	stream->next_in = Z_NULL;
+	stream->avail_in = 0;
+	if (inflateInit(stream) != Z_OK) {
+		delete stream;
+		return NULL;
+	}
+
+	return stream;
+}
+
+
+void CInflatePool::Release(z_stream* stream)
+{
+	if (stream == NULL) {
+		return;
+	}
+
+	// Also clears any error state, the stream is as good as new afterwards
+	if (inflateReset(stream) == Z_OK) {
+		StreamPool& pool = GetPool();
+		wxMutexLocker lock(pool.mutex);
+		if (pool.idle.size() < MaxIdleStreams) {
+			pool.idle.push_back(stream);
+			return;
+		}
+	}
+
+	inflateEnd(stream);
+	delete stream;
+}
+
+
+int CInflatePool::Unzip(z_stream*& stream, uint32& totalUnzipped, const byte* zipped, uint32 lenZipped, byte* unzipped, uint32* lenUnzipped)
+{
+	const uint32 room = *lenUnzipped;
+	*lenUnzipped = 0;
+
+	if (stream == NULL) {
+		// Nothing may follow the end of the stream of a block
+		if (totalUnzipped) {
+			return Z_STREAM_ERROR;
+		}
+
+		stream = Acquire();
+		if (stream == NULL) {
+			return Z_MEM_ERROR;
+		}
+	}
+
+	stream->next_in = const_cast<byte*>(zipped);
+	stream->avail_in = lenZipped;
+	stream->next_out = unzipped;
+	stream->avail_out = room;
+
+	int err = inflate(stream, Z_SYNC_FLUSH);
+
+	// All input read and all output written
+	if (err == Z_STREAM_END || (err == Z_OK && stream->avail_in == 0)) {
+		*lenUnzipped = stream->total_out - totalUnzipped;
+		totalUnzipped = stream->total_out;
+
+		if (err == Z_STREAM_END) {
+			// The stream is done, it can serve the next block
+			Release(stream);
+			stream = NULL;
+		}
+		return Z_OK;
+	} else if (err == Z_OK) {
+		// Input left, but the output buffer is full
+		return Z_BUF_ERROR;
+	}
+
+	return err;
+}
+
+
+void CInflatePool::GetStats(Stats& stats)
+{
+	StreamPool& pool = GetPool();
+	wxMutexLocker lock(pool.mutex);
+	stats.acquired = pool.acquired;
+	stats.reused = pool.reused;
+}
+// File_checked_for_headers
@@ -0,0 +1,92 @@
+//							-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+
+#ifndef INFLATEPOOL_H
+#define INFLATEPOOL_H
+
+#include "Types.h"	// Needed for byte, uint32 and uint64
+
+// Defined in <zlib.h>
+struct z_stream_s;
+
+
+/**
+ * Pool of zlib inflate streams.
+ *
+ * Every compressed block of a download is one zlib stream. Setting up a
+ * stream allocates its state and a 32 kB window, so finished streams are
+ * reset with inflateReset() and kept for the next block instead. The number
+ * of idle streams is bounded.
+ */
+class CInflatePool
+{
+public:
+	/**
+	 * Returns a stream ready to inflate a new zlib stream, or NULL if
+	 * zlib failed to set one up.
+	 */
+	static z_stream_s*	Acquire();
+
+	/**
+	 * Returns a stream to the pool, whatever state it is in. NULL is
+	 * ignored.
+	 */
+	static void	Release(z_stream_s* stream);
+
+	/**
+	 * Unzips the next packet of a compressed block. Every block is one zlib
+	 * stream, sent in several packets.
+	 *
+	 * @param stream The stream of the block, NULL before its first packet.
+	 *        It is acquired on the first packet and released once the end
+	 *        of the zlib stream was unzipped.
+	 * @param totalUnzipped The number of bytes unzipped from the block so
+	 *        far, updated on success.
+	 * @param zipped The packet.
+	 * @param lenZipped Its length.
+	 * @param unzipped Receives the unzipped data.
+	 * @param lenUnzipped The size of 'unzipped' on call, the number of bytes
+	 *        unzipped on return, 0 on errors.
+	 * @return Z_OK on success. Z_BUF_ERROR if the packet unzips to more than
+	 *         fits into 'unzipped', Z_STREAM_ERROR if it follows the end of
+	 *         the stream, or another zlib error for corrupt data. The stream
+	 *         stays with the caller on errors.
+	 */
+	static int	Unzip(z_stream_s*& stream, uint32& totalUnzipped, const byte* zipped, uint32 lenZipped, byte* unzipped, uint32* lenUnzipped);
+
+	//! Counters for the statistics.
+	struct Stats {
+		//! Number of streams handed out.
+		uint64	acquired;
+		//! Number of streams handed out from the pool.
+		uint64	reused;
+	};
+
+	/** Returns the current counters. */
+	static void	GetStats(Stats& stats);
+};
+
+#endif // INFLATEPOOL_H
+// File_checked_for_headers
@@ -35,6 +35,9 @@ DECLARE_LOCAL_EVENT_TYPE(wxEVT_CORE_SOURCE_DNS_DONE, wxEVT_USER_FIRST+SOURCE_DNS
 DECLARE_LOCAL_EVENT_TYPE(wxEVT_CORE_UDP_DNS_DONE, wxEVT_USER_FIRST+UDP_DNS_DONE)
 DECLARE_LOCAL_EVENT_TYPE(wxEVT_CORE_SERVER_DNS_DONE, wxEVT_USER_FIRST+SERVER_DNS_DONE)
 
+DECLARE_LOCAL_EVENT_TYPE(wxEVT_CORE_SECIDENT_DONE, wxEVT_USER_FIRST+SECIDENT_DONE)
+DECLARE_LOCAL_EVENT_TYPE(wxEVT_CORE_UDP_DECODED, wxEVT_USER_FIRST+UDP_DECODED)
+
 
 class CMuleInternalEvent : public wxEvent
 {
@@ -0,0 +1,79 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+
+
+#include "InternedString.h"	// Interface declarations
+
+
+const wxString CInternedString::s_empty;
+
+
+namespace {
+
+// Never destroyed, clients may still be deleted by static destructors.
+std::map<wxString, uint32>& GetPool()
+{
+	static std::map<wxString, uint32>* pool = new std::map<wxString, uint32>;
+	return *pool;
+}
+
+}
+
+
+CInternedString::Entry* CInternedString::Acquire(const wxString& str)
+{
+	if (str.IsEmpty()) {
+		return NULL;
+	}
+
+	Pool& pool = GetPool();
+	Pool::iterator it = pool.insert(Entry(str, 0)).first;
+	it->second++;
+	return &*it;
+}
+
+
+void CInternedString::Release(Entry* entry)
+{
+	if (entry && --entry->second == 0) {
+		Pool& pool = GetPool();
+		pool.erase(pool.find(entry->first));
+	}
+}
+
+
+void CInternedString::GetStats(Stats& stats)
+{
+	const Pool& pool = GetPool();
+	stats.strings = pool.size();
+	stats.references = 0;
+	stats.bytes = 0;
+	for (Pool::const_iterator it = pool.begin(); it != pool.end(); ++it) {
+		stats.references += it->second;
+		// The map node and the characters of the string
+		stats.bytes += sizeof(Entry) + 4 * sizeof(void*) + (it->first.Length() + 1) * sizeof(wxChar);
+	}
+}
+// File_checked_for_headers
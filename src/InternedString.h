@@ -0,0 +1,125 @@
+//							-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+
+
+#ifndef INTERNEDSTRING_H
+#define INTERNEDSTRING_H
+
+#include <wx/string.h>
+
+#include "Types.h"	// Needed for uint32
+
+#include <map>
+
+
+/**
+ * A string shared by all holders of an equal string.
+ *
+ * Thousands of clients carry the same few user names, mod names and client
+ * software strings. Each distinct string is stored once in a pool with a
+ * reference count and removed when the last holder goes away, so a holder
+ * costs a pointer however long the string is.
+ *
+ * The pool isn't locked, interned strings must only be used by the main
+ * thread.
+ */
+class CInternedString
+{
+public:
+	CInternedString()
+		: m_entry(NULL)
+	{}
+
+	explicit CInternedString(const wxString& str)
+		: m_entry(Acquire(str))
+	{}
+
+	CInternedString(const CInternedString& other)
+		: m_entry(other.m_entry)
+	{
+		if (m_entry) {
+			m_entry->second++;
+		}
+	}
+
+	~CInternedString()	{ Release(m_entry); }
+
+	CInternedString& operator=(const CInternedString& other)
+	{
+		if (other.m_entry) {
+			other.m_entry->second++;
+		}
+		Release(m_entry);
+		m_entry = other.m_entry;
+		return *this;
+	}
+
+	CInternedString& operator=(const wxString& str)
+	{
+		Entry* entry = Acquire(str);
+		Release(m_entry);
+		m_entry = entry;
+		return *this;
+	}
+
+	/** Returns the string, it stays valid until this one is changed. */
+	const wxString&	Get() const	{ return m_entry ? m_entry->first : s_empty; }
+	operator const wxString&() const	{ return Get(); }
+
+	bool	IsEmpty() const		{ return m_entry == NULL; }
+
+	// Equal strings share their entry
+	bool	operator==(const CInternedString& other) const	{ return m_entry == other.m_entry; }
+	bool	operator!=(const CInternedString& other) const	{ return m_entry != other.m_entry; }
+
+	//! Counters for the statistics.
+	struct Stats {
+		//! Number of distinct strings in the pool.
+		uint32	strings;
+		//! Number of holders of these strings.
+		uint32	references;
+		//! Estimated memory used by the pool.
+		uint64	bytes;
+	};
+
+	/** Returns the current counters. */
+	static void	GetStats(Stats& stats);
+
+private:
+	typedef std::map<wxString, uint32> Pool;
+	typedef Pool::value_type Entry;
+
+	/** Returns the entry of the string with one more reference, NULL for an empty one. */
+	static Entry*	Acquire(const wxString& str);
+	/** Drops a reference, the entry is removed with the last one. */
+	static void	Release(Entry* entry);
+
+	static const wxString	s_empty;
+
+	Entry*	m_entry;
+};
+
+#endif // INTERNEDSTRING_H
+// File_checked_for_headers
@@ -328,6 +328,7 @@ void CKnownFile::Init()
 	m_bAutoUpPriority = thePrefs::GetNewAutoUp();
 	m_iUpPriority = ( m_bAutoUpPriority ) ? PR_HIGH : PR_NORMAL;
 	m_hashingProgress = 0;
+	m_barVersion = 0;
 
 #ifndef CLIENT_GUI
 	m_pAICHHashSet = new CAICHHashSet(this);
@@ -1429,6 +1430,8 @@ void CKnownFile::UpdatePartsInfo()
 
 void CKnownFile::UpdateUpPartsFrequency( CUpDownClient* client, bool increment )
 {
+	UpdateBarVersion();
+
 	if ( m_AvailPartFrequency.size() != GetPartCount() ) {
 		m_AvailPartFrequency.clear();
 		m_AvailPartFrequency.insert(m_AvailPartFrequency.begin(), GetPartCount(), 0);
@@ -303,6 +303,14 @@ public:
 	virtual	void SetHashingProgress(uint16) const {}	// does something for CPartFile only
 	uint16	GetHashingProgress() const	{ return m_hashingProgress; }
 
+	/**
+	 * Returns a number that changes whenever the chunk bars of the file
+	 * must be drawn again: when the availability of the parts, or for
+	 * part-files the gaps or the requested blocks change.
+	 */
+	uint32	GetBarVersion() const		{ return m_barVersion; }
+	void	UpdateBarVersion()		{ ++m_barVersion; }
+
 #ifdef CLIENT_GUI
 	CKnownFile(const CEC_SharedFile_Tag *);
 	friend class CKnownFilesRem;
@@ -347,6 +355,7 @@ protected:
 	// The known file is const in the hashing thread, so rather drill this little hole by making it mutable
 	// than opening it all up.
 	mutable	uint16 m_hashingProgress;
+	uint32	m_barVersion;
 
 	/* Kad stuff */
 	Kademlia::WordList wordlist;
@@ -0,0 +1,140 @@
+//							-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef KNOWNFILEINDEX_H
+#define KNOWNFILEINDEX_H
+
+#include "HashMap.h"	// Needed for CHashMap
+
+#include <ctime>	// Needed for time_t
+#include <map>
+
+
+/**
+ * Finds known files by size and modification date.
+ *
+ * KNOWNFILE must provide GetFileSize() and GetLastChangeDatetime(), neither
+ * of which may change while the file is in the index. The name is not part of
+ * the key, since files are renamed while known. Different sizes and dates
+ * can also share a key, so the caller compares all three in Find().
+ *
+ * Almost every key belongs to one file, which is kept in the hash table.
+ * Further files with the same key, for example a renamed file and its old
+ * entry, go to a small overflow map.
+ */
+template <typename KNOWNFILE>
+class CKnownFileIndex
+{
+public:
+	/** Adds a file, which must not be in the index already. */
+	void Add(KNOWNFILE* file)
+	{
+		uint64 key = GetKey(file->GetFileSize(), file->GetLastChangeDatetime());
+		KNOWNFILE*& first = m_files[key];
+		if (first == NULL) {
+			first = file;
+		} else {
+			m_overflow.insert(std::make_pair(key, file));
+		}
+	}
+
+	/** Removes a file, returning false if it was not in the index. */
+	bool Remove(KNOWNFILE* file)
+	{
+		uint64 key = GetKey(file->GetFileSize(), file->GetLastChangeDatetime());
+		KNOWNFILE** first = m_files.Lookup(key);
+		if (first == NULL) {
+			return false;
+		}
+
+		std::pair<typename OverflowMap::iterator, typename OverflowMap::iterator> range = m_overflow.equal_range(key);
+		if (*first == file) {
+			if (range.first == range.second) {
+				m_files.erase(key);
+			} else {
+				// The oldest other file takes its place
+				*first = range.first->second;
+				m_overflow.erase(range.first);
+			}
+			return true;
+		}
+
+		for (typename OverflowMap::iterator it = range.first; it != range.second; ++it) {
+			if (it->second == file) {
+				m_overflow.erase(it);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * Returns the first file added with this size and date, for which
+	 * 'matches' returns true, or NULL.
+	 */
+	template <typename MATCH>
+	KNOWNFILE* Find(uint64 size, time_t date, MATCH matches) const
+	{
+		uint64 key = GetKey(size, date);
+		KNOWNFILE* const* first = m_files.Lookup(key);
+		if (first == NULL) {
+			return NULL;
+		}
+		if (matches(*first)) {
+			return *first;
+		}
+
+		std::pair<typename OverflowMap::const_iterator, typename OverflowMap::const_iterator> range = m_overflow.equal_range(key);
+		for (typename OverflowMap::const_iterator it = range.first; it != range.second; ++it) {
+			if (matches(it->second)) {
+				return it->second;
+			}
+		}
+		return NULL;
+	}
+
+	/** Returns the number of files. */
+	size_t size() const	{ return m_files.size() + m_overflow.size(); }
+
+	/** Removes all files. */
+	void clear()
+	{
+		m_files.clear();
+		m_overflow.clear();
+	}
+
+private:
+	static uint64 GetKey(uint64 size, time_t date)
+	{
+		return size ^ (static_cast<uint64>(static_cast<uint32>(date)) << 32);
+	}
+
+	typedef std::multimap<uint64, KNOWNFILE*> OverflowMap;
+
+	CHashMap<uint64, KNOWNFILE*>	m_files;
+	OverflowMap		m_overflow;
+};
+
+#endif // KNOWNFILEINDEX_H
+// File_checked_for_headers
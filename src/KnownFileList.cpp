@@ -53,14 +53,34 @@ inline bool CKnownFileList::KnownFileMatches(
 }
 
 
+// Compares the candidates of the index with KnownFileMatches
+class CKnownFileMatcher
+{
+public:
+	CKnownFileMatcher(const CKnownFileList& list, const CPath& filename, uint32 in_date, uint64 in_size)
+		: m_list(list), m_filename(filename), m_date(in_date), m_size(in_size)
+	{
+	}
+
+	bool operator()(CKnownFile* knownFile) const
+	{
+		return m_list.KnownFileMatches(knownFile, m_filename, m_date, m_size);
+	}
+
+private:
+	const CKnownFileList&	m_list;
+	const CPath&	m_filename;
+	uint32		m_date;
+	uint64		m_size;
+};
+
+
 CKnownFileList::CKnownFileList()
 {
 	accepted = 0;
 	requested = 0;
 	transferred = 0;
 	m_filename = wxT("known.met");
-	m_knownSizeMap = NULL;
-	m_duplicateSizeMap = NULL;
 	Init();
 }
 
@@ -174,7 +194,8 @@ void CKnownFileList::Clear()
 
 	DeleteContents(m_knownFileMap);
 	DeleteContents(m_duplicateFileList);
-	ReleaseIndex();
+	m_knownIndex.clear();
+	m_duplicateIndex.clear();
 }
 
 
@@ -185,23 +206,9 @@ CKnownFile* CKnownFileList::FindKnownFile(
 {
 	wxMutexLocker sLock(list_mut);
 
-	if (m_knownSizeMap) {
-		std::pair<KnownFileSizeMap::const_iterator, KnownFileSizeMap::const_iterator> p;
-		p = m_knownSizeMap->equal_range((uint32) in_size);
-		for (KnownFileSizeMap::const_iterator it = p.first; it != p.second; ++it) {
-			CKnownFile *cur_file = it->second;
-			if (KnownFileMatches(cur_file, filename, in_date, in_size)) {
-				return cur_file;
-			}
-		}
-	} else {
-		for (CKnownFileMap::const_iterator it = m_knownFileMap.begin();
-			 it != m_knownFileMap.end(); ++it) {
-			CKnownFile *cur_file = it->second;
-			if (KnownFileMatches(cur_file, filename, in_date, in_size)) {
-				return cur_file;
-			}
-		}
+	CKnownFile *cur_file = m_knownIndex.Find(in_size, in_date, CKnownFileMatcher(*this, filename, in_date, in_size));
+	if (cur_file) {
+		return cur_file;
 	}
 
 	return IsOnDuplicates(filename, in_date, in_size);
@@ -213,25 +220,7 @@ CKnownFile *CKnownFileList::IsOnDuplicates(
 	uint32 in_date,
 	uint64 in_size) const
 {
-	if (m_duplicateSizeMap) {
-		std::pair<KnownFileSizeMap::const_iterator, KnownFileSizeMap::const_iterator> p;
-		p = m_duplicateSizeMap->equal_range((uint32) in_size);
-		for (KnownFileSizeMap::const_iterator it = p.first; it != p.second; ++it) {
-			CKnownFile *cur_file = it->second;
-			if (KnownFileMatches(cur_file, filename, in_date, in_size)) {
-				return cur_file;
-			}
-		}
-	} else {
-		for (KnownFileList::const_iterator it = m_duplicateFileList.begin();
-			 it != m_duplicateFileList.end(); ++it) {
-			CKnownFile *cur_file = *it;
-			if (KnownFileMatches(cur_file, filename, in_date, in_size)) {
-				return cur_file;
-			}
-		}
-	}
-	return NULL;
+	return m_duplicateIndex.Find(in_size, (time_t)in_date, CKnownFileMatcher(*this, filename, in_date, in_size));
 }
 
 
@@ -278,6 +267,7 @@ bool CKnownFileList::Append(CKnownFile *Record, bool afterHashing)
 		CKnownFileMap::iterator it = m_knownFileMap.find(tkey);
 		if (it == m_knownFileMap.end()) {
 			m_knownFileMap[tkey] = Record;
+			m_knownIndex.Add(Record);
 			return true;
 		} else {
 			CKnownFile *existing = it->second;
@@ -313,11 +303,14 @@ bool CKnownFileList::Append(CKnownFile *Record, bool afterHashing)
 				// The file is a duplicated hash. Add THE OLD ONE to the duplicates list.
 				// (This is used when reading the known file list where the duplicates are stored in front.)
 				m_duplicateFileList.push_back(existing);
+				m_knownIndex.Remove(existing);
+				m_duplicateIndex.Add(existing);
 				if (theApp->sharedfiles) {
 					// Removing the old kad keywords created with the old filename
 					theApp->sharedfiles->RemoveKeywords(existing);
 				}
 				m_knownFileMap[tkey] = Record;
+				m_knownIndex.Add(Record);
 				return true;
 			}
 		}
@@ -330,28 +323,4 @@ bool CKnownFileList::Append(CKnownFile *Record, bool afterHashing)
 	}
 }
 
-// Make an index by size to speed up FindKnownFile
-// Size modulo 2^32 is enough here
-void CKnownFileList::PrepareIndex()
-{
-	ReleaseIndex();
-	m_knownSizeMap = new KnownFileSizeMap;
-	for (CKnownFileMap::const_iterator it = m_knownFileMap.begin(); it != m_knownFileMap.end(); ++it) {
-		m_knownSizeMap->insert(std::pair<uint32, CKnownFile*>((uint32) it->second->GetFileSize(), it->second));
-	}
-	m_duplicateSizeMap = new KnownFileSizeMap;
-	for (KnownFileList::const_iterator it = m_duplicateFileList.begin(); it != m_duplicateFileList.end(); ++it) {
-		m_duplicateSizeMap->insert(std::pair<uint32, CKnownFile*>((uint32) (*it)->GetFileSize(), *it));
-	}
-}
-
-
-void CKnownFileList::ReleaseIndex()
-{
-	delete m_knownSizeMap;
-	delete m_duplicateSizeMap;
-	m_knownSizeMap = NULL;
-	m_duplicateSizeMap = NULL;
-}
-
 // File_checked_for_headers
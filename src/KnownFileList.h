@@ -28,6 +28,7 @@
 
 
 #include "SharedFileList.h" // CKnownFileMap
+#include "KnownFileIndex.h"	// Needed for CKnownFileIndex
 
 
 class CKnownFile;
@@ -47,14 +48,14 @@ public:
 		time_t in_date,
 		uint64 in_size);
 	CKnownFile* FindKnownFileByID(const CMD4Hash& hash);
-	void	PrepareIndex();
-	void	ReleaseIndex();
 
 	uint16 requested;
 	uint32 transferred;
 	uint16 accepted;
 
 private:
+	friend class CKnownFileMatcher;
+
 	wxMutex	list_mut;
 
 	bool	Append(CKnownFile*, bool afterHashing = false);
@@ -70,15 +71,16 @@ private:
 		uint32 in_date,
 		uint64 in_size) const;
 
-	typedef std::list<CKnownFile*> KnownFileList;
+	typedef std::vector<CKnownFile*> KnownFileList;
 	KnownFileList	m_duplicateFileList;
 	CKnownFileMap	m_knownFileMap;
 	// The filename "known.met"
 	wxString	m_filename;
-	// Speed up shared files reload
-	typedef std::multimap<uint32, CKnownFile*> KnownFileSizeMap;
-	KnownFileSizeMap * m_knownSizeMap;
-	KnownFileSizeMap * m_duplicateSizeMap;
+	// The files of m_knownFileMap and m_duplicateFileList, by size and date.
+	// Kept up to date as files are added, for the shared files reload.
+	typedef CKnownFileIndex<CKnownFile> KnownFileIndex;
+	KnownFileIndex	m_knownIndex;
+	KnownFileIndex	m_duplicateIndex;
 };
 
 #endif // KNOWNFILELIST_H
@@ -210,12 +210,19 @@ private:
 class CAsioService
 {
 public:
-    CAsioService();
-    ~CAsioService();
+	/**
+	 * Starts the Asio thread pool.
+	 *
+	 * Every thread runs an io_service of its own, and every socket is handled
+	 * by one of them. numberOfThreads 0 means one thread per CPU.
+	 */
+	CAsioService(int numberOfThreads = 0);
+	~CAsioService();
 	void Stop();
+	int GetThreadCount() const { return m_numberOfThreads; }
 private:
-	static const int m_numberOfThreads;
-	class CAsioServiceThread * m_threads;
+	int m_numberOfThreads;
+	class CAsioServiceThread ** m_threads;
 };
 
 
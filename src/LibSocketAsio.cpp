@@ -58,6 +58,7 @@
 #endif
 
 #include "LibSocket.h"
+#include "AsioServicePool.h"	// Needed for CAsioServicePool
 #include <wx/thread.h>		// wxMutex
 #include <wx/intl.h>		// _()
 #include <common/Format.h>	// Needed for CFormat
@@ -71,10 +72,13 @@
 
 using namespace boost::asio;
 using namespace boost::system;	// for error_code
-static io_service s_io_service;
 
-// Number of threads in the Asio thread pool
-const int CAsioService::m_numberOfThreads = 4;
+// Upper limit for the number of threads in the Asio thread pool
+static const int MaxAsioThreads = 64;
+// Number of threads if the number of CPUs is unknown
+static const int DefaultAsioThreads = 4;
+
+static CAsioServicePool s_io_services;
 
 /**
  * ASIO Client TCP socket implementation
@@ -101,8 +105,9 @@ public:
 	// cppcheck-suppress uninitMemberVar m_readBufferPtr
 	CAsioSocketImpl(CLibSocket * libSocket) :
 		m_libSocket(libSocket),
-		m_strand(s_io_service),
-		m_timer(s_io_service)
+		m_service(s_io_services.Get()),
+		m_strand(m_service),
+		m_timer(m_service)
 	{
 		m_OK = false;
 		m_blocksRead = false;
@@ -123,7 +128,7 @@ public:
 		m_sync = false;
 		m_IP = wxT("?");
 		m_IPint = 0;
-		m_socket = new ip::tcp::socket(s_io_service);
+		m_socket = new ip::tcp::socket(m_service);
 
 		// Set socket to non blocking
 		m_socket->non_blocking();
@@ -277,7 +282,7 @@ public:
 		if (!m_closed) {
 			m_closed = true;
 			m_connected = false;
-			if (m_sync || s_io_service.stopped()) {
+			if (m_sync || m_service.stopped()) {
 				DispatchClose();
 			} else {
 				m_strand.dispatch(boost::bind(& CAsioSocketImpl::DispatchClose, this));
@@ -295,7 +300,7 @@ public:
 		m_isDestroying = true;
 		AddDebugLogLineF(logAsio, CFormat(wxT("Destroy() %p %p %s")) % m_libSocket % this % m_IP);
 		Close();
-		if (m_sync || s_io_service.stopped()) {
+		if (m_sync || m_service.stopped()) {
 			HandleDestroy();
 		} else {
 			// Close prevents creation of any more callbacks, but does not clear any callbacks already
@@ -405,7 +410,7 @@ public:
 private:
 	//
 	// Dispatch handlers
-	// Access to m_socket is all bundled in the thread running s_io_service to avoid
+	// Access to m_socket is all bundled in the thread running m_service to avoid
 	// concurrent access to the socket from several threads.
 	// So once things are running (after connect), all access goes through one of these handlers.
 	//
@@ -619,6 +624,7 @@ private:
 	uint32			m_readBufferContent;
 	bool			m_eventPending;
 	char *			m_sendBuffer;
+	io_service &	m_service;			// the io_service of the thread running our handlers
 	io_service::strand	m_strand;		// handle synchronisation in io_service thread pool
 	deadline_timer	m_timer;
 	bool			m_connected;
@@ -779,11 +785,12 @@ void CLibSocket::SetProxyState(bool state, const amuleIPV4Address * adr)
 class CAsioSocketServerImpl : public ip::tcp::acceptor
 {
 public:
-	CAsioSocketServerImpl(const amuleIPV4Address & adr, CLibSocketServer * libSocketServer)
-		: ip::tcp::acceptor(s_io_service),
+	CAsioSocketServerImpl(const amuleIPV4Address & adr, CLibSocketServer * libSocketServer,
+			io_service & service = s_io_services.Get())
+		: ip::tcp::acceptor(service),
 		  m_libSocketServer(libSocketServer),
 		  m_currentSocket(NULL),
-		  m_strand(s_io_service)
+		  m_strand(service)
 	{
 		m_ok = false;
 		m_socketAvailable = false;
@@ -968,8 +975,9 @@ private:
 public:
 	CAsioUDPSocketImpl(const amuleIPV4Address &address, int /* flags */, CLibUDPSocket * libSocket) :
 		m_libSocket(libSocket),
-		m_strand(s_io_service),
-		m_timer(s_io_service),
+		m_service(s_io_services.Get()),
+		m_strand(m_service),
+		m_timer(m_service),
 		m_address(address)
 	{
 		m_muleSocket = NULL;
@@ -1033,7 +1041,7 @@ public:
 
 	void Close()
 	{
-		if (s_io_service.stopped()) {
+		if (m_service.stopped()) {
 			DispatchClose();
 		} else {
 			m_strand.dispatch(boost::bind(& CAsioUDPSocketImpl::DispatchClose, this));
@@ -1044,7 +1052,7 @@ public:
 	{
 		AddDebugLogLineF(logAsio, CFormat(wxT("Destroy() %p %p")) % m_libSocket % this);
 		Close();
-		if (s_io_service.stopped()) {
+		if (m_service.stopped()) {
 			HandleDestroy();
 		} else {
 			// Close prevents creation of any more callbacks, but does not clear any callbacks already
@@ -1059,7 +1067,7 @@ public:
 private:
 	//
 	// Dispatch handlers
-	// Access to m_socket is all bundled in the thread running s_io_service to avoid
+	// Access to m_socket is all bundled in the thread running m_service to avoid
 	// concurrent access to the socket from several threads.
 	// So once things are running (after connect), all access goes through one of these handlers.
 	//
@@ -1143,7 +1151,7 @@ private:
 		try {
 			delete m_socket;
 			ip::udp::endpoint endpoint(m_address.GetEndpoint().address(), m_address.Service());
-			m_socket = new ip::udp::socket(s_io_service, endpoint);
+			m_socket = new ip::udp::socket(m_service, endpoint);
 			AddDebugLogLineN(logAsio, CFormat(wxT("Created UDP socket %s %d")) % m_address.IPAddress() % m_address.Service());
 			StartBackgroundRead();
 		} catch (const system_error& err) {
@@ -1163,6 +1171,7 @@ private:
 	ip::udp::socket *	m_socket;
 	CMuleUDPSocket *	m_muleSocket;
 	bool				m_OK;
+	io_service &		m_service;		// the io_service of the thread running our handlers
 	io_service::strand	m_strand;		// handle synchronisation in io_service thread pool
 	deadline_timer		m_timer;
 	amuleIPV4Address	m_address;
@@ -1244,10 +1253,11 @@ void CLibUDPSocket::Destroy()
 
 class CAsioServiceThread : public wxThread {
 public:
-	CAsioServiceThread() : wxThread(wxTHREAD_JOINABLE)
+	CAsioServiceThread(io_service & service, int threadNumber)
+		: wxThread(wxTHREAD_JOINABLE),
+		  m_service(service),
+		  m_threadNumber(threadNumber)
 	{
-		static int count = 0;
-		m_threadNumber = ++count;
 		Create();
 		Run();
 	}
@@ -1255,23 +1265,35 @@ public:
 	void * Entry()
 	{
 		AddLogLineNS(CFormat(_("Asio thread %d started")) % m_threadNumber);
-		io_service::work worker(s_io_service);		// keep io_service running
-		s_io_service.run();
+		io_service::work worker(m_service);		// keep io_service running
+		m_service.run();
 		AddDebugLogLineN(logAsio, CFormat(wxT("Asio thread %d stopped")) % m_threadNumber);
 
 		return NULL;
 	}
 
 private:
+	io_service & m_service;
 	int m_threadNumber;
 };
 
 /**
- * The constructor starts the thread.
+ * The constructor starts the threads.
  */
-CAsioService::CAsioService()
+CAsioService::CAsioService(int numberOfThreads)
 {
-	m_threads = new CAsioServiceThread[m_numberOfThreads];
+	if (numberOfThreads <= 0) {
+		numberOfThreads = wxThread::GetCPUCount();
+		if (numberOfThreads <= 0) {
+			numberOfThreads = DefaultAsioThreads;
+		}
+	}
+	m_numberOfThreads = std::min(numberOfThreads, MaxAsioThreads);
+
+	m_threads = new CAsioServiceThread*[m_numberOfThreads];
+	for (int i = 0; i < m_numberOfThreads; i++) {
+		m_threads[i] = new CAsioServiceThread(s_io_services.GetByIndex(i), i + 1);
+	}
 }
 
 
@@ -1285,11 +1307,11 @@ void CAsioService::Stop()
 	if (!m_threads) {
 		return;
 	}
-	s_io_service.stop();
+	s_io_services.Stop();
 	// Wait for threads to exit
 	for (int i = 0; i < m_numberOfThreads; i++) {
-		CAsioServiceThread * t = m_threads + i;
-		t->Wait();
+		m_threads[i]->Wait();
+		delete m_threads[i];
 	}
 	delete[] m_threads;
 	m_threads = 0;
@@ -1352,7 +1374,7 @@ bool amuleIPV4Address::Hostname(const wxString& name)
 
 	// Try to resolve (sync). Normally not required. Unless you type in your hostname as "local IP address" or something.
 	error_code ec2;
-	ip::tcp::resolver res(s_io_service);
+	ip::tcp::resolver res(s_io_services.Get());
 	// We only want to get IPV4 addresses.
 	ip::tcp::resolver::query query(ip::tcp::v4(), sname, "");
 	ip::tcp::resolver::iterator endpoint_iterator = res.resolve(query, ec2);
@@ -25,12 +25,28 @@
 
 #include "MemFile.h"	// Interface declarations
 
+#include "BufferPool.h"	// Needed for CBufferPool
+
 
 CMemFile::CMemFile(unsigned int growthRate)
 {
 	m_buffer		= NULL;
 	m_BufferSize	= 0;
 	m_fileSize		= 0;
+	m_headroom		= 0;
+	m_growthRate	= growthRate;
+	m_position		= 0;
+	m_delete		= true;
+	m_readonly		= false;
+}
+
+
+CMemFile::CMemFile(unsigned int growthRate, size_t headroom)
+{
+	m_buffer		= NULL;
+	m_BufferSize	= 0;
+	m_fileSize		= 0;
+	m_headroom		= headroom;
 	m_growthRate	= growthRate;
 	m_position		= 0;
 	m_delete		= true;
@@ -45,6 +61,7 @@ CMemFile::CMemFile(byte* buffer, size_t bufferSize)
 	m_buffer		= buffer;
 	m_BufferSize	= bufferSize;
 	m_fileSize		= bufferSize;
+	m_headroom		= 0;
 	m_growthRate	= 0;
 	m_position		= 0;
 	m_delete		= false;
@@ -58,6 +75,7 @@ CMemFile::CMemFile(const byte* buffer, size_t bufferSize)
 	m_buffer		= const_cast<byte*>(buffer);
 	m_BufferSize	= bufferSize;
 	m_fileSize		= bufferSize;
+	m_headroom		= 0;
 	m_growthRate	= 0;
 	m_position		= 0;
 	m_delete		= false;
@@ -66,8 +84,8 @@ CMemFile::CMemFile(const byte* buffer, size_t bufferSize)
 
 CMemFile::~CMemFile()
 {
-	if (m_delete) {
-		free(m_buffer);
+	if (m_delete && m_buffer) {
+		CBufferPool::Free(m_buffer - m_headroom);
 	}
 }
 
@@ -115,13 +133,30 @@ void CMemFile::enlargeBuffer(size_t size)
 		newsize = size;
 	}
 
-	byte *tmp = (byte*)realloc(m_buffer, newsize);
-	if (tmp) {
-		m_buffer = tmp;
-		m_BufferSize = newsize;
+	byte* start = m_buffer ? m_buffer - m_headroom : NULL;
+	start = CBufferPool::Reallocate(start, m_headroom + newsize, m_headroom + m_fileSize);
+	m_buffer = start + m_headroom;
+	// The pool may have handed out a larger buffer, use all of it.
+	m_BufferSize = CBufferPool::GetCapacity(start) - m_headroom;
+}
+
+
+byte* CMemFile::DetachBuffer()
+{
+	MULE_VALIDATE_STATE(m_delete, wxT("CMemFile: Attempted to detach an attached buffer."));
+
+	if (m_buffer == NULL) {
+		// Nothing written yet, but the caller still expects the headroom.
+		enlargeBuffer(0);
 	}
 
-	MULE_VALIDATE_STATE(tmp, wxT("CMemFile: Failed to (re)allocate buffer"));
+	byte* buffer = m_buffer - m_headroom;
+	m_buffer		= NULL;
+	m_BufferSize	= 0;
+	m_fileSize		= 0;
+	m_position		= 0;
+
+	return buffer;
 }
 
 
@@ -68,6 +68,18 @@ public:
 	 */
 	CMemFile(unsigned int growthRate = 1024);
 
+	/**
+	 * Creates a dynamic file object with room in front of the data.
+	 *
+	 * @param growthRate The growth-rate of the buffer, see above.
+	 * @param headroom Number of bytes kept free in front of the file.
+	 *
+	 * The headroom lets the owner of a buffer taken with DetachBuffer()
+	 * put a header in front of the data without copying it, as done by
+	 * CPacket for packet data written to a memfile.
+	 */
+	CMemFile(unsigned int growthRate, size_t headroom);
+
 	/**
 	 * Creates a mem-file attached to an already existing buffer.
 	 *
@@ -134,6 +146,19 @@ public:
 	// Sometimes it's useful to get the buffer and do stuff with it.
 	byte* GetRawBuffer() const { return m_buffer; }
 
+	/** Returns the number of bytes reserved in front of the buffer. */
+	size_t GetHeadroom() const { return m_headroom; }
+
+	/**
+	 * Takes over the buffer, including the headroom.
+	 *
+	 * @return The start of the headroom, the file data follows it.
+	 *
+	 * The buffer must be released with CBufferPool::Free(). The memfile
+	 * is empty afterwards. Only valid for memfiles that own their buffer.
+	 */
+	byte* DetachBuffer();
+
 protected:
 	/** @see CFileDataIO::doRead */
 	virtual sint64 doRead(void* buffer, size_t count) const;
@@ -162,6 +187,8 @@ private:
 	size_t	m_BufferSize;
 	//! The size of the virtual file, may be less than the buffer-size.
 	size_t	m_fileSize;
+	//! Bytes allocated in front of m_buffer.
+	size_t	m_headroom;
 	//! If true, the buffer will be freed upon termination.
 	bool	m_delete;
 	//! read-only mark.
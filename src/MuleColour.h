@@ -85,6 +85,16 @@ public:
 		return *this;
 	}
 
+	// 'covered' is given in 1/256ths
+	const CMuleColour& BlendWith(const CMuleColour& colour, uint32 covered)
+	{
+		unsigned int red = Red() + ((colour.Red() * covered + 128) >> 8);
+		unsigned int green = Green() + ((colour.Green() * covered + 128) >> 8);
+		unsigned int blue = Blue() + ((colour.Blue() * covered + 128) >> 8);
+		Set((red < 255) ? red : 255, (green < 255) ? green : 255, (blue < 255) ? blue : 255);
+		return *this;
+	}
+
 	unsigned long GetULong() const { return (Blue() << 16) | (Green() << 8) | Red(); }
 
 	bool IsBlack() const { return !Red() && !Blue() && !Green(); }
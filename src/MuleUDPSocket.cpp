@@ -31,6 +31,7 @@
 
 #include "amule.h"                      // Needed for theApp
 #include "GetTickCount.h"               // Needed for GetTickCount()
+#include "BufferPool.h"                 // Needed for CBufferPool
 #include "Packet.h"                     // Needed for CPacket
 #include <common/StringFunctions.h>     // Needed for unicode2char
 #include "Proxy.h"                      // Needed for CDatagramSocketProxy
@@ -270,7 +271,7 @@ SocketSentBytes CMuleUDPSocket::SendControlData(uint32 maxNumberOfBytesToSend, u
 		CPacket* packet = item.packet;
 		if (GetTickCount() - item.time < UDPMAXQUEUETIME) {
 			uint32_t len = packet->GetPacketSize() + 2;
-			uint8_t *sendbuffer = new uint8_t [len];
+			uint8_t *sendbuffer = CBufferPool::Allocate(len);
 			memcpy(sendbuffer, packet->GetUDPHeader(), 2);
 			memcpy(sendbuffer + 2, packet->GetDataBuffer(), packet->GetPacketSize());
 
@@ -282,10 +283,10 @@ SocketSentBytes CMuleUDPSocket::SendControlData(uint32 maxNumberOfBytesToSend, u
 				sentBytes += len;
 				m_queue.pop_front();
 				delete packet;
-				delete [] sendbuffer;
+				CBufferPool::Free(sendbuffer);
 			} else {
 				// TODO: Needs better error handling, see SentTo
-				delete [] sendbuffer;
+				CBufferPool::Free(sendbuffer);
 				break;
 			}
 		} else {
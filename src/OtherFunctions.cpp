@@ -41,7 +41,6 @@
 #include <common/MD5Sum.h>
 #include <common/Path.h>
 #include "Logger.h"
-#include "BitVector.h"		// Needed for BitVector
 
 #include "OtherFunctions.h"	// Interface declarations
 
@@ -1196,8 +1195,4 @@ CMD4Hash GetPassword(bool allowEmptyPassword)
 	return password;
 }
 
-
-const uint8 BitVector::s_posMask[] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
-const uint8 BitVector::s_negMask[] = {0xFE, 0xFD, 0xFB, 0xF7, 0xEF, 0xDF, 0xBF, 0x7F};
-
 // File_checked_for_headers
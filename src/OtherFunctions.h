@@ -163,6 +163,24 @@ void DeleteContents(STL_CONTAINER& container)
 }
 
 
+/**
+ * Estimates the heap memory of the nodes of a std::list, or of a std::map,
+ * std::set and their multi variants. Besides the elements the nodes usually
+ * hold two pointers (lists) or three pointers and a color (trees).
+ */
+template <typename STL_LIST>
+uint64 ListMemoryUsage(const STL_LIST& list)
+{
+	return list.size() * (sizeof(typename STL_LIST::value_type) + 2 * sizeof(void*));
+}
+
+template <typename STL_TREE>
+uint64 TreeMemoryUsage(const STL_TREE& tree)
+{
+	return tree.size() * (sizeof(typename STL_TREE::value_type) + 4 * sizeof(void*));
+}
+
+
 /**
  * Copies elements from the range [first, first + n) to the range [result, result + n).
  */
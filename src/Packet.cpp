@@ -33,6 +33,9 @@
 #include "MemFile.h"			// Needed for CMemFile
 #include "OtherStructs.h"		// Needed for Header_Struct
 #include "ArchSpecific.h"		// Needed for ENDIAN_*
+#include "BufferPool.h"		// Needed for CBufferPool
+
+const unsigned CPacket::HeaderSize;
 
 // Copy constructor
 CPacket::CPacket(CPacket &p)
@@ -44,15 +47,16 @@ CPacket::CPacket(CPacket &p)
 	m_bLastSplitted = p.m_bLastSplitted;
 	m_bPacked	= p.m_bPacked;
 	m_bFromPF	= p.m_bFromPF;
+	m_bExternalBuffer = false;
 	memcpy(head, p.head, sizeof head);
 	tempbuffer	= NULL;
 	if (p.completebuffer) {
-		completebuffer	= new byte[size + 10];;
+		completebuffer	= CBufferPool::Allocate(size + 10);
 		pBuffer	= completebuffer + sizeof(Header_Struct);
 	} else {
 		completebuffer	= NULL;
 		if (p.pBuffer) {
-			pBuffer = new byte[size];
+			pBuffer = CBufferPool::Allocate(size);
 		} else {
 			pBuffer = NULL;
 		}
@@ -70,6 +74,7 @@ CPacket::CPacket(uint8 protocol)
 	m_bLastSplitted = false;
 	m_bPacked	= false;
 	m_bFromPF	= false;
+	m_bExternalBuffer = false;
 	memset(head, 0, sizeof head);
 	tempbuffer	= NULL;
 	completebuffer	= NULL;
@@ -88,6 +93,7 @@ CPacket::CPacket(byte* rawHeader, byte *buf)
 	m_bLastSplitted = false;
 	m_bPacked	= false;
 	m_bFromPF	= false;
+	m_bExternalBuffer = true;
 	tempbuffer	= NULL;
 	completebuffer	= NULL;
 	pBuffer	= buf;
@@ -102,9 +108,10 @@ CPacket::CPacket(const CMemFile& datafile, uint8 protocol, uint8 ucOpcode)
 	m_bLastSplitted = false;
 	m_bPacked	= false;
 	m_bFromPF	= false;
+	m_bExternalBuffer = false;
 	memset(head, 0, sizeof head);
 	tempbuffer = NULL;
-	completebuffer = new byte[size + sizeof(Header_Struct)/*Why this 4?*/];
+	completebuffer = CBufferPool::Allocate(size + sizeof(Header_Struct)/*Why this 4?*/);
 	pBuffer = completebuffer + sizeof(Header_Struct);
 
 	// Write contents of MemFile to buffer (while keeping original position in file)
@@ -114,6 +121,31 @@ CPacket::CPacket(const CMemFile& datafile, uint8 protocol, uint8 ucOpcode)
 	datafile.Seek(position, wxFromStart);
 }
 
+CPacket::CPacket(uint8 protocol, uint8 ucOpcode, CMemFile& datafile)
+{
+	size		= datafile.GetLength();
+	opcode		= ucOpcode;
+	prot		= protocol;
+	m_bSplitted	= false;
+	m_bLastSplitted = false;
+	m_bPacked	= false;
+	m_bFromPF	= false;
+	m_bExternalBuffer = false;
+	memset(head, 0, sizeof head);
+	tempbuffer = NULL;
+	if (datafile.GetHeadroom() == HeaderSize) {
+		completebuffer = datafile.DetachBuffer();
+		pBuffer = completebuffer + HeaderSize;
+	} else {
+		completebuffer = CBufferPool::Allocate(size + HeaderSize);
+		pBuffer = completebuffer + HeaderSize;
+		off_t position = datafile.GetPosition();
+		datafile.Seek(0, wxFromStart);
+		datafile.Read(pBuffer, size);
+		datafile.Seek(position, wxFromStart);
+	}
+}
+
 CPacket::CPacket(int8 in_opcode, uint32 in_size, uint8 protocol, bool bFromPF)
 {
 	size		= in_size;
@@ -123,10 +155,11 @@ CPacket::CPacket(int8 in_opcode, uint32 in_size, uint8 protocol, bool bFromPF)
 	m_bLastSplitted = false;
 	m_bPacked	= false;
 	m_bFromPF	= bFromPF;
+	m_bExternalBuffer = false;
 	memset(head, 0, sizeof head);
 	tempbuffer	= NULL;
 	if (in_size) {
-		completebuffer = new byte[in_size + sizeof(Header_Struct) + 4 /*Why this 4?*/];
+		completebuffer = CBufferPool::Allocate(in_size + sizeof(Header_Struct) + 4 /*Why this 4?*/);
 		pBuffer = completebuffer + sizeof(Header_Struct);
 		memset(completebuffer, 0, in_size + sizeof(Header_Struct) + 4 /*Why this 4?*/);
 	} else {
@@ -145,6 +178,7 @@ CPacket::CPacket(byte* pPacketPart, uint32 nSize, bool bLast, bool bFromPF)
 	m_bLastSplitted	= bLast;
 	m_bPacked	= false;
 	m_bFromPF	= bFromPF;
+	m_bExternalBuffer = false;
 	memset(head, 0, sizeof head);
 	tempbuffer	= NULL;
 	completebuffer	= pPacketPart;
@@ -155,15 +189,13 @@ CPacket::~CPacket()
 {
 	// Never deletes pBuffer when completebuffer is not NULL
 	if (completebuffer) {
-		delete [] completebuffer;
-	} else if (pBuffer) {
+		CBufferPool::Free(completebuffer);
+	} else if (pBuffer && !m_bExternalBuffer) {
 	// On the other hand, if completebuffer is NULL and pBuffer is not NULL
-		delete [] pBuffer;
+		CBufferPool::Free(pBuffer);
 	}
 
-	if (tempbuffer) {
-		delete [] tempbuffer;
-	}
+	CBufferPool::Free(tempbuffer);
 }
 
 uint32 CPacket::GetPacketSizeFromHeader(const byte* rawHeader)
@@ -188,11 +220,8 @@ byte* CPacket::GetPacket() {
 		}
 		return completebuffer;
 	} else {
-		if (tempbuffer){
-			delete [] tempbuffer;
-			tempbuffer = NULL;
-		}
-		tempbuffer = new byte[size + sizeof(Header_Struct) + 4 /* why this 4?*/];
+		CBufferPool::Free(tempbuffer);
+		tempbuffer = CBufferPool::Allocate(size + sizeof(Header_Struct) + 4 /* why this 4?*/);
 		memcpy(tempbuffer    , GetHeader(), sizeof(Header_Struct));
 		memcpy(tempbuffer + sizeof(Header_Struct), pBuffer    , size);
 		return tempbuffer;
@@ -208,11 +237,8 @@ byte* CPacket::DetachPacket() {
 		completebuffer = pBuffer = NULL;
 		return result;
 	} else{
-		if (tempbuffer){
-			delete[] tempbuffer;
-			tempbuffer = NULL;
-		}
-		tempbuffer = new byte[size+sizeof(Header_Struct)+4 /* Why this 4?*/];
+		CBufferPool::Free(tempbuffer);
+		tempbuffer = CBufferPool::Allocate(size+sizeof(Header_Struct)+4 /* Why this 4?*/);
 		memcpy(tempbuffer,GetHeader(),sizeof(Header_Struct));
 		memcpy(tempbuffer+sizeof(Header_Struct),pBuffer,size);
 		byte* result = tempbuffer;
@@ -249,12 +275,12 @@ void CPacket::PackPacket()
 	wxASSERT(!m_bSplitted);
 
 	uLongf newsize = size + 300;
-	byte* output = new byte[newsize];
+	byte* output = CBufferPool::Allocate(newsize);
 
 	uint16 result = compress2(output, &newsize, pBuffer, size, Z_BEST_COMPRESSION);
 
 	if (result != Z_OK || size <= newsize) {
-		delete[] output;
+		CBufferPool::Free(output);
 		return;
 	}
 
@@ -265,7 +291,7 @@ void CPacket::PackPacket()
 	}
 
 	memcpy(pBuffer, output, newsize);
-	delete[] output;
+	CBufferPool::Free(output);
 	m_bPacked = true;
 
 	size = newsize;
@@ -287,7 +313,7 @@ bool CPacket::UnPackPacket(uint32 uMaxDecompressedSize) {
 		nNewSize = uMaxDecompressedSize;
 	}
 
-	byte* unpack = new byte[nNewSize];
+	byte* unpack = CBufferPool::Allocate(nNewSize);
 	uLongf unpackedsize = nNewSize;
 	uint16 result = uncompress(unpack, &unpackedsize, pBuffer, size);
 
@@ -296,13 +322,16 @@ bool CPacket::UnPackPacket(uint32 uMaxDecompressedSize) {
 		wxASSERT( pBuffer != NULL );
 
 		size = unpackedsize;
-		delete[] pBuffer;
+		if (!m_bExternalBuffer) {
+			CBufferPool::Free(pBuffer);
+		}
 		pBuffer = unpack;
+		m_bExternalBuffer = false;
 		prot = OP_EMULEPROT;
 		return true;
 	}
 
-	delete[] unpack;
+	CBufferPool::Free(unpack);
 	return false;
 }
 
@@ -37,12 +37,23 @@ class wxString;
 //			PACKET CLASS
 // TODO some parts could need some work to make it more efficient
 
+// All buffers passed to or returned from a CPacket are CBufferPool buffers,
+// except for the data of received packets.
+
 class CPacket {
 public:
+	//! Size of the TCP header in front of the data.
+	static const unsigned HeaderSize = 6;
+
 	CPacket(CPacket &p);
 	CPacket(uint8 protocol);
-	CPacket(byte* header, byte *buf); // only used for receiving packets
+	// Only used for receiving packets. The packet does not take over buf,
+	// which must stay valid as long as the packet is in use.
+	CPacket(byte* header, byte *buf);
 	CPacket(const CMemFile& datafile, uint8 protocol, uint8 ucOpcode);
+	// Takes over the buffer of a datafile created with HeaderSize headroom,
+	// which is empty afterwards. Other memfiles are copied.
+	CPacket(uint8 protocol, uint8 ucOpcode, CMemFile& datafile);
 	CPacket(int8 in_opcode, uint32 in_size, uint8 protocol, bool bFromPF = true);
 	CPacket(byte* pPacketPart, uint32 nSize, bool bLast, bool bFromPF = true); // only used for splitted packets!
 
@@ -82,6 +93,7 @@ private:
 	bool		m_bLastSplitted;
 	bool		m_bPacked;
 	bool		m_bFromPF;
+	bool		m_bExternalBuffer;
 	byte		head[6];
 	byte*		tempbuffer;
 	byte*		completebuffer;
@@ -1220,12 +1220,14 @@ void CPartFile::PartFileHashFinished(CKnownFile* result)
 void CPartFile::AddGap(uint64 start, uint64 end)
 {
 	m_gaplist.AddGap(start, end);
+	UpdateBarVersion();
 	UpdateDisplayedInfo();
 }
 
 void CPartFile::AddGap(uint16 part)
 {
 	m_gaplist.AddGap(part);
+	UpdateBarVersion();
 	UpdateDisplayedInfo();
 }
 
@@ -1251,7 +1253,7 @@ bool CPartFile::GetNextEmptyBlockInPart(uint16 partNumber, Requested_Block_Struc
 	// What is the end limit of this block, i.e. can't go outside part (or filesize)
 	uint64 partEnd = partStart + GetPartSize(partNumber) - 1;
 	// Loop until find a suitable gap and return true, or no more gaps and return false
-	CGapList::const_iterator it = m_gaplist.begin();
+	CGapList::const_iterator it = m_gaplist.FindFirstGap(start);
 	while (true) {
 		bool noGap = true;
 		uint64 gapStart, end;
@@ -1313,6 +1315,7 @@ bool CPartFile::GetNextEmptyBlockInPart(uint16 partNumber, Requested_Block_Struc
 void CPartFile::FillGap(uint64 start, uint64 end)
 {
 	m_gaplist.FillGap(start, end);
+	UpdateBarVersion();
 	UpdateCompletedInfos();
 	UpdateDisplayedInfo();
 }
@@ -1320,6 +1323,7 @@ void CPartFile::FillGap(uint64 start, uint64 end)
 void CPartFile::FillGap(uint16 part)
 {
 	m_gaplist.FillGap(part);
+	UpdateBarVersion();
 	UpdateCompletedInfos();
 	UpdateDisplayedInfo();
 }
@@ -1887,6 +1891,7 @@ bool CPartFile::GetNextRequestedBlock(CUpDownClient* sender,
 			if(GetNextEmptyBlockInPart(sender->GetLastPartAsked(), pBlock) == true) {
 				// Keep a track of all pending requested blocks
 				m_requestedblocks_list.push_back(pBlock);
+				UpdateBarVersion();
 				// Update list of blocks to return
 				toadd.push_back(pBlock);
 				newBlockCount++;
@@ -2071,6 +2076,7 @@ void  CPartFile::RemoveBlockFromList(uint64 start,uint64 end)
 
 		if ((*it2)->StartOffset <= start && (*it2)->EndOffset >= end) {
 			m_requestedblocks_list.erase(it2);
+			UpdateBarVersion();
 		}
 	}
 }
@@ -2079,6 +2085,7 @@ void  CPartFile::RemoveBlockFromList(uint64 start,uint64 end)
 void CPartFile::RemoveAllRequestedBlocks(void)
 {
 	m_requestedblocks_list.clear();
+	UpdateBarVersion();
 }
 
 
@@ -3513,6 +3520,8 @@ void CPartFile::UpdatePartsFrequency( CUpDownClient* client, bool increment )
 {
 	const BitVector& freq = client->GetPartStatus();
 
+	UpdateBarVersion();
+
 	if ( m_SrcpartFrequency.size() != GetPartCount() ) {
 		m_SrcpartFrequency.clear();
 		m_SrcpartFrequency.insert(m_SrcpartFrequency.begin(), GetPartCount(), 0);
@@ -229,6 +229,9 @@ wxString	CPreferences::s_GeoIPUpdateUrl;
 bool		CPreferences::s_preventSleepWhileDownloading;
 wxString	CPreferences::s_StatsServerName;
 wxString	CPreferences::s_StatsServerURL;
+wxString	CPreferences::s_MetricsFile;
+uint16		CPreferences::s_MetricsInterval;
+uint16		CPreferences::s_AsioThreads;
 
 /**
  * Template Cfg class for connecting with widgets.
@@ -1257,6 +1260,13 @@ void CPreferences::BuildItemList( const wxString& appdir )
 	s_MiscList.push_back( new Cfg_Str( wxT("/eMule/StatsServerName"),		s_StatsServerName,	wxT("Shorty's ED2K stats") ) );
 	s_MiscList.push_back( new Cfg_Str( wxT("/eMule/StatsServerURL"),		s_StatsServerURL,	wxT("http://ed2k.shortypower.dyndns.org/?hash=") ) );
 
+	// Metrics in the Prometheus text format, for example for the node exporter's textfile collector
+	s_MiscList.push_back( new Cfg_Str( wxT("/Statistics/MetricsFile"),		s_MetricsFile,	wxEmptyString ) );
+	s_MiscList.push_back(    MkCfg_Int( wxT("/Statistics/MetricsInterval"),	s_MetricsInterval, 15 ) );
+
+	// Threads handling the network sockets, 0 for one per CPU
+	s_MiscList.push_back(    MkCfg_Int( wxT("/eMule/AsioThreads"),		s_AsioThreads, 0 ) );
+
 	s_MiscList.push_back( new Cfg_Bool( wxT("/ExternalConnect/TransmitOnlyUploadingClients"),	s_TransmitOnlyUploadingClients, false ) );
 	s_MiscList.push_back( new Cfg_Bool( wxT("/eMule/CreateSparseFiles"),		s_createFilesSparse, true ) );
 
@@ -572,6 +572,13 @@ public:
 	static const wxString&	GetStatsServerName()		{return s_StatsServerName;}
 	static const wxString&	GetStatsServerURL()		{return s_StatsServerURL;}
 
+	// Metrics export
+	static const wxString&	GetMetricsFile()		{return s_MetricsFile;}
+	static uint16			GetMetricsInterval()	{return s_MetricsInterval;}
+
+	// Networking threads, 0 for one per CPU
+	static uint16			GetAsioThreads()		{return s_AsioThreads;}
+
 	// HTTP download
 	static wxString	GetLastHTTPDownloadURL(uint8 t);
 	static void		SetLastHTTPDownloadURL(uint8 t, const wxString& val);
@@ -813,6 +820,13 @@ protected:
 	// Stats server
 	static wxString s_StatsServerName;
 	static wxString s_StatsServerURL;
+
+	// Metrics export
+	static wxString s_MetricsFile;
+	static uint16	s_MetricsInterval;
+
+	// Networking threads
+	static uint16	s_AsioThreads;
 };
 
 
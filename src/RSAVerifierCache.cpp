@@ -0,0 +1,160 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#include "RSAVerifierCache.h"	// Interface declarations
+
+#include "CryptoPP_Inc.h"	// Needed for Crypto functions
+
+#include <algorithm>		// Needed for std::equal
+
+
+typedef CryptoPP::RSASSA_PKCS1v15_SHA_Verifier CVerifier;
+
+
+CRSAVerifierCache::CRSAVerifierCache(size_t maxEntries)
+	: m_count(0),
+	  m_maxEntries(maxEntries),
+	  m_lookups(0),
+	  m_hits(0)
+{
+}
+
+
+CRSAVerifierCache::~CRSAVerifierCache()
+{
+	Clear();
+}
+
+
+bool CRSAVerifierCache::Verify(const CMD4Hash& owner, const byte* key, uint8 keyLen,
+	const byte* message, size_t messageLen, const byte* signature, size_t signatureLen)
+{
+	CVerifier* verifier = static_cast<CVerifier*>(Take(owner, key, keyLen));
+	if (verifier == NULL) {
+		CryptoPP::StringSource source(key, keyLen, true, 0);
+		verifier = new CVerifier(source);
+	}
+
+	bool result;
+	try {
+		result = verifier->VerifyMessage(message, messageLen, signature, signatureLen);
+	} catch (...) {
+		delete verifier;
+		throw;
+	}
+	Release(owner, key, keyLen, verifier);
+
+	return result;
+}
+
+
+void* CRSAVerifierCache::Take(const CMD4Hash& owner, const byte* key, uint8 keyLen)
+{
+	wxMutexLocker lock(m_lock);
+	m_lookups++;
+
+	CEntryMap::iterator it = m_entries.find(owner);
+	if (it == m_entries.end() || it->second.verifier == NULL) {
+		return NULL;
+	}
+
+	CEntry& entry = it->second;
+	if (entry.key.size() != keyLen || !std::equal(entry.key.begin(), entry.key.end(), key)) {
+		// The client presented a different key, the old one is useless.
+		delete static_cast<CVerifier*>(entry.verifier);
+		m_ages.erase(entry.age);
+		m_entries.erase(it);
+		m_count--;
+		return NULL;
+	}
+
+	// Leave the entry in place, so it keeps its position until released.
+	void* verifier = entry.verifier;
+	entry.verifier = NULL;
+	m_hits++;
+
+	return verifier;
+}
+
+
+void CRSAVerifierCache::Release(const CMD4Hash& owner, const byte* key, uint8 keyLen, void* verifier)
+{
+	std::vector<void*> dropped;
+	{
+		wxMutexLocker lock(m_lock);
+
+		CEntryMap::iterator it = m_entries.find(owner);
+		if (it == m_entries.end()) {
+			CEntry& entry = m_entries[owner];
+			entry.key.assign(key, key + keyLen);
+			entry.verifier = verifier;
+			entry.age = m_ages.insert(m_ages.begin(), owner);
+			m_count++;
+		} else if (it->second.verifier == NULL && it->second.key.size() == keyLen
+				&& std::equal(it->second.key.begin(), it->second.key.end(), key)) {
+			it->second.verifier = verifier;
+			m_ages.splice(m_ages.begin(), m_ages, it->second.age);
+		} else {
+			// Another thread has put back a verifier for this client first.
+			dropped.push_back(verifier);
+		}
+
+		while (m_count > m_maxEntries) {
+			CEntryMap::iterator oldest = m_entries.find(m_ages.back());
+			// Entries in use have no verifier here, Release() adds them again.
+			dropped.push_back(oldest->second.verifier);
+			m_entries.erase(oldest);
+			m_ages.pop_back();
+			m_count--;
+		}
+	}
+
+	for (size_t i = 0; i < dropped.size(); ++i) {
+		delete static_cast<CVerifier*>(dropped[i]);
+	}
+}
+
+
+void CRSAVerifierCache::GetStats(Stats& stats) const
+{
+	wxMutexLocker lock(m_lock);
+	stats.lookups = m_lookups;
+	stats.hits = m_hits;
+	stats.entries = m_count;
+}
+
+
+void CRSAVerifierCache::Clear()
+{
+	wxMutexLocker lock(m_lock);
+
+	CEntryMap::iterator it = m_entries.begin();
+	for (; it != m_entries.end(); ++it) {
+		delete static_cast<CVerifier*>(it->second.verifier);
+	}
+	m_entries.clear();
+	m_ages.clear();
+	m_count = 0;
+}
+// File_checked_for_headers
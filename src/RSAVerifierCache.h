@@ -0,0 +1,124 @@
+//							-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef RSAVERIFIERCACHE_H
+#define RSAVERIFIERCACHE_H
+
+#include "MD4Hash.h"	// Needed for CMD4Hash
+
+#include <wx/thread.h>	// Needed for wxMutex
+
+#include <list>
+#include <map>
+#include <vector>
+
+
+/**
+ * Cache of parsed RSA public keys, used to check secure ident signatures.
+ *
+ * Decoding the DER encoded public key of a client costs about as much as
+ * checking its signature. Clients reconnect often, so the parsed verifiers
+ * are kept by user hash, together with the key they were created from.
+ * At most 'maxEntries' verifiers are kept, the least recently used ones
+ * are dropped first.
+ *
+ * A CryptoPP object must not be used by two threads at once, so a verifier
+ * is taken out of the cache while it is in use. If two threads check the
+ * same key at the same time, the second one parses its own copy.
+ */
+class CRSAVerifierCache
+{
+public:
+	CRSAVerifierCache(size_t maxEntries = 2000);
+	~CRSAVerifierCache();
+
+	/**
+	 * Checks a RSASSA PKCS#1 v1.5 SHA-1 signature.
+	 *
+	 * @param owner The user hash of the owner of the key.
+	 * @param key The DER encoded public key.
+	 * @param keyLen The length of the key.
+	 * @param message The signed data.
+	 * @param messageLen The length of the signed data.
+	 * @param signature The signature to check.
+	 * @param signatureLen The length of the signature.
+	 * @return True if the signature is valid.
+	 *
+	 * Throws CryptoPP::Exception if the key cannot be decoded.
+	 */
+	bool	Verify(const CMD4Hash& owner, const byte* key, uint8 keyLen,
+			const byte* message, size_t messageLen,
+			const byte* signature, size_t signatureLen);
+
+	//! Lookup counters for the statistics.
+	struct Stats {
+		//! Number of signatures checked.
+		uint64	lookups;
+		//! Number of checks that used a cached verifier.
+		uint64	hits;
+		//! Number of verifiers currently kept.
+		uint64	entries;
+	};
+
+	/** Returns the current counters. */
+	void	GetStats(Stats& stats) const;
+
+	/** Drops all cached verifiers. */
+	void	Clear();
+
+private:
+	/** Removes the verifier for the key from the cache and returns it, or NULL. */
+	void*	Take(const CMD4Hash& owner, const byte* key, uint8 keyLen);
+
+	/** Puts a verifier back into the cache, or deletes it. */
+	void	Release(const CMD4Hash& owner, const byte* key, uint8 keyLen, void* verifier);
+
+	typedef std::list<CMD4Hash> CAgeList;
+
+	struct CEntry {
+		//! The key the verifier was created from.
+		std::vector<byte>	key;
+		// A void* to avoid having to include the large CryptoPP.h file
+		void*			verifier;
+		//! Position in m_ages.
+		CAgeList::iterator	age;
+	};
+
+	typedef std::map<CMD4Hash, CEntry> CEntryMap;
+
+	//! The cached verifiers.
+	CEntryMap	m_entries;
+	//! User hashes of the entries, most recently used first.
+	CAgeList	m_ages;
+	//! Number of entries in m_ages, std::list::size() may be slow.
+	size_t		m_count;
+	size_t		m_maxEntries;
+	uint64		m_lookups;
+	uint64		m_hits;
+
+	mutable wxMutex	m_lock;
+};
+
+#endif // RSAVERIFIERCACHE_H
+// File_checked_for_headers
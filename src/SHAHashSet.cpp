@@ -45,7 +45,16 @@
 #define MINUNIQUEIPS_TOTRUST		10	// how many unique IPs have to send us a hash to make it trustworthy
 #define	MINPERCENTAGE_TOTRUST		92  // how many percentage of clients have to send the same hash to make it trustworthy
 
+// The trees loaded for recovery data are kept for files of this total size,
+// which takes less than 10 MB. Most requests are for the parts of few files.
+#define MAX_KEPT_HASHSET_DATA		(wxULL(8) * 1024 * 1024 * 1024)
+
 CAICHRequestedDataList CAICHHashSet::m_liRequestedData;
+CKnown2MetIndex CAICHHashSet::m_known2MetIndex;
+
+// Hashsets with a loaded tree, most recently used first. Main thread only.
+static std::list<CAICHHashSet*> s_keptHashSets;
+static uint64 s_keptHashSetData = 0;
 
 /////////////////////////////////////////////////////////////////////////////////////////
 ///CAICHHash
@@ -454,6 +463,82 @@ bool CAICHUntrustedHash::AddSigningIP(uint32 dwIP)
 
 
 
+/////////////////////////////////////////////////////////////////////////////////////////
+///CKnown2MetIndex
+uint64 CKnown2MetIndex::GetKey(const CAICHHash& hash)
+{
+	uint64 key;
+	memcpy(&key, hash.GetRawHash(), sizeof(key));
+	return key;
+}
+
+
+bool CKnown2MetIndex::Find(const CAICHHash& hash, CFileDataIO* file, uint64& offset)
+{
+	wxMutexLocker lock(m_mutex);
+
+	if (!m_bComplete) {
+		try {
+			m_offsets.clear();
+			uint64 nExistingSize = file->GetLength();
+			file->Seek(1, wxFromStart);
+			while (file->GetPosition() < nExistingSize) {
+				uint64 nPos = file->GetPosition();
+				CAICHHash CurrentHash(file);
+				uint32 nHashCount = file->ReadUInt32();
+				if (file->GetPosition() + nHashCount*HASHSIZE > nExistingSize) {
+					AddDebugLogLineC(logSHAHashSet, wxT("Indexing failed: File contains fewer entries than specified!"));
+					break;
+				}
+				// Only the first one of duplicates is ever found by a scan
+				if (m_offsets.Lookup(GetKey(CurrentHash)) == NULL) {
+					m_offsets[GetKey(CurrentHash)] = nPos;
+				}
+				// skip the rest of this hashset
+				file->Seek(nHashCount*HASHSIZE, wxFromCurrent);
+			}
+		} catch (const CSafeIOException& e) {
+			AddDebugLogLineC(logSHAHashSet, wxT("IO error while indexing AICH HashSets: ") + e.what());
+			m_offsets.clear();
+			return false;
+		}
+		AddDebugLogLineN(logSHAHashSet, CFormat(wxT("Indexed %u AICH HashSets")) % m_offsets.size());
+		m_bComplete = true;
+	}
+
+	const uint64* pos = m_offsets.Lookup(GetKey(hash));
+	if (pos == NULL) {
+		return false;
+	}
+	offset = *pos;
+	return true;
+}
+
+
+void CKnown2MetIndex::Add(const CAICHHash& hash, uint64 offset)
+{
+	wxMutexLocker lock(m_mutex);
+	if (m_offsets.Lookup(GetKey(hash)) == NULL) {
+		m_offsets[GetKey(hash)] = offset;
+	}
+}
+
+
+void CKnown2MetIndex::SetComplete()
+{
+	wxMutexLocker lock(m_mutex);
+	m_bComplete = true;
+}
+
+
+void CKnown2MetIndex::Reset()
+{
+	wxMutexLocker lock(m_mutex);
+	m_offsets.clear();
+	m_bComplete = false;
+}
+
+
 /////////////////////////////////////////////////////////////////////////////////////////
 ///CAICHHashSet
 CAICHHashSet::CAICHHashSet(CKnownFile* pOwner)
@@ -461,6 +546,7 @@ CAICHHashSet::CAICHHashSet(CKnownFile* pOwner)
 {
 	m_eStatus = AICH_EMPTY;
 	m_pOwner = pOwner;
+	m_bKeptLoaded = false;
 }
 
 CAICHHashSet::~CAICHHashSet(void)
@@ -479,11 +565,12 @@ bool CAICHHashSet::CreatePartRecoveryData(uint64 nPartStartPos, CFileDataIO* fil
 		wxFAIL;
 		return false;
 	}
-	if (!bDbgDontLoad) {
+	if (!bDbgDontLoad && !m_bKeptLoaded) {
 		if (!LoadHashSet()) {
 			AddDebugLogLineN(logSHAHashSet,
 				CFormat(wxT("Created RecoveryData error: failed to load hashset. File: %s")) % m_pOwner->GetFileName());
 			SetStatus(AICH_ERROR);
+			FreeHashSet();
 			return false;
 		}
 	}
@@ -521,7 +608,12 @@ bool CAICHHashSet::CreatePartRecoveryData(uint64 nPartStartPos, CFileDataIO* fil
 	}
 
 	if (!bDbgDontLoad) {
-		FreeHashSet();
+		if (bResult) {
+			// The same client or others are likely to ask for the other parts
+			KeepLoaded();
+		} else {
+			FreeHashSet();
+		}
 	}
 	return bResult;
 }
@@ -660,23 +752,19 @@ bool CAICHHashSet::SaveHashSet()
 		}
 
 		// first we check if the hashset we want to write is already stored
-		CAICHHash CurrentHash;
-		while (file.GetPosition() < nExistingSize) {
-			CurrentHash.Read(&file);
-			if (m_pHashTree.m_Hash == CurrentHash) {
+		uint64 nOffset;
+		if (m_known2MetIndex.Find(m_pHashTree.m_Hash, &file, nOffset)) {
+			file.Seek(nOffset, wxFromStart);
+			if (CAICHHash(&file) == m_pHashTree.m_Hash) {
 				// this hashset if already available, no need to save it again
 				return true;
 			}
-			uint32 nHashCount = file.ReadUInt32();
-			if (file.GetPosition() + nHashCount*HASHSIZE > nExistingSize) {
-				AddDebugLogLineC(logSHAHashSet, wxT("Saving failed: File contains fewer entries than specified!"));
-				return false;
-			}
-			// skip the rest of this hashset
-			file.Seek(nHashCount*HASHSIZE, wxFromCurrent);
+			// The file was changed behind our back
+			m_known2MetIndex.Reset();
 		}
 
 		// write hashset
+		file.Seek(nExistingSize, wxFromStart);
 		m_pHashTree.m_Hash.Write(&file);
 		uint32 nHashCount = (PARTSIZE/EMBLOCKSIZE + ((PARTSIZE % EMBLOCKSIZE != 0)? 1 : 0)) * (m_pHashTree.m_nDataSize/PARTSIZE);
 		if (m_pHashTree.m_nDataSize % PARTSIZE != 0) {
@@ -695,6 +783,7 @@ bool CAICHHashSet::SaveHashSet()
 			AddDebugLogLineC(logSHAHashSet, wxT("Failed to save HashSet: Calculated and real size of hashset differ!"));
 			return false;
 		}
+		m_known2MetIndex.Add(m_pHashTree.m_Hash, nExistingSize);
 		AddDebugLogLineN(logSHAHashSet, CFormat(wxT("Successfully saved eMuleAC Hashset, %u Hashs + 1 Masterhash written")) % nHashCount);
 	} catch (const CSafeIOException& e) {
 		AddDebugLogLineC(logSHAHashSet, wxT("IO error while saving AICH HashSet: ") + e.what());
@@ -732,18 +821,17 @@ bool CAICHHashSet::LoadHashSet()
 			return false;
 		}
 
-		CAICHHash CurrentHash;
-		uint64 nExistingSize = file.GetLength();
-		uint32 nHashCount;
-		while (file.GetPosition() < nExistingSize) {
-			CurrentHash.Read(&file);
+		uint64 nOffset;
+		if (m_known2MetIndex.Find(m_pHashTree.m_Hash, &file, nOffset)) {
+			file.Seek(nOffset, wxFromStart);
+			CAICHHash CurrentHash(&file);
 			if (m_pHashTree.m_Hash == CurrentHash) {
 				// found Hashset
 				uint32 nExpectedCount =	(PARTSIZE/EMBLOCKSIZE + ((PARTSIZE % EMBLOCKSIZE != 0)? 1 : 0)) * (m_pHashTree.m_nDataSize/PARTSIZE);
 				if (m_pHashTree.m_nDataSize % PARTSIZE != 0) {
 					nExpectedCount += (m_pHashTree.m_nDataSize % PARTSIZE)/EMBLOCKSIZE + (((m_pHashTree.m_nDataSize % PARTSIZE) % EMBLOCKSIZE != 0)? 1 : 0);
 				}
-				nHashCount = file.ReadUInt32();
+				uint32 nHashCount = file.ReadUInt32();
 				if (nHashCount != nExpectedCount) {
 					AddDebugLogLineC(logSHAHashSet, wxT("Failed to load HashSet: Available Hashs and expected hashcount differ!"));
 					return false;
@@ -762,13 +850,8 @@ bool CAICHHashSet::LoadHashSet()
 				}
 				return true;
 			}
-			nHashCount = file.ReadUInt32();
-			if (file.GetPosition() + nHashCount*HASHSIZE > nExistingSize) {
-				AddDebugLogLineC(logSHAHashSet, wxT("Saving failed: File contains fewer entries than specified!"));
-				return false;
-			}
-			// skip the rest of this hashset
-			file.Seek(nHashCount*HASHSIZE, wxFromCurrent);
+			// The file was changed behind our back, index it again next time
+			m_known2MetIndex.Reset();
 		}
 		AddDebugLogLineC(logSHAHashSet, wxT("Failed to load HashSet: HashSet not found!"));
 	} catch (const CSafeIOException& e) {
@@ -781,6 +864,9 @@ bool CAICHHashSet::LoadHashSet()
 // delete the hashset except the masterhash (we dont keep aich hashsets in memory to save ressources)
 void CAICHHashSet::FreeHashSet()
 {
+	if (m_bKeptLoaded) {
+		ForgetLoaded();
+	}
 	if (m_pHashTree.m_pLeftTree) {
 		delete m_pHashTree.m_pLeftTree;
 		m_pHashTree.m_pLeftTree = NULL;
@@ -791,6 +877,31 @@ void CAICHHashSet::FreeHashSet()
 	}
 }
 
+// Keeps the loaded tree, and frees the least recently used ones beyond the limit.
+void CAICHHashSet::KeepLoaded()
+{
+	if (m_bKeptLoaded) {
+		s_keptHashSets.remove(this);
+	} else {
+		m_bKeptLoaded = true;
+		s_keptHashSetData += m_pHashTree.m_nDataSize;
+	}
+	s_keptHashSets.push_front(this);
+
+	while (s_keptHashSetData > MAX_KEPT_HASHSET_DATA && s_keptHashSets.size() > 1) {
+		s_keptHashSets.back()->FreeHashSet();
+	}
+}
+
+
+void CAICHHashSet::ForgetLoaded()
+{
+	s_keptHashSets.remove(this);
+	s_keptHashSetData -= m_pHashTree.m_nDataSize;
+	m_bKeptLoaded = false;
+}
+
+
 void CAICHHashSet::SetMasterHash(const CAICHHash& Hash, EAICHStatus eNewStatus)
 {
 	m_pHashTree.m_Hash = Hash;
@@ -74,9 +74,11 @@ Version 2 of AICH also supports 32bit identifiers to support large files, check
 
 #include <deque>
 #include <set>
+#include <wx/thread.h>		// Needed for wxMutex
 
 #include "Types.h"
 #include "ClientRef.h"
+#include "HashMap.h"		// Needed for CHashMap
 
 #define HASHSIZE			20
 #define KNOWN2_MET_FILENAME		wxT("known2_64.met")
@@ -127,6 +129,7 @@ public:
 	void Read(byte* data)			{ memcpy(m_abyBuffer, data, HASHSIZE); }
 	wxString GetString() const;
 	byte* GetRawHash()			{ return m_abyBuffer; }
+	const byte* GetRawHash() const		{ return m_abyBuffer; }
 	static uint32 GetHashSize()		{ return HASHSIZE;}
 	unsigned int DecodeBase32(const wxString &base32);
 };
@@ -225,6 +228,42 @@ public:
 };
 
 
+/////////////////////////////////////////////////////////////////////////////////////////
+///CKnown2MetIndex
+//
+// Where the hashsets are stored in known2_64.met, by master hash. Built by the
+// first scan of the file, either the one of CAICHSyncTask or the first lookup,
+// and extended as hashsets are appended. Can be used from any thread.
+//
+class CKnown2MetIndex
+{
+public:
+	CKnown2MetIndex() : m_bComplete(false) {}
+
+	/**
+	 * Looks up the offset of a hashset.
+	 *
+	 * @param file known2_64.met, scanned if the index is not complete yet.
+	 * @return false if the hashset is not stored, or the file could not be read.
+	 */
+	bool Find(const CAICHHash& hash, CFileDataIO* file, uint64& offset);
+	//! Records the offset of a hashset.
+	void Add(const CAICHHash& hash, uint64 offset);
+	//! Marks all hashsets of the file as recorded.
+	void SetComplete();
+	//! Forgets all offsets, the next lookup scans the file again.
+	void Reset();
+
+private:
+	//! The first 8 bytes of the master hash. Lookups compare the whole hash in the file.
+	static uint64 GetKey(const CAICHHash& hash);
+
+	wxMutex		m_mutex;
+	CHashMap<uint64, uint64> m_offsets;
+	bool		m_bComplete;
+};
+
+
 using namespace std;
 
 typedef std::list<CAICHRequestedData> CAICHRequestedDataList;
@@ -237,9 +276,15 @@ private:
 	CKnownFile* m_pOwner;
 	EAICHStatus m_eStatus;
 	deque<CAICHUntrustedHash> m_aUntrustedHashs;
+	//! The loaded tree is kept for further recovery data requests.
+	bool m_bKeptLoaded;
+
+	void KeepLoaded();
+	void ForgetLoaded();
 
 public:
 	static CAICHRequestedDataList m_liRequestedData;
+	static CKnown2MetIndex m_known2MetIndex;
 	CAICHHashTree m_pHashTree;
 
 	CAICHHashSet(CKnownFile* pOwner);
@@ -0,0 +1,212 @@
+//							-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+
+#ifndef SERVERINDEX_H
+#define SERVERINDEX_H
+
+#include <wx/string.h>	// Needed for wxString
+
+#include "HashMap.h"	// Needed for CHashMap
+
+#include <algorithm>	// Needed for std::find
+#include <vector>
+
+
+/**
+ * Hashes a server address (a hostname or a dotted IP) for CHashMap.
+ */
+struct CServerAddressHash
+{
+	uint32 operator()(const wxString& address) const
+	{
+		// FNV-1a
+		uint32 hash = 2166136261u;
+		for (size_t i = 0; i < address.length(); ++i) {
+			wxChar c = address[i];
+			hash = (hash ^ static_cast<uint32>(c)) * 16777619u;
+		}
+		return hash;
+	}
+};
+
+
+/**
+ * Finds the servers of the server list by IP, address and ECID.
+ *
+ * Servers are kept in buckets by IP and by address, and the ports are
+ * compared in the few servers of a bucket, so changing the ports of a
+ * server needs no update. Changing its IP or address (SetID() or
+ * SetDynIP()) does, and the server must be passed to Update() afterwards.
+ * Of several matching servers, the one indexed first is returned.
+ *
+ * SERVER must provide GetIP(), GetAddress(), GetPort(),
+ * GetObfuscationPortUDP() and ECID(). The ECID may not change while the
+ * server is in the index.
+ */
+template <typename SERVER>
+class CServerIndex
+{
+public:
+	/** Adds a server, which must not be in the index already. */
+	void Add(SERVER* server)
+	{
+		Entry& entry = m_servers[server->ECID()];
+		entry.server = server;
+		entry.ip = server->GetIP();
+		entry.address = server->GetAddress();
+		m_byIP[entry.ip].push_back(server);
+		m_byAddress[entry.address].push_back(server);
+	}
+
+	/** Removes a server, returning false if it was not in the index. */
+	bool Remove(SERVER* server)
+	{
+		const Entry* entry = m_servers.Lookup(server->ECID());
+		if (entry == NULL || entry->server != server) {
+			return false;
+		}
+
+		RemoveFromBucket(m_byIP, entry->ip, server);
+		RemoveFromBucket(m_byAddress, entry->address, server);
+		m_servers.erase(server->ECID());
+		return true;
+	}
+
+	/** Indexes a server again, after its IP or address changed. */
+	void Update(SERVER* server)
+	{
+		if (Remove(server)) {
+			Add(server);
+		}
+	}
+
+	SERVER* FindByIP(uint32 ip) const
+	{
+		const Bucket* bucket = m_byIP.Lookup(ip);
+		return bucket ? bucket->front() : NULL;
+	}
+
+	SERVER* FindByIPTCP(uint32 ip, uint16 port) const
+	{
+		const Bucket* bucket = m_byIP.Lookup(ip);
+		if (bucket) {
+			for (typename Bucket::const_iterator it = bucket->begin(); it != bucket->end(); ++it) {
+				if ((*it)->GetPort() == port) {
+					return *it;
+				}
+			}
+		}
+		return NULL;
+	}
+
+	SERVER* FindByIPUDP(uint32 ip, uint16 udpPort, bool obfuscationPorts) const
+	{
+		const Bucket* bucket = m_byIP.Lookup(ip);
+		if (bucket) {
+			for (typename Bucket::const_iterator it = bucket->begin(); it != bucket->end(); ++it) {
+				if (IsUDPPortOf(*it, udpPort, obfuscationPorts)) {
+					return *it;
+				}
+			}
+		}
+		return NULL;
+	}
+
+	SERVER* FindByAddress(const wxString& address, uint16 port) const
+	{
+		const Bucket* bucket = m_byAddress.Lookup(address);
+		if (bucket) {
+			for (typename Bucket::const_iterator it = bucket->begin(); it != bucket->end(); ++it) {
+				if ((*it)->GetPort() == port) {
+					return *it;
+				}
+			}
+		}
+		return NULL;
+	}
+
+	SERVER* FindByECID(uint32 ecid) const
+	{
+		const Entry* entry = m_servers.Lookup(ecid);
+		return entry ? entry->server : NULL;
+	}
+
+	/**
+	 * Returns true if a server answers UDP packets on this port: the TCP
+	 * port + 4, the TCP port + 12 for the extended requests, or the
+	 * obfuscation UDP port if the packet may have come from there.
+	 */
+	static bool IsUDPPortOf(const SERVER* server, uint16 udpPort, bool obfuscationPorts)
+	{
+		// No wrapping, UDP ports below 4 and 12 belong to no TCP port
+		int port = server->GetPort();
+		return port == udpPort - 4
+			|| (obfuscationPorts && server->GetObfuscationPortUDP() == udpPort)
+			|| port == udpPort - 12;
+	}
+
+	size_t size() const	{ return m_servers.size(); }
+
+	/** Removes all servers. */
+	void clear()
+	{
+		m_servers.clear();
+		m_byIP.clear();
+		m_byAddress.clear();
+	}
+
+private:
+	typedef std::vector<SERVER*> Bucket;
+
+	//! The keys a server was indexed by, to find it again when they changed.
+	struct Entry {
+		Entry() : server(NULL), ip(0) {}
+
+		SERVER*		server;
+		uint32		ip;
+		wxString	address;
+	};
+
+	template <typename MAP, typename KEY>
+	static void RemoveFromBucket(MAP& map, const KEY& key, SERVER* server)
+	{
+		Bucket* bucket = map.Lookup(key);
+		wxCHECK_RET(bucket, wxT("Server missing from its bucket"));
+		typename Bucket::iterator it = std::find(bucket->begin(), bucket->end(), server);
+		if (it != bucket->end()) {
+			bucket->erase(it);
+		}
+		if (bucket->empty()) {
+			map.erase(key);
+		}
+	}
+
+	CHashMap<uint32, Entry>		m_servers;
+	CHashMap<uint32, Bucket>	m_byIP;
+	CHashMap<wxString, Bucket, CServerAddressHash>	m_byAddress;
+};
+
+#endif // SERVERINDEX_H
+// File_checked_for_headers
@@ -245,6 +245,7 @@ bool CServerList::AddServer(CServer* in_server, bool fromUser)
 	theStats::AddServer();
 
 	m_servers.push_back(in_server);
+	m_index.Add(in_server);
 	NotifyObservers( EventType( EventType::INSERTED, in_server ) );
 
 	if ( fromUser ) {
@@ -360,6 +361,7 @@ void CServerList::RemoveServer(CServer* in_server)
 				++m_statserverpos;
 			}
 			m_servers.erase(it);
+			m_index.Remove(in_server);
 			theStats::DeleteServer();
 
 			Notify_ServerRemove(in_server);
@@ -375,6 +377,7 @@ void CServerList::RemoveAllServers()
 
 	theStats::DeleteAllServers();
 	// no connection, safely remove all servers
+	m_index.clear();
 	while ( !m_servers.empty() ) {
 		delete m_servers.back();
 		m_servers.pop_back();
@@ -559,6 +562,11 @@ struct ServerPriorityComparator {
 void CServerList::Sort()
 {
 	m_servers.sort(ServerPriorityComparator());
+	// Lookups return the first matching server in list order
+	m_index.clear();
+	for (CInternalList::const_iterator it = m_servers.begin(); it != m_servers.end(); ++it) {
+		m_index.Add(*it);
+	}
 	// Once the list has been sorted, it doesn't really make sense to continue
 	// traversing the new order from the old position.  Plus, there's a bug in
 	// version of libstdc++ before gcc4 such that iterators that were equal to
@@ -604,61 +612,37 @@ CServer* CServerList::GetNextStatServer()
 
 CServer* CServerList::GetServerByAddress(const wxString& address, uint16 port) const
 {
-	for (CInternalList::const_iterator it = m_servers.begin(); it != m_servers.end(); ++it) {
-		CServer* const s = *it;
-		if (port == s->GetPort() && s->GetAddress() == address) {
-			return s;
-		}
-	}
-	return NULL;
+	return m_index.FindByAddress(address, port);
 }
 
 
 CServer* CServerList::GetServerByIP(uint32 nIP) const
 {
-	for (CInternalList::const_iterator it = m_servers.begin(); it != m_servers.end(); ++it){
-        CServer* const s = *it;
-		if (s->GetIP() == nIP)
-			return s;
-	}
-	return NULL;
+	return m_index.FindByIP(nIP);
 }
 
 
 CServer* CServerList::GetServerByIPTCP(uint32 nIP, uint16 nPort) const
 {
-	for (CInternalList::const_iterator it = m_servers.begin(); it != m_servers.end(); ++it){
-        CServer* const s = *it;
-		if (s->GetIP() == nIP && s->GetPort() == nPort)
-			return s;
-	}
-	return NULL;
+	return m_index.FindByIPTCP(nIP, nPort);
 }
 
 
 CServer* CServerList::GetServerByIPUDP(uint32 nIP, uint16 nUDPPort, bool bObfuscationPorts) const
 {
-	for (CInternalList::const_iterator it = m_servers.begin(); it != m_servers.end(); ++it){
-        CServer* const s =*it;
-		if (s->GetIP() == nIP
-			&& (s->GetPort() == nUDPPort-4
-				|| (bObfuscationPorts && s->GetObfuscationPortUDP() == nUDPPort)
-				|| s->GetPort() == nUDPPort - 12))
-			return s;
-	}
-	return NULL;
+	return m_index.FindByIPUDP(nIP, nUDPPort, bObfuscationPorts);
 }
 
 
 CServer* CServerList::GetServerByECID(uint32 ecid) const
 {
-	for (CInternalList::const_iterator it = m_servers.begin(); it != m_servers.end(); ++it){
-        CServer* const s = *it;
-		if (s->ECID() == ecid) {
-			return s;
-		}
-	}
-	return NULL;
+	return m_index.FindByECID(ecid);
+}
+
+
+void CServerList::UpdateServerIndex(CServer* server)
+{
+	m_index.Update(server);
 }
 
 
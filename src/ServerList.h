@@ -27,6 +27,7 @@
 #define SERVERLIST_H
 
 #include "ObservableQueue.h"
+#include "ServerIndex.h"		// Needed for CServerIndex
 
 class CServer;
 class CPacket;
@@ -54,6 +55,8 @@ public:
 	CServer*	GetServerByIPTCP(uint32 nIP, uint16 nPort) const;
 	CServer*	GetServerByIPUDP(uint32 nIP, uint16 nUDPPort, bool bObfuscationPorts = true) const;
 	CServer*	GetServerByECID(uint32 ecid) const;
+	/** Must be called after the IP or the dynamic IP of a listed server changed. */
+	void		UpdateServerIndex(CServer* server);
 	void		GetStatus(uint32 &failed, uint32 &user, uint32 &file, uint32 &tuser, uint32 &tfile, float &occ);
 	void		GetUserFileStatus( uint32 &user, uint32 &file);
 	bool		IsInitialized() const { return m_initialized; }
@@ -96,6 +99,8 @@ private:
 	CInternalList			m_servers;
 	CInternalList::const_iterator	m_serverpos;
 	CInternalList::const_iterator	m_statserverpos;
+	//! The servers of m_servers by IP, address and ECID, in the same order.
+	CServerIndex<CServer>		m_index;
 
 	uint32		m_nLastED2KServerLinkCheck;// emanuelw(20030924) added
 	wxString	m_URLUpdate;
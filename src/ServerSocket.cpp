@@ -179,6 +179,7 @@ void CServerSocket::OnConnect(int nErrorCode)
 					cur_server->GetAddress(), cur_server->GetPort());
 				if (pServer) {
 					pServer->SetID(server_ip);
+					theApp->serverlist->UpdateServerIndex(pServer);
 				} else {
 					AddDebugLogLineN(logServer, wxT("theApp->serverlist->GetServerByAddress() returned NULL"));
 					return;
@@ -300,6 +301,7 @@ bool CServerSocket::ProcessPacket(const byte* packet, uint32 size, int8 opcode)
 							CServer* eserver = theApp->serverlist->GetServerByAddress(cur_server->GetAddress(),cur_server->GetPort());
 							if (eserver){
 								eserver->SetDynIP(dynip);
+								theApp->serverlist->UpdateServerIndex(eserver);
 								cur_server->SetDynIP(dynip);
 								Notify_ServerRefresh(eserver);
 							}
@@ -30,6 +30,7 @@
 #include <common/EventIDs.h>
 #include <tags/ServerTags.h>
 
+#include "BufferPool.h"		// Needed for CBufferPool
 #include "Packet.h"		// Needed for CPacket
 #include "PartFile.h"		// Needed for CPartFile
 #include "SearchList.h"		// Needed for CSearchList
@@ -287,6 +288,7 @@ void CServerUDPSocket::ProcessPacket(CMemFile& packet, uint8 opcode, uint32 ip,
 									break;
 								case ST_DYNIP:
 									update->SetDynIP(tag.GetStr());
+									theApp->serverlist->UpdateServerIndex(update);
 									break;
 								case ST_VERSION:
 									if (tag.IsStr()) {
@@ -365,7 +367,7 @@ void CServerUDPSocket::SendPacket(CPacket* packet, CServer* host, bool delPacket
 	// We might need to encrypt the packet for this server.
 	if (!rawpacket && thePrefs::IsServerCryptLayerUDPEnabled() && host->GetServerKeyUDP() != 0 && host->SupportsObfuscationUDP()) {
 		uint16 uRawPacketSize = packet->GetPacketSize() + 2;
-		byte* pRawPacket = new byte[uRawPacketSize];
+		byte* pRawPacket = CBufferPool::Allocate(uRawPacketSize);
 		memcpy(pRawPacket, packet->GetUDPHeader(), 2);
 		memcpy(pRawPacket + 2, packet->GetDataBuffer(), packet->GetPacketSize());
 
@@ -375,7 +377,7 @@ void CServerUDPSocket::SendPacket(CPacket* packet, CServer* host, bool delPacket
 
 		CMemFile encryptedpacket(pRawPacket + 2, uRawPacketSize - 2);
 		item.packet  = new CPacket(encryptedpacket, pRawPacket[0], pRawPacket[1]);
-		delete[] pRawPacket;
+		CBufferPool::Free(pRawPacket);
 
 		if (delPacket) {
 			delete packet;
@@ -487,6 +489,7 @@ void CServerUDPSocket::OnHostnameResolved(uint32 ip)
 	} else {
 		if (update) {
 			update->SetID(ip);
+			theApp->serverlist->UpdateServerIndex(update);
 		}
 
 		item.addr.Clear();
@@ -0,0 +1,120 @@
+//							-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef SHARDEDCOUNTER_H
+#define SHARDEDCOUNTER_H
+
+#include "Types.h"	// Needed for uint64
+#include "Atomic.h"	// Needed for AtomicAdd
+
+#include <cstddef>	// Needed for size_t
+
+
+/**
+ * Counter that many threads can increase without locking.
+ *
+ * The value is split over a few shards, each on its own cache line, and
+ * every thread adds to the shard picked by its stack address. Threads
+ * thus rarely touch the same cache line, and never wait for each other.
+ * Reading sums up the shards, so reads are slower than writes; this suits
+ * statistics, which are written per packet and read a few times a second.
+ */
+class CShardedCounter
+{
+public:
+	CShardedCounter()
+	{
+		for (unsigned i = 0; i < ShardCount; ++i) {
+			m_shards[i].value = 0;
+		}
+	}
+
+	/** Adds to the counter. */
+	void Add(uint64 value)
+	{
+		AtomicAdd(m_shards[GetShard()].value, value);
+	}
+
+	/** Returns the current value. */
+	uint64 GetValue() const
+	{
+		uint64 sum = 0;
+		for (unsigned i = 0; i < ShardCount; ++i) {
+			sum += Load(i);
+		}
+		return sum;
+	}
+
+	/**
+	 * Returns the current value and resets the counter. Additions made
+	 * meanwhile are kept for the next call.
+	 */
+	uint64 Drain()
+	{
+		uint64 sum = 0;
+		for (unsigned i = 0; i < ShardCount; ++i) {
+			uint64 value = Load(i);
+			AtomicAdd(m_shards[i].value, (uint64)0 - value);
+			sum += value;
+		}
+		return sum;
+	}
+
+private:
+	//@{
+	//! Neither copyable nor assignable.
+	CShardedCounter(const CShardedCounter&);
+	CShardedCounter& operator=(const CShardedCounter&);
+	//@}
+
+	static const unsigned ShardCount = 8;
+	static const unsigned CacheLineSize = 64;
+
+	/**
+	 * Picks the shard of the calling thread. Thread stacks lie far apart,
+	 * so the stack address tells threads apart without asking the OS.
+	 */
+	static unsigned GetShard()
+	{
+		char marker;
+		uint32 page = (uint32)(reinterpret_cast<size_t>(&marker) >> 16);
+		return (page * 2654435761u) >> 29;
+	}
+
+	/** Reads a shard in one piece, even on 32 bit CPUs. */
+	uint64 Load(unsigned shard) const
+	{
+		return AtomicAdd(const_cast<volatile uint64&>(m_shards[shard].value), (uint64)0);
+	}
+
+	struct Shard {
+		volatile uint64	value;
+		char		padding[CacheLineSize - sizeof(uint64)];
+	};
+
+	Shard	m_shards[ShardCount];
+};
+
+#endif // SHARDEDCOUNTER_H
+// File_checked_for_headers
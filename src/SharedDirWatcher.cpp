@@ -0,0 +1,189 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifdef HAVE_CONFIG_H
+#	include "config.h"		// Needed for HAVE_SYS_INOTIFY_H
+#endif
+
+#include "SharedDirWatcher.h"	// Interface declarations
+
+#include "Logger.h"			// Needed for AddLogLine*
+#include <common/Format.h>		// Needed for CFormat
+#include <common/StringFunctions.h>	// Needed for filename2char
+
+#ifdef HAVE_SYS_INOTIFY_H
+#	include <sys/inotify.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <errno.h>
+
+// The events that can change what is shared from a directory. Files are
+// only looked at once they have been closed, not while they are written.
+static const uint32_t WatchedEvents = IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO
+	| IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+#endif
+
+
+CSharedDirWatcher::CSharedDirWatcher()
+	: m_fd(-1),
+	  m_limitLogged(false)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	m_fd = inotify_init();
+	if (m_fd == -1) {
+		AddDebugLogLineN(logKnownFiles, CFormat(wxT("inotify is not available: %m")));
+	} else {
+		fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+		fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+	}
+#endif
+}
+
+
+CSharedDirWatcher::~CSharedDirWatcher()
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	if (m_fd != -1) {
+		close(m_fd);
+	}
+#endif
+}
+
+
+bool CSharedDirWatcher::IsOk() const
+{
+	return m_fd != -1;
+}
+
+
+void CSharedDirWatcher::SetDirectories(const std::list<CPath>& dirs)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	if (m_fd == -1) {
+		return;
+	}
+
+	std::map<CPath, int> oldWatches;
+	oldWatches.swap(m_watches);
+	m_dirs.clear();
+
+	for (std::list<CPath>::const_iterator it = dirs.begin(); it != dirs.end(); ++it) {
+		std::map<CPath, int>::iterator old = oldWatches.find(*it);
+		if (old != oldWatches.end()) {
+			m_watches[*it] = old->second;
+			m_dirs[old->second] = *it;
+			oldWatches.erase(old);
+			continue;
+		}
+
+		int wd = inotify_add_watch(m_fd, filename2char(it->GetRaw()), WatchedEvents);
+		if (wd == -1) {
+			if (errno != ENOSPC) {
+				AddDebugLogLineN(logKnownFiles, CFormat(wxT("Cannot watch shared directory %s: %m")) % *it);
+			} else if (!m_limitLogged) {
+				// fs.inotify.max_user_watches was reached
+				AddLogLineN(CFormat(_("Cannot watch shared directory %s for changes: %m"))
+					% it->GetPrintable());
+				m_limitLogged = true;
+			}
+			continue;
+		}
+		// Two paths to the same directory get the same descriptor
+		if (m_dirs.find(wd) == m_dirs.end()) {
+			m_watches[*it] = wd;
+			m_dirs[wd] = *it;
+		}
+	}
+
+	// Stop watching directories that are no longer shared
+	for (std::map<CPath, int>::iterator it = oldWatches.begin(); it != oldWatches.end(); ++it) {
+		if (m_dirs.find(it->second) == m_dirs.end()) {
+			inotify_rm_watch(m_fd, it->second);
+		}
+	}
+
+	AddDebugLogLineN(logKnownFiles, CFormat(wxT("Watching %u shared directories for changes")) % m_dirs.size());
+#else
+	(void)dirs;
+#endif
+}
+
+
+bool CSharedDirWatcher::GetChanges(std::vector<CChange>& changes)
+{
+	bool complete = true;
+
+#ifdef HAVE_SYS_INOTIFY_H
+	if (m_fd == -1) {
+		return true;
+	}
+
+	// Aligned for struct inotify_event
+	union {
+		char	data[16384];
+		struct inotify_event event;
+	} buf;
+
+	for (;;) {
+		ssize_t len = read(m_fd, buf.data, sizeof(buf.data));
+		if (len <= 0) {
+			if (len == -1 && errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+
+		for (ssize_t pos = 0; pos + (ssize_t)sizeof(struct inotify_event) <= len; ) {
+			const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(buf.data + pos);
+			pos += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				complete = false;
+				continue;
+			}
+
+			std::map<int, CPath>::iterator dir = m_dirs.find(event->wd);
+			if (dir == m_dirs.end()) {
+				continue;
+			}
+
+			if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+				changes.push_back(CChange(dir->second, CPath()));
+				if (event->mask & IN_IGNORED) {
+					// The watch is gone, the next rescan sets it up again if needed
+					m_watches.erase(dir->second);
+					m_dirs.erase(dir);
+				}
+			} else if (event->len && !(event->mask & IN_ISDIR)) {
+				changes.push_back(CChange(dir->second, CPath(char2filename(event->name))));
+			}
+		}
+	}
+#else
+	(void)changes;
+#endif
+
+	return complete;
+}
+// File_checked_for_headers
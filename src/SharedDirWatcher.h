@@ -0,0 +1,94 @@
+//							-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef SHAREDDIRWATCHER_H
+#define SHAREDDIRWATCHER_H
+
+#include <common/Path.h>	// Needed for CPath
+
+#include <list>
+#include <map>
+#include <vector>
+
+
+/**
+ * Reports the files that change in the shared directories, so they can be
+ * added to or removed from the shares without scanning the directories.
+ *
+ * Uses inotify where available. Elsewhere IsOk() returns false and no
+ * changes are ever reported. The watcher is polled, GetChanges() never
+ * blocks, and it must only be used from the main thread.
+ */
+class CSharedDirWatcher
+{
+public:
+	//! A file in a watched directory was written, created, moved or deleted.
+	struct CChange
+	{
+		CChange(const CPath& d, const CPath& n) : dir(d), name(n) {}
+
+		CPath	dir;
+		//! Empty if the directory itself was moved or deleted.
+		CPath	name;
+	};
+
+	CSharedDirWatcher();
+	~CSharedDirWatcher();
+
+	/** Returns true if changes can be watched on this system. */
+	bool IsOk() const;
+
+	/**
+	 * Watches exactly the given directories from now on.
+	 *
+	 * Directories that cannot be watched, for example because the limit
+	 * of watches was reached, are only covered by the next rescan.
+	 */
+	void SetDirectories(const std::list<CPath>& dirs);
+
+	/**
+	 * Appends the changes that happened since the last call.
+	 *
+	 * @return false if changes were lost, because the kernel queue overflowed.
+	 */
+	bool GetChanges(std::vector<CChange>& changes);
+
+private:
+	//! The inotify descriptor, or -1.
+	int	m_fd;
+	//! The watched directories, by watch descriptor.
+	std::map<int, CPath>	m_dirs;
+	//! The watch descriptors, by directory.
+	std::map<CPath, int>	m_watches;
+	//! Set once the limit of watches was reached, so this is only logged once.
+	bool	m_limitLogged;
+
+	/** Not copyable. */
+	CSharedDirWatcher(const CSharedDirWatcher&);
+	/** Not assignable. */
+	CSharedDirWatcher& operator=(const CSharedDirWatcher&);
+};
+
+#endif // SHAREDDIRWATCHER_H
+// File_checked_for_headers
@@ -31,6 +31,9 @@
 
 #include <wx/utils.h>
 
+#include <algorithm>		// Needed for std::find
+#include <set>
+
 #include "Packet.h"		// Needed for CPacket
 #include "MemFile.h"		// Needed for CMemFile
 #include "ServerConnect.h"	// Needed for CServerConnect
@@ -47,14 +50,26 @@
 #include <common/FileFunctions.h>
 #include "GuiEvents.h"		// Needed for Notify_*
 #include "SHAHashSet.h"		// Needed for CAICHHash
+#include "SharedDirWatcher.h"	// Needed for CSharedDirWatcher
+#include "CFile.h"		// Needed for CFile
 
 
 #include "kademlia/kademlia/Kademlia.h"
 #include "kademlia/kademlia/Search.h"
 #include "ClientList.h"
+#include "updownclient.h"	// Needed for CUpDownClient
 
 typedef std::deque<CKnownFile*> KnownFileArray;
 
+// Version of shareddirstate.dat
+static const uint8 DIRSTATE_VERSION = 1;
+// How long a changed file must stay unchanged before it is shared.
+static const uint32 SHAREDDIR_SETTLE_TIME = SEC2MS(2);
+// How long to wait before trying again to publish something that could not be published.
+static const uint32 PUBLISH_RETRY_TIME = MIN2S(5);
+// The most files or keywords looked at in one turn of Kad publishing.
+static const uint32 PUBLISH_CHECKS_PER_TURN = 1000;
+
 ///////////////////////////////////////////////////////////////////////////////
 // CPublishKeyword
 
@@ -124,6 +139,15 @@ protected:
 ///////////////////////////////////////////////////////////////////////////////
 // CPublishKeywordList
 
+// Hashes a keyword by its address, for CDeadlineQueue.
+struct CPublishKeywordHash
+{
+	uint32 operator()(const CPublishKeyword* keyword) const
+	{
+		return CIntegerHash()(reinterpret_cast<size_t>(keyword));
+	}
+};
+
 class CPublishKeywordList
 {
 public:
@@ -141,8 +165,12 @@ public:
 
 	int GetCount() const { return m_lstKeywords.size(); }
 
-	CPublishKeyword* GetNextKeyword();
-	void ResetNextKeyword();
+	/** Returns the keyword that is due for publishing first, or NULL if none is due. */
+	CPublishKeyword* GetNextKeyword(uint32 tNow) const;
+	/** Sets when the keyword is to be published next. */
+	void SetKeywordPublishTime(CPublishKeyword* pPubKw, uint32 tNextPublishTime);
+	/** Returns the number of keywords due for publishing. */
+	uint32 GetDueCount(uint32 tNow) const { return m_queue.CountDue(tNow); }
 
 	uint32 GetNextPublishTime() const { return m_tNextPublishKeywordTime; }
 	void SetNextPublishTime(uint32 tNextPublishKeywordTime) { m_tNextPublishKeywordTime = tNextPublishKeywordTime; }
@@ -152,7 +180,8 @@ protected:
 	//CTypedPtrMap<CMapStringToPtr, CString, CPublishKeyword*> m_lstKeywords;
 	typedef std::list<CPublishKeyword*> CKeyWordList;
 	CKeyWordList m_lstKeywords;
-	CKeyWordList::iterator m_posNextKeyword;
+	//! The keywords by the time they are to be published next.
+	CDeadlineQueue<CPublishKeyword*, CPublishKeywordHash> m_queue;
 	uint32 m_tNextPublishKeywordTime;
 
 	CPublishKeyword* FindKeyword(const wxString& rstrKeyword, CKeyWordList::iterator* ppos = NULL);
@@ -160,7 +189,6 @@ protected:
 
 CPublishKeywordList::CPublishKeywordList()
 {
-	ResetNextKeyword();
 	SetNextPublishTime(0);
 }
 
@@ -169,20 +197,18 @@ CPublishKeywordList::~CPublishKeywordList()
 	RemoveAllKeywords();
 }
 
-CPublishKeyword* CPublishKeywordList::GetNextKeyword()
+CPublishKeyword* CPublishKeywordList::GetNextKeyword(uint32 tNow) const
 {
-	if (m_posNextKeyword == m_lstKeywords.end()) {
-		m_posNextKeyword = m_lstKeywords.begin();
-		if (m_posNextKeyword == m_lstKeywords.end()) {
-			return NULL;
-		}
+	if (m_queue.empty() || m_queue.GetFirstDeadline() > tNow) {
+		return NULL;
 	}
-	return *m_posNextKeyword++;
+	return m_queue.GetFirst();
 }
 
-void CPublishKeywordList::ResetNextKeyword()
+void CPublishKeywordList::SetKeywordPublishTime(CPublishKeyword* pPubKw, uint32 tNextPublishTime)
 {
-	m_posNextKeyword = m_lstKeywords.begin();
+	pPubKw->SetNextPublishTime(tNextPublishTime);
+	m_queue.Set(pPubKw, tNextPublishTime);
 }
 
 CPublishKeyword* CPublishKeywordList::FindKeyword(const wxString& rstrKeyword, CKeyWordList::iterator* ppos)
@@ -208,6 +234,7 @@ void CPublishKeywordList::AddKeyword(const wxString& keyword, CKnownFile *file)
 	if (pubKw == NULL) {
 		pubKw = new CPublishKeyword(keyword);
 		m_lstKeywords.push_back(pubKw);
+		m_queue.Set(pubKw, pubKw->GetNextPublishTime());
 		SetNextPublishTime(0);
 	}
 	pubKw->AddRef(file);
@@ -229,9 +256,7 @@ void CPublishKeywordList::RemoveKeyword(const wxString& keyword, CKnownFile *fil
 	CPublishKeyword* pubKw = FindKeyword(keyword, &pos);
 	if (pubKw != NULL) {
 		if (pubKw->RemoveRef(file) == 0) {
-			if (pos == m_posNextKeyword) {
-				++m_posNextKeyword;
-			}
+			m_queue.Remove(pubKw);
 			m_lstKeywords.erase(pos);
 			delete pubKw;
 			SetNextPublishTime(0);
@@ -252,7 +277,7 @@ void CPublishKeywordList::RemoveKeywords(CKnownFile* pFile)
 void CPublishKeywordList::RemoveAllKeywords()
 {
 	DeleteContents(m_lstKeywords);
-	ResetNextKeyword();
+	m_queue.clear();
 	SetNextPublishTime(0);
 }
 
@@ -272,9 +297,7 @@ void CPublishKeywordList::PurgeUnreferencedKeywords()
 	while (it != m_lstKeywords.end()) {
 		CPublishKeyword* pPubKw = *it;
 		if (pPubKw->GetRefCount() == 0) {
-			if (it == m_posNextKeyword) {
-				++m_posNextKeyword;
-			}
+			m_queue.Remove(pPubKw);
 			m_lstKeywords.erase(it++);
 			delete pPubKw;
 			SetNextPublishTime(0);
@@ -292,21 +315,24 @@ CSharedFileList::CSharedFileList(CKnownFileList* in_filelist){
 	m_lastPublishED2KFlag = true;
 	/* Kad Stuff */
 	m_keywords = new CPublishKeywordList;
-	m_currFileSrc = 0;
-	m_currFileNotes = 0;
 	m_lastPublishKadSrc = 0;
 	m_lastPublishKadNotes = 0;
+	m_lastPublishBuddyIP = 0;
 	m_currFileKey = 0;
+	m_dirStatesLoaded = false;
+	m_dirStatesHidden = false;
+	m_watcher = new CSharedDirWatcher;
 }
 
 
 CSharedFileList::~CSharedFileList()
 {
+	delete m_watcher;
 	delete m_keywords;
 }
 
 
-void CSharedFileList::FindSharedFiles()
+void CSharedFileList::FindSharedFiles(bool full)
 {
 	/* Abort loading if we are shutting down. */
 	if(theApp->IsOnShutDown()) {
@@ -321,7 +347,9 @@ void CSharedFileList::FindSharedFiles()
 
 	{
 		wxMutexLocker lock(list_mut);
-		m_Files_map.clear();
+		m_files.clear();
+		m_publishSrcQueue.clear();
+		m_publishNotesQueue.clear();
 	}
 
 	// All part files are automatically shared.
@@ -350,14 +378,40 @@ void CSharedFileList::FindSharedFiles()
 	sharedPaths.sort();
 	sharedPaths.unique();
 
-	filelist->PrepareIndex();
+	if (!m_dirStatesLoaded) {
+		LoadDirStates();
+		m_dirStatesLoaded = true;
+	}
+
+	// The states only tell which files were found with the same setting.
+	if (m_dirStatesHidden != thePrefs::ShareHiddenFiles()) {
+		m_dirStates.clear();
+		m_dirStatesHidden = thePrefs::ShareHiddenFiles();
+	}
+
+	// Forget the directories that are no longer shared.
+	for (DirStateMap::iterator it = m_dirStates.begin(); it != m_dirStates.end(); ) {
+		if (std::find(sharedPaths.begin(), sharedPaths.end(), it->first) == sharedPaths.end()) {
+			m_dirStates.erase(it++);
+		} else {
+			++it;
+		}
+	}
+
+	// Changes seen from now on are not covered by this scan.
+	m_changedPaths.clear();
+	m_watcher->SetDirectories(sharedPaths);
+	std::vector<CSharedDirWatcher::CChange> ignored;
+	m_watcher->GetChanges(ignored);
+
 	// Gathering is done in the foreground and can be slowed down severely by parallel background hashing.
 	// So just store the hashing tasks for now.
 	TaskList hashTasks;
 	for (std::list<CPath>::iterator it = sharedPaths.begin(); it != sharedPaths.end(); ++it) {
-		AddFilesFromDirectory(*it, hashTasks);
+		AddFilesFromDirectory(*it, hashTasks, full);
 	}
-	filelist->ReleaseIndex();
+
+	SaveDirStates();
 
 	// Now that the shared files are gathered feed the hashing tasks to the scheduler to start hashing.
 	unsigned addedFiles = 0;
@@ -392,7 +446,7 @@ bool CheckDirectory(const wxString& a, const CPath& b)
 }
 
 
-unsigned CSharedFileList::AddFilesFromDirectory(const CPath& directory, TaskList & hashTasks)
+unsigned CSharedFileList::AddFilesFromDirectory(const CPath& directory, TaskList & hashTasks, bool full)
 {
 	// Do not allow these folders to be shared:
 	//  - The .aMule folder
@@ -410,9 +464,32 @@ unsigned CSharedFileList::AddFilesFromDirectory(const CPath& directory, TaskList
 		AddLogLineNS(CFormat(_("Shared directory not found, skipping: %s"))
 			% directory.GetPrintable());
 
+		m_dirStates.erase(directory);
 		return 0;
 	}
 
+	// Taken before listing the directory, so that changes made while
+	// listing it do not go unnoticed the next time.
+	time_t dirDate = CPath::GetModificationTime(directory);
+	uint32 dirEntries = 0;
+	{
+		// Counting does not need a stat() per entry, unlike listing files.
+		CDirIterator countDir(directory);
+		for (CPath name = countDir.GetFirstFile(CDirIterator::Any); name.IsOk(); name = countDir.GetNextFile()) {
+			dirEntries++;
+		}
+	}
+
+	DirStateMap::iterator known = m_dirStates.find(directory);
+	if (known != m_dirStates.end()) {
+		if (!full && (dirDate != (time_t)-1) && (known->second.mtime == dirDate) && (known->second.entries == dirEntries)) {
+			if (AddFilesFromDirState(directory, known->second)) {
+				return 0;
+			}
+		}
+		m_dirStates.erase(known);
+	}
+
 	CDirIterator::FileType searchFor = CDirIterator::FileNoHidden;
 	if (thePrefs::ShareHiddenFiles()) {
 		 searchFor = CDirIterator::File;
@@ -420,6 +497,8 @@ unsigned CSharedFileList::AddFilesFromDirectory(const CPath& directory, TaskList
 
 	unsigned knownFiles = 0;
 	unsigned addedFiles = 0;
+	bool complete = true;
+	CDirState state;
 
 	CDirIterator SharedDir(directory);
 
@@ -442,6 +521,7 @@ unsigned CSharedFileList::AddFilesFromDirectory(const CPath& directory, TaskList
 		if ((fdate == (time_t)-1) || (fsize == wxInvalidOffset)) {
 			AddDebugLogLineN(logKnownFiles,
 				CFormat(wxT("Failed to retrieve modification time or size for '%s', skipping.")) % fullPath);
+			complete = false;
 			continue;
 		}
 
@@ -455,6 +535,7 @@ unsigned CSharedFileList::AddFilesFromDirectory(const CPath& directory, TaskList
 		CKnownFile* toadd = filelist->FindKnownFile(fname, fdate, fsize);
 		if (toadd) {
 			knownFiles++;
+			state.files.push_back(toadd->GetFileHash());
 			if (AddFile(toadd)) {
 				AddDebugLogLineN(logKnownFiles,
 					CFormat(wxT("Added known file '%s' to shares"))
@@ -481,19 +562,124 @@ unsigned CSharedFileList::AddFilesFromDirectory(const CPath& directory, TaskList
 			% directory.GetPrintable());
 	}
 
+	// Only remember directories whose files are all known. A directory
+	// changed in the second it was listed could have the same time later.
+	if (complete && (addedFiles == 0) && (dirDate != (time_t)-1) && (dirDate < time(NULL) - 1)) {
+		state.mtime = dirDate;
+		state.entries = dirEntries;
+		m_dirStates[directory] = state;
+	}
+
 	return addedFiles;
 }
 
 
+bool CSharedFileList::AddFilesFromDirState(const CPath& directory, const CDirState& state)
+{
+	std::vector<CKnownFile*> files;
+	files.reserve(state.files.size());
+	for (std::vector<CMD4Hash>::const_iterator it = state.files.begin(); it != state.files.end(); ++it) {
+		CKnownFile* file = filelist->FindKnownFileByID(*it);
+		if (file == NULL) {
+			// known.met was changed behind our back, list the directory
+			return false;
+		}
+		files.push_back(file);
+	}
+
+	AddDebugLogLineN(logKnownFiles,
+		CFormat(wxT("Shared directory unchanged, adding %u known files: %s")) % files.size() % directory);
+
+	for (std::vector<CKnownFile*>::iterator it = files.begin(); it != files.end(); ++it) {
+		if (AddFile(*it)) {
+			(*it)->SetFilePath(directory);
+		}
+	}
+
+	if (files.empty()) {
+		AddLogLineN(CFormat(_("No shareable files found in directory: %s"))
+			% directory.GetPrintable());
+	}
+
+	return true;
+}
+
+
+void CSharedFileList::LoadDirStates()
+{
+	CPath fullpath = CPath(thePrefs::GetConfigDir() + wxT("shareddirstate.dat"));
+	if (!fullpath.FileExists()) {
+		return;
+	}
+
+	CFile file;
+	if (!file.Open(fullpath)) {
+		return;
+	}
+
+	try {
+		if (file.ReadUInt8() != DIRSTATE_VERSION) {
+			return;
+		}
+		m_dirStatesHidden = file.ReadUInt8() != 0;
+
+		uint32 count = file.ReadUInt32();
+		for (uint32 i = 0; i < count; ++i) {
+			CPath dir = CPath::FromUniv(file.ReadString(true));
+			CDirState& state = m_dirStates[dir];
+			state.mtime = (time_t)file.ReadUInt64();
+			state.entries = file.ReadUInt32();
+			uint32 files = file.ReadUInt32();
+			state.files.reserve(files);
+			for (uint32 j = 0; j < files; ++j) {
+				state.files.push_back(file.ReadHash());
+			}
+		}
+	} catch (const CSafeIOException& e) {
+		AddDebugLogLineN(logKnownFiles, CFormat(wxT("Failed to read shareddirstate.dat: %s")) % e.what());
+		// Every directory will be listed again
+		m_dirStates.clear();
+	}
+}
+
+
+void CSharedFileList::SaveDirStates()
+{
+	CFile file(thePrefs::GetConfigDir() + wxT("shareddirstate.dat"), CFile::write_safe);
+	if (!file.IsOpened()) {
+		return;
+	}
+
+	try {
+		file.WriteUInt8(DIRSTATE_VERSION);
+		file.WriteUInt8(m_dirStatesHidden ? 1 : 0);
+		file.WriteUInt32(m_dirStates.size());
+		for (DirStateMap::const_iterator it = m_dirStates.begin(); it != m_dirStates.end(); ++it) {
+			file.WriteString(CPath::ToUniv(it->first), utf8strRaw);
+			file.WriteUInt64(it->second.mtime);
+			file.WriteUInt32(it->second.entries);
+			file.WriteUInt32(it->second.files.size());
+			for (std::vector<CMD4Hash>::const_iterator hash = it->second.files.begin(); hash != it->second.files.end(); ++hash) {
+				file.WriteHash(*hash);
+			}
+		}
+		file.Close();
+	} catch (const CIOFailureException& e) {
+		AddLogLineC(CFormat(_("Error while saving %s file: %s")) % wxT("shareddirstate.dat") % e.what());
+	}
+}
+
+
 bool CSharedFileList::AddFile(CKnownFile* pFile)
 {
 	wxASSERT(pFile->GetHashCount() == pFile->GetED2KPartHashCount());
 
 	wxMutexLocker lock(list_mut);
 
-	CKnownFileMap::value_type entry(pFile->GetFileHash(), pFile);
-	if (m_Files_map.insert(entry).second) {
-		/* Keywords to publish on Kad */
+	if (m_files.Add(pFile)) {
+		/* Sources, notes and keywords to publish on Kad */
+		m_publishSrcQueue.Set(pFile->GetFileHash(), pFile->GetLastPublishTimeKadSrc());
+		m_publishNotesQueue.Set(pFile->GetFileHash(), pFile->GetLastPublishTimeKadNotes());
 		m_keywords->AddKeywords(pFile);
 		theStats::AddSharedFile(pFile->GetFileSize());
 		return true;
@@ -522,7 +708,9 @@ void CSharedFileList::SafeAddKFile(CKnownFile* toadd, bool bOnlyAdd)
 void CSharedFileList::RemoveFile(CKnownFile* toremove){
 	Notify_SharedFilesRemoveFile(toremove);
 	wxMutexLocker lock(list_mut);
-	if (m_Files_map.erase(toremove->GetFileHash()) > 0) {
+	if (m_files.Remove(toremove->GetFileHash())) {
+		m_publishSrcQueue.Remove(toremove->GetFileHash());
+		m_publishNotesQueue.Remove(toremove->GetFileHash());
 		theStats::RemoveSharedFile(toremove->GetFileSize());
 	}
 	/* This file keywords must not be published to kad anymore */
@@ -530,7 +718,7 @@ void CSharedFileList::RemoveFile(CKnownFile* toremove){
 }
 
 
-void CSharedFileList::Reload()
+void CSharedFileList::Reload(bool full)
 {
 	// Madcat - Disable reloading if reloading already in progress.
 	// Kry - Fixed to let non-english language users use the 'Reload' button :P
@@ -547,7 +735,7 @@ void CSharedFileList::Reload()
 		/* Public identifiers must be erased as they might be invalid now */
 		m_PublicSharedDirNames.clear();
 
-		FindSharedFiles();
+		FindSharedFiles(full);
 
 		/* And now the unreferenced keywords must be removed also */
 		m_keywords->PurgeUnreferencedKeywords();
@@ -559,28 +747,10 @@ void CSharedFileList::Reload()
 }
 
 
-const CKnownFile *CSharedFileList::GetFileByIndex(unsigned int index) const
-{
-	wxMutexLocker lock(list_mut);
-	if ( index >= m_Files_map.size() ) {
-		return NULL;
-	}
-	CKnownFileMap::const_iterator pos = m_Files_map.begin();
-	std::advance(pos, index);
-	return pos->second;
-}
-
-
 CKnownFile*	CSharedFileList::GetFileByID(const CMD4Hash& filehash)
 {
 	wxMutexLocker lock(list_mut);
-	CKnownFileMap::iterator it = m_Files_map.find(filehash);
-
-	if ( it != m_Files_map.end() ) {
-		return it->second;
-	} else {
-		return NULL;
-	}
+	return m_files.Find(filehash);
 }
 
 short CSharedFileList::GetFilePriorityByID(const CMD4Hash& filehash)
@@ -597,14 +767,7 @@ void CSharedFileList::CopyFileList(std::vector<CKnownFile*>& out_list) const
 {
 	wxMutexLocker lock(list_mut);
 
-	out_list.reserve(m_Files_map.size());
-	for (
-		CKnownFileMap::const_iterator it = m_Files_map.begin();
-		it != m_Files_map.end();
-		++it
-		) {
-		out_list.push_back(it->second);
-	}
+	m_files.Copy(out_list);
 }
 
 
@@ -621,9 +784,9 @@ void CSharedFileList::GetSharedFilesByDirectory(const wxString& directory,
 	wxMutexLocker lock(list_mut);
 
 	const CPath dir = CPath(directory);
-	for (CKnownFileMap::iterator pos = m_Files_map.begin();
-	     pos != m_Files_map.end(); ++pos ) {
-		CKnownFile *cur_file = pos->second;
+	for (CSharedFileTable<CKnownFile>::const_iterator pos = m_files.begin();
+	     pos != m_files.end(); ++pos ) {
+		CKnownFile *cur_file = *pos;
 
 		if (dir.IsSameDir(cur_file->GetFilePath())) {
 			list.push_back(cur_file);
@@ -637,8 +800,8 @@ void CSharedFileList::ClearED2KPublishInfo(){
 	CKnownFile* cur_file;
 	m_lastPublishED2KFlag = true;
 	wxMutexLocker lock(list_mut);
-	for (CKnownFileMap::iterator pos = m_Files_map.begin(); pos != m_Files_map.end(); ++pos ) {
-		cur_file = pos->second;
+	for (CSharedFileTable<CKnownFile>::const_iterator pos = m_files.begin(); pos != m_files.end(); ++pos ) {
+		cur_file = *pos;
 		cur_file->SetPublishedED2K(false);
 	}
 }
@@ -647,9 +810,10 @@ void CSharedFileList::ClearKadSourcePublishInfo()
 {
 	wxMutexLocker lock(list_mut);
 	CKnownFile* cur_file;
-	for (CKnownFileMap::iterator pos = m_Files_map.begin(); pos != m_Files_map.end(); ++pos ) {
-		cur_file = pos->second;
+	for (CSharedFileTable<CKnownFile>::const_iterator pos = m_files.begin(); pos != m_files.end(); ++pos ) {
+		cur_file = *pos;
 		cur_file->SetLastPublishTimeKadSrc(0,0);
+		m_publishSrcQueue.Set(cur_file->GetFileHash(), 0);
 	}
 }
 
@@ -685,17 +849,17 @@ void CSharedFileList::SendListToServer(){
 	{
 		wxMutexLocker lock(list_mut);
 
-		if (m_Files_map.empty() || !theApp->IsConnectedED2K() ) {
+		if (m_files.empty() || !theApp->IsConnectedED2K() ) {
 			return;
 		}
 
 		// Getting a sorted list of the non-published files.
-		SortedList.reserve( m_Files_map.size() );
+		SortedList.reserve( m_files.size() );
 
-		CKnownFileMap::iterator it = m_Files_map.begin();
-		for ( ; it != m_Files_map.end(); ++it ) {
-			if (!it->second->GetPublishedED2K()) {
-				SortedList.push_back( it->second );
+		CSharedFileTable<CKnownFile>::const_iterator it = m_files.begin();
+		for ( ; it != m_files.end(); ++it ) {
+			if (!(*it)->GetPublishedED2K()) {
+				SortedList.push_back( *it );
 			}
 		}
 	}
@@ -756,6 +920,7 @@ void CSharedFileList::SendListToServer(){
 
 void CSharedFileList::Process()
 {
+	ProcessDirChanges();
 	Publish();
 	if( !m_lastPublishED2KFlag || ( ::GetTickCount() - m_lastPublishED2K < ED2KREPUBLISHTIME ) ) {
 		return;
@@ -764,6 +929,150 @@ void CSharedFileList::Process()
 	m_lastPublishED2K = ::GetTickCount();
 }
 
+void CSharedFileList::ProcessDirChanges()
+{
+	if (reloading || !m_watcher->IsOk()) {
+		return;
+	}
+
+	std::vector<CSharedDirWatcher::CChange> changes;
+	if (!m_watcher->GetChanges(changes)) {
+		AddDebugLogLineN(logKnownFiles, wxT("Too many changes in the shared directories, rescanning them"));
+		Reload(true);
+		return;
+	}
+
+	uint32 now = ::GetTickCount();
+	for (std::vector<CSharedDirWatcher::CChange>::iterator it = changes.begin(); it != changes.end(); ++it) {
+		m_changedPaths[ChangedPath(it->dir, it->name)] = now;
+	}
+
+	// Wait until a file has been left alone for a while, it might be
+	// copied in several steps or be replaced right after it was written.
+	std::vector<ChangedPath> changed;
+	bool dirChanged = false;
+	for (ChangedPathMap::iterator it = m_changedPaths.begin(); it != m_changedPaths.end(); ) {
+		if (now - it->second >= SHAREDDIR_SETTLE_TIME) {
+			m_dirStates.erase(it->first.first);
+			if (it->first.second.IsOk()) {
+				changed.push_back(it->first);
+			} else {
+				dirChanged = true;
+			}
+			m_changedPaths.erase(it++);
+		} else {
+			++it;
+		}
+	}
+
+	if (dirChanged) {
+		// A shared directory was moved or deleted, the other directories are not listed again.
+		Reload();
+	} else if (!changed.empty()) {
+		UpdateChangedFiles(changed);
+		SaveDirStates();
+	}
+}
+
+
+void CSharedFileList::UpdateChangedFiles(const std::vector<ChangedPath>& changed)
+{
+	std::set<CPath> dirs;
+	for (std::vector<ChangedPath>::const_iterator it = changed.begin(); it != changed.end(); ++it) {
+		dirs.insert(it->first);
+	}
+
+	// The shared files in the changed directories, by full path.
+	std::map<CPath, CKnownFile*> sharedPaths;
+	// Names of downloads being completed, they are shared once they are done.
+	std::set<CPath> completing;
+	{
+		wxMutexLocker lock(list_mut);
+		for (CSharedFileTable<CKnownFile>::const_iterator it = m_files.begin(); it != m_files.end(); ++it) {
+			CKnownFile* file = *it;
+			if (file->IsPartFile()) {
+				if (file->GetStatus() == PS_COMPLETING) {
+					completing.insert(file->GetFileName());
+				}
+			} else if (dirs.count(file->GetFilePath())) {
+				sharedPaths[file->GetFilePath().JoinPaths(file->GetFileName())] = file;
+			}
+		}
+	}
+
+	// First take out the files that changed or are gone ...
+	std::vector<CKnownFile*> removed;
+	std::vector<ChangedPath> added;
+	for (std::vector<ChangedPath>::const_iterator it = changed.begin(); it != changed.end(); ++it) {
+		if (completing.count(it->second)) {
+			continue;
+		}
+
+		CPath fullPath = it->first.JoinPaths(it->second);
+		time_t fdate = (time_t)-1;
+		sint64 fsize = 0;
+		bool exists = fullPath.FileExists()
+			&& (thePrefs::ShareHiddenFiles() || !it->second.GetRaw().StartsWith(wxT(".")));
+		if (exists) {
+			fdate = CPath::GetModificationTime(fullPath);
+			fsize = fullPath.GetFileSize();
+			exists = (fdate != (time_t)-1) && (fsize != wxInvalidOffset) && (fsize != 0);
+		}
+
+		std::map<CPath, CKnownFile*>::iterator shared = sharedPaths.find(fullPath);
+		if (shared != sharedPaths.end()) {
+			CKnownFile* file = shared->second;
+			if (exists && (file->GetLastChangeDatetime() == fdate) && ((sint64)file->GetFileSize() == fsize)) {
+				continue;
+			}
+			AddDebugLogLineN(logKnownFiles, CFormat(wxT("Shared file changed or removed: %s")) % fullPath);
+			RemoveFile(file);
+			removed.push_back(file);
+		}
+
+		if (exists) {
+			added.push_back(*it);
+		}
+	}
+
+	// ... then add the new ones, which might be the same files under another name.
+	bool newFiles = false;
+	for (std::vector<ChangedPath>::iterator it = added.begin(); it != added.end(); ++it) {
+		CPath fullPath = it->first.JoinPaths(it->second);
+		time_t fdate = CPath::GetModificationTime(fullPath);
+		uint64 fsize = fullPath.GetFileSize();
+
+		CKnownFile* toadd = filelist->FindKnownFile(it->second, fdate, fsize);
+		if (toadd == NULL) {
+			for (std::vector<CKnownFile*>::iterator file = removed.begin(); file != removed.end(); ++file) {
+				if (((*file)->GetLastChangeDatetime() == fdate) && ((*file)->GetFileSize() == fsize)) {
+					AddDebugLogLineN(logKnownFiles, CFormat(wxT("Shared file renamed to %s")) % fullPath);
+					toadd = *file;
+					toadd->SetFileName(it->second);
+					removed.erase(file);
+					break;
+				}
+			}
+		}
+
+		if (toadd) {
+			toadd->SetFilePath(it->first);
+			if (AddFile(toadd)) {
+				Notify_SharedFilesShowFile(toadd);
+				newFiles = true;
+			}
+		} else {
+			AddDebugLogLineN(logKnownFiles, CFormat(wxT("Hashing new shared file '%s'")) % fullPath);
+			CThreadScheduler::AddTask(new CHashingTask(it->first, it->second));
+		}
+	}
+
+	if (newFiles) {
+		m_lastPublishED2KFlag = true;
+	}
+}
+
+
 void CSharedFileList::Publish()
 {
 	// Variables to save cpu.
@@ -773,114 +1082,182 @@ void CSharedFileList::Publish()
 	if( Kademlia::CKademlia::IsConnected() && ( !IsFirewalled || ( IsFirewalled && theApp->clientlist->GetBuddyStatus() == Connected)) && GetCount() && Kademlia::CKademlia::GetPublish()) {
 		//We are connected to Kad. We are either open or have a buddy. And Kad is ready to start publishing.
 
-		if( Kademlia::CKademlia::GetTotalStoreKey() < KADEMLIATOTALSTOREKEY) {
-
-			//We are not at the max simultaneous keyword publishes
-			if (tNow >= m_keywords->GetNextPublishTime()) {
-
-				//Enough time has passed since last keyword publish
-
-				//Get the next keyword which has to be (re)-published
-				CPublishKeyword* pPubKw = m_keywords->GetNextKeyword();
-				if (pPubKw) {
-
-					//We have the next keyword to check if it can be published
-
-					//Debug check to make sure things are going well.
-					wxASSERT( pPubKw->GetRefCount() != 0 );
-
-					if (tNow >= pPubKw->GetNextPublishTime()) {
-						//This keyword can be published.
-						Kademlia::CSearch* pSearch = Kademlia::CSearchManager::PrepareLookup(Kademlia::CSearch::STOREKEYWORD, false, pPubKw->GetKadID());
-						if (pSearch) {
-							//pSearch was created. Which means no search was already being done with this HashID.
-							//This also means that it was checked to see if network load wasn't a factor.
-
-							//This sets the filename into the search object so we can show it in the gui.
-							pSearch->SetFileName(pPubKw->GetKeyword());
-
-							//Add all file IDs which relate to the current keyword to be published
-							const KnownFileArray& aFiles = pPubKw->GetReferences();
-							uint32 count = 0;
-							for (unsigned int f = 0; f < aFiles.size(); ++f) {
-
-								//Only publish complete files as someone else should have the full file to publish these keywords.
-								//As a side effect, this may help reduce people finding incomplete files in the network.
-								if( !aFiles[f]->IsPartFile() ) {
-									count++;
-									pSearch->AddFileID(Kademlia::CUInt128(aFiles[f]->GetFileHash().GetHash()));
-									if( count > 150 ) {
-										//We only publish up to 150 files per keyword publish then rotate the list.
-										pPubKw->RotateReferences(f);
-										break;
-									}
-								}
-							}
-
-							if( count ) {
-								//Start our keyword publish
-								pPubKw->SetNextPublishTime(tNow+(KADEMLIAREPUBLISHTIMEK));
-								pPubKw->IncPublishedCount();
-								Kademlia::CSearchManager::StartSearch(pSearch);
-							} else {
-								//There were no valid files to publish with this keyword.
-								delete pSearch;
-							}
-						}
-					}
+		if (IsFirewalled) {
+			// Sources point to the buddy, so all of them are due again when it changed.
+			CUpDownClient* buddy = theApp->clientlist->GetBuddy();
+			uint32 buddyIP = buddy ? buddy->GetIP() : 0;
+			if (buddyIP && buddyIP != m_lastPublishBuddyIP) {
+				wxMutexLocker lock(list_mut);
+				for (CSharedFileTable<CKnownFile>::const_iterator it = m_files.begin(); it != m_files.end(); ++it) {
+					m_publishSrcQueue.Set((*it)->GetFileHash(), 0);
 				}
-				m_keywords->SetNextPublishTime(KADEMLIAPUBLISHTIME+tNow);
+				m_lastPublishBuddyIP = buddyIP;
 			}
 		}
 
-		if( Kademlia::CKademlia::GetTotalStoreSrc() < KADEMLIATOTALSTORESRC) {
-			if(tNow >= m_lastPublishKadSrc) {
-				if(m_currFileSrc > GetCount()) {
-					m_currFileSrc = 0;
-				}
-				CKnownFile* pCurKnownFile = const_cast<CKnownFile*>(GetFileByIndex(m_currFileSrc));
-				if(pCurKnownFile) {
-					if(pCurKnownFile->PublishSrc()) {
-						Kademlia::CUInt128 kadFileID;
-						kadFileID.SetValueBE(pCurKnownFile->GetFileHash().GetHash());
-						if(Kademlia::CSearchManager::PrepareLookup(Kademlia::CSearch::STOREFILE, true, kadFileID )==NULL) {
-							pCurKnownFile->SetLastPublishTimeKadSrc(0,0);
-						}
-					}
-				}
-				m_currFileSrc++;
+		if (tNow >= m_keywords->GetNextPublishTime()) {
+			PublishKeywords(tNow);
+			m_keywords->SetNextPublishTime(KADEMLIAPUBLISHTIME+tNow);
+		}
 
-				// even if we did not publish a source, reset the timer so that this list is processed
-				// only every KADEMLIAPUBLISHTIME seconds.
-				m_lastPublishKadSrc = KADEMLIAPUBLISHTIME+tNow;
-			}
+		if (tNow >= m_lastPublishKadSrc) {
+			PublishFiles(Kademlia::CSearch::STOREFILE, tNow);
+			m_lastPublishKadSrc = KADEMLIAPUBLISHTIME+tNow;
 		}
 
-		if( Kademlia::CKademlia::GetTotalStoreNotes() < KADEMLIATOTALSTORENOTES) {
-			if(tNow >= m_lastPublishKadNotes) {
-				if(m_currFileNotes > GetCount()) {
-					m_currFileNotes = 0;
-				}
-				CKnownFile* pCurKnownFile = const_cast<CKnownFile*>(GetFileByIndex(m_currFileNotes));
-				if(pCurKnownFile) {
-					if(pCurKnownFile->PublishNotes()) {
-						Kademlia::CUInt128 kadFileID;
-						kadFileID.SetValueBE(pCurKnownFile->GetFileHash().GetHash());
-						if(Kademlia::CSearchManager::PrepareLookup(Kademlia::CSearch::STORENOTES, true, kadFileID )==NULL)
-							pCurKnownFile->SetLastPublishTimeKadNotes(0);
-					}
+		if (tNow >= m_lastPublishKadNotes) {
+			PublishFiles(Kademlia::CSearch::STORENOTES, tNow);
+			m_lastPublishKadNotes = KADEMLIAPUBLISHTIME+tNow;
+		}
+	}
+}
+
+
+void CSharedFileList::PublishKeywords(uint32 tNow)
+{
+	uint32 stores = Kademlia::CKademlia::GetTotalStoreKey();
+
+	// Take the keywords in the order they are due, until all store slots are in use.
+	for (uint32 checks = 0; stores < KADEMLIATOTALSTOREKEY && checks < PUBLISH_CHECKS_PER_TURN; ++checks) {
+		CPublishKeyword* pPubKw = m_keywords->GetNextKeyword(tNow);
+		if (pPubKw == NULL) {
+			break;
+		}
+
+		//Debug check to make sure things are going well.
+		wxASSERT( pPubKw->GetRefCount() != 0 );
+
+		//Only publish complete files as someone else should have the full file to publish these keywords.
+		//As a side effect, this may help reduce people finding incomplete files in the network.
+		const KnownFileArray& aFiles = pPubKw->GetReferences();
+		unsigned int f = 0;
+		while (f < aFiles.size() && aFiles[f]->IsPartFile()) {
+			++f;
+		}
+		if (f == aFiles.size()) {
+			//There are no valid files to publish with this keyword yet.
+			m_keywords->SetKeywordPublishTime(pPubKw, tNow + PUBLISH_RETRY_TIME);
+			continue;
+		}
+
+		Kademlia::CSearch* pSearch = Kademlia::CSearchManager::PrepareLookup(Kademlia::CSearch::STOREKEYWORD, false, pPubKw->GetKadID());
+		if (pSearch == NULL) {
+			//Already publishing this keyword, or the network load is too high.
+			m_keywords->SetKeywordPublishTime(pPubKw, tNow + PUBLISH_RETRY_TIME);
+			continue;
+		}
+
+		//This sets the filename into the search object so we can show it in the gui.
+		pSearch->SetFileName(pPubKw->GetKeyword());
+
+		//Add all file IDs which relate to the current keyword to be published
+		uint32 count = 0;
+		for (; f < aFiles.size(); ++f) {
+			if( !aFiles[f]->IsPartFile() ) {
+				count++;
+				pSearch->AddFileID(Kademlia::CUInt128(aFiles[f]->GetFileHash().GetHash()));
+				if( count > 150 ) {
+					//We only publish up to 150 files per keyword publish then rotate the list.
+					pPubKw->RotateReferences(f);
+					break;
 				}
-				m_currFileNotes++;
+			}
+		}
 
-				// even if we did not publish a source, reset the timer so that this list is processed
-				// only every KADEMLIAPUBLISHTIME seconds.
-				m_lastPublishKadNotes = KADEMLIAPUBLISHTIME+tNow;
+		//Start our keyword publish
+		m_keywords->SetKeywordPublishTime(pPubKw, tNow+(KADEMLIAREPUBLISHTIMEK));
+		pPubKw->IncPublishedCount();
+		if (Kademlia::CSearchManager::StartSearch(pSearch)) {
+			stores++;
+		}
+	}
+}
+
+
+void CSharedFileList::PublishFiles(uint32 searchType, uint32 tNow)
+{
+	bool notes = (searchType == Kademlia::CSearch::STORENOTES);
+	CPublishQueue& queue = notes ? m_publishNotesQueue : m_publishSrcQueue;
+	uint32 stores = notes ? Kademlia::CKademlia::GetTotalStoreNotes() : Kademlia::CKademlia::GetTotalStoreSrc();
+	uint32 maxStores = notes ? KADEMLIATOTALSTORENOTES : KADEMLIATOTALSTORESRC;
+
+	// Take the files in the order they are due, until all store slots are in use.
+	// Files that were never published have no publish time and come first.
+	for (uint32 checks = 0; stores < maxStores && checks < PUBLISH_CHECKS_PER_TURN; ++checks) {
+		CKnownFile* pCurKnownFile = GetNextFileToPublish(queue, tNow);
+		if (pCurKnownFile == NULL) {
+			break;
+		}
+
+		uint32 next;
+		if (notes ? pCurKnownFile->PublishNotes() : pCurKnownFile->PublishSrc()) {
+			Kademlia::CUInt128 kadFileID;
+			kadFileID.SetValueBE(pCurKnownFile->GetFileHash().GetHash());
+			if (Kademlia::CSearchManager::PrepareLookup(searchType, true, kadFileID) == NULL) {
+				if (notes) {
+					pCurKnownFile->SetLastPublishTimeKadNotes(0);
+				} else {
+					pCurKnownFile->SetLastPublishTimeKadSrc(0,0);
+				}
+				next = tNow + PUBLISH_RETRY_TIME;
+			} else {
+				stores++;
+				next = notes ? pCurKnownFile->GetLastPublishTimeKadNotes() : pCurKnownFile->GetLastPublishTimeKadSrc();
+			}
+		} else {
+			next = notes ? pCurKnownFile->GetLastPublishTimeKadNotes() : pCurKnownFile->GetLastPublishTimeKadSrc();
+			if (next <= tNow) {
+				// Nothing to publish. Notes are looked at again when the comment or rating changes.
+				next = tNow + (notes ? KADEMLIAREPUBLISHTIMEN : PUBLISH_RETRY_TIME);
 			}
 		}
+
+		wxMutexLocker lock(list_mut);
+		if (m_files.Find(pCurKnownFile->GetFileHash()) == pCurKnownFile) {
+			queue.Set(pCurKnownFile->GetFileHash(), next);
+		}
+	}
+}
+
+
+CKnownFile* CSharedFileList::GetNextFileToPublish(CPublishQueue& queue, uint32 tNow)
+{
+	wxMutexLocker lock(list_mut);
+
+	while (!queue.empty() && queue.GetFirstDeadline() <= tNow) {
+		CKnownFile* file = m_files.Find(queue.GetFirst());
+		if (file) {
+			return file;
+		}
+		queue.Remove(queue.GetFirst());
+	}
+	return NULL;
+}
+
+
+void CSharedFileList::RepublishNotes(CKnownFile* pFile)
+{
+	wxMutexLocker lock(list_mut);
+	if (m_files.Find(pFile->GetFileHash()) == pFile) {
+		m_publishNotesQueue.Set(pFile->GetFileHash(), pFile->GetLastPublishTimeKadNotes());
 	}
 }
 
 
+void CSharedFileList::GetKadPublishStats(CKadPublishStats& stats) const
+{
+	uint32 tNow = time(NULL);
+
+	stats.keywords = m_keywords->GetCount();
+	stats.keywordsDue = m_keywords->GetDueCount(tNow);
+
+	wxMutexLocker lock(list_mut);
+	stats.files = m_files.size();
+	stats.sourcesDue = m_publishSrcQueue.CountDue(tNow);
+	stats.notesDue = m_publishNotesQueue.CountDue(tNow);
+}
+
+
 void CSharedFileList::AddKeywords(CKnownFile* pFile)
 {
 	m_keywords->AddKeywords(pFile);
@@ -1072,9 +1449,9 @@ void CSharedFileList::CheckAICHHashes(const std::list<CAICHHash>& hashes)
 
 	// Now we check that all files which are in the sharedfilelist have a
 	// corresponding hash in our list. Those how don't are queued for hashing.
-	CKnownFileMap::iterator it = m_Files_map.begin();
-	for (; it != m_Files_map.end(); ++it) {
-		const CKnownFile* file = it->second;
+	CSharedFileTable<CKnownFile>::const_iterator it = m_files.begin();
+	for (; it != m_files.end(); ++it) {
+		const CKnownFile* file = *it;
 
 		if (file->IsPartFile() == false) {
 			CAICHHashSet* hashset = file->GetAICHHashset();
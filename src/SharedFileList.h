@@ -28,21 +28,25 @@
 
 #include <list>
 #include <map>
+#include <vector>
 #include <wx/thread.h>		// Needed for wxMutex
 
 #include "Types.h"		// Needed for uint16 and uint64
+#include "MD4Hash.h"		// Needed for CMD4Hash
+#include "SharedFileTable.h"	// Needed for CSharedFileTable
+#include "DeadlineQueue.h"	// Needed for CDeadlineQueue
+#include <common/Path.h>	// Needed for CPath
 
 struct UnknownFile_Struct;
 
 class CKnownFileList;
 class CKnownFile;
 class CMemFile;
-class CMD4Hash;
 class CServer;
 class CPublishKeywordList;
-class CPath;
 class CAICHHash;
 class CThreadTask;
+class CSharedDirWatcher;
 
 
 typedef std::map<CMD4Hash,CKnownFile*> CKnownFileMap;
@@ -53,14 +57,20 @@ class CSharedFileList {
 public:
 	CSharedFileList(CKnownFileList* in_filelist);
 	~CSharedFileList();
-	void	Reload();
+	/**
+	 * Rebuilds the list of shared files.
+	 *
+	 * @param full If false, directories that did not change since they were
+	 *             last scanned are not listed again, their files are taken
+	 *             from the known files.
+	 */
+	void	Reload(bool full = false);
 	void	SafeAddKFile(CKnownFile* toadd, bool bOnlyAdd = false);
 	void	RemoveFile(CKnownFile* toremove);
 	CKnownFile*	GetFileByID(const CMD4Hash& filehash);
 	short	GetFilePriorityByID(const CMD4Hash& filehash);
-	const CKnownFile* GetFileByIndex(unsigned int index) const;
-	size_t	GetCount()	{ wxMutexLocker lock(list_mut); return m_Files_map.size(); }
-	size_t  GetFileCount()	{ wxMutexLocker lock(list_mut); return m_Files_map.size(); }
+	size_t	GetCount()	{ wxMutexLocker lock(list_mut); return m_files.size(); }
+	size_t  GetFileCount()	{ wxMutexLocker lock(list_mut); return m_files.size(); }
 	void	CopyFileList(std::vector<CKnownFile*>& out_list) const;
 	void	UpdateItem(CKnownFile* toupdate);
 	void    GetSharedFilesByDirectory(const wxString& directory, CKnownFilePtrList& list);
@@ -94,6 +104,23 @@ public:
 	void	RemoveKeywords(CKnownFile* pFile);
 	// This is actually unused, but keep it here - will be needed later.
 	void	ClearKadSourcePublishInfo();
+	/** Publishes the notes of a file as soon as possible, after its comment or rating changed. */
+	void	RepublishNotes(CKnownFile* pFile);
+
+	//! How much Kad publishing is behind.
+	struct CKadPublishStats {
+		//! Number of shared files.
+		uint32	files;
+		//! Files whose sources are due for publishing.
+		uint32	sourcesDue;
+		//! Files whose notes are due for publishing, or still have to be checked for notes.
+		uint32	notesDue;
+		//! Number of keywords of the shared files.
+		uint32	keywords;
+		//! Keywords due for publishing.
+		uint32	keywordsDue;
+	};
+	void	GetKadPublishStats(CKadPublishStats& stats) const;
 
 	/**
 	 * Checks for files which missing or wrong AICH hashes.
@@ -104,26 +131,64 @@ public:
 private:
 	typedef std::list<CThreadTask *> TaskList;
 
+	//! What a shared directory looked like when it was last scanned.
+	struct CDirState {
+		//! Modification time of the directory.
+		time_t	mtime;
+		//! Number of entries in the directory.
+		uint32	entries;
+		//! The files that were shared from it.
+		std::vector<CMD4Hash> files;
+	};
+	typedef std::map<CPath, CDirState> DirStateMap;
+	//! A changed file: directory and name, the name is empty if the directory itself changed.
+	typedef std::pair<CPath, CPath> ChangedPath;
+	//! Changed files and when they last changed.
+	typedef std::map<ChangedPath, uint32> ChangedPathMap;
+
+	//! Shared files by the time their sources or notes are to be published next.
+	typedef CDeadlineQueue<CMD4Hash, CMD4HashHash> CPublishQueue;
+
+	void	PublishKeywords(uint32 tNow);
+	/** Publishes the files due in one queue, as far as store slots are free. */
+	void	PublishFiles(uint32 searchType, uint32 tNow);
+	/** Returns the first file of the queue if it is due, or NULL. */
+	CKnownFile*	GetNextFileToPublish(CPublishQueue& queue, uint32 tNow);
+
 	bool	AddFile(CKnownFile* pFile);
-	unsigned	AddFilesFromDirectory(const CPath& directory, TaskList & hashTasks);
-	void	FindSharedFiles();
+	unsigned	AddFilesFromDirectory(const CPath& directory, TaskList & hashTasks, bool full);
+	bool	AddFilesFromDirState(const CPath& directory, const CDirState& state);
+	void	FindSharedFiles(bool full);
 	bool	reloading;
 
+	/* Incremental rescans */
+	void	LoadDirStates();
+	void	SaveDirStates();
+	void	ProcessDirChanges();
+	void	UpdateChangedFiles(const std::vector<ChangedPath>& changed);
+
+	DirStateMap		m_dirStates;
+	bool			m_dirStatesLoaded;
+	bool			m_dirStatesHidden;
+	CSharedDirWatcher*	m_watcher;
+	ChangedPathMap		m_changedPaths;
+
 	void	SendListToServer();
 	uint32 m_lastPublishED2K;
 	bool	 m_lastPublishED2KFlag;
 
 	CKnownFileList*	filelist;
 
-	CKnownFileMap		m_Files_map;
+	CSharedFileTable<CKnownFile>	m_files;
 	mutable wxMutex		list_mut;
 
 	StringPathMap m_PublicSharedDirNames;  //! used for mapping strings to shared directories
 
 	/* Kad Stuff */
 	CPublishKeywordList* m_keywords;
-	unsigned int m_currFileSrc;
-	unsigned int m_currFileNotes;
+	CPublishQueue m_publishSrcQueue;
+	CPublishQueue m_publishNotesQueue;
+	uint32 m_lastPublishBuddyIP;
 	unsigned int m_currFileKey;
 	uint32 m_lastPublishKadSrc;
 	uint32 m_lastPublishKadNotes;
@@ -0,0 +1,156 @@
+//							-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef SHAREDFILETABLE_H
+#define SHAREDFILETABLE_H
+
+#include "HashMap.h"	// Needed for CHashMap
+#include "MD4Hash.h"	// Needed for CMD4Hash
+
+#include <vector>
+
+
+/**
+ * Hashes a CMD4Hash for CHashMap. File hashes are well distributed already,
+ * so the first bytes will do.
+ */
+struct CMD4HashHash
+{
+	uint32 operator()(const CMD4Hash& hash) const
+	{
+		return RawPeekUInt32(hash.GetHash());
+	}
+};
+
+
+/**
+ * The shared files, in a dense array with an index by file hash.
+ *
+ * Files are found by hash and by position in constant time. Removing a
+ * file moves the last file into its place, so positions are only stable
+ * while no file is removed. Every removal, and clear(), increases the
+ * generation, which callers keeping a position between calls can compare
+ * to tell whether it still refers to the same file. Adding a file appends
+ * it and leaves the generation alone.
+ *
+ * KNOWNFILE must provide GetFileHash(), which may not change while the
+ * file is in the table. The table does no locking of its own.
+ */
+template <typename KNOWNFILE>
+class CSharedFileTable
+{
+public:
+	typedef typename std::vector<KNOWNFILE*>::const_iterator const_iterator;
+
+	CSharedFileTable()
+		: m_generation(0)
+	{
+	}
+
+	/** Appends a file, returning false if one with the same hash is present. */
+	bool Add(KNOWNFILE* file)
+	{
+		uint32& index = m_index[file->GetFileHash()];
+		if (index) {
+			return false;
+		}
+		m_files.push_back(file);
+		// Stored one-based, zero is a new entry of the index
+		index = m_files.size();
+		return true;
+	}
+
+	/** Removes the file with this hash, returning the file or NULL. */
+	KNOWNFILE* Remove(const CMD4Hash& hash)
+	{
+		uint32* index = m_index.Lookup(hash);
+		if (index == NULL) {
+			return NULL;
+		}
+
+		uint32 pos = *index - 1;
+		KNOWNFILE* file = m_files[pos];
+		m_index.erase(hash);
+		if (pos + 1 < m_files.size()) {
+			KNOWNFILE* last = m_files.back();
+			m_files[pos] = last;
+			*m_index.Lookup(last->GetFileHash()) = pos + 1;
+		}
+		m_files.pop_back();
+		m_generation++;
+
+		return file;
+	}
+
+	/** Returns the file with this hash, or NULL. */
+	KNOWNFILE* Find(const CMD4Hash& hash) const
+	{
+		const uint32* index = m_index.Lookup(hash);
+		return index ? m_files[*index - 1] : NULL;
+	}
+
+	/** Returns the file at this position, or NULL if past the end. */
+	KNOWNFILE* GetAt(size_t pos) const
+	{
+		return pos < m_files.size() ? m_files[pos] : NULL;
+	}
+
+	/** Returns the position of the file with this hash, or -1. */
+	int GetPosition(const CMD4Hash& hash) const
+	{
+		const uint32* index = m_index.Lookup(hash);
+		return index ? static_cast<int>(*index) - 1 : -1;
+	}
+
+	/** Changes whenever a file was removed and positions may have moved. */
+	uint32 GetGeneration() const	{ return m_generation; }
+
+	/** Appends all files to 'out', in the order of their positions. */
+	void Copy(std::vector<KNOWNFILE*>& out) const
+	{
+		out.insert(out.end(), m_files.begin(), m_files.end());
+	}
+
+	const_iterator begin() const	{ return m_files.begin(); }
+	const_iterator end() const	{ return m_files.end(); }
+	size_t size() const		{ return m_files.size(); }
+	bool empty() const		{ return m_files.empty(); }
+
+	/** Removes all files. */
+	void clear()
+	{
+		m_files.clear();
+		m_index.clear();
+		m_generation++;
+	}
+
+private:
+	std::vector<KNOWNFILE*>	m_files;
+	//! One-based positions in m_files, by file hash.
+	CHashMap<CMD4Hash, uint32, CMD4HashHash>	m_index;
+	uint32	m_generation;
+};
+
+#endif // SHAREDFILETABLE_H
+// File_checked_for_headers
@@ -27,6 +27,8 @@
 
 #include <common/MenuIDs.h>
 
+#include <wx/dcmemory.h>		// Needed for wxMemoryDC
+
 #include "muuli_wdr.h"			// Needed for ID_SHFILELIST
 #include "SharedFilesWnd.h"		// Needed for CSharedFilesWnd
 #include "amuleDlg.h"			// Needed for CamuleDlg
@@ -36,12 +38,13 @@
 #include "amule.h"				// Needed for theApp
 #include "ServerConnect.h"		// Needed for CServerConnect
 #include "Preferences.h"		// Needed for thePrefs
-#include "BarShader.h"			// Needed for CBarShader
+#include "BarShader.h"			// Needed for CBarShader and CBarCache
 #include "DataToText.h"			// Needed for PriorityToStr
 #include "GuiEvents.h"			// Needed for CoreNotify_*
 #include "MuleCollection.h"		// Needed for CMuleCollection
 #include "DownloadQueue.h"		// Needed for CDownloadQueue
 #include "TransferWnd.h"		// Needed for CTransferWnd
+#include "OtherFunctions.h"		// Needed for DeleteContents
 
 
 BEGIN_EVENT_TABLE(CSharedFilesCtrl,CMuleListCtrl)
@@ -124,6 +127,7 @@ wxString CSharedFilesCtrl::GetOldColumnOrder() const
 
 CSharedFilesCtrl::~CSharedFilesCtrl()
 {
+	DeleteContents(m_barCache);
 }
 
 
@@ -218,6 +222,7 @@ void CSharedFilesCtrl::ShowFileList()
 {
 	Freeze();
 	DeleteAllItems();
+	DeleteContents(m_barCache);
 
 	std::vector<CKnownFile*> files;
 	theApp->sharedfiles->CopyFileList(files);
@@ -241,6 +246,12 @@ void CSharedFilesCtrl::RemoveFile(CKnownFile *toRemove)
 
 		ShowFilesCount();
 	}
+
+	BarCacheMap::iterator it = m_barCache.find(toRemove);
+	if (it != m_barCache.end()) {
+		delete it->second;
+		m_barCache.erase(it);
+	}
 }
 
 
@@ -634,17 +645,34 @@ bool CSharedFilesCtrl::AltSortAllowed(unsigned column) const
 }
 
 
-void CSharedFilesCtrl::DrawAvailabilityBar(CKnownFile* file, wxDC* dc, const wxRect& rect ) const
+void CSharedFilesCtrl::DrawAvailabilityBar(CKnownFile* file, wxDC* dc, const wxRect& rect )
 {
+	if (rect.width <= 0 || rect.height <= 0) {
+		return;
+	}
+
+	CBarCache*& cache = m_barCache[file];
+	if (cache == NULL) {
+		cache = new CBarCache();
+	}
+
+	bool bFlat = thePrefs::UseFlatBar();
+	wxMemoryDC cdcStatus;
+
+	// Only drawn again when the availability of the parts changes
+	if (!cache->NeedsRedraw(file->GetBarVersion(), 0, rect.width, rect.height, bFlat, CPreferences::Get3DDepth())) {
+		cdcStatus.SelectObject(cache->GetBitmap());
+		dc->Blit(rect.x, rect.y, rect.width, rect.height, &cdcStatus, 0, 0);
+		return;
+	}
+	cdcStatus.SelectObject(cache->GetBitmap());
+
 	// Reference to the availability list
 	const ArrayOfUInts16& list = file->IsPartFile() ?
 		static_cast<CPartFile*>(file)->m_SrcpartFrequency :
 		file->m_AvailPartFrequency;
-	wxPen   old_pen   = dc->GetPen();
-	wxBrush old_brush = dc->GetBrush();
-	bool bFlat = thePrefs::UseFlatBar();
 
-	wxRect barRect = rect;
+	wxRect barRect(0, 0, rect.width, rect.height);
 	if (!bFlat) { // round bar has a black border, the bar itself is 1 pixel less on each border
 		barRect.x ++;
 		barRect.y ++;
@@ -663,17 +691,16 @@ void CSharedFilesCtrl::DrawAvailabilityBar(CKnownFile* file, wxDC* dc, const wxR
 		s_ChunkBar.FillRange(start, end, CMuleColour(list[i] ? 0 : 255, list[i] ? ((210-(22*( list[i] - 1 ) ) < 0) ? 0 : (210-(22*( list[i] - 1 ) ))) : 0, list[i] ? 255 : 0));
 	}
 	s_ChunkBar.FillRange(end + 1, file->GetFileSize() - 1, CMuleColour(255, 0, 0));
-	s_ChunkBar.Draw(dc, barRect.x, barRect.y, bFlat);
+	s_ChunkBar.Draw(&cdcStatus, barRect.x, barRect.y, bFlat);
 
 	if (!bFlat) {
 		// Draw black border
-		dc->SetPen( *wxBLACK_PEN );
-		dc->SetBrush( *wxTRANSPARENT_BRUSH );
-		dc->DrawRectangle(rect);
+		cdcStatus.SetPen( *wxBLACK_PEN );
+		cdcStatus.SetBrush( *wxTRANSPARENT_BRUSH );
+		cdcStatus.DrawRectangle(0, 0, rect.width, rect.height);
 	}
 
-	dc->SetPen( old_pen );
-	dc->SetBrush( old_brush );
+	dc->Blit(rect.x, rect.y, rect.width, rect.height, &cdcStatus, 0, 0);
 }
 
 void CSharedFilesCtrl::OnRename( wxCommandEvent& WXUNUSED(event) )
@@ -28,9 +28,12 @@
 
 #include "MuleListCtrl.h"	// Needed for CMuleListCtrl
 
+#include <map>			// Needed for std::map
+
 
 class CSharedFileList;
 class CKnownFile;
+class CBarCache;
 class wxMenu;
 
 
@@ -110,7 +113,7 @@ private:
 	 * is determined using the currently known sources, while availability for
 	 * Known-files is determined using the sources requesting that file.
 	 */
-	void	DrawAvailabilityBar( CKnownFile* file, wxDC* dc, const wxRect& rect ) const;
+	void	DrawAvailabilityBar( CKnownFile* file, wxDC* dc, const wxRect& rect );
 
 	/**
 	 * Overloaded function needed to do custom drawing of the items.
@@ -187,6 +190,10 @@ private:
 	//! Pointer used to ensure that the menu isn't displayed twice.
 	wxMenu* m_menu;
 
+	typedef std::map<const CKnownFile*, CBarCache*> BarCacheMap;
+	//! The drawn availability bars of the files.
+	BarCacheMap m_barCache;
+
 
 	DECLARE_EVENT_TABLE()
 };
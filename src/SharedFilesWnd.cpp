@@ -210,7 +210,8 @@ void CSharedFilesWnd::SelectionUpdated()
 
 void CSharedFilesWnd::OnBtnReloadShared( wxCommandEvent& WXUNUSED(evt) )
 {
-	theApp->sharedfiles->Reload();
+	// List all directories again, also those that look unchanged.
+	theApp->sharedfiles->Reload(true);
 #ifndef CLIENT_GUI
 	// remote gui will update display when data is back
 	SelectionUpdated();
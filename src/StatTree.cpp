@@ -377,15 +377,15 @@ void CStatTreeItemCounterMax::AddECValues(CECTag *tag) const
 wxString CStatTreeItemPackets::GetDisplayString() const
 {
 	return CFormat(wxGetTranslation(m_label)) %
-		a_brackets_b(CastItoXBytes(m_bytes), CastItoIShort(m_packets));
+		a_brackets_b(CastItoXBytes(m_bytes.GetValue()), CastItoIShort(m_packets.GetValue()));
 }
 #endif
 
 void CStatTreeItemPackets::AddECValues(CECTag *tag) const
 {
-	CECTag value(EC_TAG_STAT_NODE_VALUE, m_bytes);
+	CECTag value(EC_TAG_STAT_NODE_VALUE, m_bytes.GetValue());
 	value.AddTag(CECTag(EC_TAG_STAT_VALUE_TYPE, (uint8)EC_VALUE_BYTES));
-	CECTag tmp(EC_TAG_STAT_NODE_VALUE, (uint64)m_packets);
+	CECTag tmp(EC_TAG_STAT_NODE_VALUE, m_packets.GetValue());
 	tmp.AddTag(CECTag(EC_TAG_STAT_VALUE_TYPE, (uint8)EC_VALUE_ISHORT));
 	value.AddTag(tmp);
 	tag->AddTag(value);
@@ -397,12 +397,12 @@ void CStatTreeItemPackets::AddECValues(CECTag *tag) const
 #ifndef AMULE_DAEMON
 wxString CStatTreeItemPacketTotals::GetDisplayString() const
 {
-	uint32_t tmp_packets = m_packets;
-	uint64_t tmp_bytes = m_bytes;
+	uint64_t tmp_packets = m_packets.GetValue();
+	uint64_t tmp_bytes = m_bytes.GetValue();
 	for (std::vector<CStatTreeItemPackets*>::const_iterator it = m_counters.begin();
 	     it != m_counters.end(); ++it) {
-		tmp_packets += (*it)->m_packets;
-		tmp_bytes += (*it)->m_bytes;
+		tmp_packets += (*it)->m_packets.GetValue();
+		tmp_bytes += (*it)->m_bytes.GetValue();
 	}
 
 	return CFormat(wxGetTranslation(m_label)) %
@@ -412,12 +412,12 @@ wxString CStatTreeItemPacketTotals::GetDisplayString() const
 
 void CStatTreeItemPacketTotals::AddECValues(CECTag *tag) const
 {
-	uint32_t tmp_packets = m_packets;
-	uint64_t tmp_bytes = m_bytes;
+	uint64_t tmp_packets = m_packets.GetValue();
+	uint64_t tmp_bytes = m_bytes.GetValue();
 	for (std::vector<CStatTreeItemPackets*>::const_iterator it = m_counters.begin();
 	     it != m_counters.end(); ++it) {
-		tmp_packets += (*it)->m_packets;
-		tmp_bytes += (*it)->m_bytes;
+		tmp_packets += (*it)->m_packets.GetValue();
+		tmp_bytes += (*it)->m_bytes.GetValue();
 	}
 
 	CECTag value(EC_TAG_STAT_NODE_VALUE, tmp_bytes);
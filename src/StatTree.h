@@ -52,6 +52,7 @@
 
 #include <wx/datetime.h>	// Needed for wxDateTime
 #include "GetTickCount.h"	// Needed for GetTickCount64()
+#include "ShardedCounter.h"	// Needed for CShardedCounter
 
 
 /**
@@ -719,19 +720,29 @@ public:
 	 */
 	CStatTreeItemPackets(const wxString &label)
 	:
-	CStatTreeItemBase(label, stNone),
-	m_packets(0),
-	m_bytes(0) {}
+	CStatTreeItemBase(label, stNone) {}
 
 	/**
 	 * Add a packet of size 'size'.
+	 *
+	 * Called per packet from several threads, so this does not lock.
 	 */
 	void operator+=(long size)
 	{
-		++m_packets;
-		m_bytes += size;
+		m_packets.Add(1);
+		m_bytes.Add(size);
 	}
 
+	/**
+	 * Retrieve the number of packets counted here.
+	 */
+	uint64_t GetPackets() const { return m_packets.GetValue(); }
+
+	/**
+	 * Retrieve the bytes in the packets counted here.
+	 */
+	uint64_t GetBytes() const { return m_bytes.GetValue(); }
+
 #ifndef AMULE_DAEMON
 	/**
 	 * @see CStatTreeItemBase::GetDisplayString()
@@ -750,10 +761,10 @@ protected:
 	virtual	void AddECValues(CECTag *tag) const;
 
 	//! Total number of packets.
-	uint32_t m_packets;
+	CShardedCounter m_packets;
 
 	//! Total bytes in the packets.
-	uint64_t m_bytes;
+	CShardedCounter m_bytes;
 };
 
 
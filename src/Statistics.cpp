@@ -31,9 +31,6 @@
 #include <ec/cpp/ECTag.h>		// Needed for CECTag
 
 #ifndef CLIENT_GUI
-	#ifndef AMULE_DAEMON
-		#include <common/Format.h>		// Needed for CFormat
-	#endif
 	#include "CFile.h"		// Needed for CFile access
 	#include <common/Path.h>	// Needed for JoinPaths
 	#include <wx/config.h>		// Needed for wxConfig
@@ -42,6 +39,17 @@
 	#include "ServerList.h"		// Needed for CServerList (tree)
 	#include <cmath>		// Needed for std::floor
 	#include "updownclient.h"	// Needed for CUpDownClient
+	#include "BufferPool.h"		// Needed for CBufferPool (tree)
+	#include "EncryptedDatagramSocket.h"	// Needed for CEncryptedDatagramSocket (tree)
+	#include <common/Format.h>		// Needed for CFormat
+	#include "ThreadScheduler.h"		// Needed for CThreadScheduler (metrics)
+	#include "UploadBandwidthThrottler.h"	// Needed for UploadBandwidthThrottler (metrics)
+	#include "ClientCreditsList.h"		// Needed for CClientCreditsList (metrics)
+	#include "InflatePool.h"		// Needed for CInflatePool (metrics)
+	#include "SharedFileList.h"		// Needed for CSharedFileList (tree, metrics)
+	#include "ClientList.h"		// Needed for CClientList (tree, metrics)
+	#include "UploadQueue.h"		// Needed for CUploadQueue (tree, metrics)
+	#include "InternedString.h"		// Needed for CInternedString (tree, metrics)
 #else
 	#include "GetTickCount.h"	// Needed for GetTickCount64()
 	#include <ec/cpp/RemoteConnect.h>		// Needed for CRemoteConnect
@@ -68,10 +76,10 @@ void CPreciseRateCounter::CalculateRate(uint64_t now)
 {
 	wxMutexLocker lock(m_mutex);
 
-	m_total += m_tmp_sum;
-	m_byte_history.push_back(m_tmp_sum);
+	uint32_t pending = (uint32_t)m_pending.Drain();
+	m_total += pending;
+	m_byte_history.push_back(pending);
 	m_tick_history.push_back(now);
-	m_tmp_sum = 0;
 
 	uint64_t timespan = now - m_tick_history.front();
 
@@ -190,6 +198,17 @@ CStatTreeItemCounterMax*	CStatistics::s_activeConnections;
 CStatTreeItemMaxConnLimitReached* CStatistics::s_limitReached;
 CStatTreeItemSimple*		CStatistics::s_avgConnections;
 
+// Packet buffers
+CStatTreeItemSimple*		CStatistics::s_bufferAllocations;
+CStatTreeItemSimple*		CStatistics::s_bufferReuse;
+CStatTreeItemSimple*		CStatistics::s_bufferUnpooled;
+CStatTreeItemSimple*		CStatistics::s_bufferPooledBytes;
+
+// Obfuscated UDP
+CStatTreeItemSimple*		CStatistics::s_udpDecrypted;
+CStatTreeItemSimple*		CStatistics::s_udpKeysPerPacket;
+CStatTreeItemSimple*		CStatistics::s_udpFirstKey;
+
 // Clients
 CStatTreeItemHiddenCounter*	CStatistics::s_clients;
 CStatTreeItemCounter*		CStatistics::s_unknown;
@@ -217,6 +236,20 @@ CStatTreeItemSimple*		CStatistics::s_serverOccupation;
 CStatTreeItemCounter*		CStatistics::s_numberOfShared;
 CStatTreeItemCounter*		CStatistics::s_sizeOfShare;
 
+// Kad publishing
+CStatTreeItemSimple*		CStatistics::s_kadPublishedSources;
+CStatTreeItemSimple*		CStatistics::s_kadSourcesDue;
+CStatTreeItemSimple*		CStatistics::s_kadPublishedKeywords;
+CStatTreeItemSimple*		CStatistics::s_kadKeywordsDue;
+CStatTreeItemSimple*		CStatistics::s_kadNotesDue;
+
+// Memory
+CStatTreeItemSimple*		CStatistics::s_memClients;
+CStatTreeItemSimple*		CStatistics::s_memClientList;
+CStatTreeItemSimple*		CStatistics::s_memUploadQueue;
+CStatTreeItemSimple*		CStatistics::s_memDownloadSources;
+CStatTreeItemSimple*		CStatistics::s_memClientStrings;
+
 // Kad
 uint64_t			CStatistics::s_kadNodesTotal;
 uint16_t			CStatistics::s_kadNodesCur;
@@ -359,6 +392,173 @@ void CStatistics::Save()
 	}
 }
 
+
+namespace {
+
+// Appends the help and type lines that start a metric.
+void AddMetricHeader(wxString& out, const wxChar* name, const wxChar* type, const wxChar* help)
+{
+	out += CFormat(wxT("# HELP %s %s\n# TYPE %s %s\n")) % name % help % name % type;
+}
+
+// Appends one sample, labels are given as 'name="value"' pairs.
+void AddMetric(wxString& out, const wxChar* name, const wxString& labels, uint64 value)
+{
+	out += CFormat(labels.IsEmpty() ? wxT("%s%s %llu\n") : wxT("%s{%s} %llu\n")) % name % labels % value;
+}
+
+void AddMetric(wxString& out, const wxChar* name, const wxString& labels, double value)
+{
+	out += CFormat(labels.IsEmpty() ? wxT("%s%s %.1f\n") : wxT("%s{%s} %.1f\n")) % name % labels % value;
+}
+
+// Appends the packet and byte counts of one overhead counter.
+void AddOverheadMetrics(wxString& packets, wxString& bytes, const wxChar* direction, const wxChar* type, const CStatTreeItemPackets* counter)
+{
+	wxString labels = CFormat(wxT("direction=\"%s\",type=\"%s\"")) % direction % type;
+	AddMetric(packets, wxT("amule_overhead_packets_total"), labels, counter->GetPackets());
+	AddMetric(bytes, wxT("amule_overhead_bytes_total"), labels, counter->GetBytes());
+}
+
+}
+
+
+void CStatistics::ExportMetrics(const CPath& path)
+{
+	wxString out;
+
+	AddMetricHeader(out, wxT("amule_uptime_seconds"), wxT("gauge"), wxT("Time since the core was started."));
+	AddMetric(out, wxT("amule_uptime_seconds"), wxEmptyString, GetUptimeSeconds());
+
+	AddMetricHeader(out, wxT("amule_session_bytes_total"), wxT("counter"), wxT("Payload bytes transferred in this session."));
+	AddMetric(out, wxT("amule_session_bytes_total"), wxT("direction=\"up\""), GetSessionSentBytes());
+	AddMetric(out, wxT("amule_session_bytes_total"), wxT("direction=\"down\""), GetSessionReceivedBytes());
+
+	AddMetricHeader(out, wxT("amule_lifetime_bytes_total"), wxT("counter"), wxT("Payload bytes transferred in all sessions."));
+	AddMetric(out, wxT("amule_lifetime_bytes_total"), wxT("direction=\"up\""), GetTotalSentBytes());
+	AddMetric(out, wxT("amule_lifetime_bytes_total"), wxT("direction=\"down\""), GetTotalReceivedBytes());
+
+	AddMetricHeader(out, wxT("amule_rate_bytes_per_second"), wxT("gauge"), wxT("Current transfer rates."));
+	AddMetric(out, wxT("amule_rate_bytes_per_second"), wxT("direction=\"up\",kind=\"payload\""), GetUploadRate());
+	AddMetric(out, wxT("amule_rate_bytes_per_second"), wxT("direction=\"down\",kind=\"payload\""), GetDownloadRate());
+	AddMetric(out, wxT("amule_rate_bytes_per_second"), wxT("direction=\"up\",kind=\"overhead\""), GetUpOverheadRate());
+	AddMetric(out, wxT("amule_rate_bytes_per_second"), wxT("direction=\"down\",kind=\"overhead\""), GetDownOverheadRate());
+
+	wxString packets;
+	wxString bytes;
+	AddOverheadMetrics(packets, bytes, wxT("up"), wxT("file_request"), s_fileReqUpOverhead);
+	AddOverheadMetrics(packets, bytes, wxT("up"), wxT("source_exchange"), s_sourceXchgUpOverhead);
+	AddOverheadMetrics(packets, bytes, wxT("up"), wxT("server"), s_serverUpOverhead);
+	AddOverheadMetrics(packets, bytes, wxT("up"), wxT("kad"), s_kadUpOverhead);
+	AddOverheadMetrics(packets, bytes, wxT("up"), wxT("other"), s_totalUpOverhead);
+	AddOverheadMetrics(packets, bytes, wxT("down"), wxT("file_request"), s_fileReqDownOverhead);
+	AddOverheadMetrics(packets, bytes, wxT("down"), wxT("source_exchange"), s_sourceXchgDownOverhead);
+	AddOverheadMetrics(packets, bytes, wxT("down"), wxT("server"), s_serverDownOverhead);
+	AddOverheadMetrics(packets, bytes, wxT("down"), wxT("kad"), s_kadDownOverhead);
+	AddOverheadMetrics(packets, bytes, wxT("down"), wxT("other"), s_totalDownOverhead);
+	AddMetricHeader(out, wxT("amule_overhead_packets_total"), wxT("counter"), wxT("Protocol packets sent and received."));
+	out += packets;
+	AddMetricHeader(out, wxT("amule_overhead_bytes_total"), wxT("counter"), wxT("Bytes in protocol packets sent and received."));
+	out += bytes;
+
+	AddMetricHeader(out, wxT("amule_crypt_overhead_bytes_total"), wxT("counter"), wxT("Bytes spent on protocol obfuscation."));
+	AddMetric(out, wxT("amule_crypt_overhead_bytes_total"), wxT("direction=\"up\""), s_cryptUpOverhead->GetValue());
+	AddMetric(out, wxT("amule_crypt_overhead_bytes_total"), wxT("direction=\"down\""), s_cryptDownOverhead->GetValue());
+
+	AddMetricHeader(out, wxT("amule_upload_clients"), wxT("gauge"), wxT("Clients in the upload queue."));
+	AddMetric(out, wxT("amule_upload_clients"), wxT("state=\"uploading\""), (uint64)GetActiveUploadsCount());
+	AddMetric(out, wxT("amule_upload_clients"), wxT("state=\"waiting\""), (uint64)GetWaitingUserCount());
+
+	AddMetricHeader(out, wxT("amule_download_sources"), wxT("gauge"), wxT("Sources of the files being downloaded."));
+	AddMetric(out, wxT("amule_download_sources"), wxT("state=\"found\""), (uint64)GetFoundSources());
+	AddMetric(out, wxT("amule_download_sources"), wxT("state=\"downloading\""), (uint64)GetDownloadingSources());
+
+	AddMetricHeader(out, wxT("amule_connections"), wxT("gauge"), wxT("Open TCP connections."));
+	AddMetric(out, wxT("amule_connections"), wxEmptyString, (uint64)GetActiveConnections());
+
+	AddMetricHeader(out, wxT("amule_shared_files"), wxT("gauge"), wxT("Files being shared."));
+	AddMetric(out, wxT("amule_shared_files"), wxEmptyString, (uint64)GetSharedFileCount());
+
+	AddMetricHeader(out, wxT("amule_kad_nodes"), wxT("gauge"), wxT("Known Kad nodes."));
+	AddMetric(out, wxT("amule_kad_nodes"), wxEmptyString, (uint64)GetKadNodes());
+
+	if (theApp->sharedfiles) {
+		CSharedFileList::CKadPublishStats publishStats;
+		theApp->sharedfiles->GetKadPublishStats(publishStats);
+		AddMetricHeader(out, wxT("amule_kad_publish_due"), wxT("gauge"), wxT("Sources, keywords and notes due for publishing to Kad."));
+		AddMetric(out, wxT("amule_kad_publish_due"), wxT("type=\"source\""), (uint64)publishStats.sourcesDue);
+		AddMetric(out, wxT("amule_kad_publish_due"), wxT("type=\"keyword\""), (uint64)publishStats.keywordsDue);
+		AddMetric(out, wxT("amule_kad_publish_due"), wxT("type=\"notes\""), (uint64)publishStats.notesDue);
+		AddMetricHeader(out, wxT("amule_kad_publish_keywords"), wxT("gauge"), wxT("Keywords of the shared files."));
+		AddMetric(out, wxT("amule_kad_publish_keywords"), wxEmptyString, (uint64)publishStats.keywords);
+	}
+
+	if (theApp->uploadBandwidthThrottler) {
+		AddMetricHeader(out, wxT("amule_throttler_sockets"), wxT("gauge"), wxT("Sockets served by the upload throttler."));
+		AddMetric(out, wxT("amule_throttler_sockets"), wxT("queue=\"slots\""), (uint64)theApp->uploadBandwidthThrottler->GetSlotCount());
+		AddMetric(out, wxT("amule_throttler_sockets"), wxT("queue=\"control\""), (uint64)theApp->uploadBandwidthThrottler->GetControlQueueLength());
+	}
+
+	AddMetricHeader(out, wxT("amule_hashing_tasks"), wxT("gauge"), wxT("Files queued for or being hashed."));
+	AddMetric(out, wxT("amule_hashing_tasks"), wxT("type=\"md4\""), (uint64)CThreadScheduler::GetPendingTaskCount(wxT("Hashing")));
+	AddMetric(out, wxT("amule_hashing_tasks"), wxT("type=\"aich\""), (uint64)CThreadScheduler::GetPendingTaskCount(wxT("AICH Hashing")));
+
+	CBufferPool::Stats bufferStats;
+	CBufferPool::GetStats(bufferStats);
+	AddMetricHeader(out, wxT("amule_buffer_allocations_total"), wxT("counter"), wxT("Packet buffers handed out by the buffer pool."));
+	AddMetric(out, wxT("amule_buffer_allocations_total"), wxT("source=\"pool\""), bufferStats.reused);
+	AddMetric(out, wxT("amule_buffer_allocations_total"), wxT("source=\"heap\""), bufferStats.allocations - bufferStats.reused);
+	AddMetricHeader(out, wxT("amule_buffer_pooled_bytes"), wxT("gauge"), wxT("Memory held by the buffer pool."));
+	AddMetric(out, wxT("amule_buffer_pooled_bytes"), wxEmptyString, bufferStats.pooledBytes);
+
+	CInflatePool::Stats inflateStats;
+	CInflatePool::GetStats(inflateStats);
+	AddMetricHeader(out, wxT("amule_inflate_streams_total"), wxT("counter"), wxT("Inflate streams set up for compressed download blocks."));
+	AddMetric(out, wxT("amule_inflate_streams_total"), wxT("source=\"pool\""), inflateStats.reused);
+	AddMetric(out, wxT("amule_inflate_streams_total"), wxT("source=\"new\""), inflateStats.acquired - inflateStats.reused);
+
+	CEncryptedDatagramSocket::DecryptStats decryptStats;
+	CEncryptedDatagramSocket::GetDecryptStats(decryptStats);
+	AddMetricHeader(out, wxT("amule_udp_decrypt_keys_total"), wxT("counter"), wxT("Keys tried to decrypt obfuscated UDP packets."));
+	AddMetric(out, wxT("amule_udp_decrypt_keys_total"), wxEmptyString, decryptStats.keysTried);
+	AddMetricHeader(out, wxT("amule_udp_decrypted_total"), wxT("counter"), wxT("Obfuscated UDP packets decrypted."));
+	AddMetric(out, wxT("amule_udp_decrypted_total"), wxT("key=\"first\""), decryptStats.firstTry);
+	AddMetric(out, wxT("amule_udp_decrypted_total"), wxT("key=\"other\""), decryptStats.decrypted - decryptStats.firstTry);
+
+	if (theApp->clientlist && theApp->uploadqueue) {
+		CClientList::MemoryStats memoryStats;
+		theApp->clientlist->GetMemoryStats(memoryStats);
+		CInternedString::Stats stringStats;
+		CInternedString::GetStats(stringStats);
+		AddMetricHeader(out, wxT("amule_memory_bytes"), wxT("gauge"), wxT("Estimated memory used by the clients and their lists."));
+		AddMetric(out, wxT("amule_memory_bytes"), wxT("part=\"clients\""), memoryStats.clientBytes);
+		AddMetric(out, wxT("amule_memory_bytes"), wxT("part=\"client_list\""), memoryStats.listBytes);
+		AddMetric(out, wxT("amule_memory_bytes"), wxT("part=\"upload_queue\""), memoryStats.uploadBytes + theApp->uploadqueue->GetMemoryUsage());
+		AddMetric(out, wxT("amule_memory_bytes"), wxT("part=\"download_sources\""), memoryStats.downloadBytes);
+		AddMetric(out, wxT("amule_memory_bytes"), wxT("part=\"client_strings\""), stringStats.bytes);
+	}
+
+	CRSAVerifierCache::Stats verifierStats;
+	theApp->clientcredits->GetVerifierStats(verifierStats);
+	AddMetricHeader(out, wxT("amule_secident_checks_total"), wxT("counter"), wxT("Secure ident signatures checked."));
+	AddMetric(out, wxT("amule_secident_checks_total"), wxT("key=\"cached\""), verifierStats.hits);
+	AddMetric(out, wxT("amule_secident_checks_total"), wxT("key=\"decoded\""), verifierStats.lookups - verifierStats.hits);
+
+	// write_safe renames the finished file into place, so a scraper
+	// reads either the previous or the new metrics.
+	try {
+		wxCharBuffer data = out.mb_str(wxConvUTF8);
+		CFile file;
+		if (file.Open(path, CFile::write_safe)) {
+			file.Write(data.data(), strlen(data.data()));
+			file.Close();
+		}
+	} catch (const CSafeIOException& e) {
+		AddDebugLogLineN(logGeneral, wxT("Failed to write the metrics file: ") + e.what());
+	}
+}
+
+
 void CStatistics::CalculateRates()
 {
 	uint64_t now = GetTickCount64();
@@ -621,7 +821,7 @@ void CStatistics::ComputeAverages(
 	runningAvg->m_tick_history.clear();
 	runningAvg->m_byte_history.clear();
 	runningAvg->m_total = 0;
-	runningAvg->m_tmp_sum = 0;
+	runningAvg->m_pending.Drain();
 
 	if (pos == listHR.rend()) {
 		sTarget = 0.0;
@@ -787,6 +987,20 @@ void CStatistics::InitStatsTree()
 	s_avgConnections->SetValue(0.0);
 	tmpRoot1->AddChild(new CStatTreeItemPeakConnections(wxTRANSLATE("Peak Connections (estimate): %i")));
 
+	tmpRoot2 = tmpRoot1->AddChild(new CStatTreeItemBase(wxTRANSLATE("Packet Buffers")));
+	s_bufferAllocations = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Allocations: %llu"))));
+	s_bufferReuse = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Reused from pool: %.2f%%"))));
+	s_bufferReuse->SetValue(0.0);
+	s_bufferUnpooled = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Too large for pool: %llu"))));
+	s_bufferPooledBytes = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Pooled memory: %s"), stNone, dmBytes)));
+
+	tmpRoot2 = tmpRoot1->AddChild(new CStatTreeItemBase(wxTRANSLATE("Obfuscated UDP")));
+	s_udpDecrypted = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Decrypted packets: %llu"))));
+	s_udpKeysPerPacket = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Keys tried per decrypted packet: %.2f"))));
+	s_udpKeysPerPacket->SetValue(0.0);
+	s_udpFirstKey = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Decrypted with first key: %.2f%%"))));
+	s_udpFirstKey->SetValue(0.0);
+
 	s_clients = static_cast<CStatTreeItemHiddenCounter*>(s_statTree->AddChild(new CStatTreeItemHiddenCounter(wxTRANSLATE("Clients"), stSortChildren | stSortByValue)));
 	s_unknown = static_cast<CStatTreeItemCounter*>(s_clients->AddChild(new CStatTreeItemCounter(wxTRANSLATE("Unknown: %s")), 6));
 	//s_lowID = static_cast<CStatTreeItem*>(s_clients->AddChild(new CStatTreeItem(wxTRANSLATE("LowID: %u (%.2f%% Total %.2f%% Known)")), 5));
@@ -817,6 +1031,23 @@ void CStatistics::InitStatsTree()
 	s_sizeOfShare = static_cast<CStatTreeItemCounter*>(tmpRoot1->AddChild(new CStatTreeItemCounter(wxTRANSLATE("Total size of Shared Files: %s"))));
 	s_sizeOfShare->SetDisplayMode(dmBytes);
 	tmpRoot1->AddChild(new CStatTreeItemAverage(wxTRANSLATE("Average file size: %s"), s_sizeOfShare, s_numberOfShared, dmBytes));
+
+	tmpRoot2 = tmpRoot1->AddChild(new CStatTreeItemBase(wxTRANSLATE("Kad Publishing")));
+	s_kadPublishedSources = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Sources published: %.2f%%"))));
+	s_kadPublishedSources->SetValue(0.0);
+	s_kadSourcesDue = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Sources waiting: %llu"))));
+	s_kadPublishedKeywords = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Keywords published: %.2f%%"))));
+	s_kadPublishedKeywords->SetValue(0.0);
+	s_kadKeywordsDue = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Keywords waiting: %llu"))));
+	s_kadNotesDue = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Files to check for notes: %llu"))));
+
+	// Estimates, see CClientList::GetMemoryStats
+	tmpRoot1 = s_statTree->AddChild(new CStatTreeItemBase(wxTRANSLATE("Memory")));
+	s_memClients = static_cast<CStatTreeItemSimple*>(tmpRoot1->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Clients: %s"), stNone, dmBytes)));
+	s_memClientList = static_cast<CStatTreeItemSimple*>(tmpRoot1->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Client list: %s"), stNone, dmBytes)));
+	s_memUploadQueue = static_cast<CStatTreeItemSimple*>(tmpRoot1->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Upload queue: %s"), stNone, dmBytes)));
+	s_memDownloadSources = static_cast<CStatTreeItemSimple*>(tmpRoot1->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Download sources: %s"), stNone, dmBytes)));
+	s_memClientStrings = static_cast<CStatTreeItemSimple*>(tmpRoot1->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Client strings: %s"), stNone, dmBytes)));
 }
 
 
@@ -831,6 +1062,41 @@ void CStatistics::UpdateStatsTree()
 
 	s_avgConnections->SetValue(theApp->listensocket->GetAverageConnections());
 
+	CBufferPool::Stats bufferStats;
+	CBufferPool::GetStats(bufferStats);
+	s_bufferAllocations->SetValue(bufferStats.allocations);
+	s_bufferReuse->SetValue(bufferStats.allocations ? 100.0 * bufferStats.reused / bufferStats.allocations : 0.0);
+	s_bufferUnpooled->SetValue(bufferStats.unpooled);
+	s_bufferPooledBytes->SetValue(bufferStats.pooledBytes);
+
+	CEncryptedDatagramSocket::DecryptStats decryptStats;
+	CEncryptedDatagramSocket::GetDecryptStats(decryptStats);
+	s_udpDecrypted->SetValue(decryptStats.decrypted);
+	s_udpKeysPerPacket->SetValue(decryptStats.decrypted ? (double)decryptStats.keysTried / decryptStats.decrypted : 0.0);
+	s_udpFirstKey->SetValue(decryptStats.decrypted ? 100.0 * decryptStats.firstTry / decryptStats.decrypted : 0.0);
+
+	if (theApp->sharedfiles) {
+		CSharedFileList::CKadPublishStats publishStats;
+		theApp->sharedfiles->GetKadPublishStats(publishStats);
+		s_kadPublishedSources->SetValue(publishStats.files ? 100.0 * (publishStats.files - publishStats.sourcesDue) / publishStats.files : 0.0);
+		s_kadSourcesDue->SetValue((uint64)publishStats.sourcesDue);
+		s_kadPublishedKeywords->SetValue(publishStats.keywords ? 100.0 * (publishStats.keywords - publishStats.keywordsDue) / publishStats.keywords : 0.0);
+		s_kadKeywordsDue->SetValue((uint64)publishStats.keywordsDue);
+		s_kadNotesDue->SetValue((uint64)publishStats.notesDue);
+	}
+
+	if (theApp->clientlist && theApp->uploadqueue) {
+		CClientList::MemoryStats memoryStats;
+		theApp->clientlist->GetMemoryStats(memoryStats);
+		s_memClients->SetValue(memoryStats.clientBytes);
+		s_memClientList->SetValue(memoryStats.listBytes);
+		s_memUploadQueue->SetValue(memoryStats.uploadBytes + theApp->uploadqueue->GetMemoryUsage());
+		s_memDownloadSources->SetValue(memoryStats.downloadBytes);
+	}
+	CInternedString::Stats stringStats;
+	CInternedString::GetStats(stringStats);
+	s_memClientStrings->SetValue(stringStats.bytes);
+
 	// get serverstats
 	// TODO: make these realtime, too
 	uint32 servfail;
@@ -29,6 +29,7 @@
 
 #include "Constants.h"		// Needed for StatsGraphType
 #include "StatTree.h"		// Needed for CStatTreeItem* classes
+#include "ShardedCounter.h"	// Needed for CShardedCounter
 
 #include <deque>		// Needed for std::deque
 
@@ -72,7 +73,7 @@ class CPreciseRateCounter {
 	 * @param count_average Counts average instead of rate.
 	 */
 	CPreciseRateCounter(uint32_t timespan, bool count_average = false)
-		: m_timespan(timespan), m_total(0), m_rate(0.0), m_max_rate(0.0), m_tmp_sum(0), m_count_average(count_average)
+		: m_timespan(timespan), m_total(0), m_rate(0.0), m_max_rate(0.0), m_count_average(count_average)
 		{
 			if (!count_average) {
 				uint64_t cur_time = GetTickCount64();
@@ -123,8 +124,10 @@ class CPreciseRateCounter {
 
 	/**
 	 * Add bytes to be tracked for rate-counting.
+	 *
+	 * Called per packet from several threads, so this does not lock.
 	 */
-	void	operator+=(uint32_t bytes)	{ wxMutexLocker lock(m_mutex); m_tmp_sum += bytes; }
+	void	operator+=(uint32_t bytes)	{ m_pending.Add(bytes); }
 
  protected:
 
@@ -134,7 +137,7 @@ class CPreciseRateCounter {
 	uint32_t	m_total;
 	double		m_rate;
 	double		m_max_rate;
-	uint32_t	m_tmp_sum;
+	CShardedCounter	m_pending;
 	wxMutex		m_mutex;
 	bool		m_count_average;
 };
@@ -212,6 +215,7 @@ class CStatTreeItemPeakConnections : public CStatTreeItemBase {
 
 
 class CUpDownClient;
+class CPath;
 
 class CStatistics {
 	friend class CStatisticsDlg;	// to access CStatistics::GetTreeRoot()
@@ -222,6 +226,13 @@ class CStatistics {
 	static void	Load();
 	static void	Save();
 
+	/**
+	 * Writes the main counters to a file in the Prometheus text format.
+	 *
+	 * The file is replaced atomically, so a scraper never sees it half written.
+	 */
+	static void	ExportMetrics(const CPath& path);
+
 	/* Statistics graph functions */
 
 	void	 RecordHistory();
@@ -440,6 +451,17 @@ class CStatistics {
 	static	CStatTreeItemMaxConnLimitReached* s_limitReached;
 	static	CStatTreeItemSimple*		s_avgConnections;
 
+	// Packet buffers
+	static	CStatTreeItemSimple*		s_bufferAllocations;
+	static	CStatTreeItemSimple*		s_bufferReuse;
+	static	CStatTreeItemSimple*		s_bufferUnpooled;
+	static	CStatTreeItemSimple*		s_bufferPooledBytes;
+
+	// Obfuscated UDP
+	static	CStatTreeItemSimple*		s_udpDecrypted;
+	static	CStatTreeItemSimple*		s_udpKeysPerPacket;
+	static	CStatTreeItemSimple*		s_udpFirstKey;
+
 	// Clients
 	static	CStatTreeItemHiddenCounter*	s_clients;
 	static	CStatTreeItemCounter*		s_unknown;
@@ -467,6 +489,20 @@ class CStatistics {
 	static	CStatTreeItemCounter*		s_numberOfShared;
 	static	CStatTreeItemCounter*		s_sizeOfShare;
 
+	// Kad publishing
+	static	CStatTreeItemSimple*		s_kadPublishedSources;
+	static	CStatTreeItemSimple*		s_kadSourcesDue;
+	static	CStatTreeItemSimple*		s_kadPublishedKeywords;
+	static	CStatTreeItemSimple*		s_kadKeywordsDue;
+	static	CStatTreeItemSimple*		s_kadNotesDue;
+
+	// Memory
+	static	CStatTreeItemSimple*		s_memClients;
+	static	CStatTreeItemSimple*		s_memClientList;
+	static	CStatTreeItemSimple*		s_memUploadQueue;
+	static	CStatTreeItemSimple*		s_memDownloadSources;
+	static	CStatTreeItemSimple*		s_memClientStrings;
+
 	// Kad nodes
 	static	uint64_t	s_kadNodesTotal;
 	static	uint16_t	s_kadNodesCur;
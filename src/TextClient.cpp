@@ -1035,6 +1035,7 @@ namespace MuleNotify
 {
 	void HandleNotification(const class CMuleNotiferBase&) {}
 	void HandleNotificationAlways(const class CMuleNotiferBase&) {}
+	void HandleNotificationBatched(const class CMuleNotiferBase&) {}
 }
 
 // File_checked_for_headers
@@ -120,6 +120,19 @@ bool CThreadScheduler::AddTask(CThreadTask* task, bool overwrite)
 }
 
 
+size_t CThreadScheduler::GetPendingTaskCount(const wxString& type)
+{
+	wxMutexLocker lock(s_lock);
+
+	if (s_scheduler == NULL) {
+		return 0;
+	}
+
+	CTypeMap::const_iterator it = s_scheduler->m_taskDescs.find(type);
+	return (it == s_scheduler->m_taskDescs.end()) ? 0 : it->second.size();
+}
+
+
 /** Returns string representation of error code. */
 wxString GetErrMsg(wxThreadError err)
 {
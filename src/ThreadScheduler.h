@@ -93,6 +93,11 @@ public:
 	 */
 	static bool AddTask(CThreadTask* task, bool overwrite = false);
 
+	/**
+	 * Returns the number of tasks of the given type that are queued or running.
+	 */
+	static size_t GetPendingTaskCount(const wxString& type);
+
 private:
 	CThreadScheduler();
 	~CThreadScheduler();
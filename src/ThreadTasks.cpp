@@ -277,6 +277,9 @@ CAICHSyncTask::CAICHSyncTask()
 
 void CAICHSyncTask::Entry()
 {
+	// The offsets of the hashsets are recorded again while reading the file
+	CAICHHashSet::m_known2MetIndex.Reset();
+
 	ConvertToKnown2ToKnown264();
 
 	AddDebugLogLineN( logAICHThread, wxT("Syncronization thread started.") );
@@ -298,6 +301,7 @@ void CAICHSyncTask::Entry()
 			AddDebugLogLineC(logAICHThread, wxT("IO failure while creating hashlist (Aborting): ") + e.what());
 			return;
 		}
+		CAICHHashSet::m_known2MetIndex.SetComplete();
 	} else {
 		if (!file.Open(fullpath, CFile::read)) {
 			AddDebugLogLineC( logAICHThread, wxT("Error, failed to open 'known2_64.met' file!") );
@@ -312,6 +316,7 @@ void CAICHSyncTask::Entry()
 
 			uint64 nExistingSize = file.GetLength();
 			while (file.GetPosition() < nExistingSize) {
+				uint64 nPos = file.GetPosition();
 				// Read the next hash
 				hashlist.push_back(CAICHHash(&file));
 
@@ -319,6 +324,7 @@ void CAICHSyncTask::Entry()
 				if (file.GetPosition() + nHashCount * CAICHHash::GetHashSize() > nExistingSize){
 					throw CEOFException(wxT("Hashlist ends past end of file."));
 				}
+				CAICHHashSet::m_known2MetIndex.Add(hashlist.back(), nPos);
 
 				// skip the rest of this hashset
 				nLastVerifiedPos = file.Seek(nHashCount * HASHSIZE, wxFromCurrent);
@@ -330,9 +336,11 @@ void CAICHSyncTask::Entry()
 			file.SetLength(nLastVerifiedPos);
 		} catch (const CIOFailureException& e) {
 			AddDebugLogLineC(logAICHThread, wxT("IO failure while reading hashlist (Aborting): ") + e.what());
+			CAICHHashSet::m_known2MetIndex.Reset();
 
 			return;
 		}
+		CAICHHashSet::m_known2MetIndex.SetComplete();
 
 		AddDebugLogLineN( logAICHThread, wxT("Masterhashes of known files have been loaded.") );
 	}
@@ -97,6 +97,28 @@ uint64 UploadBandwidthThrottler::GetNumberOfSentBytesOverheadSinceLastCallAndRes
 	return numberOfSentBytesSinceLastCall;
 }
 
+/**
+ * @return the number of sockets that have an upload slot
+ */
+size_t UploadBandwidthThrottler::GetSlotCount()
+{
+	wxMutexLocker lock( m_sendLocker );
+
+	return m_StandardOrder_list.size();
+}
+
+/**
+ * @return the number of sockets waiting to send control packets
+ */
+size_t UploadBandwidthThrottler::GetControlQueueLength()
+{
+	wxMutexLocker sendLock( m_sendLocker );
+	wxMutexLocker queueLock( m_tempQueueLocker );
+
+	return m_ControlQueue_list.size() + m_ControlQueueFirst_list.size()
+		+ m_TempControlQueue_list.size() + m_TempControlQueueFirst_list.size();
+}
+
 
 /**
  * Add a socket to the list of sockets that have upload slots. The main thread will
@@ -44,6 +44,8 @@ public:
 
 	uint64 GetNumberOfSentBytesSinceLastCallAndReset();
     uint64 GetNumberOfSentBytesOverheadSinceLastCallAndReset();
+	size_t GetSlotCount();
+	size_t GetControlQueueLength();
 
     void AddToStandardList(uint32 index, ThrottledFileSocket* socket);
     bool RemoveFromStandardList(ThrottledFileSocket* socket);
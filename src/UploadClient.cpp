@@ -286,7 +286,6 @@ void CUpDownClient::CreateStandardPackets(const byte* buffer, uint32 togo, Reque
 {
 	uint32 nPacketSize;
 
-	CMemFile memfile(buffer, togo);
 	if (togo > 10240) {
 		nPacketSize = togo/(uint32)(togo/10240);
 	} else {
@@ -306,7 +305,8 @@ void CUpDownClient::CreateStandardPackets(const byte* buffer, uint32 togo, Reque
 
 		bool bLargeBlocks = (startpos > 0xFFFFFFFF) || (endpos > 0xFFFFFFFF);
 
-		CMemFile data(nPacketSize + 16 + 2 * (bLargeBlocks ? 8 :4));
+		// Reserve room for the packet header, so the packet can take over the buffer
+		CMemFile data(nPacketSize + 16 + 2 * (bLargeBlocks ? 8 :4), CPacket::HeaderSize);
 		data.WriteHash(GetUploadFileID());
 		if (bLargeBlocks) {
 			data.WriteUInt64(startpos);
@@ -315,11 +315,9 @@ void CUpDownClient::CreateStandardPackets(const byte* buffer, uint32 togo, Reque
 			data.WriteUInt32(startpos);
 			data.WriteUInt32(endpos);
 		}
-		char *tempbuf = new char[nPacketSize];
-		memfile.Read(tempbuf, nPacketSize);
-		data.Write(tempbuf, nPacketSize);
-		delete [] tempbuf;
-		CPacket* packet = new CPacket(data, (bLargeBlocks ? OP_EMULEPROT : OP_EDONKEYPROT), (bLargeBlocks ? (uint8)OP_SENDINGPART_I64 : (uint8)OP_SENDINGPART));
+		data.Write(buffer, nPacketSize);
+		buffer += nPacketSize;
+		CPacket* packet = new CPacket((bLargeBlocks ? OP_EMULEPROT : OP_EDONKEYPROT), (bLargeBlocks ? (uint8)OP_SENDINGPART_I64 : (uint8)OP_SENDINGPART), data);
 		theStats::AddUpOverheadFileRequest(16 + 2 * (bLargeBlocks ? 8 :4));
 		theStats::AddUploadToSoft(GetClientSoft(), nPacketSize);
 		AddDebugLogLineN(logLocalClient,
@@ -340,7 +338,7 @@ void CUpDownClient::CreatePackedPackets(const byte* buffer, uint32 togo, Request
 		return;
 	}
 
-	CMemFile memfile(output.get(), newsize);
+	const byte* packed = output.get();
 
 	uint32 totalPayloadSize = 0;
 	uint32 oldSize = togo;
@@ -360,7 +358,7 @@ void CUpDownClient::CreatePackedPackets(const byte* buffer, uint32 togo, Request
 
 		bool isLargeBlock = (currentblock->StartOffset > 0xFFFFFFFF) || (currentblock->EndOffset > 0xFFFFFFFF);
 
-		CMemFile data(nPacketSize + 16 + (isLargeBlock ? 12 : 8));
+		CMemFile data(nPacketSize + 16 + (isLargeBlock ? 12 : 8), CPacket::HeaderSize);
 		data.WriteHash(GetUploadFileID());
 		if (isLargeBlock) {
 			data.WriteUInt64(currentblock->StartOffset);
@@ -368,11 +366,9 @@ void CUpDownClient::CreatePackedPackets(const byte* buffer, uint32 togo, Request
 			data.WriteUInt32(currentblock->StartOffset);
 		}
 		data.WriteUInt32(newsize);
-		char *tempbuf = new char[nPacketSize];
-		memfile.Read(tempbuf, nPacketSize);
-		data.Write(tempbuf,nPacketSize);
-		delete [] tempbuf;
-		CPacket* packet = new CPacket(data, OP_EMULEPROT, (isLargeBlock ? OP_COMPRESSEDPART_I64 : OP_COMPRESSEDPART));
+		data.Write(packed, nPacketSize);
+		packed += nPacketSize;
+		CPacket* packet = new CPacket(OP_EMULEPROT, (isLargeBlock ? OP_COMPRESSEDPART_I64 : OP_COMPRESSEDPART), data);
 
 		// approximate payload size
 		uint32 payloadSize = nPacketSize*oldSize/newsize;
@@ -810,9 +806,9 @@ void CUpDownClient::CheckForAggressive()
 		if ( m_Aggressiveness >= 10 && (!IsBanned() && m_nDownloadState != DS_DOWNLOADING )) {
 			AddDebugLogLineN(logClient, CFormat( wxT("Aggressive client banned (score: %d): %s -- %s -- %s") )
 				% m_Aggressiveness
-				% m_Username
-				% m_strModVersion
-				% m_fullClientVerString );
+				% m_Username.Get()
+				% m_strModVersion.Get()
+				% m_fullClientVerString.Get() );
 			Ban();
 		}
 	} else {
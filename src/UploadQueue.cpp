@@ -48,6 +48,7 @@
 #include "ClientTCPSocket.h"	// Needed for CClientTCPSocket
 #include "SharedFileList.h"	// Needed for CSharedFileList
 #include "updownclient.h"	// Needed for CUpDownClient
+#include "OtherFunctions.h"	// Needed for ListMemoryUsage
 #include "amule.h"		// Needed for theApp
 #include "Preferences.h"
 #include "ClientList.h"
@@ -349,6 +350,16 @@ bool CUploadQueue::IsDownloading(const CUpDownClient* client) const
 }
 
 
+uint64 CUploadQueue::GetMemoryUsage() const
+{
+	uint64 bytes = ListMemoryUsage(m_waitinglist) + ListMemoryUsage(m_uploadinglist) + TreeMemoryUsage(suspendedUploadsSet);
+#if EXTENDED_UPLOADQUEUE
+	bytes += ListMemoryUsage(m_possiblyWaitingList);
+#endif
+	return bytes;
+}
+
+
 CUpDownClient* CUploadQueue::GetWaitingClientByIP_UDP(uint32 dwIP, uint16 nUDPPort, bool bIgnorePortOnUniqueIP, bool* pbMultipleIPs)
 {
 	CUpDownClient* pMatchingIPClient = NULL;
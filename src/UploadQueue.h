@@ -60,6 +60,8 @@ public:
 
 	const CClientRefList& GetWaitingList() const { return m_waitinglist; }
 	const CClientRefList& GetUploadingList() const { return m_uploadinglist; }
+	//! Estimated memory used by the queue lists, the clients not included.
+	uint64	GetMemoryUsage() const;
 
 	CUpDownClient* GetWaitingClientByIP_UDP(uint32 dwIP, uint16 nUDPPort, bool bIgnorePortOnUniqueIP, bool* pbMultipleIPs = NULL);
 
@@ -77,6 +77,12 @@ BEGIN_EVENT_TABLE(CamuleGuiApp, wxApp)
 
 	EVT_MULE_INTERNAL(wxEVT_CORE_SERVER_DNS_DONE, -1, CamuleGuiApp::OnServerDnsDone)
 
+	// Secure ident signature created or checked
+	EVT_MULE_INTERNAL(wxEVT_CORE_SECIDENT_DONE, -1, CamuleGuiApp::OnSecIdentDone)
+
+	// Received UDP datagrams decoded
+	EVT_MULE_INTERNAL(wxEVT_CORE_UDP_DECODED, -1, CamuleGuiApp::OnUDPDecoded)
+
 	// Hash ended notifier
 	EVT_MULE_HASHING(CamuleGuiApp::OnFinishedHashing)
 	EVT_MULE_AICH_HASHING(CamuleGuiApp::OnFinishedAICHHashing)
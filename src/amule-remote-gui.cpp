@@ -263,7 +263,8 @@ bool CamuleRemoteGuiApp::OnInit()
 	m_connect = new CRemoteConnect(this);
 
 #ifdef ASIO_SOCKETS
-	m_AsioService = new CAsioService;
+	// Only the EC connection, one thread is plenty
+	m_AsioService = new CAsioService(1);
 #endif
 
 	glob_prefs = new CPreferencesRem(m_connect);
@@ -1035,6 +1036,7 @@ void CKnownFilesRem::ProcessItemUpdate(const CEC_SharedFile_Tag *tag, CKnownFile
 		for(int i = 0; i < file->GetPartCount(); ++i) {
 			file->m_AvailPartFrequency[i] = data[i];
 		}
+		file->UpdateBarVersion();
 	}
 	wxString fileName;
 	if (tag->FileName(fileName)) {
@@ -1633,6 +1635,7 @@ void CKnownFilesRem::ProcessItemUpdatePartfile(const CEC_PartFile_Tag *tag, CPar
 				file->m_requestedblocks_list.push_back(block);
 			}
 		}
+		file->UpdateBarVersion();
 	}
 
 	// Get source names and counts
@@ -2235,4 +2238,6 @@ DEFINE_LOCAL_EVENT_TYPE(wxEVT_CORE_FINISHED_HTTP_DOWNLOAD)
 DEFINE_LOCAL_EVENT_TYPE(wxEVT_CORE_SOURCE_DNS_DONE)
 DEFINE_LOCAL_EVENT_TYPE(wxEVT_CORE_UDP_DNS_DONE)
 DEFINE_LOCAL_EVENT_TYPE(wxEVT_CORE_SERVER_DNS_DONE)
+DEFINE_LOCAL_EVENT_TYPE(wxEVT_CORE_SECIDENT_DONE)
+DEFINE_LOCAL_EVENT_TYPE(wxEVT_CORE_UDP_DECODED)
 // File_checked_for_headers
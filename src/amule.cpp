@@ -50,6 +50,7 @@
 #include <common/Format.h>		// Needed for CFormat
 #include "kademlia/kademlia/Kademlia.h"
 #include "kademlia/kademlia/Prefs.h"
+#include "kademlia/kademlia/SearchManager.h"
 #include "kademlia/kademlia/UDPFirewallTester.h"
 #include "CanceledFileList.h"
 #include "ClientCreditsList.h"		// Needed for CClientCreditsList
@@ -554,7 +555,7 @@ bool CamuleApp::OnInit()
 	uploadBandwidthThrottler = new UploadBandwidthThrottler();
 
 #ifdef ASIO_SOCKETS
-	m_AsioService = new CAsioService;
+	m_AsioService = new CAsioService(thePrefs::GetAsioThreads());
 #endif
 
 	// Start performing background tasks
@@ -1127,6 +1128,22 @@ void CamuleApp::OnServerDnsDone(CMuleInternalEvent& evt)
 }
 
 
+void CamuleApp::OnSecIdentDone(CMuleInternalEvent& evt)
+{
+	wxCHECK_RET(clientcredits, wxT("Secure ident job finished after shutdown"));
+	clientcredits->OnSecIdentJobDone(static_cast<CSecIdentJob*>(evt.GetClientData()));
+}
+
+
+void CamuleApp::OnUDPDecoded(CMuleInternalEvent& WXUNUSED(evt))
+{
+	// The socket may be gone already when shutting down
+	if (clientudp) {
+		clientudp->ProcessDecoded();
+	}
+}
+
+
 void CamuleApp::OnTCPTimer(CTimerEvent& WXUNUSED(evt))
 {
 	if(!IsRunning()) {
@@ -1143,7 +1160,7 @@ void CamuleApp::OnTCPTimer(CTimerEvent& WXUNUSED(evt))
 void CamuleApp::OnCoreTimer(CTimerEvent& WXUNUSED(evt))
 {
 	// Former TimerProc section
-	static uint64 msPrev1, msPrev5, msPrevSave, msPrevHist, msPrevOS, msPrevKnownMet;
+	static uint64 msPrev1, msPrev5, msPrevSave, msPrevHist, msPrevOS, msPrevKnownMet, msPrevMetrics;
 	uint64 msCur = theStats::GetUptimeMillis();
 	TheTime = msCur / 1000;
 
@@ -1180,6 +1197,9 @@ void CamuleApp::OnCoreTimer(CTimerEvent& WXUNUSED(evt))
 	uploadqueue->Process();
 	downloadqueue->Process();
 	//theApp->clientcredits->Process();
+	if (Kademlia::CKademlia::IsRunning()) {
+		Kademlia::CSearchManager::CheckTimeouts();
+	}
 	theStats::CalculateRates();
 
 	if (msCur-msPrevHist > 1000) {
@@ -1242,6 +1262,11 @@ void CamuleApp::OnCoreTimer(CTimerEvent& WXUNUSED(evt))
 		msPrevOS = msCur;
 	}
 
+	if (!thePrefs::GetMetricsFile().IsEmpty() && msCur - msPrevMetrics >= thePrefs::GetMetricsInterval() * 1000ull) {
+		theStats::ExportMetrics(CPath(thePrefs::GetMetricsFile()));
+		msPrevMetrics = msCur;
+	}
+
 	if (msCur - msPrevKnownMet >= 30*60*1000/*There must be a prefs option for this*/) {
 		// Save Shared Files data
 		knownfiles->Save();
@@ -2061,4 +2086,6 @@ DEFINE_LOCAL_EVENT_TYPE(wxEVT_CORE_FINISHED_HTTP_DOWNLOAD)
 DEFINE_LOCAL_EVENT_TYPE(wxEVT_CORE_SOURCE_DNS_DONE)
 DEFINE_LOCAL_EVENT_TYPE(wxEVT_CORE_UDP_DNS_DONE)
 DEFINE_LOCAL_EVENT_TYPE(wxEVT_CORE_SERVER_DNS_DONE)
+DEFINE_LOCAL_EVENT_TYPE(wxEVT_CORE_SECIDENT_DONE)
+DEFINE_LOCAL_EVENT_TYPE(wxEVT_CORE_UDP_DECODED)
 // File_checked_for_headers
@@ -326,6 +326,8 @@ protected:
 	void OnUDPDnsDone(CMuleInternalEvent& evt);
 	void OnSourceDnsDone(CMuleInternalEvent& evt);
 	void OnServerDnsDone(CMuleInternalEvent& evt);
+	void OnSecIdentDone(CMuleInternalEvent& evt);
+	void OnUDPDecoded(CMuleInternalEvent& evt);
 
 	void OnTCPTimer(CTimerEvent& evt);
 	void OnCoreTimer(CTimerEvent& evt);
@@ -108,6 +108,12 @@ BEGIN_EVENT_TABLE(CamuleDaemonApp, wxAppConsole)
 
 	EVT_MULE_INTERNAL(wxEVT_CORE_SERVER_DNS_DONE, -1, CamuleDaemonApp::OnServerDnsDone)
 
+	// Secure ident signature created or checked
+	EVT_MULE_INTERNAL(wxEVT_CORE_SECIDENT_DONE, -1, CamuleDaemonApp::OnSecIdentDone)
+
+	// Received UDP datagrams decoded
+	EVT_MULE_INTERNAL(wxEVT_CORE_UDP_DECODED, -1, CamuleDaemonApp::OnUDPDecoded)
+
 	// Hash ended notifier
 	EVT_MULE_HASHING(CamuleDaemonApp::OnFinishedHashing)
 	EVT_MULE_AICH_HASHING(CamuleDaemonApp::OnFinishedAICHHashing)
@@ -49,4 +49,8 @@ enum CanceledFileListVersions {
 	CANCELEDFILE_VERSION	= 0x21
 };
 
+enum IPFilterCacheVersions {
+	IPFILTERCACHE_VERSION	= 0x01
+};
+
 #endif // DATAFILEVERSION_H
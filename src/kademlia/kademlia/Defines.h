@@ -51,6 +51,9 @@ const unsigned int K	=		10;
 #define LOG_BASE_EXPONENT		5
 #define HELLO_TIMEOUT			20
 #define SEARCH_JUMPSTART		1
+#define SEARCH_REQUEST_TIMEOUT		SEC2MS(3)	// for contacts without a round trip time
+#define SEARCH_REQUEST_MIN_TIMEOUT	300
+#define SEARCH_UNKNOWN_RTT		500	// assumed when choosing the next contact to ask
 #define SEARCH_LIFETIME			45
 #define SEARCHFILE_LIFETIME		45
 #define SEARCHKEYWORD_LIFETIME		45
@@ -296,11 +296,11 @@ void CKademlia::Process()
 	}
 }
 
-void CKademlia::ProcessPacket(const uint8_t *data, uint32_t lenData, uint32_t ip, uint16_t port, bool validReceiverKey, const CKadUDPKey& senderKey)
+void CKademlia::ProcessPacket(const uint8_t *data, uint32_t lenData, uint32_t ip, uint16_t port, bool validReceiverKey, const CKadUDPKey& senderKey, CKadParsedRequest* request)
 {
 	try {
 		if( instance && instance->m_udpListener ) {
-			instance->m_udpListener->ProcessPacket(data, lenData, ip, port, validReceiverKey, senderKey);
+			instance->m_udpListener->ProcessPacket(data, lenData, ip, port, validReceiverKey, senderKey, request);
 		}
 	} catch (const wxString& DEBUG_ONLY(error)) {
 		AddDebugLogLineN(logKadMain, CFormat(wxT("Exception on Kad ProcessPacket while processing packet (length = %u) from %s:"))
@@ -313,6 +313,19 @@ void CKademlia::ProcessPacket(const uint8_t *data, uint32_t lenData, uint32_t ip
 	}
 }
 
+void CKademlia::PacketsReceived()
+{
+	if (instance && instance->m_udpListener && instance->m_prefs) {
+		//Update connection state only when it changes.
+		bool curCon = instance->m_prefs->HasHadContact();
+		instance->m_prefs->SetLastContact();
+		CUDPFirewallTester::Connected();
+		if (curCon != instance->m_prefs->HasHadContact()) {
+			theApp->ShowConnectionState();
+		}
+	}
+}
+
 void CKademlia::RecheckFirewalled()
 {
 	if (instance && instance->m_prefs && !IsRunningInLANMode()) {
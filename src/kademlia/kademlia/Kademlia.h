@@ -97,7 +97,16 @@ public:
 		}
 	}
 
-	static void ProcessPacket(const uint8_t* data, uint32_t lenData, uint32_t ip, uint16_t port, bool validReceiverKey, const CKadUDPKey& senderKey);
+	/**
+	 * Handles a received Kad packet.
+	 *
+	 * The packet must have passed CPacketTracking::CheckInRequest().
+	 * 'request' is the packet as parsed by CKademliaUDPListener::ParseRequest()
+	 * already, or NULL if it is to be parsed here.
+	 */
+	static void ProcessPacket(const uint8_t* data, uint32_t lenData, uint32_t ip, uint16_t port, bool validReceiverKey, const CKadUDPKey& senderKey, CKadParsedRequest* request = NULL);
+	/** Updates the connection state, once for a batch of received packets. */
+	static void PacketsReceived();
 
 	static void AddEvent(CRoutingZone *zone) throw()		{ m_events[zone] = zone; }
 	static void RemoveEvent(CRoutingZone *zone)			{ m_events.erase(zone); }
@@ -62,6 +62,7 @@ there client on the eMule forum..
 #include "../../Logger.h"
 #include "../../Preferences.h"
 #include "../../GuiEvents.h"
+#include "../../GetTickCount.h"
 
 ////////////////////////////////////////
 using namespace Kademlia;
@@ -77,7 +78,6 @@ CSearch::CSearch()
 	m_stopping = false;
 	m_totalLoad = 0;
 	m_totalLoadResponses = 0;
-	m_lastResponse = m_created;
 	m_searchTermsData = NULL;
 	m_searchTermsDataSize = 0;
 	m_nodeSpecialSearchRequester = NULL;
@@ -154,33 +154,33 @@ CSearch::~CSearch()
 void CSearch::Go()
 {
 	// Start with a lot of possible contacts, this is a fallback in case search stalls due to dead contacts
-	if (m_possible.empty()) {
+	if (!m_candidates.HasPossible()) {
+		ContactMap possible;
 		CUInt128 distance(CKademlia::GetPrefs()->GetKadID() ^ m_target);
-		CKademlia::GetRoutingZone()->GetClosestTo(3, m_target, distance, 50, &m_possible, true, true);
-	}
+		CKademlia::GetRoutingZone()->GetClosestTo(3, m_target, distance, 50, &possible, true, true);
 
-	if (!m_possible.empty()) {
 		//Lets keep our contact list entries in mind to dec the inUse flag.
-		for (ContactMap::iterator it = m_possible.begin(); it != m_possible.end(); ++it) {
+		for (ContactMap::iterator it = possible.begin(); it != possible.end(); ++it) {
+			m_candidates.Add(it->first, it->second);
 			m_inUse[it->first] = it->second;
 		}
+	}
 
-		wxASSERT(m_possible.size() == m_inUse.size());
-
-		// Take top ALPHA_QUERY to start search with.
-		int count = m_type == NODE ? 1 : min(ALPHA_QUERY, (int)m_possible.size());
+	// Take top ALPHA_QUERY to start search with, the fastest of the closest first.
+	int count = m_type == NODE ? 1 : ALPHA_QUERY;
 
-		// Send initial packets to start the search.
-		ContactMap::iterator it = m_possible.begin();
-		for (int i = 0; i < count; i++) {
-			CContact *c = it->second;
-			// Move to tried
-			m_tried[it->first] = c;
-			// Send the KadID so other side can check if I think it has the right KadID.
-			// Send request
-			SendFindValue(c);
-			++it;
+	// Send initial packets to start the search.
+	for (int i = 0; i < count; i++) {
+		const CandidateList::Candidate *next = m_candidates.GetNextUntried(ALPHA_QUERY);
+		if (next == NULL) {
+			break;
 		}
+		CContact *c = next->contact;
+		// Move to tried
+		m_candidates.SetTried(next->distance);
+		// Send the KadID so other side can check if I think it has the right KadID.
+		// Send request
+		SendFindValue(c);
 	}
 }
 
@@ -237,14 +237,17 @@ void CSearch::PrepareToStop() throw()
 
 void CSearch::JumpStart()
 {
-	// If we had a response within the last 3 seconds, no need to jumpstart the search.
-	if ((time_t)(m_lastResponse + SEC(3)) > time(NULL)) {
+	// If we are still waiting for an answer, no need to jumpstart the search.
+	m_candidates.ExpireRequests(::GetTickCount());
+	if (m_candidates.GetWaitingCount() > 0) {
 		return;
 	}
 
-	// If we ran out of contacts, stop search.
-	if (m_possible.empty()) {
-		PrepareToStop();
+	// If we ran out of contacts, stop search, once late answers are unlikely.
+	if (!m_candidates.HasPossible()) {
+		if (::GetTickCount() - m_candidates.GetLastRequest() >= SEARCH_REQUEST_TIMEOUT) {
+			PrepareToStop();
+		}
 		return;
 	}
 
@@ -253,44 +256,54 @@ void CSearch::JumpStart()
 	// The reason for this is that we may not have found the closest node alive due to results being limited to 2 contacts,
 	// which could very well have been the duplicates of our dead closest nodes
 	bool lookupCloserNodes = false;
-	if (m_requestedMoreNodesContact == NULL && GetRequestContactCount() == KADEMLIA_FIND_VALUE && m_tried.size() >= 3 * KADEMLIA_FIND_VALUE) {
-		ContactMap::const_iterator it = m_tried.begin();
+	if (m_requestedMoreNodesContact == NULL && GetRequestContactCount() == KADEMLIA_FIND_VALUE && m_candidates.GetTriedCount() >= 3 * KADEMLIA_FIND_VALUE) {
+		size_t i = 0;
 		lookupCloserNodes = true;
-		for (unsigned i = 0; i < KADEMLIA_FIND_VALUE; i++) {
-			if (m_responded.count(it->first) > 0) {
-				lookupCloserNodes = false;
-				break;
+		for (unsigned tried = 0; tried < KADEMLIA_FIND_VALUE; i++) {
+			if (m_candidates[i].IsTried()) {
+				if (m_candidates[i].HasResponded()) {
+					lookupCloserNodes = false;
+					break;
+				}
+				tried++;
 			}
-			++it;
 		}
 		if (lookupCloserNodes) {
-			while (it != m_tried.end()) {
-				if (m_responded.count(it->first) > 0) {
+			for (; i < m_candidates.size(); i++) {
+				if (m_candidates[i].IsTried() && m_candidates[i].HasResponded()) {
 					AddDebugLogLineN(logKadSearch, CFormat(wxT("Best %d nodes for lookup (id=%x) were unreachable or dead, reasking closest for more")) % KADEMLIA_FIND_VALUE % GetSearchID());
-					SendFindValue(it->second, true);
+					SendFindValue(m_candidates[i].contact, true);
 					return;
 				}
-				++it;
 			}
 		}
 	}
 
 	// Search for contacts that can be used to jumpstart a stalled search.
-	while (!m_possible.empty()) {
+	while (m_candidates.HasPossible()) {
 		// Get a contact closest to our target.
-		CContact *c = m_possible.begin()->second;
+		const CandidateList::Candidate *first = m_candidates.GetFirstPossible();
 
 		// Have we already tried to contact this node.
-		if (m_tried.count(m_possible.begin()->first) > 0) {
+		if (first->IsTried()) {
 			// Did we get a response from this node, if so, try to store or get info.
-			if (m_responded.count(m_possible.begin()->first) > 0) {
+			if (first->HasResponded()) {
 				StorePacket();
 			}
 			// Remove from possible list.
-			m_possible.erase(m_possible.begin());
+			m_candidates.RemoveFirstPossible();
 		} else {
+			// Contacts further than one that responded are only asked at the
+			// pace of a stalled search, the lookup has converged.
+			const CandidateList::Candidate *responded = m_candidates.GetFirstResponded();
+			if (responded != NULL && responded->distance < first->distance && ::GetTickCount() - m_candidates.GetLastRequest() < SEARCH_REQUEST_TIMEOUT) {
+				break;
+			}
+			// Ask the fastest of the closest untried contacts.
+			const CandidateList::Candidate *next = m_candidates.GetNextUntried(ALPHA_QUERY);
+			CContact *c = next->contact;
 			// Add to tried list.
-			m_tried[m_possible.begin()->first] = c;
+			m_candidates.SetTried(next->distance);
 			// Send the KadID so other side can check if I think it has the right KadID.
 			// Send request
 			SendFindValue(c);
@@ -300,6 +313,14 @@ void CSearch::JumpStart()
 
 }
 
+void CSearch::CheckTimeouts(uint32_t now)
+{
+	// Go on when the last waiting request times out, not on the next jumpstart.
+	if (!m_stopping && m_candidates.ExpireRequests(now) > 0 && m_candidates.GetWaitingCount() == 0) {
+		JumpStart();
+	}
+}
+
 void CSearch::ProcessResponse(uint32_t fromIP, uint16_t fromPort, ContactList *results)
 {
 	AddDebugLogLineN(logKadSearch, wxT("Processing search response from ") + KadIPPortToString(fromIP, fromPort));
@@ -310,17 +331,22 @@ void CSearch::ProcessResponse(uint32_t fromIP, uint16_t fromPort, ContactList *r
 		m_delete.push_back(*response);
 	}
 
-	m_lastResponse = time(NULL);
-
 	// Find contact that is responding.
 	CUInt128 fromDistance(0u);
 	CContact *fromContact = NULL;
-	for (ContactMap::const_iterator it = m_tried.begin(); it != m_tried.end(); ++it) {
-		CContact *tmpContact = it->second;
-		if ((tmpContact->GetIPAddress() == fromIP) && (tmpContact->GetUDPPort() == fromPort)) {
-			fromDistance = it->first;
-			fromContact = tmpContact;
-			break;
+	const CandidateList::Candidate *from = m_candidates.FindTried(fromIP, fromPort);
+	if (from != NULL) {
+		fromDistance = from->distance;
+		fromContact = from->contact;
+
+		uint32_t rtt;
+		if (m_candidates.SetAnswered(fromDistance, ::GetTickCount(), rtt)) {
+			fromContact->UpdateRTT(rtt);
+			// Contacts from results are copies, the routing table keeps its own
+			CContact *known = CKademlia::GetRoutingZone()->GetContact(fromContact->GetClientID());
+			if (known != NULL && known != fromContact) {
+				known->UpdateRTT(rtt);
+			}
 		}
 	}
 
@@ -342,7 +368,7 @@ void CSearch::ProcessResponse(uint32_t fromIP, uint16_t fromPort, ContactList *r
 		// Note that we got an answer.
 		m_answers++;
 		// We clear the possible list to force the search to stop.
-		m_possible.clear();
+		m_candidates.ClearPossible();
 		return;
 	}
 
@@ -365,12 +391,13 @@ void CSearch::ProcessResponse(uint32_t fromIP, uint16_t fromPort, ContactList *r
 			}
 
 			// Ignore this contact if already known or tried it.
-			if (m_possible.count(distance) > 0) {
-				AddDebugLogLineN(logKadSearch, wxT("Search result from already known client: ignore"));
-				continue;
-			}
-			if (m_tried.count(distance) > 0) {
-				AddDebugLogLineN(logKadSearch, wxT("Search result from already tried client: ignore"));
+			const CandidateList::Candidate *known = m_candidates.Find(distance);
+			if (known != NULL) {
+				if (known->IsPossible()) {
+					AddDebugLogLineN(logKadSearch, wxT("Search result from already known client: ignore"));
+				} else {
+					AddDebugLogLineN(logKadSearch, wxT("Search result from already tried client: ignore"));
+				}
 				continue;
 			}
 
@@ -396,31 +423,20 @@ void CSearch::ProcessResponse(uint32_t fromIP, uint16_t fromPort, ContactList *r
 				receivedSubnets[c->GetIPAddress() & 0xFFFFFF00] = 1;
 			}
 
-			// Add to possible
-			m_possible[distance] = c;
+			// Add to possible, with the round trip time known from the routing table
+			CContact *routingContact = CKademlia::GetRoutingZone()->GetContact(c->GetClientID());
+			if (routingContact != NULL) {
+				c->SetRTT(routingContact->GetRTT());
+			}
+			m_candidates.Add(distance, c);
 
 			// Verify if the result is closer to the target than the one we just checked.
 			if (distance < fromDistance) {
 				// The top ALPHA_QUERY of results are used to determine if we send a request.
-				bool top = false;
-				if (m_best.size() < ALPHA_QUERY) {
-					top = true;
-					m_best[distance] = c;
-				} else {
-					ContactMap::iterator worst = m_best.end();
-					--worst;
-					if (distance < worst->first) {
-						// Prevent having more than ALPHA_QUERY within the Best list.
-						m_best.erase(worst);
-						m_best[distance] = c;
-						top = true;
-					}
-				}
-
-				if (top) {
+				if (m_candidates.OfferBest(distance, ALPHA_QUERY)) {
 					// We determined this contact is a candidate for a request.
 					// Add to tried
-					m_tried[distance] = c;
+					m_candidates.SetTried(distance);
 					// Send the KadID so other side can check if I think it has the right KadID.
 					// Send request
 					SendFindValue(c);
@@ -429,24 +445,29 @@ void CSearch::ProcessResponse(uint32_t fromIP, uint16_t fromPort, ContactList *r
 		}
 
 		// Add to list of people who responded.
-		m_responded[fromDistance] = providedCloserContacts;
+		m_candidates.SetResponded(fromDistance, providedCloserContacts);
 
 		// Complete node search, just increment the counter.
 		if (m_type == NODECOMPLETE || m_type == NODESPECIAL) {
 			AddDebugLogLineN(logKadSearch, wxString(wxT("Search result type: Node")) + (m_type == NODECOMPLETE ? wxT("Complete") : wxT("Special")));
 			m_answers++;
 		}
+
+		// Nothing left to wait for, go on right away instead of on the next jumpstart.
+		if (!m_stopping && m_candidates.GetWaitingCount() == 0) {
+			JumpStart();
+		}
 	}
 }
 
 void CSearch::StorePacket()
 {
-	wxASSERT(!m_possible.empty());
+	wxASSERT(m_candidates.HasPossible());
 
 	// This method is currently only called by jumpstart so only use best possible.
-	ContactMap::const_iterator possible = m_possible.begin();
-	CUInt128 fromDistance(possible->first);
-	CContact *from = possible->second;
+	const CandidateList::Candidate *possible = m_candidates.GetFirstPossible();
+	CUInt128 fromDistance(possible->distance);
+	CContact *from = possible->contact;
 
 	if (fromDistance < m_closestDistantFound || m_closestDistantFound == 0) {
 		m_closestDistantFound = fromDistance;
@@ -1125,6 +1146,7 @@ void CSearch::SendFindValue(CContact *contact, bool reaskMore)
 				CKademlia::GetUDPListener()->SendPacket(packetdata, KADEMLIA2_REQ, contact->GetIPAddress(), contact->GetUDPPort(), 0, NULL);
 				wxASSERT(contact->GetUDPKey() == CKadUDPKey(0));
 			}
+			m_candidates.SetRequested(contact->GetClientID() ^ m_target, ::GetTickCount());
 #ifdef __DEBUG__
 			switch (m_type) {
 				case NODE:
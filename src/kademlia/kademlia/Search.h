@@ -40,6 +40,7 @@ there client on the eMule forum..
 #define __SEARCH_H__
 
 #include "SearchManager.h"
+#include "SearchCandidates.h"
 
 class CKnownFile;
 class CTag;
@@ -108,6 +109,7 @@ private:
 	void ProcessResultKeyword(const CUInt128 &answer, TagPtrList *info);
 	void ProcessResultNotes(const CUInt128 &answer, TagPtrList *info);
 	void JumpStart();
+	void CheckTimeouts(uint32_t now);
 	void SendFindValue(CContact *contact, bool reaskMore = false);
 	void PrepareToStop() throw();
 	void StorePacket();
@@ -121,7 +123,6 @@ private:
 	uint32_t	m_totalRequestAnswers;
 	uint32_t	m_totalLoad;
 	uint32_t	m_totalLoadResponses;
-	uint32_t	m_lastResponse;
 
 	uint32_t	m_searchID;
 	CUInt128	m_target;
@@ -132,12 +133,9 @@ private:
 	UIntList	m_fileIDs;
 	CKadClientSearcher *m_nodeSpecialSearchRequester; // used to callback result for NODESPECIAL searches
 
-	typedef std::map<CUInt128, bool>	RespondedMap;
+	typedef CSearchCandidates<CContact> CandidateList;
 
-	ContactMap	m_possible;
-	ContactMap	m_tried;
-	RespondedMap	m_responded;
-	ContactMap	m_best;
+	CandidateList	m_candidates;
 	ContactList	m_delete;
 	ContactMap	m_inUse;
 	CUInt128	m_closestDistantFound; // not used for the search itself, but for statistical data collecting
@@ -0,0 +1,336 @@
+//								-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2008-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef KADEMLIA_KADEMLIA_SEARCHCANDIDATES_H
+#define KADEMLIA_KADEMLIA_SEARCHCANDIDATES_H
+
+#include <common/Macros.h>	// Needed for SEC2MS
+#include "Defines.h"		// Needed for SEARCH_REQUEST_TIMEOUT
+#include "../utils/UInt128.h"	// Needed for CUInt128
+
+#include <algorithm>
+#include <vector>
+
+namespace Kademlia
+{
+
+/**
+ * The contacts of a lookup, in one array sorted by their distance to the
+ * target.
+ *
+ * A contact is possible until the lookup is done with it, tried once a
+ * request was sent to it, and responded once it answered. Requests are
+ * waiting for an answer until they time out, after a multiple of the round
+ * trip time of the contact. Contacts without a round trip time get the
+ * average of the answers to this lookup so far. A lookup has stalled when
+ * no requests are waiting.
+ *
+ * CONTACT must provide GetIPAddress(), GetUDPPort() and GetRTT(), the
+ * smoothed round trip time in milliseconds or 0 if it is not known.
+ */
+template <typename CONTACT>
+class CSearchCandidates
+{
+      public:
+	enum {
+		TRIED		= 0x01,
+		//! Waiting for the answer to a request.
+		WAITING		= 0x02,
+		//! The request timed out without an answer.
+		EXPIRED		= 0x04,
+		RESPONDED	= 0x08,
+		//! The response had contacts closer to the target.
+		CLOSER		= 0x10,
+		//! No longer possible.
+		DONE		= 0x20
+	};
+
+	struct Candidate {
+		Candidate(const CUInt128& d, CONTACT* c)
+			: distance(d), contact(c), sent(0), timeout(0), state(0)
+		{}
+
+		bool IsTried() const		{ return (state & TRIED) != 0; }
+		bool HasResponded() const	{ return (state & RESPONDED) != 0; }
+		bool IsPossible() const		{ return (state & DONE) == 0; }
+
+		CUInt128	distance;
+		CONTACT*	contact;
+		//! Tick the last request was sent.
+		uint32_t	sent;
+		//! Milliseconds to wait for the answer, 0 for the lookup average.
+		uint32_t	timeout;
+		uint8_t		state;
+	};
+
+	CSearchCandidates()
+		: m_possibleCount(0), m_triedCount(0), m_waitingCount(0), m_averageRTT(0), m_lastRequest(0)
+	{}
+
+	/** Adds a possible contact, returning false if the distance is known. */
+	bool Add(const CUInt128& distance, CONTACT* contact)
+	{
+		typename CandidateArray::iterator it = LowerBound(distance);
+		if (it != m_candidates.end() && it->distance == distance) {
+			return false;
+		}
+		m_candidates.insert(it, Candidate(distance, contact));
+		m_possibleCount++;
+		return true;
+	}
+
+	/** Returns the contact at this distance, or NULL. */
+	const Candidate* Find(const CUInt128& distance) const
+	{
+		typename CandidateArray::const_iterator it = std::lower_bound(m_candidates.begin(), m_candidates.end(), distance, DistanceLess());
+		return (it != m_candidates.end() && it->distance == distance) ? &*it : NULL;
+	}
+
+	bool IsKnown(const CUInt128& distance) const	{ return Find(distance) != NULL; }
+
+	/** Returns the tried contact with this address, or NULL. */
+	const Candidate* FindTried(uint32_t ip, uint16_t port) const
+	{
+		for (typename CandidateArray::const_iterator it = m_candidates.begin(); it != m_candidates.end(); ++it) {
+			if (it->IsTried() && it->contact->GetIPAddress() == ip && it->contact->GetUDPPort() == port) {
+				return &*it;
+			}
+		}
+		return NULL;
+	}
+
+	/** Marks a contact as tried. */
+	void SetTried(const CUInt128& distance)
+	{
+		Candidate* c = Get(distance);
+		if (c && !c->IsTried()) {
+			c->state |= TRIED;
+			m_triedCount++;
+		}
+	}
+
+	/** Notes a request sent to a contact at 'now'. */
+	void SetRequested(const CUInt128& distance, uint32_t now)
+	{
+		Candidate* c = Get(distance);
+		if (c) {
+			if (!(c->state & WAITING)) {
+				m_waitingCount++;
+			}
+			c->state = (c->state | WAITING) & ~EXPIRED;
+			c->sent = now;
+			m_lastRequest = now;
+			c->timeout = c->contact->GetRTT() ? GetTimeout(c->contact->GetRTT()) : 0;
+		}
+	}
+
+	/**
+	 * Notes an answer from a contact at 'now'. Returns true and the round
+	 * trip time in 'rtt' if it answers a request, even a timed out one.
+	 */
+	bool SetAnswered(const CUInt128& distance, uint32_t now, uint32_t& rtt)
+	{
+		Candidate* c = Get(distance);
+		if (c == NULL || !(c->state & (WAITING | EXPIRED))) {
+			return false;
+		}
+		if (c->state & WAITING) {
+			m_waitingCount--;
+		}
+		c->state &= ~(WAITING | EXPIRED);
+		rtt = now - c->sent;
+		m_averageRTT = m_averageRTT ? (m_averageRTT * 3 + rtt) / 4 : std::max<uint32_t>(rtt, 1);
+		return true;
+	}
+
+	/**
+	 * Marks a contact as responded, with closer contacts or not. A contact
+	 * given up on before it responded is possible again.
+	 */
+	void SetResponded(const CUInt128& distance, bool closer)
+	{
+		Candidate* c = Get(distance);
+		if (c) {
+			if (!c->HasResponded() && !c->IsPossible()) {
+				c->state &= ~DONE;
+				m_possibleCount++;
+			}
+			c->state = (c->state & ~CLOSER) | RESPONDED | (closer ? CLOSER : 0);
+		}
+	}
+
+	/** Stops waiting for the requests that timed out, returning their number. */
+	size_t ExpireRequests(uint32_t now)
+	{
+		size_t expired = 0;
+		if (m_waitingCount) {
+			uint32_t averageTimeout = GetTimeout(m_averageRTT);
+			for (typename CandidateArray::iterator it = m_candidates.begin(); it != m_candidates.end(); ++it) {
+				if ((it->state & WAITING) && now - it->sent >= (it->timeout ? it->timeout : averageTimeout)) {
+					it->state = (it->state & ~WAITING) | EXPIRED;
+					expired++;
+				}
+			}
+			m_waitingCount -= expired;
+		}
+		return expired;
+	}
+
+	/** Tick the last request was sent. */
+	uint32_t GetLastRequest() const	{ return m_lastRequest; }
+	/** Number of requests waiting for an answer. */
+	size_t GetWaitingCount() const	{ return m_waitingCount; }
+	/** Number of contacts tried so far. */
+	size_t GetTriedCount() const	{ return m_triedCount; }
+	bool HasPossible() const	{ return m_possibleCount > 0; }
+
+	/** Returns the closest possible contact, or NULL. */
+	const Candidate* GetFirstPossible() const
+	{
+		for (typename CandidateArray::const_iterator it = m_candidates.begin(); it != m_candidates.end(); ++it) {
+			if (it->IsPossible()) {
+				return &*it;
+			}
+		}
+		return NULL;
+	}
+
+	/** Returns the closest contact that responded, possible or not, or NULL. */
+	const Candidate* GetFirstResponded() const
+	{
+		for (typename CandidateArray::const_iterator it = m_candidates.begin(); it != m_candidates.end(); ++it) {
+			if (it->HasResponded()) {
+				return &*it;
+			}
+		}
+		return NULL;
+	}
+
+	/** The lookup is done with the closest possible contact. */
+	void RemoveFirstPossible()
+	{
+		for (typename CandidateArray::iterator it = m_candidates.begin(); it != m_candidates.end(); ++it) {
+			if (it->IsPossible()) {
+				it->state |= DONE;
+				m_possibleCount--;
+				break;
+			}
+		}
+	}
+
+	/** The lookup is done with all contacts. */
+	void ClearPossible()
+	{
+		for (typename CandidateArray::iterator it = m_candidates.begin(); it != m_candidates.end(); ++it) {
+			it->state |= DONE;
+		}
+		m_possibleCount = 0;
+	}
+
+	/**
+	 * Returns the fastest of the 'window' closest possible contacts that
+	 * were not tried yet, or NULL. Contacts without a round trip time count
+	 * as taking SEARCH_UNKNOWN_RTT.
+	 */
+	const Candidate* GetNextUntried(size_t window) const
+	{
+		const Candidate* best = NULL;
+		uint32_t bestRTT = 0;
+		for (typename CandidateArray::const_iterator it = m_candidates.begin(); window > 0 && it != m_candidates.end(); ++it) {
+			if (it->IsPossible() && !it->IsTried()) {
+				uint32_t rtt = it->contact->GetRTT() ? it->contact->GetRTT() : SEARCH_UNKNOWN_RTT;
+				if (best == NULL || rtt < bestRTT) {
+					best = &*it;
+					bestRTT = rtt;
+				}
+				window--;
+			}
+		}
+		return best;
+	}
+
+	/**
+	 * Keeps the 'count' closest distances offered, returning true if this
+	 * one is among them now.
+	 */
+	bool OfferBest(const CUInt128& distance, size_t count)
+	{
+		std::vector<CUInt128>::iterator it = std::lower_bound(m_best.begin(), m_best.end(), distance);
+		if (m_best.size() < count) {
+			m_best.insert(it, distance);
+			return true;
+		} else if (it != m_best.end()) {
+			m_best.pop_back();
+			m_best.insert(it, distance);
+			return true;
+		}
+		return false;
+	}
+
+	/** All contacts, possible or not, closest first. */
+	const Candidate& operator[](size_t index) const	{ return m_candidates[index]; }
+	size_t size() const	{ return m_candidates.size(); }
+	bool empty() const	{ return m_candidates.empty(); }
+
+	/** Milliseconds to wait for an answer from a contact with this round trip time. */
+	static uint32_t GetTimeout(uint32_t rtt)
+	{
+		if (rtt == 0) {
+			return SEARCH_REQUEST_TIMEOUT;
+		}
+		return std::max<uint32_t>(SEARCH_REQUEST_MIN_TIMEOUT, std::min<uint32_t>(SEARCH_REQUEST_TIMEOUT, 4 * rtt));
+	}
+
+      private:
+	typedef std::vector<Candidate> CandidateArray;
+
+	struct DistanceLess {
+		bool operator()(const Candidate& c, const CUInt128& distance) const	{ return c.distance < distance; }
+	};
+
+	typename CandidateArray::iterator LowerBound(const CUInt128& distance)
+	{
+		return std::lower_bound(m_candidates.begin(), m_candidates.end(), distance, DistanceLess());
+	}
+
+	Candidate* Get(const CUInt128& distance)
+	{
+		typename CandidateArray::iterator it = LowerBound(distance);
+		return (it != m_candidates.end() && it->distance == distance) ? &*it : NULL;
+	}
+
+	CandidateArray		m_candidates;
+	//! The closest distances offered to OfferBest(), sorted.
+	std::vector<CUInt128>	m_best;
+	size_t			m_possibleCount;
+	size_t			m_triedCount;
+	size_t			m_waitingCount;
+	//! Smoothed round trip time of the answers so far, 0 if none.
+	uint32_t		m_averageRTT;
+	uint32_t		m_lastRequest;
+};
+
+} // namespace Kademlia
+
+#endif /* KADEMLIA_KADEMLIA_SEARCHCANDIDATES_H */
@@ -49,6 +49,7 @@ there client on the eMule forum..
 #include "../../RandomFunctions.h"		// Needed for GetRandomUInt128()
 #include "../../OtherFunctions.h"		// Needed for DeleteContents()
 #include "../../CompilerSpecific.h"		// Needed for __FUNCTION__
+#include "../../GetTickCount.h"			// Needed for GetTickCount()
 
 #include <wx/tokenzr.h>
 
@@ -395,6 +396,14 @@ void CSearchManager::JumpStart()
 	}
 }
 
+void CSearchManager::CheckTimeouts()
+{
+	uint32_t now = ::GetTickCount();
+	for (SearchMap::iterator it = m_searches.begin(); it != m_searches.end(); ++it) {
+		it->second->CheckTimeouts(now);
+	}
+}
+
 void CSearchManager::UpdateStats() throw()
 {
 	uint8_t m_totalFile = 0;
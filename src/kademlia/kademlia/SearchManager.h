@@ -84,6 +84,9 @@ public:
 
 	static void UpdateStats() throw();
 
+	// Lets lookups go on as soon as their last waiting request timed out
+	static void CheckTimeouts();
+
 	static bool AlreadySearchingFor(const CUInt128& target) throw() { return m_searches.count(target) > 0; }
 
 	static const wxChar* GetInvalidKeywordChars() { return wxT(" ()[]{}<>,._-!?:;\\/\""); }
@@ -95,6 +95,22 @@ CKademliaUDPListener::~CKademliaUDPListener()
 	}
 }
 
+CKadParsedRequest::CKadParsedRequest(uint8_t opcode)
+	: m_opcode(opcode),
+	  m_startPosition(0),
+	  m_fileSize(0),
+	  m_searchTerms(NULL),
+	  m_entry(NULL)
+{
+}
+
+CKadParsedRequest::~CKadParsedRequest()
+{
+	CKademliaUDPListener::Free(m_searchTerms);
+	DeleteContents(m_keyEntries);
+	delete m_entry;
+}
+
 // Used by Kad1.0 and Kad2.0
 void CKademliaUDPListener::Bootstrap(uint32_t ip, uint16_t port, uint8_t kadVersion, const CUInt128* cryptTargetID)
 {
@@ -210,7 +226,51 @@ void CKademliaUDPListener::SendPublishSourcePacket(const CContact& contact, cons
 	}
 }
 
-void CKademliaUDPListener::ProcessPacket(const uint8_t* data, uint32_t lenData, uint32_t ip, uint16_t port, bool validReceiverKey, const CKadUDPKey& senderKey)
+CKadParsedRequest* CKademliaUDPListener::ParseRequest(const uint8_t* data, uint32_t lenData, uint32_t ip, uint16_t port)
+{
+	uint8_t opcode = data[1];
+	switch (opcode) {
+		case KADEMLIA2_SEARCH_NOTES_REQ:
+		case KADEMLIA2_SEARCH_KEY_REQ:
+		case KADEMLIA2_SEARCH_SOURCE_REQ:
+		case KADEMLIA2_PUBLISH_NOTES_REQ:
+		case KADEMLIA2_PUBLISH_KEY_REQ:
+		case KADEMLIA2_PUBLISH_SOURCE_REQ:
+			break;
+		default:
+			return NULL;
+	}
+
+	CScopedPtr<CKadParsedRequest> request(new CKadParsedRequest(opcode));
+	CMemFile bio(data + 2, lenData - 2);
+	request->m_target = bio.ReadUInt128();
+
+	switch (opcode) {
+		case KADEMLIA2_SEARCH_NOTES_REQ:
+			request->m_fileSize = bio.ReadUInt64();
+			break;
+		case KADEMLIA2_SEARCH_KEY_REQ:
+			Parse2SearchKeyRequest(*request, bio);
+			break;
+		case KADEMLIA2_SEARCH_SOURCE_REQ:
+			request->m_startPosition = (bio.ReadUInt16() & 0x7FFF);
+			request->m_fileSize = bio.ReadUInt64();
+			break;
+		case KADEMLIA2_PUBLISH_NOTES_REQ:
+			Parse2PublishNotesRequest(*request, bio, ip, port);
+			break;
+		case KADEMLIA2_PUBLISH_KEY_REQ:
+			Parse2PublishKeyRequest(*request, bio, ip, port);
+			break;
+		case KADEMLIA2_PUBLISH_SOURCE_REQ:
+			Parse2PublishSourceRequest(*request, bio, ip, port);
+			break;
+	}
+
+	return request.release();
+}
+
+void CKademliaUDPListener::ProcessPacket(const uint8_t* data, uint32_t lenData, uint32_t ip, uint16_t port, bool validReceiverKey, const CKadUDPKey& senderKey, CKadParsedRequest* request)
 {
 	// we do not accept (<= 0.48a) unencrypted incoming packets from port 53 (DNS) to avoid attacks based on DNS protocol confusion
 	if (port == 53 && senderKey.IsEmpty()) {
@@ -218,21 +278,16 @@ void CKademliaUDPListener::ProcessPacket(const uint8_t* data, uint32_t lenData,
 		return;
 	}
 
-	//Update connection state only when it changes.
-	bool curCon = CKademlia::GetPrefs()->HasHadContact();
-	CKademlia::GetPrefs()->SetLastContact();
-	CUDPFirewallTester::Connected();
-	if( curCon != CKademlia::GetPrefs()->HasHadContact()) {
-		theApp->ShowConnectionState();
-	}
-
 	uint8_t opcode = data[1];
 	const uint8_t *packetData = data + 2;
 	uint32_t lenPacket = lenData - 2;
 
-	if (!InTrackListIsAllowedPacket(ip, opcode, validReceiverKey)) {
-		return;
+	// Requests that no decoding thread has parsed yet
+	CScopedPtr<CKadParsedRequest> parsed(request ? NULL : ParseRequest(data, lenData, ip, port));
+	if (parsed.get()) {
+		request = parsed.get();
 	}
+	wxASSERT(request == NULL || request->m_opcode == opcode);
 
 	switch (opcode) {
 		case KADEMLIA2_BOOTSTRAP_REQ:
@@ -265,15 +320,15 @@ void CKademliaUDPListener::ProcessPacket(const uint8_t* data, uint32_t lenData,
 			break;
 		case KADEMLIA2_SEARCH_NOTES_REQ:
 			DebugRecv(Kad2SearchNotesReq, ip, port);
-			Process2SearchNotesRequest(packetData, lenPacket, ip, port, senderKey);
+			Process2SearchNotesRequest(*request, ip, port, senderKey);
 			break;
 		case KADEMLIA2_SEARCH_KEY_REQ:
 			DebugRecv(Kad2SearchKeyReq, ip, port);
-			Process2SearchKeyRequest(packetData, lenPacket, ip, port, senderKey);
+			Process2SearchKeyRequest(*request, ip, port, senderKey);
 			break;
 		case KADEMLIA2_SEARCH_SOURCE_REQ:
 			DebugRecv(Kad2SearchSourceReq, ip, port);
-			Process2SearchSourceRequest(packetData, lenPacket, ip, port, senderKey);
+			Process2SearchSourceRequest(*request, ip, port, senderKey);
 			break;
 		case KADEMLIA_SEARCH_RES:
 			DebugRecv(KadSearchRes, ip, port);
@@ -289,15 +344,15 @@ void CKademliaUDPListener::ProcessPacket(const uint8_t* data, uint32_t lenData,
 			break;
 		case KADEMLIA2_PUBLISH_NOTES_REQ:
 			DebugRecv(Kad2PublishNotesReq, ip, port);
-			Process2PublishNotesRequest(packetData, lenPacket, ip, port, senderKey);
+			Process2PublishNotesRequest(*request, ip, port, senderKey);
 			break;
 		case KADEMLIA2_PUBLISH_KEY_REQ:
 			DebugRecv(Kad2PublishKeyReq, ip, port);
-			Process2PublishKeyRequest(packetData, lenPacket, ip, port, senderKey);
+			Process2PublishKeyRequest(*request, ip, port, senderKey);
 			break;
 		case KADEMLIA2_PUBLISH_SOURCE_REQ:
 			DebugRecv(Kad2PublishSourceReq, ip, port);
-			Process2PublishSourceRequest(packetData, lenPacket, ip, port, senderKey);
+			Process2PublishSourceRequest(*request, ip, port, senderKey);
 			break;
 		case KADEMLIA_PUBLISH_RES:
 			DebugRecv(KadPublishRes, ip, port);
@@ -871,7 +926,7 @@ SSearchTerm* CKademliaUDPListener::CreateSearchExpressionTree(CMemFile& bio, int
 	else if (op == 0x03 || op == 0x08) { // Numeric relation (0x03=32-bit or 0x08=64-bit)
 		static const struct {
 			SSearchTerm::ESearchTermType eSearchTermOp;
-			wxString pszOp;
+			const wxChar* pszOp;
 		} _aOps[] =
 		{
 			{ SSearchTerm::OpEqual,		wxT("=")	}, // mmop=0x00
@@ -908,35 +963,29 @@ SSearchTerm* CKademliaUDPListener::CreateSearchExpressionTree(CMemFile& bio, int
 
 // KADEMLIA2_SEARCH_KEY_REQ
 // Used in Kad2.0 only
-void CKademliaUDPListener::Process2SearchKeyRequest(const uint8_t *packetData, uint32_t lenPacket, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey)
+void CKademliaUDPListener::Parse2SearchKeyRequest(CKadParsedRequest& request, CMemFile& bio)
 {
-	CMemFile bio(packetData, lenPacket);
-	CUInt128 target = bio.ReadUInt128();
 	uint16_t startPosition = bio.ReadUInt16();
 	bool restrictive = ((startPosition & 0x8000) == 0x8000);
-	startPosition &= 0x7FFF;
-	SSearchTerm* pSearchTerms = NULL;
+	request.m_startPosition = startPosition & 0x7FFF;
 	if (restrictive) {
-		pSearchTerms = CreateSearchExpressionTree(bio, 0);
-		if (pSearchTerms == NULL) {
+		request.m_searchTerms = CreateSearchExpressionTree(bio, 0);
+		if (request.m_searchTerms == NULL) {
 			throw wxString(wxT("Invalid search expression"));
 		}
 	}
-	CKademlia::GetIndexed()->SendValidKeywordResult(target, pSearchTerms, ip, port, false, startPosition, senderKey);
-	if (pSearchTerms) {
-		Free(pSearchTerms);
-	}
+}
+
+void CKademliaUDPListener::Process2SearchKeyRequest(const CKadParsedRequest& request, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey)
+{
+	CKademlia::GetIndexed()->SendValidKeywordResult(request.m_target, request.m_searchTerms, ip, port, false, request.m_startPosition, senderKey);
 }
 
 // KADEMLIA2_SEARCH_SOURCE_REQ
 // Used in Kad2.0 only
-void CKademliaUDPListener::Process2SearchSourceRequest(const uint8_t *packetData, uint32_t lenPacket, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey)
+void CKademliaUDPListener::Process2SearchSourceRequest(const CKadParsedRequest& request, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey)
 {
-	CMemFile bio(packetData, lenPacket);
-	CUInt128 target = bio.ReadUInt128();
-	uint16_t startPosition = (bio.ReadUInt16() & 0x7FFF);
-	uint64_t fileSize = bio.ReadUInt64();
-	CKademlia::GetIndexed()->SendValidSourceResult(target, ip, port, startPosition, fileSize, senderKey);
+	CKademlia::GetIndexed()->SendValidSourceResult(request.m_target, ip, port, request.m_startPosition, request.m_fileSize, senderKey);
 }
 
 void CKademliaUDPListener::ProcessSearchResponse(CMemFile& bio)
@@ -989,30 +1038,10 @@ void CKademliaUDPListener::Process2SearchResponse(const uint8_t *packetData, uin
 
 // KADEMLIA2_PUBLISH_KEY_REQ
 // Used in Kad2.0 only
-void CKademliaUDPListener::Process2PublishKeyRequest(const uint8_t *packetData, uint32_t lenPacket, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey)
+void CKademliaUDPListener::Parse2PublishKeyRequest(CKadParsedRequest& request, CMemFile& bio, uint32_t ip, uint16_t port)
 {
-	//Used Pointers
-	CIndexed *indexed = CKademlia::GetIndexed();
-
-	// check if we are UDP firewalled
-	if (CUDPFirewallTester::IsFirewalledUDP(true)) {
-		//We are firewalled. We should not index this entry and give publisher a false report.
-		return;
-	}
-
-	CMemFile bio(packetData, lenPacket);
-	CUInt128 file = bio.ReadUInt128();
-
-	CUInt128 distance(CKademlia::GetPrefs()->GetKadID());
-	distance ^= file;
-
-	if (distance.Get32BitChunk(0) > SEARCHTOLERANCE && !::IsLanIP(wxUINT32_SWAP_ALWAYS(ip))) {
-		return;
-	}
-
 	DEBUG_ONLY( wxString strInfo; )
 	uint16_t count = bio.ReadUInt16();
-	uint8_t load = 0;
 	while (count > 0) {
 		DEBUG_ONLY( strInfo.Clear(); )
 
@@ -1023,7 +1052,7 @@ void CKademliaUDPListener::Process2PublishKeyRequest(const uint8_t *packetData,
 		{
 			entry->m_uIP = ip;
 			entry->m_uUDPport = port;
-			entry->m_uKeyID = file;
+			entry->m_uKeyID = request.m_target;
 			entry->m_uSourceID = target;
 			entry->m_tLifeTime = (uint32_t)time(NULL) + KADEMLIAREPUBLISHTIMEK;
 			entry->m_bSource = false;
@@ -1059,35 +1088,18 @@ void CKademliaUDPListener::Process2PublishKeyRequest(const uint8_t *packetData,
 				AddDebugLogLineN(logClientKadUDP, strInfo);
 			}
 #endif
+			request.m_keyEntries.push_back(entry);
 		} catch(...) {
 			//DebugClientOutput(wxT("CKademliaUDPListener::Process2PublishKeyRequest"),ip,port,packetData,lenPacket);
 			delete entry;
 			throw;
 		}
 
-		if (!indexed->AddKeyword(file, target, entry, load)) {
-			//We already indexed the maximum number of keywords.
-			//We do not index anymore but we still send a success..
-			//Reason: Because if a VERY busy node tells the publisher it failed,
-			//this busy node will spread to all the surrounding nodes causing popular
-			//keywords to be stored on MANY nodes..
-			//So, once we are full, we will periodically clean our list until we can
-			//begin storing again..
-			delete entry;
-			entry = NULL;
-		}
 		count--;
 	}
-	CMemFile packetdata(17);
-	packetdata.WriteUInt128(file);
-	packetdata.WriteUInt8(load);
-	DebugSend(Kad2PublishRes, ip, port);
-	SendPacket(packetdata, KADEMLIA2_PUBLISH_RES, ip, port, senderKey, NULL);
 }
 
-// KADEMLIA2_PUBLISH_SOURCE_REQ
-// Used in Kad2.0 only
-void CKademliaUDPListener::Process2PublishSourceRequest(const uint8_t *packetData, uint32_t lenPacket, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey)
+void CKademliaUDPListener::Process2PublishKeyRequest(CKadParsedRequest& request, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey)
 {
 	//Used Pointers
 	CIndexed *indexed = CKademlia::GetIndexed();
@@ -1098,8 +1110,7 @@ void CKademliaUDPListener::Process2PublishSourceRequest(const uint8_t *packetDat
 		return;
 	}
 
-	CMemFile bio(packetData, lenPacket);
-	CUInt128 file = bio.ReadUInt128();
+	const CUInt128& file = request.m_target;
 
 	CUInt128 distance(CKademlia::GetPrefs()->GetKadID());
 	distance ^= file;
@@ -1108,15 +1119,43 @@ void CKademliaUDPListener::Process2PublishSourceRequest(const uint8_t *packetDat
 		return;
 	}
 
-	DEBUG_ONLY( wxString strInfo; )
 	uint8_t load = 0;
-	bool flag = false;
+	for (size_t i = 0; i < request.m_keyEntries.size(); ++i) {
+		// The index takes the entry, or it is deleted here
+		Kademlia::CKeyEntry* entry = request.m_keyEntries[i];
+		request.m_keyEntries[i] = NULL;
+		CUInt128 target = entry->m_uSourceID;
+
+		if (!indexed->AddKeyword(file, target, entry, load)) {
+			//We already indexed the maximum number of keywords.
+			//We do not index anymore but we still send a success..
+			//Reason: Because if a VERY busy node tells the publisher it failed,
+			//this busy node will spread to all the surrounding nodes causing popular
+			//keywords to be stored on MANY nodes..
+			//So, once we are full, we will periodically clean our list until we can
+			//begin storing again..
+			delete entry;
+			entry = NULL;
+		}
+	}
+	CMemFile packetdata(17);
+	packetdata.WriteUInt128(file);
+	packetdata.WriteUInt8(load);
+	DebugSend(Kad2PublishRes, ip, port);
+	SendPacket(packetdata, KADEMLIA2_PUBLISH_RES, ip, port, senderKey, NULL);
+}
+
+// KADEMLIA2_PUBLISH_SOURCE_REQ
+// Used in Kad2.0 only
+void CKademliaUDPListener::Parse2PublishSourceRequest(CKadParsedRequest& request, CMemFile& bio, uint32_t ip, uint16_t port)
+{
+	DEBUG_ONLY( wxString strInfo; )
 	CUInt128 target = bio.ReadUInt128();
 	Kademlia::CEntry* entry = new Kademlia::CEntry();
 	try {
 		entry->m_uIP = ip;
 		entry->m_uUDPport = port;
-		entry->m_uKeyID = file;
+		entry->m_uKeyID = request.m_target;
 		entry->m_uSourceID = target;
 		entry->m_bSource = false;
 		entry->m_tLifeTime = (uint32_t)time(NULL) + KADEMLIAREPUBLISHTIMES;
@@ -1176,12 +1215,40 @@ void CKademliaUDPListener::Process2PublishSourceRequest(const uint8_t *packetDat
 			AddDebugLogLineN(logClientKadUDP, strInfo);
 		}
 #endif
+		request.m_entry = entry;
 	} catch(...) {
 		//DebugClientOutput(wxT("CKademliaUDPListener::Process2PublishSourceRequest"),ip,port,packetData,lenPacket);
 		delete entry;
 		throw;
 	}
+}
+
+void CKademliaUDPListener::Process2PublishSourceRequest(CKadParsedRequest& request, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey)
+{
+	//Used Pointers
+	CIndexed *indexed = CKademlia::GetIndexed();
+
+	// check if we are UDP firewalled
+	if (CUDPFirewallTester::IsFirewalledUDP(true)) {
+		//We are firewalled. We should not index this entry and give publisher a false report.
+		return;
+	}
+
+	const CUInt128& file = request.m_target;
+
+	CUInt128 distance(CKademlia::GetPrefs()->GetKadID());
+	distance ^= file;
+
+	if (distance.Get32BitChunk(0) > SEARCHTOLERANCE && !::IsLanIP(wxUINT32_SWAP_ALWAYS(ip))) {
+		return;
+	}
 
+	// The index takes the entry, or it is deleted here
+	Kademlia::CEntry* entry = request.m_entry;
+	request.m_entry = NULL;
+	CUInt128 target = entry->m_uSourceID;
+	uint8_t load = 0;
+	bool flag = false;
 	if (entry->m_bSource == true) {
 		if (indexed->AddSources(file, target, entry, load)) {
 			flag = true;
@@ -1247,12 +1314,9 @@ void CKademliaUDPListener::Process2PublishResponse(const uint8_t *packetData, ui
 
 // KADEMLIA2_SEARCH_NOTES_REQ
 // Used only by Kad2.0
-void CKademliaUDPListener::Process2SearchNotesRequest(const uint8_t *packetData, uint32_t lenPacket, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey)
+void CKademliaUDPListener::Process2SearchNotesRequest(const CKadParsedRequest& request, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey)
 {
-	CMemFile bio(packetData, lenPacket);
-	CUInt128 target = bio.ReadUInt128();
-	uint64_t fileSize = bio.ReadUInt64();
-	CKademlia::GetIndexed()->SendValidNoteResult(target, ip, port, fileSize, senderKey);
+	CKademlia::GetIndexed()->SendValidNoteResult(request.m_target, ip, port, request.m_fileSize, senderKey);
 }
 
 // KADEMLIA_SEARCH_NOTES_RES
@@ -1270,31 +1334,15 @@ void CKademliaUDPListener::ProcessSearchNotesResponse(const uint8_t *packetData,
 
 // KADEMLIA2_PUBLISH_NOTES_REQ
 // Used only by Kad2.0
-void CKademliaUDPListener::Process2PublishNotesRequest(const uint8_t *packetData, uint32_t lenPacket, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey)
+void CKademliaUDPListener::Parse2PublishNotesRequest(CKadParsedRequest& request, CMemFile& bio, uint32_t ip, uint16_t port)
 {
-	// check if we are UDP firewalled
-	if (CUDPFirewallTester::IsFirewalledUDP(true)) {
-		//We are firewalled. We should not index this entry and give publisher a false report.
-		return;
-	}
-
-	CMemFile bio(packetData, lenPacket);
-	CUInt128 target = bio.ReadUInt128();
-
-	CUInt128 distance(CKademlia::GetPrefs()->GetKadID());
-	distance ^= target;
-
-	if (distance.Get32BitChunk(0) > SEARCHTOLERANCE && !::IsLanIP(wxUINT32_SWAP_ALWAYS(ip))) {
-		return;
-	}
-
 	CUInt128 source = bio.ReadUInt128();
 
 	Kademlia::CEntry* entry = new Kademlia::CEntry();
 	try {
 		entry->m_uIP = ip;
 		entry->m_uUDPport = port;
-		entry->m_uKeyID = target;
+		entry->m_uKeyID = request.m_target;
 		entry->m_uSourceID = source;
 		entry->m_bSource = false;
 		uint32_t tags = bio.ReadUInt8();
@@ -1318,12 +1366,36 @@ void CKademliaUDPListener::Process2PublishNotesRequest(const uint8_t *packetData
 			}
 			tags--;
 		}
+		request.m_entry = entry;
 	} catch(...) {
 		//DebugClientOutput(wxT("CKademliaUDPListener::Process2PublishNotesRequest"),ip,port,packetData,lenPacket);
 		delete entry;
 		entry = NULL;
 		throw;
 	}
+}
+
+void CKademliaUDPListener::Process2PublishNotesRequest(CKadParsedRequest& request, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey)
+{
+	// check if we are UDP firewalled
+	if (CUDPFirewallTester::IsFirewalledUDP(true)) {
+		//We are firewalled. We should not index this entry and give publisher a false report.
+		return;
+	}
+
+	const CUInt128& target = request.m_target;
+
+	CUInt128 distance(CKademlia::GetPrefs()->GetKadID());
+	distance ^= target;
+
+	if (distance.Get32BitChunk(0) > SEARCHTOLERANCE && !::IsLanIP(wxUINT32_SWAP_ALWAYS(ip))) {
+		return;
+	}
+
+	// The index takes the entry, or it is deleted here
+	Kademlia::CEntry* entry = request.m_entry;
+	request.m_entry = NULL;
+	CUInt128 source = entry->m_uSourceID;
 
 	uint8_t load = 0;
 	if (CKademlia::GetIndexed()->AddNotes(target, source, entry, load)) {
@@ -44,6 +44,7 @@ there client on the eMule forum..
 #include "PacketTracking.h"
 
 #include <list>
+#include <vector>
 
 
 class CMemFile;
@@ -56,6 +57,8 @@ namespace Kademlia {
 class CContact;
 class CKadUDPKey;
 class CKadClientSearcher;
+class CEntry;
+class CKeyEntry;
 
 struct FetchNodeID_Struct {
 	uint32_t ip;
@@ -71,6 +74,40 @@ struct FetchNodeID_Struct {
 #define DebugRecv(what, ip, port)	DebugRecvF(wxSTRINGIZE_T(what), ip, port)
 
 
+/**
+ * A request packet as read by CKademliaUDPListener::ParseRequest().
+ *
+ * It owns all it holds and shares nothing with the Kad state, so a
+ * decoding thread can parse the packet and hand it over to the core
+ * thread, where CKademliaUDPListener::ProcessPacket() acts on it.
+ */
+class CKadParsedRequest
+{
+public:
+	CKadParsedRequest(uint8_t opcode);
+	~CKadParsedRequest();
+
+	//! The opcode of the parsed packet.
+	uint8_t			m_opcode;
+	//! The keyword, file or notes ID that comes first in the packet.
+	CUInt128		m_target;
+	//! Where a search continues, for KADEMLIA2_SEARCH_KEY_REQ and KADEMLIA2_SEARCH_SOURCE_REQ.
+	uint16_t		m_startPosition;
+	//! The file size of KADEMLIA2_SEARCH_SOURCE_REQ and KADEMLIA2_SEARCH_NOTES_REQ.
+	uint64_t		m_fileSize;
+	//! The expression of a restrictive KADEMLIA2_SEARCH_KEY_REQ, or NULL.
+	SSearchTerm*		m_searchTerms;
+	//! The entries of KADEMLIA2_PUBLISH_KEY_REQ, the handler takes those it keeps.
+	std::vector<CKeyEntry*>	m_keyEntries;
+	//! The entry of KADEMLIA2_PUBLISH_SOURCE_REQ or KADEMLIA2_PUBLISH_NOTES_REQ, or NULL.
+	CEntry*			m_entry;
+
+private:
+	CKadParsedRequest(const CKadParsedRequest&);
+	CKadParsedRequest& operator=(const CKadParsedRequest&);
+};
+
+
 class CKademliaUDPListener : public CPacketTracking
 {
 public:
@@ -80,15 +117,31 @@ public:
 	void SendMyDetails(uint8_t opcode, uint32_t ip, uint16_t port, uint8_t kadVersion, const CKadUDPKey& targetKey, const CUInt128* cryptTargetID, bool requestAckPacket);
 	void SendNullPacket(uint8_t opcode, uint32_t ip, uint16_t port, const CKadUDPKey& targetKey, const CUInt128* cryptTargetID);
 	void SendPublishSourcePacket(const CContact& contact, const CUInt128& targetID, const CUInt128& contactID, const TagPtrList& tags);
-	virtual void ProcessPacket(const uint8_t* data, uint32_t lenData, uint32_t ip, uint16_t port, bool validReceiverKey, const CKadUDPKey& senderKey);
+	virtual void ProcessPacket(const uint8_t* data, uint32_t lenData, uint32_t ip, uint16_t port, bool validReceiverKey, const CKadUDPKey& senderKey, CKadParsedRequest* request = NULL);
+
+	/**
+	 * Reads the search and publish requests, which are the costly ones to parse.
+	 *
+	 * Safe to call from any thread. Returns NULL for other packets, which
+	 * are parsed by their handlers, and throws on malformed packets.
+	 */
+	static CKadParsedRequest* ParseRequest(const uint8_t* data, uint32_t lenData, uint32_t ip, uint16_t port);
 	void SendPacket(const CMemFile& data, uint8_t opcode, uint32_t destinationHost, uint16_t destinationPort, const CKadUDPKey& targetKey, const CUInt128* cryptTargetID);
 
 //	bool FindNodeIDByIP(CKadClientSearcher *requester, uint32_t ip, uint16_t tcpPort, uint16_t udpPort);
 	void ExpireClientSearch(CKadClientSearcher *expireImmediately = NULL);
 private:
+	friend class CKadParsedRequest;
+
 	static SSearchTerm* CreateSearchExpressionTree(CMemFile& bio, int iLevel);
 	static void Free(SSearchTerm* pSearchTerms);
 
+	// Parsing of requests, see ParseRequest()
+	static void Parse2SearchKeyRequest	(CKadParsedRequest& request, CMemFile& bio);
+	static void Parse2PublishKeyRequest	(CKadParsedRequest& request, CMemFile& bio, uint32_t ip, uint16_t port);
+	static void Parse2PublishSourceRequest	(CKadParsedRequest& request, CMemFile& bio, uint32_t ip, uint16_t port);
+	static void Parse2PublishNotesRequest	(CKadParsedRequest& request, CMemFile& bio, uint32_t ip, uint16_t port);
+
 	// Kad1.0
 	void SendLegacyChallenge(uint32_t ip, uint16_t port, const CUInt128& contactID);
 
@@ -113,13 +166,13 @@ private:
 	void Process2HelloResponseAck		(const uint8_t* packetData, uint32_t lenPacket, uint32_t ip, bool validReceiverKey);
 	void ProcessKademlia2Request		(const uint8_t* packetData, uint32_t lenPacket, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
 	void ProcessKademlia2Response		(const uint8_t* packetData, uint32_t lenPacket, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
-	void Process2SearchNotesRequest		(const uint8_t* packetData, uint32_t lenPacket, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
-	void Process2SearchKeyRequest		(const uint8_t* packetData, uint32_t lenPacket, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
-	void Process2SearchSourceRequest	(const uint8_t* packetData, uint32_t lenPacket, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
+	void Process2SearchNotesRequest		(const CKadParsedRequest& request, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
+	void Process2SearchKeyRequest		(const CKadParsedRequest& request, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
+	void Process2SearchSourceRequest	(const CKadParsedRequest& request, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
 	void Process2SearchResponse		(const uint8_t* packetData, uint32_t lenPacket, const CKadUDPKey& senderKey);
-	void Process2PublishNotesRequest	(const uint8_t* packetData, uint32_t lenPacket, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
-	void Process2PublishKeyRequest		(const uint8_t* packetData, uint32_t lenPacket, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
-	void Process2PublishSourceRequest	(const uint8_t* packetData, uint32_t lenPacket, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
+	void Process2PublishNotesRequest	(CKadParsedRequest& request, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
+	void Process2PublishKeyRequest		(CKadParsedRequest& request, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
+	void Process2PublishSourceRequest	(CKadParsedRequest& request, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
 	void Process2PublishResponse		(const uint8_t* packetData, uint32_t lenPacket, uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
 	void Process2Ping			(uint32_t ip, uint16_t port, const CKadUDPKey& senderKey);
 	void Process2Pong			(const uint8_t* packetData, uint32_t lenPacket, uint32_t ip);
@@ -42,7 +42,6 @@ using namespace Kademlia;
 
 CPacketTracking::~CPacketTracking()
 {
-	DeleteContents(m_mapTrackPacketsIn);
 }
 
 void CPacketTracking::AddTrackedOutPacket(uint32_t ip, uint8_t opcode)
@@ -52,16 +51,7 @@ void CPacketTracking::AddTrackedOutPacket(uint32_t ip, uint8_t opcode)
 	if (!IsTrackedOutListRequestPacket(opcode)) {
 		return;
 	}
-	uint32_t now = ::GetTickCount();
-	TrackPackets_Struct track = { ip, now, opcode };
-	listTrackedRequests.push_front(track);
-	while (!listTrackedRequests.empty()) {
-		if (now - listTrackedRequests.back().inserted > SEC2MS(180)) {
-			listTrackedRequests.pop_back();
-		} else {
-			break;
-		}
-	}
+	m_outRequests.Add(ip, opcode, ::GetTickCount());
 }
 
 bool CPacketTracking::IsTrackedOutListRequestPacket(uint8_t opcode) throw()
@@ -93,19 +83,12 @@ bool CPacketTracking::IsOnOutTrackList(uint32_t ip, uint8_t opcode, bool dontRem
 		wxFAIL;	// code error / bug
 	}
 #endif
-	uint32_t now = ::GetTickCount();
-	for (TrackedPacketList::iterator it = listTrackedRequests.begin(); it != listTrackedRequests.end(); ++it) {
-		if (it->ip == ip && it->opcode == opcode && now - it->inserted < SEC2MS(180)) {
-			if (!dontRemove) {
-				listTrackedRequests.erase(it);
-			}
-			return true;
-		}
-	}
-	return false;
+	return m_outRequests.Check(ip, opcode, ::GetTickCount(), dontRemove);
 }
 
-bool CPacketTracking::InTrackListIsAllowedPacket(uint32_t ip, uint8_t opcode, bool /*bValidSenderkey*/)
+CPacketTracking::InRequestShard CPacketTracking::s_inRequests[16];
+
+CPacketTracking::InRequestVerdict CPacketTracking::CheckInRequest(uint32_t ip, uint8_t opcode, bool lanMode)
 {
 	// this tracklist tacks _incoming_ request packets and acts as a general flood protection by dropping
 	// too frequent requests from a single IP, avoiding response floods, processing time DOS attacks and slowing down
@@ -162,97 +145,47 @@ bool CPacketTracking::InTrackListIsAllowedPacket(uint32_t ip, uint8_t opcode, bo
 			break;
 		default:
 			// not any request packets, so it's a response packet - no further checks on this point
-			return true;
+			return InRequestAllowed;
 	}
 
 	const uint32_t secondsPerPacket = 60 / allowedPacketsPerMinute;
 	const uint32_t currentTick = ::GetTickCount();
 
-	// time for cleaning up?
-	if (currentTick - lastTrackInCleanup > MIN2MS(12)) {
-		InTrackListCleanup();
-	}
+	// All requests of an IP go to the same part
+	InRequestShard& shard = s_inRequests[(ip ^ (ip >> 8)) % itemsof(s_inRequests)];
+	wxMutexLocker lock(shard.lock);
 
-	// check for existing entries
-	TrackedPacketInMap::iterator it2 = m_mapTrackPacketsIn.find(ip);
-	TrackPacketsIn_Struct *trackEntry;
-	if (it2 == m_mapTrackPacketsIn.end()) {
-		trackEntry = new TrackPacketsIn_Struct();
-		trackEntry->m_ip = ip;
-		m_mapTrackPacketsIn[ip] = trackEntry;
-	} else {
-		trackEntry = it2->second;
+	// time for cleaning up? Expired entries are also dropped while requests come in, this only catches up.
+	if (currentTick - shard.lastCleanup > MIN2MS(12)) {
+		DEBUG_ONLY( const uint32_t dbgOldSize = shard.requests.GetCount(); )
+		shard.lastCleanup = currentTick;
+		shard.requests.Cleanup(currentTick);
+		AddDebugLogLineN(logKadPacketTracking, CFormat(wxT("Cleaned up Kad Incoming Requests Tracklist, entries before: %u, after %u")) % dbgOldSize % shard.requests.GetCount());
 	}
 
-	// search specific request tracks
-	for (TrackPacketsIn_Struct::TrackedRequestList::iterator it = trackEntry->m_trackedRequests.begin(); it != trackEntry->m_trackedRequests.end(); ++it) {
-		if (it->m_opcode == opcode) {
-			// already tracked requests with this opcode, remove already expired request counts
-			if (it->m_count > 0 && currentTick - it->m_firstAdded > SEC2MS(secondsPerPacket)) {
-				uint32_t removeCount = (currentTick - it->m_firstAdded) / SEC2MS(secondsPerPacket);
-				if (removeCount > it->m_count) {
-					it->m_count = 0;
-					it->m_firstAdded = currentTick; // for the packet we just process
-				} else {
-					it->m_count -= removeCount;
-					it->m_firstAdded += SEC2MS(secondsPerPacket) * removeCount;
-				}
-			}
-			// we increase the counter in any case, even if we drop the packet later
-			it->m_count++;
-			// remember only for easier cleanup
-			trackEntry->m_lastExpire = std::max(trackEntry->m_lastExpire, it->m_firstAdded + SEC2MS(secondsPerPacket) * it->m_count);
-
-			if (CKademlia::IsRunningInLANMode() && ::IsLanIP(wxUINT32_SWAP_ALWAYS(ip))) {
-				return true;	// no flood detection in LAN mode
-			}
+	CInRequestTracker::TrackedRequestIn_Struct& request = shard.requests.Add(ip, opcode, currentTick, SEC2MS(secondsPerPacket));
 
-			// now the actual check if this request is allowed
-			if (it->m_count > allowedPacketsPerMinute * 5) {
-				// this is so far above the limit that it has to be an intentional flood / misuse in any case
-				// so we take the next higher punishment and ban the IP
-				AddDebugLogLineN(logKadPacketTracking, CFormat(wxT("Massive request flood detected for opcode 0x%X (0x%X) from IP %s - Banning IP")) % opcode % dbgOrgOpcode % KadIPToString(ip));
-				theApp->clientlist->AddBannedClient(wxUINT32_SWAP_ALWAYS(ip));
-				return false; // drop packet
-			} else if (it->m_count > allowedPacketsPerMinute) {
-				// over the limit, drop the packet but do nothing else
-				if (!it->m_dbgLogged) {
-					it->m_dbgLogged = true;
-					AddDebugLogLineN(logKadPacketTracking, CFormat(wxT("Request flood detected for opcode 0x%X (0x%X) from IP %s - Dropping packets with this opcode")) % opcode % dbgOrgOpcode % KadIPToString(ip));
-				}
-				return false; // drop packet
-			} else {
-				it->m_dbgLogged = false;
-			}
-			return true;
-		}
+	if (lanMode && ::IsLanIP(wxUINT32_SWAP_ALWAYS(ip))) {
+		return InRequestAllowed;	// no flood detection in LAN mode
 	}
 
-	// add a new entry for this request, no checks needed since 1 is always ok
-	TrackPacketsIn_Struct::TrackedRequestIn_Struct curTrackedRequest;
-	curTrackedRequest.m_opcode = opcode;
-	curTrackedRequest.m_dbgLogged = false;
-	curTrackedRequest.m_firstAdded = currentTick;
-	curTrackedRequest.m_count = 1;
-	// remember only for easier cleanup
-	trackEntry->m_lastExpire = std::max(trackEntry->m_lastExpire, currentTick + SEC2MS(secondsPerPacket));
-	trackEntry->m_trackedRequests.push_back(curTrackedRequest);
-	return true;
-}
-
-void CPacketTracking::InTrackListCleanup()
-{
-	const uint32_t currentTick = ::GetTickCount();
-	DEBUG_ONLY( const uint32_t dbgOldSize = m_mapTrackPacketsIn.size(); )
-	lastTrackInCleanup = currentTick;
-	for (TrackedPacketInMap::iterator it = m_mapTrackPacketsIn.begin(); it != m_mapTrackPacketsIn.end();) {
-		TrackedPacketInMap::iterator it2 = it++;
-		if (it2->second->m_lastExpire < currentTick) {
-			delete it2->second;
-			m_mapTrackPacketsIn.erase(it2);
+	// now the actual check if this request is allowed
+	if (request.m_count > allowedPacketsPerMinute * 5) {
+		// this is so far above the limit that it has to be an intentional flood / misuse in any case
+		// so we take the next higher punishment and ban the IP
+		AddDebugLogLineN(logKadPacketTracking, CFormat(wxT("Massive request flood detected for opcode 0x%X (0x%X) from IP %s - Banning IP")) % opcode % dbgOrgOpcode % KadIPToString(ip));
+		return InRequestBanned;
+	} else if (request.m_count > allowedPacketsPerMinute) {
+		// over the limit, drop the packet but do nothing else
+		if (!request.m_dbgLogged) {
+			request.m_dbgLogged = true;
+			AddDebugLogLineN(logKadPacketTracking, CFormat(wxT("Request flood detected for opcode 0x%X (0x%X) from IP %s - Dropping packets with this opcode")) % opcode % dbgOrgOpcode % KadIPToString(ip));
 		}
+		return InRequestDropped;
+	} else {
+		request.m_dbgLogged = false;
 	}
-	AddDebugLogLineN(logKadPacketTracking, CFormat(wxT("Cleaned up Kad Incoming Requests Tracklist, entries before: %u, after %u")) % dbgOldSize % m_mapTrackPacketsIn.size());
+	return InRequestAllowed;
 }
 
 void CPacketTracking::AddLegacyChallenge(const CUInt128& contactID, const CUInt128& challengeID, uint32_t ip, uint8_t opcode)
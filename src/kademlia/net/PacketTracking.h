@@ -27,20 +27,16 @@
 #ifndef KADEMLIA_NET_PACKETTRACKING_H
 #define KADEMLIA_NET_PACKETTRACKING_H
 
-#include <map>
 #include <list>
+#include <wx/thread.h>
+#include "RequestTracker.h"
 #include "../utils/UInt128.h"
 #include "../../Types.h"
+#include <common/Macros.h>
 
 namespace Kademlia
 {
 
-struct TrackPackets_Struct {
-	uint32_t ip;
-	uint32_t inserted;
-	uint8_t  opcode;
-};
-
 struct TrackChallenge_Struct {
 	uint32_t	ip;
 	uint32_t	inserted;
@@ -49,50 +45,52 @@ struct TrackChallenge_Struct {
 	CUInt128	challenge;
 };
 
-struct TrackPacketsIn_Struct {
-	struct TrackedRequestIn_Struct {
-		uint32_t m_count;
-		uint32_t m_firstAdded;
-		uint8_t	 m_opcode;
-		bool	 m_dbgLogged;
-	};
-
-	TrackPacketsIn_Struct()
-	{
-		m_lastExpire = 0;
-		m_ip = 0;
-	}
-
-	uint32_t m_ip;
-	uint32_t m_lastExpire;
-	typedef std::list<TrackedRequestIn_Struct>	TrackedRequestList;
-	TrackedRequestList	m_trackedRequests;
-};
-
 class CPacketTracking
 {
       public:
-	CPacketTracking() throw() { lastTrackInCleanup = 0; }
+	CPacketTracking() throw() : m_outRequests(SEC2MS(180)) {}
 	virtual ~CPacketTracking();
 
+	//! What the flood protection decided on an incoming packet.
+	enum InRequestVerdict {
+		InRequestAllowed,
+		InRequestDropped,
+		//! Dropped, and the sender is to be banned.
+		InRequestBanned
+	};
+
+	/**
+	 * The flood protection for incoming requests.
+	 *
+	 * Counts the request and decides if it may be handled. It may be
+	 * called from any thread, so finding out if a LAN sender is exempt
+	 * (see CKademlia::IsRunningInLANMode()) and banning the sender are
+	 * left to the caller on the core thread.
+	 */
+	static InRequestVerdict CheckInRequest(uint32_t ip, uint8_t opcode, bool lanMode);
+
       protected:
 	void AddTrackedOutPacket(uint32_t ip, uint8_t opcode);
 	bool IsOnOutTrackList(uint32_t ip, uint8_t opcode, bool dontRemove = false);
-	bool InTrackListIsAllowedPacket(uint32_t ip, uint8_t opcode, bool validReceiverkey);
-	void InTrackListCleanup();
 	void AddLegacyChallenge(const CUInt128& contactID, const CUInt128& challengeID, uint32_t ip, uint8_t opcode);
 	bool IsLegacyChallenge(const CUInt128& challengeID, uint32_t ip, uint8_t opcode, CUInt128& contactID);
 	bool HasActiveLegacyChallenge(uint32_t ip) const;
 
       private:
 	static bool IsTrackedOutListRequestPacket(uint8_t opcode) throw();
-	typedef std::list<TrackPackets_Struct>		TrackedPacketList;
 	typedef std::list<TrackChallenge_Struct>	TrackChallengeList;
-	typedef std::map<uint32_t, TrackPacketsIn_Struct*>	TrackedPacketInMap;
-	TrackedPacketList	listTrackedRequests;
+	COutRequestTracker	m_outRequests;
 	TrackChallengeList	listChallengeRequests;
-	TrackedPacketInMap	m_mapTrackPacketsIn;
-	uint32_t		lastTrackInCleanup;
+
+	//! The incoming requests of a part of the IPs, each part has its own lock.
+	struct InRequestShard {
+		InRequestShard() : lastCleanup(0) {}
+
+		wxMutex			lock;
+		CInRequestTracker	requests;
+		uint32_t		lastCleanup;
+	};
+	static InRequestShard	s_inRequests[16];
 };
 
 } // namespace Kademlia
@@ -0,0 +1,164 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2008-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#include "RequestTracker.h"
+#include <common/Macros.h>
+
+#include <algorithm>		// Needed for std::min
+
+
+using namespace Kademlia;
+
+
+// How often a tracked incoming request is checked for expiry
+static const uint32_t InCheckInterval = MIN2MS(1);
+// Counters are forgotten at most this long after the last request, even
+// if they have not dropped to zero. The IP has been banned long before.
+static const uint32_t InMaxTrackTime = MIN2MS(60);
+
+
+static inline uint64_t MakeKey(uint32_t ip, uint8_t opcode)
+{
+	return (static_cast<uint64_t>(opcode) << 32) | ip;
+}
+
+
+void COutRequestTracker::Add(uint32_t ip, uint8_t opcode, uint32_t now)
+{
+	Expire(now);
+
+	uint64_t key = MakeKey(ip, opcode);
+	m_requests[key].push_back(now);
+	m_expireQueue.push_back(ExpireEntry(now, key));
+}
+
+
+bool COutRequestTracker::Check(uint32_t ip, uint8_t opcode, uint32_t now, bool dontRemove)
+{
+	Expire(now);
+
+	uint64_t key = MakeKey(ip, opcode);
+	TimeList* times = m_requests.Lookup(key);
+	if (times == NULL) {
+		return false;
+	}
+
+	if (!dontRemove) {
+		// The latest request is answered first
+		times->pop_back();
+		if (times->empty()) {
+			m_requests.erase(key);
+		}
+	}
+	return true;
+}
+
+
+void COutRequestTracker::Expire(uint32_t now)
+{
+	while (!m_expireQueue.empty() && now - m_expireQueue.front().first >= m_timeout) {
+		uint64_t key = m_expireQueue.front().second;
+		m_expireQueue.pop_front();
+		ExpireKey(key, now);
+	}
+}
+
+
+void COutRequestTracker::ExpireKey(uint64_t key, uint32_t now)
+{
+	TimeList* times = m_requests.Lookup(key);
+	if (times == NULL) {
+		// All requests have been answered
+		return;
+	}
+
+	TimeList::iterator it = times->begin();
+	while (it != times->end() && now - *it >= m_timeout) {
+		++it;
+	}
+	if (it == times->end()) {
+		m_requests.erase(key);
+	} else {
+		times->erase(times->begin(), it);
+	}
+}
+
+
+CInRequestTracker::TrackedRequestIn_Struct& CInRequestTracker::Add(uint32_t ip, uint8_t opcode, uint32_t now, uint32_t msPerPacket)
+{
+	Cleanup(now);
+
+	uint64_t key = MakeKey(ip, opcode);
+	TrackedRequestIn_Struct* entry = m_requests.Lookup(key);
+	if (entry == NULL) {
+		entry = &m_requests[key];
+		entry->m_count = 1;
+		entry->m_firstAdded = now;
+		entry->m_expire = now + msPerPacket;
+		entry->m_dbgLogged = false;
+		m_checkQueue.push_back(CheckEntry(now, key));
+		return *entry;
+	}
+
+	// already tracked requests with this opcode, remove already expired request counts
+	if (entry->m_count > 0 && now - entry->m_firstAdded > msPerPacket) {
+		uint32_t removeCount = (now - entry->m_firstAdded) / msPerPacket;
+		if (removeCount > entry->m_count) {
+			entry->m_count = 0;
+			entry->m_firstAdded = now; // for the packet we just process
+		} else {
+			entry->m_count -= removeCount;
+			entry->m_firstAdded += msPerPacket * removeCount;
+		}
+	}
+	// we increase the counter in any case, even if we drop the packet later
+	entry->m_count++;
+
+	uint64_t remaining = static_cast<uint64_t>(msPerPacket) * entry->m_count;
+	uint32_t age = now - entry->m_firstAdded;
+	remaining = (remaining > age) ? remaining - age : 0;
+	entry->m_expire = now + static_cast<uint32_t>(std::min<uint64_t>(remaining, InMaxTrackTime));
+
+	return *entry;
+}
+
+
+void CInRequestTracker::Cleanup(uint32_t now)
+{
+	while (!m_checkQueue.empty() && now - m_checkQueue.front().first >= InCheckInterval) {
+		uint64_t key = m_checkQueue.front().second;
+		m_checkQueue.pop_front();
+
+		TrackedRequestIn_Struct* entry = m_requests.Lookup(key);
+		if (entry == NULL) {
+			continue;
+		}
+		if (static_cast<int32_t>(now - entry->m_expire) >= 0) {
+			m_requests.erase(key);
+		} else {
+			// Still counting, look again later
+			m_checkQueue.push_back(CheckEntry(now, key));
+		}
+	}
+}
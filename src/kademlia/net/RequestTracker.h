@@ -0,0 +1,121 @@
+//								-*- C++ -*-
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2008-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef KADEMLIA_NET_REQUESTTRACKER_H
+#define KADEMLIA_NET_REQUESTTRACKER_H
+
+#include "../../HashMap.h"
+#include <deque>
+#include <vector>
+
+namespace Kademlia
+{
+
+/**
+ * Remembers the requests sent to other nodes, so only answers to
+ * requests of our own are accepted.
+ *
+ * Requests are kept by IP and opcode for 'timeout' milliseconds. Both
+ * adding and checking a request take constant time, expired requests
+ * are dropped in the order they were sent.
+ */
+class COutRequestTracker
+{
+      public:
+	COutRequestTracker(uint32_t timeout) : m_timeout(timeout) {}
+
+	/** Adds a request sent at 'now'. */
+	void Add(uint32_t ip, uint8_t opcode, uint32_t now);
+
+	/**
+	 * Checks if a request with the opcode was sent to the IP and has not
+	 * timed out. Unless 'dontRemove' is set, the request is answered then.
+	 */
+	bool Check(uint32_t ip, uint8_t opcode, uint32_t now, bool dontRemove);
+
+	/** Returns the number of IP and opcode pairs with open requests. */
+	size_t GetCount() const { return m_requests.size(); }
+
+      private:
+	typedef std::vector<uint32_t> TimeList;
+	typedef std::pair<uint32_t, uint64_t> ExpireEntry;
+
+	/** Drops the requests that have timed out. */
+	void Expire(uint32_t now);
+	/** Removes the timed out requests of a key, erasing it if none are left. */
+	void ExpireKey(uint64_t key, uint32_t now);
+
+	//! The times the open requests were sent, oldest first.
+	CHashMap<uint64_t, TimeList>	m_requests;
+	//! The keys of all sent requests, in the order they were sent.
+	std::deque<ExpireEntry>		m_expireQueue;
+	uint32_t			m_timeout;
+};
+
+
+/**
+ * Counts the requests received from other nodes, for the flood protection.
+ *
+ * Every IP and opcode pair has a counter, which goes down by one every
+ * 'msPerPacket' milliseconds. Pairs are forgotten some time after their
+ * counter has dropped to zero. Both the check for a request and the
+ * cleanup take constant time per request.
+ */
+class CInRequestTracker
+{
+      public:
+	struct TrackedRequestIn_Struct {
+		uint32_t m_count;
+		uint32_t m_firstAdded;
+		//! Time the counter drops to zero.
+		uint32_t m_expire;
+		bool	 m_dbgLogged;
+	};
+
+	CInRequestTracker() {}
+
+	/**
+	 * Counts a request received at 'now'.
+	 *
+	 * @return The counter of the IP and opcode, including this request.
+	 */
+	TrackedRequestIn_Struct& Add(uint32_t ip, uint8_t opcode, uint32_t now, uint32_t msPerPacket);
+
+	/** Forgets the IPs that have not sent requests for a while. */
+	void Cleanup(uint32_t now);
+
+	/** Returns the number of IP and opcode pairs tracked. */
+	size_t GetCount() const { return m_requests.size(); }
+
+      private:
+	typedef std::pair<uint32_t, uint64_t> CheckEntry;
+
+	CHashMap<uint64_t, TrackedRequestIn_Struct>	m_requests;
+	//! Every key once, in the order they are to be checked for expiry.
+	std::deque<CheckEntry>				m_checkQueue;
+};
+
+} // namespace Kademlia
+
+#endif /* KADEMLIA_NET_REQUESTTRACKER_H */
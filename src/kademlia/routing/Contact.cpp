@@ -40,6 +40,8 @@ there client on the eMule forum..
 
 #include <common/Macros.h>
 
+#include <algorithm>	// Needed for std::max
+
 #include "../../Statistics.h"
 
 ////////////////////////////////////////
@@ -62,6 +64,7 @@ CContact::CContact(const CUInt128 &clientID, uint32_t ip, uint16_t udpPort, uint
 	  m_expires(0),
 	  m_created(m_lastTypeSet),
 	  m_inUse(0),
+	  m_rtt(0),
 	  m_version(version),
 	  m_ipVerified(ipVerified),
 	  m_receivedHelloPacket(false),
@@ -91,6 +94,13 @@ void CContact::CheckingType() throw()
 	m_type++;
 }
 
+void CContact::UpdateRTT(uint32_t rtt) throw()
+{
+	// Answers in the same tick still took some time
+	rtt = std::max<uint32_t>(rtt, 1);
+	m_rtt = m_rtt ? (m_rtt * 7 + rtt) / 8 : rtt;
+}
+
 void CContact::UpdateType() throw()
 {
 	time_t now = time(NULL);
@@ -104,6 +104,11 @@ public:
 	bool	GetReceivedHelloPacket() const throw()		{ return m_receivedHelloPacket; }
 	void	SetReceivedHelloPacket() throw()		{ m_receivedHelloPacket = true; }
 
+	// Smoothed round trip time of lookup requests in milliseconds, 0 if unknown
+	uint32_t GetRTT() const throw()				{ return m_rtt; }
+	void	 SetRTT(uint32_t rtt) throw()			{ m_rtt = rtt; }
+	void	 UpdateRTT(uint32_t rtt) throw();
+
 private:
 	CUInt128	m_clientID;
 	CUInt128	m_distance;
@@ -115,6 +120,7 @@ private:
 	time_t		m_expires;
 	time_t		m_created;
 	uint32_t	m_inUse;
+	uint32_t	m_rtt;
 	uint8_t		m_version;
 	bool		m_ipVerified;
 	bool		m_receivedHelloPacket;
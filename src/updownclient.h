@@ -36,6 +36,7 @@
 #include "ClientCredits.h"	// Needed for EIdentState
 #include <ec/cpp/ECID.h>	// Needed for CECID
 #include "BitVector.h"		// Needed for BitVector
+#include "InternedString.h"	// Needed for CInternedString
 #include "ClientRef.h"		// Needed for debug defines
 
 #include <map>
@@ -171,6 +172,7 @@ public:
 	uint32		GetIP() const			{ return m_dwUserIP; }
 	bool		HasLowID() const		{ return IsLowID(m_nUserIDHybrid); }
 	wxString	GetFullIP() const		{ return Uint32toStringIP(m_FullUserIP); }
+	uint32		GetFullUserIP() const		{ return m_FullUserIP; }
 	uint32		GetConnectIP() const		{ return m_nConnectIP; }
 	uint32		GetUserIDHybrid() const		{ return m_nUserIDHybrid; }
 	void		SetUserIDHybrid(uint32 val);
@@ -239,8 +241,10 @@ public:
 
 	void		SendPublicKeyPacket();
 	void		SendSignaturePacket();
+	void		SendSignature(const byte* signature, uint8 siglen, uint8 byChaIPKind);
 	void		ProcessPublicKeyPacket(const byte* pachPacket, uint32 nSize);
 	void		ProcessSignaturePacket(const byte* pachPacket, uint32 nSize);
+	void		OnIdentVerified(bool verified, uint8 byChaIPKind);
 	uint8		GetSecureIdentState();
 
 	void		SendSecIdentStatePacket();
@@ -357,24 +361,31 @@ public:
 	void		SetUpCompleteSourcesCount(uint16 n)	{ m_nUpCompleteSourcesCount = n; }
 
 	//chat
-	uint8		GetChatState()			{ return m_byChatstate; }
-	void		SetChatState(uint8 nNewS)	{ m_byChatstate = nNewS; }
-	EChatCaptchaState GetChatCaptchaState() const	{ return (EChatCaptchaState)m_nChatCaptchaState; }
+	uint8		GetChatState()			{ return m_messageData ? m_messageData->chatState : (uint8)MS_NONE; }
+	void		SetChatState(uint8 nNewS)	{ if (m_messageData || nNewS != MS_NONE) { GetMessageData().chatState = nNewS; } }
+	EChatCaptchaState GetChatCaptchaState() const	{ return m_messageData ? (EChatCaptchaState)m_messageData->captchaState : CA_NONE; }
 	void		ProcessCaptchaRequest(CMemFile* data);
 	void		ProcessCaptchaReqRes(uint8 nStatus);
 	void		ProcessChatMessage(wxString message);
 	// message filtering
-	uint8		GetMessagesReceived() const	{ return m_cMessagesReceived; }
-	void		IncMessagesReceived()		{ m_cMessagesReceived < 255 ? ++m_cMessagesReceived : 255; }
-	uint8		GetMessagesSent() const		{ return m_cMessagesSent; }
-	void		IncMessagesSent()		{ m_cMessagesSent < 255 ? ++m_cMessagesSent : 255; }
+	uint8		GetMessagesReceived() const	{ return m_messageData ? m_messageData->messagesReceived : 0; }
+	void		IncMessagesReceived()		{ uint8& n = GetMessageData().messagesReceived; n < 255 ? ++n : 255; }
+	uint8		GetMessagesSent() const		{ return m_messageData ? m_messageData->messagesSent : 0; }
+	void		IncMessagesSent()		{ uint8& n = GetMessageData().messagesSent; n < 255 ? ++n : 255; }
 	bool		IsSpammer() const		{ return m_fIsSpammer; }
 	void		SetSpammer(bool bVal);
 	bool		IsMessageFiltered(const wxString& message);
 
+	/**
+	 * Adds the estimated heap memory of the client to the totals: the
+	 * client itself with its chat state, the upload requests and the
+	 * download state. Interned strings are counted by CInternedString.
+	 */
+	void		AddMemoryUsage(uint64& client, uint64& upload, uint64& download) const;
+
 	//File Comment
-	const wxString&	GetFileComment() const		{ return m_strComment; }
-	uint8		GetFileRating() const		{ return m_iRating; }
+	const wxString&	GetFileComment() const;
+	uint8		GetFileRating() const		{ return m_messageData ? m_messageData->rating : 0; }
 
 	const wxString&	GetSoftStr() const		{ return m_clientSoftString; }
 	const wxString&	GetSoftVerStr() const		{ return m_clientVerString; }
@@ -396,7 +407,12 @@ public:
 	EUtf8Str	GetUnicodeSupport() const;
 
 	// Barry - Process zip file as it arrives, don't need to wait until end of block
-	int		unzip(Pending_Block_Struct *block, byte *zipped, uint32 lenZipped, byte **unzipped, uint32 *lenUnzipped, int iRecursion = 0);
+	/**
+	 * Unzips the next piece of a compressed block into 'unzipped'.
+	 * lenUnzipped is the size of the buffer on entry, and the number of
+	 * bytes unzipped on return.
+	 */
+	int		unzip(Pending_Block_Struct *block, byte *zipped, uint32 lenZipped, byte *unzipped, uint32 *lenUnzipped);
 	void		UpdateDisplayedInfo(bool force = false);
 	int		GetFileListRequested() const	{ return m_iFileListRequested; }
 	void		SetFileListRequested(int iFileListRequested) { m_iFileListRequested = iFileListRequested; }
@@ -653,7 +669,7 @@ private:
 	uint8		m_byEmuleVersion;
 	uint8		m_byDataCompVer;
 	bool		m_bEmuleProtocol;
-	wxString	m_Username;
+	CInternedString	m_Username;
 	uint32		m_FullUserIP;
 	CMD4Hash	m_UserHash;
 	bool		m_HasValidHash;
@@ -710,7 +726,7 @@ private:
 	//! so that the files know the actual availability of parts.
 	BitVector	m_upPartStatus;
 	uint16		m_lastPartAsked;
-	wxString	m_strModVersion;
+	CInternedString	m_strModVersion;
 
 	std::list<Requested_Block_Struct*>	m_BlockRequests_queue;
 	std::list<Requested_Block_Struct*>	m_DoneBlocks_list;
@@ -739,16 +755,36 @@ private:
 	float		kBpsDown;
 	uint32		msReceivedPrev;
 	uint32		bytesReceivedCycle;
-	// chat
-	wxString	m_strComment;
-	uint8		m_byChatstate;
-	uint8		m_nChatCaptchaState;
-	uint8		m_cCaptchasSent;
-	int8		m_iRating;
-	uint8		m_cMessagesReceived;		// count of chatmessages he sent to me
-	uint8		m_cMessagesSent;			// count of chatmessages I sent to him
-	wxString	m_strCaptchaChallenge;
-	wxString	m_strCaptchaPendingMsg;
+
+	/**
+	 * Chat and file comment state. Only few clients ever chat or comment,
+	 * so it's allocated on the first change and the getters return the
+	 * defaults until then.
+	 */
+	struct MessageData {
+		MessageData()
+			: chatState(MS_NONE),
+			  captchaState(CA_NONE),
+			  captchasSent(0),
+			  rating(0),
+			  messagesReceived(0),
+			  messagesSent(0)
+		{}
+
+		uint8		chatState;
+		uint8		captchaState;
+		uint8		captchasSent;
+		int8		rating;
+		uint8		messagesReceived;	// count of chatmessages he sent to me
+		uint8		messagesSent;		// count of chatmessages I sent to him
+		wxString	comment;
+		wxString	captchaChallenge;
+		wxString	captchaPendingMsg;
+		wxString	pendingMessage;
+	};
+
+	MessageData&	GetMessageData();
+	MessageData*	m_messageData;
 
 	unsigned int
 		m_fHashsetRequesting : 1, // we have sent a hashset request to this client
@@ -807,12 +843,12 @@ private:
 
 	bool		m_OSInfo_sent;
 
-	wxString	m_clientSoftString;	/* software name */
-	wxString	m_clientVerString;	/* version + optional mod name */
-	wxString	m_clientVersionString;	/* version string */
-	wxString	m_fullClientVerString;	/* full info string */
-	wxString	m_sClientOSInfo;
-	wxString	m_pendingMessage;
+	// Interned, most clients share the same few
+	CInternedString	m_clientSoftString;	/* software name */
+	CInternedString	m_clientVerString;	/* version + optional mod name */
+	CInternedString	m_clientVersionString;	/* version string */
+	CInternedString	m_fullClientVerString;	/* full info string */
+	CInternedString	m_sClientOSInfo;
 
 	int		SecIdentSupRec;
 
@@ -823,7 +859,7 @@ private:
 	// needed for stats
 	uint32		m_lastClientSoft;
 	uint32		m_lastClientVersion;
-	wxString	m_lastOSInfo;
+	CInternedString	m_lastOSInfo;
 
 	/* For buddies timeout */
 	uint32		m_nCreationTime;
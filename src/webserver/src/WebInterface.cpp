@@ -409,6 +409,13 @@ namespace MuleNotify
 		CMuleGUIEvent evt(ntf.Clone());
 		wxPostEvent(wxTheApp, evt);
 	}
+
+
+	// Only a few sockets here, every notification gets an event of its own.
+	void HandleNotificationBatched(const CMuleNotiferBase& ntf)
+	{
+		HandleNotificationAlways(ntf);
+	}
 }
 
 
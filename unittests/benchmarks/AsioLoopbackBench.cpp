@@ -0,0 +1,323 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+//
+// Measures socket events per second handed from the Asio threads to the
+// core thread, over loopback connections.
+//
+// Usage: AsioLoopbackBench [threads] [connections] [seconds]
+//
+// Pairs of connected sockets play ping-pong. Every received message is a
+// notification for the main thread, which answers it, the way the core
+// handles the read notifications of LibSocketAsio. The sockets get their
+// io_service from CAsioServicePool, and the notifications reach the main
+// thread through MuleNotify::HandleNotificationAlways, like before, or
+// MuleNotify::HandleNotificationBatched, like the socket events now.
+// This runs with one io_service shared by all threads and with one
+// io_service per thread, each with and without batching.
+//
+
+#ifdef HAVE_CONFIG_H
+#	include "config.h"		// Needed for ASIO_SOCKETS
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef ASIO_SOCKETS
+
+#define BOOST_ALL_NO_LIB
+
+#include <cstring>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+
+// Same as LibSocketAsio, build Boost.System in if we have its sources
+#ifdef HAVE_BOOST_SOURCES
+#	include <boost/../libs/system/src/error_code.cpp>
+#endif
+
+#include "AsioServicePool.h"
+#include "GuiEvents.h"
+
+#include <wx/init.h>
+#include <wx/app.h>
+#include <wx/thread.h>
+#include <wx/stopwatch.h>
+
+
+using namespace boost::asio;
+using boost::system::error_code;
+
+
+static const size_t MessageSize = 64;
+
+
+// Like amuleweb, this program posts the notifications itself.
+DEFINE_LOCAL_EVENT_TYPE(MULE_EVT_NOTIFY)
+
+namespace MuleNotify
+{
+	void HandleNotificationAlways(const CMuleNotiferBase& ntf)
+	{
+		CMuleGUIEvent evt(ntf.Clone());
+		wxPostEvent(wxTheApp, evt);
+	}
+}
+
+
+// Messages handled and wx events it took, counted on the main thread
+static uint64 s_messages = 0;
+static uint64 s_wakeups = 0;
+// Cleared when a run ends, so late notifications are dropped
+static bool s_running = false;
+
+
+/**
+ * Runs the notifications posted to the application, the way
+ * CamuleApp::OnNotifyEvent does.
+ */
+class CNotifyHandler : public wxEvtHandler
+{
+public:
+	void OnNotifyEvent(CMuleGUIEvent& evt)
+	{
+		s_wakeups++;
+		evt.Notify();
+	}
+
+	DECLARE_EVENT_TABLE()
+};
+
+BEGIN_EVENT_TABLE(CNotifyHandler, wxEvtHandler)
+	EVT_MULE_NOTIFY(CNotifyHandler::OnNotifyEvent)
+END_EVENT_TABLE()
+
+
+/**
+ * One end of a loopback connection. Reads and writes run on the Asio
+ * thread of its io_service, the answer is triggered by the main thread.
+ */
+class CConnection
+{
+public:
+	CConnection(io_service& service, bool batched)
+		: m_socket(service),
+		  m_strand(service),
+		  m_batched(batched),
+		  m_received(0)
+	{
+		memset(m_buffer, 0, sizeof(m_buffer));
+	}
+
+	ip::tcp::socket& GetSocket() { return m_socket; }
+
+	// Starts the ping-pong, from the main thread
+	void Start(bool send)
+	{
+		if (send) {
+			m_received = MessageSize;
+			m_strand.post(boost::bind(&CConnection::Reply, this));
+		} else {
+			m_strand.post(boost::bind(&CConnection::StartRead, this));
+		}
+	}
+
+	// Answers the last message, on the main thread
+	static void OnMessage(CConnection* conn)
+	{
+		if (s_running) {
+			s_messages++;
+			conn->m_strand.post(boost::bind(&CConnection::Reply, conn));
+		}
+	}
+
+private:
+	void StartRead()
+	{
+		m_socket.async_read_some(buffer(m_buffer, sizeof(m_buffer)),
+			m_strand.wrap(boost::bind(&CConnection::HandleRead, this, placeholders::error, placeholders::bytes_transferred)));
+	}
+
+	void HandleRead(const error_code& ec, size_t received)
+	{
+		if (!ec && received) {
+			m_received = received;
+			if (m_batched) {
+				MuleNotify::DoNotifyBatched(&CConnection::OnMessage, this);
+			} else {
+				MuleNotify::DoNotifyAlways(&CConnection::OnMessage, this);
+			}
+		}
+	}
+
+	void Reply()
+	{
+		error_code ec;
+		write(m_socket, buffer(m_buffer, m_received), ec);
+		if (!ec) {
+			StartRead();
+		}
+	}
+
+	ip::tcp::socket		m_socket;
+	io_service::strand	m_strand;
+	bool			m_batched;
+	char			m_buffer[MessageSize];
+	size_t			m_received;
+};
+
+
+// Runs an io_service of the pool, like the CAsioServiceThread of LibSocketAsio
+class CServiceThread : public wxThread
+{
+public:
+	CServiceThread(io_service& service)
+		: wxThread(wxTHREAD_JOINABLE),
+		  m_service(service)
+	{
+	}
+
+	void* Entry()
+	{
+		io_service::work worker(m_service);
+		m_service.run();
+		return NULL;
+	}
+
+private:
+	io_service& m_service;
+};
+
+
+static void Run(int threads, int connections, int seconds, bool perThread, bool batched)
+{
+	// Sockets take their io_service round robin from the ones created here
+	CAsioServicePool pool;
+	int serviceCount = perThread ? threads : 1;
+	pool.GetByIndex(serviceCount - 1);
+
+	std::vector<CConnection*> conns;
+	{
+		io_service setup;
+		ip::tcp::acceptor acceptor(setup, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+		for (int i = 0; i < connections; ++i) {
+			CConnection* client = new CConnection(pool.Get(), batched);
+			CConnection* server = new CConnection(pool.Get(), batched);
+			client->GetSocket().connect(acceptor.local_endpoint());
+			acceptor.accept(server->GetSocket());
+			client->GetSocket().set_option(ip::tcp::no_delay(true));
+			server->GetSocket().set_option(ip::tcp::no_delay(true));
+			conns.push_back(client);
+			conns.push_back(server);
+		}
+	}
+
+	std::vector<CServiceThread*> workers;
+	for (int i = 0; i < threads; ++i) {
+		workers.push_back(new CServiceThread(pool.GetByIndex(i % serviceCount)));
+		workers[i]->Create();
+		workers[i]->Run();
+	}
+
+	s_messages = 0;
+	s_wakeups = 0;
+	s_running = true;
+	for (size_t i = 0; i < conns.size(); ++i) {
+		conns[i]->Start(i % 2 == 0);
+	}
+
+	wxStopWatch watch;
+	while (watch.Time() < seconds * 1000) {
+		uint64 wakeups = s_wakeups;
+		wxTheApp->ProcessPendingEvents();
+		if (wakeups == s_wakeups) {
+			wxThread::Yield();
+		}
+	}
+	long elapsed = watch.Time();
+	uint64 messages = s_messages;
+	uint64 wakeups = s_wakeups;
+
+	// Drop whatever is still on its way before the connections go
+	s_running = false;
+	pool.Stop();
+	for (int i = 0; i < threads; ++i) {
+		workers[i]->Wait();
+		delete workers[i];
+	}
+	wxTheApp->ProcessPendingEvents();
+	MuleNotify::ProcessBatchedNotifications();
+	for (size_t i = 0; i < conns.size(); ++i) {
+		delete conns[i];
+	}
+
+	printf("%-24s %-12s %10.0f events/s, %6.1f events per wakeup\n",
+		perThread ? "io_service per thread," : "shared io_service,",
+		batched ? "batched:" : "unbatched:",
+		elapsed ? messages * 1000.0 / elapsed : 0.0,
+		wakeups ? (double)messages / wakeups : 0.0);
+}
+
+
+int main(int argc, char** argv)
+{
+	wxInitializer init;
+	if (!init.IsOk() || !wxTheApp) {
+		return 1;
+	}
+
+	CNotifyHandler handler;
+	wxTheApp->SetNextHandler(&handler);
+
+	int threads = (argc > 1) ? atoi(argv[1]) : wxThread::GetCPUCount();
+	if (threads < 1) {
+		threads = 1;
+	}
+	int connections = (argc > 2) ? atoi(argv[2]) : 200;
+	if (connections < 1) {
+		connections = 1;
+	}
+	int seconds = (argc > 3) ? atoi(argv[3]) : 3;
+	if (seconds < 1) {
+		seconds = 1;
+	}
+
+	printf("%d threads, %d loopback connections, %d s per run\n", threads, connections, seconds);
+	Run(threads, connections, seconds, false, false);
+	Run(threads, connections, seconds, false, true);
+	Run(threads, connections, seconds, true, false);
+	Run(threads, connections, seconds, true, true);
+
+	wxTheApp->SetNextHandler(NULL);
+	return 0;
+}
+
+#else
+
+int main()
+{
+	printf("Built without Boost.Asio, nothing to measure.\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,2136 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+//
+// Loads a local amuled with fake ed2k clients and measures its transfers.
+//
+// Usage: Ed2kLoadBench [pid=<pid of amuled>] [leechers=100] [seeders=10]
+//                      [files=2] [size=50] [seconds=60] [port=4661]
+//                      [clientport=14662] [seed=4711] [obfuscate] [compress]
+//
+// A fake ed2k server listens on 127.0.0.1:<port>. Add it to amuled as
+// 'localhost:<port>', amuled drops servers and sources on 127.0.0.1 but
+// not a server given by name, and connect to it. The server gives amuled
+// a high ID and keeps the list of files amuled offers.
+//
+// The leechers then connect to amuled, each from an address 127.1.x.y of
+// its own since amuled queues at most three clients of an IP, ask for its
+// complete shared files and download from them whenever amuled gives them
+// an upload slot. They listen on <clientport> of their address, where
+// amuled connects to them when a slot becomes free.
+//
+// The seeders share synthetic files of <size> MiB, whose ed2k links are
+// printed at the start, add them to amuled to have it download them. The
+// server hands the seeders out as LowID sources and passes on the callback
+// requests of amuled, so the seeders connect to amuled, from 127.2.x.y.
+// amuled knows the files once it has downloaded them, use another seed to
+// have it download again.
+//
+// With 'obfuscate' the fake clients ask for obfuscated connections, with
+// 'compress' they ask amuled for compressed blocks and send compressed
+// blocks to it.
+//
+// Every five seconds and at the end this prints how fast amuled uploads
+// to the leechers and downloads from the seeders, the time from a block
+// request to the first byte of the block, and, given the pid of amuled,
+// its CPU time per MiB transferred and its memory use from /proc.
+//
+// Other loopback addresses than 127.0.0.1 work out of the box on Linux,
+// other systems need aliases for them. Every fake client takes up to two
+// file descriptors, raise 'ulimit -n' for many of them.
+//
+
+#ifdef HAVE_CONFIG_H
+#	include "config.h"		// Needed for ASIO_SOCKETS
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef ASIO_SOCKETS
+
+#define BOOST_ALL_NO_LIB
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+
+// Same as LibSocketAsio, build Boost.System in if we have its sources
+#ifdef HAVE_BOOST_SOURCES
+#	include <boost/../libs/system/src/error_code.cpp>
+#endif
+
+#ifdef __linux__
+#	include <unistd.h>		// Needed for sysconf
+#endif
+
+#include <zlib.h>
+
+#include <wx/init.h>
+
+#include "Types.h"
+#include "ArchSpecific.h"		// Needed for PeekUInt32 and PokeUInt32
+#include "MD4Hash.h"
+#include "RC4Encrypt.h"
+#include "CryptoPP_Inc.h"		// Needed for MD4
+#include <common/MD5Sum.h>
+#include <common/ClientVersion.h>	// Needed for EDONKEYVERSION
+#include <protocol/Protocols.h>
+#include <protocol/ed2k/Constants.h>
+#include <protocol/ed2k/ClientSoftware.h>
+#include <protocol/ed2k/Client2Client/TCP.h>
+#include <protocol/ed2k/Client2Server/TCP.h>
+#include <tags/ClientTags.h>
+#include <tags/FileTags.h>
+#include <tags/TagTypes.h>
+
+
+using namespace boost::asio;
+using boost::system::error_code;
+
+
+// From EncryptedStreamSocket.cpp
+static const uint8	MAGICVALUE_REQUESTER = 34;
+static const uint8	MAGICVALUE_SERVER = 203;
+static const uint32	MAGICVALUE_SYNC = 0x835E6FC4;
+static const uint8	ENM_OBFUSCATION = 0x00;
+
+//! amuled sends the data of a block in packets of this size.
+static const uint32	DataPacketSize = 10240;
+//! Longer packets are taken for a broken stream.
+static const uint32	MaxPacketSize = 2 * 1024 * 1024;
+//! 127.0.0.1 as an ed2k ID, the address of the fake server.
+static const uint32	LoopbackID = 0x0100007F;
+
+
+struct CBenchOptions
+{
+	CBenchOptions()
+		: pid(0), leechers(100), seeders(10), files(2), size(50), seconds(60),
+		  port(4661), clientPort(14662), seed(4711), obfuscate(false), compress(false)
+	{
+	}
+
+	uint32	pid;
+	uint32	leechers;
+	uint32	seeders;
+	uint32	files;
+	//! Of the synthetic files, in MiB.
+	uint32	size;
+	uint32	seconds;
+	uint16	port;
+	uint16	clientPort;
+	uint32	seed;
+	bool	obfuscate;
+	bool	compress;
+};
+
+static CBenchOptions s_options;
+
+
+/** What the fake clients see of amuled, since the measuring started. */
+struct CBenchStats
+{
+	CBenchStats()
+		: uploadPayload(0), uploadWire(0), uploadBlocks(0), slotsGiven(0), slotsEnded(0),
+		  downloadPayload(0), downloadWire(0), downloadBlocks(0), callbacks(0),
+		  connectFailures(0), closed(0), errors(0)
+	{
+	}
+
+	// amuled uploading to the leechers
+	uint64	uploadPayload;
+	uint64	uploadWire;
+	uint32	uploadBlocks;
+	uint32	slotsGiven;
+	uint32	slotsEnded;
+	//! From a block request to the first data of the block, in microseconds.
+	std::vector<uint32>	firstByte;
+	//! From an upload request to the slot, in milliseconds.
+	std::vector<uint32>	slotWait;
+
+	// amuled downloading from the seeders
+	uint64	downloadPayload;
+	uint64	downloadWire;
+	uint32	downloadBlocks;
+	uint32	callbacks;
+	//! From a callback request to the first block request, in milliseconds.
+	std::vector<uint32>	callbackToRequest;
+
+	uint32	connectFailures;
+	uint32	closed;
+	uint32	errors;
+};
+
+static CBenchStats s_stats;
+
+
+//! Microseconds since the first call.
+static uint64 GetMicroTime()
+{
+	static const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+	return (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds();
+}
+
+
+//! Mixes the bits of a number, the step of SplitMix64.
+static uint64 Mix64(uint64 x)
+{
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+
+static uint64 s_random = 0;
+
+static uint32 GetRandomUint32()
+{
+	return (uint32)Mix64(s_random++);
+}
+
+
+//! An IPv4 address as an ed2k ID, in network order read as a little endian number.
+static uint32 GetED2KID(const ip::address_v4& address)
+{
+	ip::address_v4::bytes_type bytes = address.to_bytes();
+	return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32)bytes[3] << 24);
+}
+
+
+/** Builds a packet, its header is filled in when it is done. */
+class CPacketWriter
+{
+public:
+	static const uint32 HeaderSize = 6;
+
+	CPacketWriter(uint32 reserve = 64)
+		: m_data(HeaderSize)
+	{
+		m_data.reserve(HeaderSize + reserve);
+	}
+
+	void WriteUInt8(uint8 value)		{ m_data.push_back(value); }
+	void WriteUInt16(uint16 value)		{ PokeUInt16(Grow(2), value); }
+	void WriteUInt32(uint32 value)		{ PokeUInt32(Grow(4), value); }
+	void WriteUInt64(uint64 value)		{ PokeUInt64(Grow(8), value); }
+	void WriteHash(const CMD4Hash& hash)	{ memcpy(Grow(MD4HASH_LENGTH), hash.GetHash(), MD4HASH_LENGTH); }
+
+	void Write(const void* data, uint32 length)
+	{
+		if (length) {
+			memcpy(Grow(length), data, length);
+		}
+	}
+
+	void WriteString(const std::string& value)
+	{
+		WriteUInt16(value.size());
+		Write(value.data(), value.size());
+	}
+
+	// Tags in the old format with a one byte name, which every client reads
+	void WriteTag(uint8 name, uint32 value)
+	{
+		WriteUInt8(TAGTYPE_UINT32);
+		WriteUInt16(1);
+		WriteUInt8(name);
+		WriteUInt32(value);
+	}
+
+	void WriteTag(uint8 name, const std::string& value)
+	{
+		WriteUInt8(TAGTYPE_STRING);
+		WriteUInt16(1);
+		WriteUInt8(name);
+		WriteString(value);
+	}
+
+	//! Appends room for 'length' bytes, to be written by the caller.
+	byte* Grow(uint32 length)
+	{
+		size_t size = m_data.size();
+		m_data.resize(size + length);
+		return &m_data[size];
+	}
+
+	//! Writes the header, the packet is then ready to be sent.
+	std::vector<byte>& Finish(uint8 protocol, uint8 opcode)
+	{
+		m_data[0] = protocol;
+		PokeUInt32(&m_data[1], m_data.size() - 5);
+		m_data[5] = opcode;
+		return m_data;
+	}
+
+private:
+	std::vector<byte>	m_data;
+};
+
+
+/** Reads the fields of a received packet, throws if it is too short. */
+class CPacketReader
+{
+public:
+	CPacketReader(const byte* data, uint32 size)
+		: m_data(data),
+		  m_size(size),
+		  m_pos(0)
+	{
+	}
+
+	uint8 ReadUInt8()	{ return *Read(1); }
+	uint16 ReadUInt16()	{ return PeekUInt16(Read(2)); }
+	uint32 ReadUInt32()	{ return PeekUInt32(Read(4)); }
+	uint64 ReadUInt64()	{ return PeekUInt64(Read(8)); }
+	CMD4Hash ReadHash()	{ return CMD4Hash(Read(MD4HASH_LENGTH)); }
+
+	std::string ReadString()
+	{
+		uint16 length = ReadUInt16();
+		return std::string((const char*)Read(length), length);
+	}
+
+	//! Skips 'length' bytes and returns where they are.
+	const byte* Read(uint32 length)
+	{
+		if (length > m_size - m_pos) {
+			throw std::runtime_error("Packet too short");
+		}
+		const byte* data = m_data + m_pos;
+		m_pos += length;
+		return data;
+	}
+
+	uint32 GetRemaining() const { return m_size - m_pos; }
+
+	/**
+	 * Reads a tag of either format.
+	 *
+	 * @return The name of the tag, 0 for a string name.
+	 */
+	uint8 ReadTag(uint64& value, std::string& str)
+	{
+		uint8 type = ReadUInt8();
+		uint8 name = 0;
+		if (type & 0x80) {
+			type &= 0x7F;
+			name = ReadUInt8();
+		} else {
+			uint16 length = ReadUInt16();
+			const byte* data = Read(length);
+			name = length == 1 ? data[0] : 0;
+		}
+
+		value = 0;
+		str.clear();
+		switch (type) {
+			case TAGTYPE_UINT8:	value = ReadUInt8(); break;
+			case TAGTYPE_UINT16:	value = ReadUInt16(); break;
+			case TAGTYPE_UINT32:	value = ReadUInt32(); break;
+			case TAGTYPE_UINT64:	value = ReadUInt64(); break;
+			case TAGTYPE_STRING:	str = ReadString(); break;
+			case TAGTYPE_HASH16:	Read(MD4HASH_LENGTH); break;
+			case TAGTYPE_FLOAT32:	Read(4); break;
+			case TAGTYPE_BOOL:	Read(1); break;
+			case TAGTYPE_BOOLARRAY:	Read((ReadUInt16() + 7) / 8); break;
+			case TAGTYPE_BLOB:	Read(ReadUInt32()); break;
+			case TAGTYPE_BSOB:	Read(ReadUInt8()); break;
+			default:
+				if (type >= TAGTYPE_STR1 && type <= TAGTYPE_STR16) {
+					uint32 length = type - TAGTYPE_STR1 + 1;
+					str.assign((const char*)Read(length), length);
+				} else {
+					throw std::runtime_error("Unknown tag type");
+				}
+		}
+		return name;
+	}
+
+private:
+	const byte*	m_data;
+	uint32		m_size;
+	uint32		m_pos;
+};
+
+
+class CConnection;
+typedef boost::shared_ptr<CConnection> CConnectionPtr;
+
+
+/** Gets what happens on the connections of a fake client or of the fake server. */
+class CConnectionHandler
+{
+public:
+	virtual ~CConnectionHandler() {}
+
+	//! The connection can be used, after the obfuscation handshake if there is one.
+	virtual void OnConnected(CConnection* conn) = 0;
+	//! A packet arrived. Packed packets arrive unpacked, as eMule packets.
+	virtual void OnPacket(CConnection* conn, uint8 protocol, uint8 opcode, CPacketReader& packet) = 0;
+	//! The connection failed or was closed by the other side.
+	virtual void OnClosed(CConnection* conn) = 0;
+};
+
+
+/**
+ * An ed2k connection, with the obfuscation of EncryptedStreamSocket.
+ *
+ * The handlers keep it alive as long as they use it, and so do the Asio
+ * operations running on it.
+ */
+class CConnection : public boost::enable_shared_from_this<CConnection>
+{
+public:
+	CConnection(io_service& service, CConnectionHandler& handler)
+		: m_service(service),
+		  m_socket(service),
+		  m_handler(handler),
+		  m_state(CS_IDLE),
+		  m_ownHash(NULL),
+		  m_obfuscated(false),
+		  m_decrypted(0),
+		  m_writing(false)
+	{
+	}
+
+	ip::tcp::socket& GetSocket() { return m_socket; }
+
+	/** Connects from a local address, obfuscated with the user hash of the other side if given. */
+	void Connect(const ip::address_v4& local, const ip::tcp::endpoint& remote, const CMD4Hash* obfuscateFor)
+	{
+		if (obfuscateFor) {
+			m_remoteHash = *obfuscateFor;
+			m_obfuscated = true;
+		}
+		m_state = CS_CONNECTING;
+
+		error_code ec;
+		m_socket.open(ip::tcp::v4(), ec);
+		if (!ec) {
+			m_socket.set_option(socket_base::reuse_address(true), ec);
+			m_socket.bind(ip::tcp::endpoint(local, 0), ec);
+		}
+		if (ec) {
+			m_service.post(boost::bind(&CConnection::HandleConnect, shared_from_this(), ec));
+		} else {
+			m_socket.async_connect(remote, boost::bind(&CConnection::HandleConnect, shared_from_this(), placeholders::error));
+		}
+	}
+
+	/** Starts an accepted connection, an obfuscated one is expected to use our user hash. */
+	void Accept(const CMD4Hash* ownHash)
+	{
+		m_ownHash = ownHash;
+		m_state = CS_DETECTING;
+		StartRead();
+	}
+
+	void Send(CPacketWriter& packet, uint8 protocol, uint8 opcode)
+	{
+		if (m_state != CS_OPEN) {
+			return;
+		}
+		std::vector<byte>& data = packet.Finish(protocol, opcode);
+		Write(&data[0], data.size());
+	}
+
+	//! Closes the connection without telling the handler.
+	void Close()
+	{
+		if (m_state != CS_CLOSED) {
+			m_state = CS_CLOSED;
+			error_code ec;
+			m_socket.close(ec);
+		}
+	}
+
+	bool IsObfuscated() const	{ return m_obfuscated; }
+	bool IsOpen() const		{ return m_state == CS_OPEN; }
+
+private:
+	enum State {
+		CS_IDLE,
+		CS_CONNECTING,
+		//! Accepted, waiting for the first byte that tells if it is obfuscated.
+		CS_DETECTING,
+		//! Accepted, waiting for the rest of the obfuscation request.
+		CS_REQUEST,
+		//! Connected, waiting for the answer to our obfuscation request.
+		CS_ANSWER,
+		CS_OPEN,
+		CS_CLOSED
+	};
+
+	void HandleConnect(const error_code& ec)
+	{
+		if (m_state == CS_CLOSED) {
+			return;
+		} else if (ec) {
+			s_stats.connectFailures++;
+			Fail(NULL);
+			return;
+		}
+
+		error_code ignored;
+		m_socket.set_option(ip::tcp::no_delay(true), ignored);
+		StartRead();
+		if (m_obfuscated) {
+			SendObfuscationRequest();
+		} else {
+			Open();
+		}
+	}
+
+	void StartRead()
+	{
+		m_socket.async_read_some(buffer(m_readBuffer, sizeof(m_readBuffer)),
+			boost::bind(&CConnection::HandleRead, shared_from_this(), placeholders::error, placeholders::bytes_transferred));
+	}
+
+	void HandleRead(const error_code& ec, size_t received)
+	{
+		if (m_state == CS_CLOSED) {
+			return;
+		} else if (ec || !received) {
+			s_stats.closed++;
+			Fail(NULL);
+			return;
+		}
+
+		m_input.insert(m_input.end(), m_readBuffer, m_readBuffer + received);
+		try {
+			ProcessInput();
+		} catch (const std::exception& e) {
+			Fail(e.what());
+			return;
+		}
+		if (m_state != CS_CLOSED) {
+			StartRead();
+		}
+	}
+
+	void ProcessInput()
+	{
+		size_t pos = 0;
+		while (m_state != CS_CLOSED) {
+			if (m_obfuscated && m_decrypted < m_input.size() && m_state != CS_DETECTING) {
+				m_receiveKey.RC4Crypt(&m_input[m_decrypted], &m_input[m_decrypted], m_input.size() - m_decrypted);
+				m_decrypted = m_input.size();
+			}
+			const byte* data = m_input.empty() ? NULL : &m_input[pos];
+			size_t available = m_input.size() - pos;
+
+			if (m_state == CS_DETECTING) {
+				if (available < 1) {
+					break;
+				} else if (data[0] == OP_EDONKEYPROT || data[0] == OP_EMULEPROT || data[0] == OP_PACKEDPROT) {
+					Open();
+					continue;
+				} else if (!m_ownHash) {
+					throw std::runtime_error("Obfuscated connection without a user hash");
+				} else if (available < 5) {
+					break;
+				}
+				// <marker 1><random key part 4>, in clear
+				m_obfuscated = true;
+				SetKeys(*m_ownHash, PeekUInt32(data + 1), false);
+				pos += 5;
+				m_decrypted = pos;
+				m_state = CS_REQUEST;
+			} else if (m_state == CS_REQUEST) {
+				// <magic value 4><supported method 1><preferred method 1><padding length 1><padding>
+				if (available < 7 || available < 7u + data[6]) {
+					break;
+				} else if (PeekUInt32(data) != MAGICVALUE_SYNC) {
+					throw std::runtime_error("Wrong obfuscation magic value");
+				}
+				pos += 7 + data[6];
+
+				byte answer[6];
+				PokeUInt32(answer, MAGICVALUE_SYNC);
+				answer[4] = ENM_OBFUSCATION;
+				answer[5] = 0;		// No padding
+				Write(answer, sizeof(answer));
+				Open();
+			} else if (m_state == CS_ANSWER) {
+				// <magic value 4><method 1><padding length 1><padding>
+				if (available < 6 || available < 6u + data[5]) {
+					break;
+				} else if (PeekUInt32(data) != MAGICVALUE_SYNC) {
+					throw std::runtime_error("Wrong obfuscation magic value");
+				}
+				pos += 6 + data[5];
+				Open();
+			} else if (m_state == CS_OPEN) {
+				// <protocol 1><length 4><opcode 1><payload length - 1>
+				if (available < CPacketWriter::HeaderSize) {
+					break;
+				}
+				uint8 protocol = data[0];
+				uint32 length = PeekUInt32(data + 1);
+				if (protocol != OP_EDONKEYPROT && protocol != OP_EMULEPROT && protocol != OP_PACKEDPROT) {
+					throw std::runtime_error("Unknown protocol");
+				} else if (length < 1 || length > MaxPacketSize) {
+					throw std::runtime_error("Invalid packet length");
+				} else if (available < 5 + length) {
+					break;
+				}
+				Dispatch(protocol, data[5], data + CPacketWriter::HeaderSize, length - 1);
+				pos += 5 + length;
+			} else {
+				break;
+			}
+		}
+
+		if (m_state != CS_CLOSED) {
+			m_input.erase(m_input.begin(), m_input.begin() + pos);
+			m_decrypted = m_decrypted > pos ? m_decrypted - pos : 0;
+		}
+	}
+
+	void Dispatch(uint8 protocol, uint8 opcode, const byte* data, uint32 size)
+	{
+		if (protocol != OP_PACKEDPROT) {
+			CPacketReader packet(data, size);
+			m_handler.OnPacket(this, protocol, opcode, packet);
+			return;
+		}
+
+		// Same guess as CPacket::UnPackPacket, grown until it fits
+		uLongf unpackedSize = size * 10 + 300;
+		std::vector<byte> unpacked;
+		int result = Z_BUF_ERROR;
+		while (result == Z_BUF_ERROR && unpackedSize <= MaxPacketSize) {
+			unpacked.resize(unpackedSize);
+			result = uncompress(&unpacked[0], &unpackedSize, data, size);
+			if (result == Z_BUF_ERROR) {
+				unpackedSize = unpacked.size() * 2;
+			}
+		}
+		if (result != Z_OK) {
+			throw std::runtime_error("Failed to unpack a packet");
+		}
+		CPacketReader packet(&unpacked[0], unpackedSize);
+		m_handler.OnPacket(this, OP_EMULEPROT, opcode, packet);
+	}
+
+	void Open()
+	{
+		m_state = CS_OPEN;
+		m_handler.OnConnected(this);
+	}
+
+	void Fail(const char* error)
+	{
+		if (error) {
+			s_stats.errors++;
+			printf("Connection error: %s\n", error);
+		}
+		Close();
+		m_handler.OnClosed(this);
+	}
+
+	//! Sets up RC4 as EncryptedStreamSocket does, the requester side sends on the requester key.
+	void SetKeys(const CMD4Hash& hash, uint32 randomKeyPart, bool requester)
+	{
+		uint8 keyData[21];
+		memcpy(keyData, hash.GetHash(), MD4HASH_LENGTH);
+		PokeUInt32(keyData + 17, randomKeyPart);
+
+		keyData[16] = MAGICVALUE_REQUESTER;
+		MD5Sum md5(keyData, sizeof(keyData));
+		(requester ? m_sendKey : m_receiveKey).SetKey(md5);
+
+		keyData[16] = MAGICVALUE_SERVER;
+		md5.Calculate(keyData, sizeof(keyData));
+		(requester ? m_receiveKey : m_sendKey).SetKey(md5);
+	}
+
+	void SendObfuscationRequest()
+	{
+		uint32 randomKeyPart = GetRandomUint32();
+		SetKeys(m_remoteHash, randomKeyPart, true);
+		m_state = CS_ANSWER;
+
+		// <marker 1><random key part 4>, in clear, and encrypted
+		// <magic value 4><supported method 1><preferred method 1><padding length 1>
+		byte request[12];
+		do {
+			request[0] = GetRandomUint32();
+		} while (request[0] == OP_EDONKEYPROT || request[0] == OP_EMULEPROT || request[0] == OP_PACKEDPROT);
+		PokeUInt32(request + 1, randomKeyPart);
+		PokeUInt32(request + 5, MAGICVALUE_SYNC);
+		request[9] = ENM_OBFUSCATION;
+		request[10] = ENM_OBFUSCATION;
+		request[11] = 0;		// No padding
+		m_sendKey.RC4Crypt(request + 5, request + 5, sizeof(request) - 5);
+
+		m_output.push_back(std::vector<byte>(request, request + sizeof(request)));
+		StartWrite();
+	}
+
+	//! Queues data to be sent, encrypting it on an obfuscated connection.
+	void Write(byte* data, uint32 length)
+	{
+		if (m_obfuscated) {
+			m_sendKey.RC4Crypt(data, data, length);
+		}
+		m_output.push_back(std::vector<byte>(data, data + length));
+		StartWrite();
+	}
+
+	void StartWrite()
+	{
+		if (!m_writing && !m_output.empty()) {
+			m_writing = true;
+			async_write(m_socket, buffer(m_output.front()),
+				boost::bind(&CConnection::HandleWrite, shared_from_this(), placeholders::error));
+		}
+	}
+
+	void HandleWrite(const error_code& ec)
+	{
+		m_writing = false;
+		if (m_state == CS_CLOSED) {
+			return;
+		} else if (ec) {
+			s_stats.closed++;
+			Fail(NULL);
+			return;
+		}
+		m_output.pop_front();
+		StartWrite();
+	}
+
+	io_service&		m_service;
+	ip::tcp::socket		m_socket;
+	CConnectionHandler&	m_handler;
+	State			m_state;
+
+	//! Key of incoming obfuscated connections.
+	const CMD4Hash*		m_ownHash;
+	//! Key of outgoing obfuscated connections.
+	CMD4Hash		m_remoteHash;
+	bool			m_obfuscated;
+	CRC4EncryptableBuffer	m_sendKey;
+	CRC4EncryptableBuffer	m_receiveKey;
+
+	byte			m_readBuffer[64 * 1024];
+	std::vector<byte>	m_input;
+	//! Where the received data still needs to be decrypted.
+	size_t			m_decrypted;
+	std::deque<std::vector<byte> >	m_output;
+	bool			m_writing;
+};
+
+
+/** A file of the seeders, its data is made up from its seed and the offset. */
+class CSyntheticFile
+{
+public:
+	CSyntheticFile(uint32 seed, uint32 index, uint64 size)
+		: m_seed(Mix64(((uint64)seed << 32) | index)),
+		  m_size(size)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "Ed2kLoadBench-%u-%u.dat", seed, index);
+		m_name = name;
+
+		if (m_size < PARTSIZE) {
+			HashRange(0, m_size, m_hash);
+		} else {
+			// A file of whole parts gets an empty part hash at its end, as CKnownFile does
+			m_partHashes.resize(m_size / PARTSIZE + 1);
+			for (size_t i = 0; i < m_partHashes.size(); ++i) {
+				HashRange(i * PARTSIZE, std::min<uint64>((i + 1) * PARTSIZE, m_size), m_partHashes[i]);
+			}
+			std::vector<byte> hashes(m_partHashes.size() * MD4HASH_LENGTH);
+			for (size_t i = 0; i < m_partHashes.size(); ++i) {
+				memcpy(&hashes[i * MD4HASH_LENGTH], m_partHashes[i].GetHash(), MD4HASH_LENGTH);
+			}
+			MD4 md4;
+			md4.CalculateDigest(m_hash.GetHash(), &hashes[0], hashes.size());
+		}
+	}
+
+	const CMD4Hash& GetHash() const				{ return m_hash; }
+	const std::vector<CMD4Hash>& GetPartHashes() const	{ return m_partHashes; }
+	const std::string& GetName() const			{ return m_name; }
+	uint64 GetSize() const					{ return m_size; }
+	bool IsLarge() const					{ return m_size > OLD_MAX_FILE_SIZE; }
+
+	std::string GetLink() const
+	{
+		char size[32];
+		snprintf(size, sizeof(size), "%llu", (unsigned long long)m_size);
+		return "ed2k://|file|" + m_name + "|" + size + "|" + m_hash.EncodeSTL() + "|/";
+	}
+
+	/**
+	 * Writes the data of the file at an offset.
+	 *
+	 * Every byte is one of 16 characters, so the data compresses to about a
+	 * half, about as well as the usual shared files that are not archives.
+	 */
+	void Fill(uint64 offset, byte* out, uint32 length) const
+	{
+		static const char symbols[] = "0123456789abcdef";
+		uint64 word = offset / 8;
+		uint32 skip = offset % 8;
+		while (length) {
+			uint64 bits = Mix64(m_seed ^ word++) >> (skip * 4);
+			for (uint32 i = skip; i < 8 && length; ++i, --length) {
+				*out++ = symbols[bits & 15];
+				bits >>= 4;
+			}
+			skip = 0;
+		}
+	}
+
+private:
+#ifdef __WEAK_CRYPTO__
+	typedef CryptoPP::Weak::MD4 MD4;
+#else
+	typedef CryptoPP::MD4 MD4;
+#endif
+
+	void HashRange(uint64 start, uint64 end, CMD4Hash& hash) const
+	{
+		MD4 md4;
+		std::vector<byte> data(1024 * 1024);
+		for (uint64 pos = start; pos < end; pos += data.size()) {
+			uint32 length = std::min<uint64>(end - pos, data.size());
+			Fill(pos, &data[0], length);
+			md4.Update(&data[0], length);
+		}
+		md4.Final(hash.GetHash());
+	}
+
+	uint64			m_seed;
+	uint64			m_size;
+	std::string		m_name;
+	CMD4Hash		m_hash;
+	std::vector<CMD4Hash>	m_partHashes;
+};
+
+
+/** A complete file amuled offered to the fake server. */
+struct COfferedFile
+{
+	CMD4Hash	hash;
+	uint64		size;
+	std::string	name;
+};
+
+
+class CSeeder;
+
+
+/** The ed2k server amuled is connected to. */
+class CFakeServer : public CConnectionHandler
+{
+public:
+	CFakeServer(io_service& service, const std::vector<CSyntheticFile*>& files)
+		: m_service(service),
+		  m_acceptor(service),
+		  m_files(files),
+		  m_loggedIn(false)
+	{
+	}
+
+	bool Listen()
+	{
+		error_code ec;
+		ip::tcp::endpoint endpoint(ip::address_v4::loopback(), s_options.port);
+		m_acceptor.open(endpoint.protocol(), ec);
+		if (!ec) {
+			m_acceptor.set_option(socket_base::reuse_address(true), ec);
+			m_acceptor.bind(endpoint, ec);
+		}
+		if (!ec) {
+			m_acceptor.listen(socket_base::max_connections, ec);
+		}
+		if (ec) {
+			printf("Failed to listen on 127.0.0.1:%u: %s\n", s_options.port, ec.message().c_str());
+			return false;
+		}
+		StartAccept();
+		return true;
+	}
+
+	void AddSeeder(CSeeder* seeder) { m_seeders.push_back(seeder); }
+
+	bool IsLoggedIn() const				{ return m_loggedIn; }
+	//! Where amuled listens for clients.
+	const ip::tcp::endpoint& GetClientEndpoint() const	{ return m_clientEndpoint; }
+	const CMD4Hash& GetClientHash() const		{ return m_clientHash; }
+
+	void GetOfferedFiles(std::vector<COfferedFile>& files) const
+	{
+		files.clear();
+		for (std::map<CMD4Hash, COfferedFile>::const_iterator it = m_offered.begin(); it != m_offered.end(); ++it) {
+			files.push_back(it->second);
+		}
+	}
+
+private:
+	void StartAccept()
+	{
+		m_accepting.reset(new CConnection(m_service, *this));
+		m_acceptor.async_accept(m_accepting->GetSocket(), boost::bind(&CFakeServer::HandleAccept, this, placeholders::error));
+	}
+
+	void HandleAccept(const error_code& ec)
+	{
+		if (!ec) {
+			// amuled has one server connection, a new one replaces the old one
+			if (m_client) {
+				m_client->Close();
+			}
+			m_client = m_accepting;
+			m_loggedIn = false;
+			m_client->Accept(NULL);
+		}
+		StartAccept();
+	}
+
+	void OnConnected(CConnection*) {}
+
+	void OnPacket(CConnection* conn, uint8, uint8 opcode, CPacketReader& packet)
+	{
+		switch (opcode) {
+			case OP_LOGINREQUEST:
+				ProcessLogin(conn, packet);
+				break;
+			case OP_OFFERFILES:
+				ProcessOfferFiles(packet);
+				break;
+			case OP_GETSOURCES:
+			case OP_GETSOURCES_OBFU:
+				ProcessGetSources(conn, packet, opcode == OP_GETSOURCES_OBFU);
+				break;
+			case OP_CALLBACKREQUEST:
+				ProcessCallbackRequest(conn, packet);
+				break;
+			default:
+				// Searches and server lists are not answered
+				break;
+		}
+	}
+
+	void OnClosed(CConnection* conn)
+	{
+		if (conn == m_client.get()) {
+			if (m_loggedIn) {
+				printf("amuled disconnected from the server\n");
+			}
+			m_loggedIn = false;
+			m_client.reset();
+		}
+	}
+
+	// <hash 16><ID 4><port 2><tag count 4><tags>
+	void ProcessLogin(CConnection* conn, CPacketReader& packet)
+	{
+		m_clientHash = packet.ReadHash();
+		packet.ReadUInt32();
+		uint16 port = packet.ReadUInt16();
+		error_code ec;
+		m_clientEndpoint = ip::tcp::endpoint(conn->GetSocket().remote_endpoint(ec).address(), port);
+		m_loggedIn = true;
+
+		CPacketWriter message;
+		message.WriteString("Ed2kLoadBench fake server");
+		conn->Send(message, OP_EDONKEYPROT, OP_SERVERMESSAGE);
+
+		// A high ID, the same as the address, as the paranoid filter wants it
+		CPacketWriter idChange;
+		idChange.WriteUInt32(GetED2KID(m_clientEndpoint.address().to_v4()));
+		idChange.WriteUInt32(SRV_TCPFLG_COMPRESSION | SRV_TCPFLG_NEWTAGS | SRV_TCPFLG_UNICODE | SRV_TCPFLG_LARGEFILES);
+		conn->Send(idChange, OP_EDONKEYPROT, OP_IDCHANGE);
+
+		CPacketWriter status;
+		status.WriteUInt32(s_options.leechers + s_options.seeders + 1);
+		status.WriteUInt32(m_files.size());
+		conn->Send(status, OP_EDONKEYPROT, OP_SERVERSTATUS);
+
+		printf("amuled logged in, it listens on %s:%u\n",
+			m_clientEndpoint.address().to_string().c_str(), m_clientEndpoint.port());
+	}
+
+	// <count 4>(<hash 16><ID 4><port 2><tag count 4><tags>)[count]
+	void ProcessOfferFiles(CPacketReader& packet)
+	{
+		uint32 count = packet.ReadUInt32();
+		for (uint32 i = 0; i < count; ++i) {
+			COfferedFile file;
+			file.hash = packet.ReadHash();
+			// With compression, incomplete files have this ID
+			bool complete = packet.ReadUInt32() != 0xfcfcfcfc;
+			packet.ReadUInt16();
+			file.size = 0;
+
+			uint32 tags = packet.ReadUInt32();
+			for (uint32 j = 0; j < tags; ++j) {
+				uint64 value;
+				std::string str;
+				switch (packet.ReadTag(value, str)) {
+					case FT_FILENAME:	file.name = str; break;
+					case FT_FILESIZE:	file.size |= value; break;
+					case FT_FILESIZE_HI:	file.size |= value << 32; break;
+				}
+			}
+
+			if (complete && file.size && !GetSyntheticFile(file.hash)) {
+				m_offered[file.hash] = file;
+			}
+		}
+	}
+
+	// <hash 16><size 4>, or <hash 16><0 4><size 8> for large files
+	void ProcessGetSources(CConnection* conn, CPacketReader& packet, bool obfuscation)
+	{
+		// amuled sends several requests in one frame, each is a packet of its own
+		CMD4Hash hash = packet.ReadHash();
+		if (!GetSyntheticFile(hash)) {
+			return;
+		}
+
+		// <hash 16><count 1>(<ID 4><port 2>[<crypt options 1>])[count]
+		uint32 count = std::min<size_t>(m_seeders.size(), 255);
+		CPacketWriter answer(17 + count * 7);
+		answer.WriteHash(hash);
+		answer.WriteUInt8(count);
+		for (uint32 i = 0; i < count; ++i) {
+			WriteSource(answer, m_seeders[i]);
+			if (obfuscation) {
+				// No user hash, amuled gets LowIDs connected by callback anyway
+				answer.WriteUInt8(0);
+			}
+		}
+		conn->Send(answer, OP_EDONKEYPROT, obfuscation ? (uint8)OP_FOUNDSOURCES_OBFU : (uint8)OP_FOUNDSOURCES);
+	}
+
+	// <ID 4>
+	void ProcessCallbackRequest(CConnection* conn, CPacketReader& packet);
+
+	void WriteSource(CPacketWriter& packet, const CSeeder* seeder);
+
+	const CSyntheticFile* GetSyntheticFile(const CMD4Hash& hash) const
+	{
+		for (size_t i = 0; i < m_files.size(); ++i) {
+			if (m_files[i]->GetHash() == hash) {
+				return m_files[i];
+			}
+		}
+		return NULL;
+	}
+
+	io_service&			m_service;
+	ip::tcp::acceptor		m_acceptor;
+	CConnectionPtr			m_accepting;
+	CConnectionPtr			m_client;
+	const std::vector<CSyntheticFile*>&	m_files;
+	std::vector<CSeeder*>		m_seeders;
+
+	bool				m_loggedIn;
+	CMD4Hash			m_clientHash;
+	ip::tcp::endpoint		m_clientEndpoint;
+	std::map<CMD4Hash, COfferedFile>	m_offered;
+};
+
+
+/** What the leechers and the seeders have in common, an eMule client as amuled sees it. */
+class CFakeClient : public CConnectionHandler
+{
+public:
+	uint32 GetID() const		{ return m_id; }
+	uint16 GetPort() const		{ return m_port; }
+
+protected:
+	/**
+	 * @param network The leechers are on 127.1.x.y, the seeders on 127.2.x.y.
+	 * @param id The ed2k ID, 0 for a high ID.
+	 */
+	CFakeClient(io_service& service, uint32 index, uint8 network, uint32 id)
+		: m_service(service),
+		  m_index(index)
+	{
+		ip::address_v4::bytes_type bytes = {{ 127, network, (uint8)(index / 250), (uint8)(index % 250 + 1) }};
+		m_address = ip::address_v4(bytes);
+		m_id = id ? id : GetED2KID(m_address);
+		m_port = s_options.clientPort;
+
+		for (uint32 i = 0; i < MD4HASH_LENGTH; i += 4) {
+			PokeUInt32(m_userHash.GetHash() + i, GetRandomUint32());
+		}
+		// Marks an eMule user hash
+		m_userHash[5] = 14;
+		m_userHash[14] = 111;
+
+		char name[32];
+		snprintf(name, sizeof(name), "%s %u", network == 1 ? "leecher" : "seeder", index);
+		m_name = name;
+	}
+
+	//! Sends OP_HELLO or OP_HELLOANSWER.
+	void SendHello(CConnection* conn, uint8 opcode)
+	{
+		// Unicode, no UDP, no secure ident, no source exchange, no AICH,
+		// no extended requests and no multipackets, it keeps amuled simple.
+		uint32 miscOptions1 = (1 << 28) | ((s_options.compress ? 1 : 0) << 20) | (1 << 2);
+		// Large files and obfuscation
+		uint32 miscOptions2 = (1 << 4) | (s_options.obfuscate ? (1 << 8) | (1 << 7) : 0);
+
+		CPacketWriter packet(128);
+		if (opcode == OP_HELLO) {
+			packet.WriteUInt8(MD4HASH_LENGTH);
+		}
+		packet.WriteHash(m_userHash);
+		packet.WriteUInt32(m_id);
+		packet.WriteUInt16(m_port);
+		packet.WriteUInt32(6);
+		packet.WriteTag(CT_NAME, m_name);
+		packet.WriteTag(CT_VERSION, EDONKEYVERSION);
+		packet.WriteTag(CT_EMULE_UDPPORTS, 0);
+		packet.WriteTag(CT_EMULE_MISCOPTIONS1, miscOptions1);
+		packet.WriteTag(CT_EMULE_MISCOPTIONS2, miscOptions2);
+		// eMule 0.50a
+		packet.WriteTag(CT_EMULE_VERSION, (SO_EMULE << 24) | (50 << 10));
+		packet.WriteUInt32(LoopbackID);
+		packet.WriteUInt16(s_options.port);
+		conn->Send(packet, OP_EDONKEYPROT, opcode);
+	}
+
+	//! Sends a packet of just a file hash.
+	static void SendHash(CConnection* conn, const CMD4Hash& hash, uint8 opcode)
+	{
+		CPacketWriter packet(MD4HASH_LENGTH);
+		packet.WriteHash(hash);
+		conn->Send(packet, OP_EDONKEYPROT, opcode);
+	}
+
+	io_service&		m_service;
+	uint32			m_index;
+	ip::address_v4		m_address;
+	uint32			m_id;
+	uint16			m_port;
+	CMD4Hash		m_userHash;
+	std::string		m_name;
+};
+
+
+/**
+ * Downloads from amuled.
+ *
+ * A leecher asks for one file and waits in the queue of amuled for a slot.
+ * In its slot it keeps three blocks requested, as eMule does, until
+ * amuled ends the slot, and then waits for the next one.
+ */
+class CLeecher : public CFakeClient
+{
+public:
+	CLeecher(io_service& service, uint32 index, CFakeServer& server)
+		: CFakeClient(service, index, 1, 0),
+		  m_server(server),
+		  m_acceptor(service),
+		  m_timer(service),
+		  m_state(LS_IDLE),
+		  m_cursor(0),
+		  m_pass(0),
+		  m_waitStart(0),
+		  m_waiting(false),
+		  m_asked(false)
+	{
+	}
+
+	enum State {
+		LS_IDLE,
+		//! Connecting and asking for the file.
+		LS_ASKING,
+		LS_QUEUED,
+		LS_DOWNLOADING
+	};
+
+	State GetState() const { return m_state; }
+
+	bool Listen()
+	{
+		error_code ec;
+		ip::tcp::endpoint endpoint(m_address, m_port);
+		m_acceptor.open(endpoint.protocol(), ec);
+		if (!ec) {
+			m_acceptor.set_option(socket_base::reuse_address(true), ec);
+			m_acceptor.bind(endpoint, ec);
+		}
+		if (!ec) {
+			m_acceptor.listen(socket_base::max_connections, ec);
+		}
+		if (ec) {
+			printf("Failed to listen on %s:%u: %s\n", m_address.to_string().c_str(), m_port, ec.message().c_str());
+			return false;
+		}
+		StartAccept();
+		return true;
+	}
+
+	//! Asks amuled for one of the files it offers.
+	void Start(const COfferedFile& file)
+	{
+		m_file = file;
+		// Start somewhere in the file, on a block border
+		m_cursor = Mix64(m_index) % (m_file.size / EMBLOCKSIZE + 1) * EMBLOCKSIZE;
+		if (m_cursor >= m_file.size) {
+			m_cursor = 0;
+		}
+		Ask();
+	}
+
+private:
+	//! A requested block, the end points behind its last byte.
+	struct CBlock
+	{
+		uint64	start;
+		uint64	end;
+		uint64	requested;
+		uint32	received;
+	};
+
+	void StartAccept()
+	{
+		m_accepting.reset(new CConnection(m_service, *this));
+		m_acceptor.async_accept(m_accepting->GetSocket(), boost::bind(&CLeecher::HandleAccept, this, placeholders::error));
+	}
+
+	//! amuled connects us when it has a slot for us.
+	void HandleAccept(const error_code& ec)
+	{
+		if (!ec) {
+			if (m_conn) {
+				m_conn->Close();
+			}
+			m_conn = m_accepting;
+			m_conn->Accept(&m_userHash);
+		}
+		StartAccept();
+	}
+
+	void Ask()
+	{
+		m_state = LS_ASKING;
+		m_asked = false;
+		if (m_conn && m_conn->IsOpen()) {
+			SendFileRequest();
+		} else {
+			if (m_conn) {
+				m_conn->Close();
+			}
+			m_conn.reset(new CConnection(m_service, *this));
+			m_conn->Connect(m_address, m_server.GetClientEndpoint(), s_options.obfuscate ? &m_server.GetClientHash() : NULL);
+		}
+	}
+
+	//! Asks again after 'delay' ms.
+	void AskLater(uint32 delay)
+	{
+		m_timer.expires_from_now(boost::posix_time::milliseconds(delay));
+		m_timer.async_wait(boost::bind(&CLeecher::HandleTimer, this, placeholders::error));
+	}
+
+	void HandleTimer(const error_code& ec)
+	{
+		if (!ec && m_state != LS_DOWNLOADING && m_state != LS_IDLE) {
+			Ask();
+		}
+	}
+
+	void SendFileRequest()
+	{
+		SendHash(m_conn.get(), m_file.hash, OP_REQUESTFILENAME);
+		SendHash(m_conn.get(), m_file.hash, OP_SETREQFILEID);
+	}
+
+	void OnConnected(CConnection* conn)
+	{
+		if (conn == m_conn.get() && m_state == LS_ASKING) {
+			SendHello(conn, OP_HELLO);
+		}
+	}
+
+	void OnPacket(CConnection* conn, uint8 protocol, uint8 opcode, CPacketReader& packet)
+	{
+		if (conn != m_conn.get()) {
+			return;
+		}
+		if (protocol == OP_EDONKEYPROT) {
+			switch (opcode) {
+				case OP_HELLO:
+					SendHello(conn, OP_HELLOANSWER);
+					break;
+				case OP_HELLOANSWER:
+					if (m_state == LS_ASKING) {
+						SendFileRequest();
+					}
+					break;
+				case OP_FILESTATUS:
+					if (m_state == LS_ASKING) {
+						SendHash(conn, m_file.hash, OP_STARTUPLOADREQ);
+						m_asked = true;
+						if (!m_waiting) {
+							m_waitStart = GetMicroTime();
+							m_waiting = true;
+						}
+					}
+					break;
+				case OP_FILEREQANSNOFIL:
+					printf("%s: amuled does not share %s any more\n", m_name.c_str(), m_file.name.c_str());
+					m_state = LS_IDLE;
+					break;
+				case OP_QUEUERANK:
+					Queued();
+					break;
+				case OP_ACCEPTUPLOADREQ:
+					if (m_state != LS_DOWNLOADING) {
+						s_stats.slotsGiven++;
+						if (m_waiting) {
+							s_stats.slotWait.push_back((GetMicroTime() - m_waitStart) / 1000);
+							m_waiting = false;
+						}
+						m_timer.cancel();
+						m_state = LS_DOWNLOADING;
+						m_blocks.clear();
+						RequestBlocks();
+					}
+					break;
+				case OP_OUTOFPARTREQS:
+					s_stats.slotsEnded++;
+					m_state = LS_QUEUED;
+					m_blocks.clear();
+					// Ask for the next slot, not earlier than amuled takes for aggressive
+					AskLater(MIN_REQUESTTIME);
+					break;
+				case OP_SENDINGPART:
+					ProcessData(packet, false, false);
+					break;
+				case OP_REQUESTFILENAME:
+				case OP_SETREQFILEID:
+				case OP_STARTUPLOADREQ:
+					// We share nothing
+					SendHash(conn, packet.ReadHash(), OP_FILEREQANSNOFIL);
+					break;
+			}
+		} else {
+			switch (opcode) {
+				case OP_QUEUERANKING:
+					Queued();
+					break;
+				case OP_SENDINGPART_I64:
+					ProcessData(packet, true, false);
+					break;
+				case OP_COMPRESSEDPART:
+					ProcessData(packet, false, true);
+					break;
+				case OP_COMPRESSEDPART_I64:
+					ProcessData(packet, true, true);
+					break;
+			}
+		}
+	}
+
+	void OnClosed(CConnection* conn)
+	{
+		if (conn != m_conn.get()) {
+			return;
+		}
+		m_conn.reset();
+		m_blocks.clear();
+		if (m_state == LS_ASKING && !m_asked) {
+			// The upload request did not get through, that does not count as asking
+			AskLater(5000);
+		} else if (m_state == LS_ASKING) {
+			// Closed before the queue rank, we are probably queued anyway
+			Queued();
+		} else if (m_state == LS_DOWNLOADING) {
+			// Lost the slot, ask again not earlier than amuled takes for aggressive
+			m_state = LS_QUEUED;
+			AskLater(MIN_REQUESTTIME);
+		}
+		// A queued leecher waits for amuled to connect it, and reasks in time
+	}
+
+	//! Waits in the queue, reasking as eMule does to stay in it.
+	void Queued()
+	{
+		if (m_state != LS_QUEUED) {
+			m_state = LS_QUEUED;
+			AskLater(FILEREASKTIME);
+		}
+	}
+
+	/**
+	 * Finds the next block. The blocks follow each other through the file.
+	 *
+	 * amuled drops requests for the blocks it already sent in a slot, so
+	 * after wrapping around in a slot the same blocks could not be asked
+	 * again. Each pass through the file moves the block borders by a byte,
+	 * skipping the bytes before the first border.
+	 */
+	void NextBlock(uint64& start, uint64& end)
+	{
+		if (m_cursor >= m_file.size) {
+			m_pass++;
+			m_cursor = m_pass % EMBLOCKSIZE;
+		}
+		uint64 shift = m_pass % EMBLOCKSIZE;
+		start = m_cursor;
+		end = std::min(start + EMBLOCKSIZE - (start - shift) % EMBLOCKSIZE, m_file.size);
+		m_cursor = end;
+	}
+
+	void RequestBlocks()
+	{
+		if (m_state != LS_DOWNLOADING || !m_conn) {
+			return;
+		}
+
+		uint64 starts[3] = { 0, 0, 0 };
+		uint64 ends[3] = { 0, 0, 0 };
+		uint32 count = 0;
+		for (; m_blocks.size() < 3; ++count) {
+			CBlock block;
+			NextBlock(block.start, block.end);
+			block.requested = GetMicroTime();
+			block.received = 0;
+			m_blocks.push_back(block);
+			starts[count] = block.start;
+			ends[count] = block.end;
+		}
+		if (!count) {
+			return;
+		}
+
+		// Empty slots of the request stay zero
+		bool large = m_file.size > OLD_MAX_FILE_SIZE;
+		CPacketWriter packet(MD4HASH_LENGTH + 48);
+		packet.WriteHash(m_file.hash);
+		for (uint32 i = 0; i < 3; ++i) {
+			large ? packet.WriteUInt64(starts[i]) : packet.WriteUInt32(starts[i]);
+		}
+		for (uint32 i = 0; i < 3; ++i) {
+			large ? packet.WriteUInt64(ends[i]) : packet.WriteUInt32(ends[i]);
+		}
+		m_conn->Send(packet, large ? OP_EMULEPROT : OP_EDONKEYPROT, large ? (uint8)OP_REQUESTPARTS_I64 : (uint8)OP_REQUESTPARTS);
+	}
+
+	/**
+	 * Takes the data of a block.
+	 *
+	 * Sent data is <hash 16><start><end><data>, compressed data is
+	 * <hash 16><start of the block><packed size of the block 4><data>.
+	 */
+	void ProcessData(CPacketReader& packet, bool large, bool packed)
+	{
+		CMD4Hash hash = packet.ReadHash();
+		uint64 start = large ? packet.ReadUInt64() : packet.ReadUInt32();
+		uint64 end = (large && !packed) ? packet.ReadUInt64() : packet.ReadUInt32();
+		uint32 length = packet.GetRemaining();
+
+		std::deque<CBlock>::iterator it = m_blocks.begin();
+		for (; it != m_blocks.end(); ++it) {
+			if (packed ? start == it->start : (start >= it->start && start < it->end)) {
+				break;
+			}
+		}
+		if (hash != m_file.hash || it == m_blocks.end()) {
+			// Late data of a slot that ended
+			return;
+		} else if (!packed && end - start != length) {
+			throw std::runtime_error("Data does not match its range");
+		}
+
+		if (!it->received) {
+			s_stats.firstByte.push_back(GetMicroTime() - it->requested);
+		}
+		it->received += length;
+		s_stats.uploadWire += length;
+
+		bool done = packed ? it->received >= end : it->received >= it->end - it->start;
+		if (!packed) {
+			s_stats.uploadPayload += length;
+		} else if (done) {
+			s_stats.uploadPayload += it->end - it->start;
+		}
+		if (done) {
+			s_stats.uploadBlocks++;
+			m_blocks.erase(it);
+			RequestBlocks();
+		}
+	}
+
+	CFakeServer&		m_server;
+	ip::tcp::acceptor	m_acceptor;
+	CConnectionPtr		m_accepting;
+	CConnectionPtr		m_conn;
+	deadline_timer		m_timer;
+
+	State			m_state;
+	COfferedFile		m_file;
+	std::deque<CBlock>	m_blocks;
+	uint64			m_cursor;
+	uint32			m_pass;
+	//! When the first upload request for the next slot was sent.
+	uint64			m_waitStart;
+	bool			m_waiting;
+	//! The upload request was sent since the last Ask().
+	bool			m_asked;
+};
+
+
+/**
+ * Uploads the synthetic files to amuled.
+ *
+ * A seeder has a LowID, amuled gets it connected through the server.
+ * Everything amuled asks is answered at once, there are no queues.
+ */
+class CSeeder : public CFakeClient
+{
+public:
+	CSeeder(io_service& service, uint32 index, const std::vector<CSyntheticFile*>& files)
+		: CFakeClient(service, index, 2, index + 1),
+		  m_files(files)
+	{
+	}
+
+	//! The server asks us to connect to amuled.
+	void Callback(const ip::tcp::endpoint& client, const CMD4Hash& clientHash)
+	{
+		CSeederConnection seederConn;
+		seederConn.conn.reset(new CConnection(m_service, *this));
+		seederConn.callbackTime = GetMicroTime();
+		seederConn.requested = false;
+		m_conns.push_back(seederConn);
+		seederConn.conn->Connect(m_address, client, s_options.obfuscate ? &clientHash : NULL);
+	}
+
+	uint32 GetConnectionCount() const { return m_conns.size(); }
+
+private:
+	struct CSeederConnection
+	{
+		CConnectionPtr	conn;
+		uint64		callbackTime;
+		bool		requested;
+	};
+
+	void OnConnected(CConnection* conn)
+	{
+		SendHello(conn, OP_HELLO);
+	}
+
+	void OnPacket(CConnection* conn, uint8 protocol, uint8 opcode, CPacketReader& packet)
+	{
+		if (protocol == OP_EDONKEYPROT) {
+			switch (opcode) {
+				case OP_REQUESTFILENAME: {
+					// Extended requests, if any, are ignored
+					const CSyntheticFile* file = GetFile(conn, packet);
+					if (file) {
+						CPacketWriter answer;
+						answer.WriteHash(file->GetHash());
+						answer.WriteString(file->GetName());
+						conn->Send(answer, OP_EDONKEYPROT, OP_REQFILENAMEANSWER);
+					}
+					break;
+				}
+				case OP_SETREQFILEID: {
+					const CSyntheticFile* file = GetFile(conn, packet);
+					if (file) {
+						// A complete file has no part status
+						CPacketWriter answer;
+						answer.WriteHash(file->GetHash());
+						answer.WriteUInt16(0);
+						conn->Send(answer, OP_EDONKEYPROT, OP_FILESTATUS);
+					}
+					break;
+				}
+				case OP_HASHSETREQUEST: {
+					const CSyntheticFile* file = GetFile(conn, packet);
+					if (file) {
+						const std::vector<CMD4Hash>& hashes = file->GetPartHashes();
+						CPacketWriter answer(MD4HASH_LENGTH * (hashes.size() + 1) + 2);
+						answer.WriteHash(file->GetHash());
+						answer.WriteUInt16(hashes.size());
+						for (size_t i = 0; i < hashes.size(); ++i) {
+							answer.WriteHash(hashes[i]);
+						}
+						conn->Send(answer, OP_EDONKEYPROT, OP_HASHSETANSWER);
+					}
+					break;
+				}
+				case OP_STARTUPLOADREQ:
+					if (GetFile(conn, packet)) {
+						CPacketWriter answer(0);
+						conn->Send(answer, OP_EDONKEYPROT, OP_ACCEPTUPLOADREQ);
+					}
+					break;
+				case OP_REQUESTPARTS:
+					ProcessRequestParts(conn, packet, false);
+					break;
+			}
+		} else if (opcode == OP_REQUESTPARTS_I64) {
+			ProcessRequestParts(conn, packet, true);
+		}
+	}
+
+	void OnClosed(CConnection* conn)
+	{
+		for (std::vector<CSeederConnection>::iterator it = m_conns.begin(); it != m_conns.end(); ++it) {
+			if (it->conn.get() == conn) {
+				m_conns.erase(it);
+				break;
+			}
+		}
+	}
+
+	//! Reads the hash of a request and answers OP_FILEREQANSNOFIL for a file we do not have.
+	const CSyntheticFile* GetFile(CConnection* conn, CPacketReader& packet)
+	{
+		CMD4Hash hash = packet.ReadHash();
+		for (size_t i = 0; i < m_files.size(); ++i) {
+			if (m_files[i]->GetHash() == hash) {
+				return m_files[i];
+			}
+		}
+		SendHash(conn, hash, OP_FILEREQANSNOFIL);
+		return NULL;
+	}
+
+	// <hash 16><start 4 or 8>[3]<end 4 or 8>[3]
+	void ProcessRequestParts(CConnection* conn, CPacketReader& packet, bool large)
+	{
+		const CSyntheticFile* file = GetFile(conn, packet);
+		if (!file) {
+			return;
+		}
+		uint64 starts[3], ends[3];
+		for (uint32 i = 0; i < 3; ++i) {
+			starts[i] = large ? packet.ReadUInt64() : packet.ReadUInt32();
+		}
+		for (uint32 i = 0; i < 3; ++i) {
+			ends[i] = large ? packet.ReadUInt64() : packet.ReadUInt32();
+		}
+
+		for (std::vector<CSeederConnection>::iterator it = m_conns.begin(); it != m_conns.end(); ++it) {
+			if (it->conn.get() == conn && !it->requested) {
+				it->requested = true;
+				s_stats.callbackToRequest.push_back((GetMicroTime() - it->callbackTime) / 1000);
+			}
+		}
+
+		for (uint32 i = 0; i < 3; ++i) {
+			if (ends[i] > starts[i]) {
+				if (ends[i] > file->GetSize() || ends[i] - starts[i] > 3 * EMBLOCKSIZE) {
+					throw std::runtime_error("Invalid block request");
+				}
+				SendBlock(conn, *file, starts[i], ends[i]);
+			}
+		}
+	}
+
+	//! Sends a block in packets of the size amuled uses, compressed if that makes it smaller.
+	void SendBlock(CConnection* conn, const CSyntheticFile& file, uint64 start, uint64 end)
+	{
+		uint32 length = end - start;
+		bool large = file.IsLarge();
+		s_stats.downloadBlocks++;
+		s_stats.downloadPayload += length;
+
+		if (s_options.compress) {
+			std::vector<byte> data(length);
+			file.Fill(start, &data[0], length);
+			uLongf packedSize = compressBound(length);
+			std::vector<byte> packed(packedSize);
+			if (compress2(&packed[0], &packedSize, &data[0], length, Z_BEST_SPEED) == Z_OK && packedSize < length) {
+				for (uint32 pos = 0; pos < packedSize; pos += DataPacketSize) {
+					uint32 size = std::min<uint32>(packedSize - pos, DataPacketSize);
+					CPacketWriter packet(MD4HASH_LENGTH + 12 + size);
+					packet.WriteHash(file.GetHash());
+					large ? packet.WriteUInt64(start) : packet.WriteUInt32(start);
+					packet.WriteUInt32(packedSize);
+					packet.Write(&packed[pos], size);
+					conn->Send(packet, OP_EMULEPROT, large ? (uint8)OP_COMPRESSEDPART_I64 : (uint8)OP_COMPRESSEDPART);
+				}
+				s_stats.downloadWire += packedSize;
+				return;
+			}
+		}
+
+		for (uint64 pos = start; pos < end; pos += DataPacketSize) {
+			uint32 size = std::min<uint64>(end - pos, DataPacketSize);
+			CPacketWriter packet(MD4HASH_LENGTH + 16 + size);
+			packet.WriteHash(file.GetHash());
+			if (large) {
+				packet.WriteUInt64(pos);
+				packet.WriteUInt64(pos + size);
+			} else {
+				packet.WriteUInt32(pos);
+				packet.WriteUInt32(pos + size);
+			}
+			file.Fill(pos, packet.Grow(size), size);
+			conn->Send(packet, large ? OP_EMULEPROT : OP_EDONKEYPROT, large ? (uint8)OP_SENDINGPART_I64 : (uint8)OP_SENDINGPART);
+		}
+		s_stats.downloadWire += length;
+	}
+
+	const std::vector<CSyntheticFile*>&	m_files;
+	std::vector<CSeederConnection>		m_conns;
+};
+
+
+void CFakeServer::ProcessCallbackRequest(CConnection* conn, CPacketReader& packet)
+{
+	uint32 id = packet.ReadUInt32();
+	if (id >= 1 && id <= m_seeders.size()) {
+		s_stats.callbacks++;
+		m_seeders[id - 1]->Callback(m_clientEndpoint, m_clientHash);
+	} else {
+		CPacketWriter answer(0);
+		conn->Send(answer, OP_EDONKEYPROT, OP_CALLBACK_FAIL);
+	}
+}
+
+
+void CFakeServer::WriteSource(CPacketWriter& packet, const CSeeder* seeder)
+{
+	packet.WriteUInt32(seeder->GetID());
+	packet.WriteUInt16(seeder->GetPort());
+}
+
+
+/** CPU time and memory of a process, from /proc on Linux. */
+class CProcessMonitor
+{
+public:
+	//! The pid 0 stands for this process.
+	CProcessMonitor(uint32 pid)
+	{
+		char path[32];
+		if (pid) {
+			snprintf(path, sizeof(path), "/proc/%u", pid);
+		} else {
+			strcpy(path, "/proc/self");
+		}
+		m_path = path;
+	}
+
+	//! CPU time in ms, user and system.
+	bool GetCPUTime(uint64& time) const
+	{
+#ifdef __linux__
+		FILE* file = fopen((m_path + "/stat").c_str(), "r");
+		if (!file) {
+			return false;
+		}
+		char line[1024];
+		bool ok = fgets(line, sizeof(line), file) != NULL;
+		fclose(file);
+
+		// The name of the program is in parentheses and may contain anything
+		const char* fields = ok ? strrchr(line, ')') : NULL;
+		unsigned long user = 0, system = 0;
+		if (!fields || sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &user, &system) != 2) {
+			return false;
+		}
+		time = (uint64)(user + system) * 1000 / sysconf(_SC_CLK_TCK);
+		return true;
+#else
+		(void)time;
+		return false;
+#endif
+	}
+
+	//! Resident memory now and at most, in KiB.
+	bool GetMemory(uint64& resident, uint64& peak) const
+	{
+#ifdef __linux__
+		FILE* file = fopen((m_path + "/status").c_str(), "r");
+		if (!file) {
+			return false;
+		}
+		char line[256];
+		resident = peak = 0;
+		while (fgets(line, sizeof(line), file)) {
+			unsigned long value;
+			if (sscanf(line, "VmRSS: %lu", &value) == 1) {
+				resident = value;
+			} else if (sscanf(line, "VmHWM: %lu", &value) == 1) {
+				peak = value;
+			}
+		}
+		fclose(file);
+		return resident != 0;
+#else
+		(void)resident;
+		(void)peak;
+		return false;
+#endif
+	}
+
+private:
+	std::string	m_path;
+};
+
+
+/** The value below which 'percent' of the sorted values are. */
+static uint32 Percentile(const std::vector<uint32>& sorted, uint32 percent)
+{
+	if (sorted.empty()) {
+		return 0;
+	}
+	return sorted[std::min<size_t>(sorted.size() * percent / 100, sorted.size() - 1)];
+}
+
+
+static double ToMiB(uint64 bytes)
+{
+	return bytes / (1024.0 * 1024.0);
+}
+
+
+/** Runs the server and the clients, and reports what they see. */
+class CLoadBench
+{
+public:
+	CLoadBench(io_service& service)
+		: m_service(service),
+		  m_server(service, m_files),
+		  m_timer(service),
+		  m_amuled(s_options.pid),
+		  m_self(0),
+		  m_loginTime(0),
+		  m_startTime(0),
+		  m_started(0),
+		  m_nextFile(0),
+		  m_ticks(0),
+		  m_lastTime(0),
+		  m_startCPU(0),
+		  m_lastCPU(0),
+		  m_selfCPU(0),
+		  m_maxResident(0)
+	{
+	}
+
+	~CLoadBench()
+	{
+		for (size_t i = 0; i < m_leechers.size(); ++i) {
+			delete m_leechers[i];
+		}
+		for (size_t i = 0; i < m_seeders.size(); ++i) {
+			delete m_seeders[i];
+		}
+		for (size_t i = 0; i < m_files.size(); ++i) {
+			delete m_files[i];
+		}
+	}
+
+	bool Init()
+	{
+		for (uint32 i = 0; i < s_options.files; ++i) {
+			m_files.push_back(new CSyntheticFile(s_options.seed, i, (uint64)s_options.size * 1024 * 1024));
+		}
+		for (uint32 i = 0; i < s_options.seeders; ++i) {
+			m_seeders.push_back(new CSeeder(m_service, i, m_files));
+			m_server.AddSeeder(m_seeders.back());
+		}
+		for (uint32 i = 0; i < s_options.leechers; ++i) {
+			m_leechers.push_back(new CLeecher(m_service, i, m_server));
+			if (!m_leechers.back()->Listen()) {
+				return false;
+			}
+		}
+		if (!m_server.Listen()) {
+			return false;
+		}
+
+		printf("%u leechers, %u seeders%s%s, %u s\n", s_options.leechers, s_options.seeders,
+			s_options.obfuscate ? ", obfuscated" : "", s_options.compress ? ", compressed" : "", s_options.seconds);
+		if (!m_seeders.empty()) {
+			printf("Files of the seeders, add them to amuled:\n");
+			for (size_t i = 0; i < m_files.size(); ++i) {
+				printf("  %s\n", m_files[i]->GetLink().c_str());
+			}
+		}
+		printf("Waiting for amuled to connect to the server localhost:%u\n", s_options.port);
+
+		m_timer.expires_from_now(boost::posix_time::milliseconds(TickTime));
+		m_timer.async_wait(boost::bind(&CLoadBench::HandleTimer, this, placeholders::error));
+		return true;
+	}
+
+private:
+	//! The timer ticks every 100 ms, the leechers start ten a tick.
+	static const uint32 TickTime = 100;
+	static const uint32 LeechersPerTick = 10;
+	static const uint32 TicksPerReport = 50;
+
+	void HandleTimer(const error_code& ec)
+	{
+		if (ec) {
+			return;
+		}
+		uint64 now = GetMicroTime();
+		uint64 resident, peak;
+
+		if (!m_startTime) {
+			// Start a few seconds after the login, when amuled has offered its files
+			if (!m_server.IsLoggedIn()) {
+				m_loginTime = 0;
+			} else if (!m_loginTime) {
+				m_loginTime = now;
+			} else if (now - m_loginTime >= 3000000) {
+				Start(now);
+			}
+		} else {
+			StartLeechers();
+			if (s_options.pid && m_amuled.GetMemory(resident, peak)) {
+				m_maxResident = std::max(m_maxResident, resident);
+			}
+			if (++m_ticks % TicksPerReport == 0) {
+				Report(now);
+			}
+			if (now - m_startTime >= s_options.seconds * 1000000ull) {
+				Summary(now);
+				m_service.stop();
+				return;
+			}
+		}
+
+		m_timer.expires_from_now(boost::posix_time::milliseconds(TickTime));
+		m_timer.async_wait(boost::bind(&CLoadBench::HandleTimer, this, placeholders::error));
+	}
+
+	void Start(uint64 now)
+	{
+		m_server.GetOfferedFiles(m_offered);
+		printf("amuled offers %u complete files\n", (unsigned)m_offered.size());
+		if (m_offered.empty() && !m_leechers.empty()) {
+			printf("The leechers have nothing to download, share some files in amuled\n");
+		}
+
+		m_startTime = now;
+		s_stats = CBenchStats();
+		m_last = s_stats;
+		m_lastTime = now;
+		if (s_options.pid) {
+			m_amuled.GetCPUTime(m_startCPU);
+		}
+		m_self.GetCPUTime(m_selfCPU);
+		m_lastCPU = m_startCPU;
+	}
+
+	void StartLeechers()
+	{
+		if (m_offered.empty()) {
+			return;
+		}
+		for (uint32 i = 0; i < LeechersPerTick && m_started < m_leechers.size(); ++i) {
+			m_leechers[m_started++]->Start(m_offered[m_nextFile++ % m_offered.size()]);
+		}
+	}
+
+	//! Prints the transfers since the last report.
+	void Report(uint64 now)
+	{
+		uint32 downloading = 0, queued = 0, connections = 0;
+		for (size_t i = 0; i < m_leechers.size(); ++i) {
+			downloading += m_leechers[i]->GetState() == CLeecher::LS_DOWNLOADING;
+			queued += m_leechers[i]->GetState() == CLeecher::LS_QUEUED;
+		}
+		for (size_t i = 0; i < m_seeders.size(); ++i) {
+			connections += m_seeders[i]->GetConnectionCount();
+		}
+
+		double seconds = (now - m_lastTime) / 1e6;
+		printf("%4u s: up %7.2f MiB/s (%u slots, %u queued), down %7.2f MiB/s (%u sources)",
+			(unsigned)((now - m_startTime) / 1000000),
+			ToMiB(s_stats.uploadPayload - m_last.uploadPayload) / seconds, downloading, queued,
+			ToMiB(s_stats.downloadPayload - m_last.downloadPayload) / seconds, connections);
+
+		uint64 cpu, resident, peak;
+		if (s_options.pid && m_amuled.GetCPUTime(cpu) && m_amuled.GetMemory(resident, peak)) {
+			printf(", amuled %3.0f%% CPU, %.1f MiB", (cpu - m_lastCPU) / 10.0 / seconds, resident / 1024.0);
+			m_lastCPU = cpu;
+		}
+		printf("\n");
+
+		m_last = s_stats;
+		m_lastTime = now;
+	}
+
+	void Summary(uint64 now)
+	{
+		double seconds = (now - m_startTime) / 1e6;
+		std::sort(s_stats.firstByte.begin(), s_stats.firstByte.end());
+		std::sort(s_stats.slotWait.begin(), s_stats.slotWait.end());
+		std::sort(s_stats.callbackToRequest.begin(), s_stats.callbackToRequest.end());
+
+		printf("amuled uploading:   %7.2f MiB/s, %.2f MiB/s on the wire, %u blocks, %u slots given, %u ended\n",
+			ToMiB(s_stats.uploadPayload) / seconds, ToMiB(s_stats.uploadWire) / seconds,
+			s_stats.uploadBlocks, s_stats.slotsGiven, s_stats.slotsEnded);
+		printf("  request to first byte: median %.2f ms, 90%% %.2f ms, 99%% %.2f ms\n",
+			Percentile(s_stats.firstByte, 50) / 1000.0, Percentile(s_stats.firstByte, 90) / 1000.0,
+			Percentile(s_stats.firstByte, 99) / 1000.0);
+		printf("  request to slot:       median %u ms, 90%% %u ms, 99%% %u ms\n",
+			Percentile(s_stats.slotWait, 50), Percentile(s_stats.slotWait, 90), Percentile(s_stats.slotWait, 99));
+		printf("amuled downloading: %7.2f MiB/s, %.2f MiB/s on the wire, %u blocks, %u callbacks\n",
+			ToMiB(s_stats.downloadPayload) / seconds, ToMiB(s_stats.downloadWire) / seconds,
+			s_stats.downloadBlocks, s_stats.callbacks);
+		printf("  callback to request:   median %u ms, 90%% %u ms, 99%% %u ms\n",
+			Percentile(s_stats.callbackToRequest, 50), Percentile(s_stats.callbackToRequest, 90),
+			Percentile(s_stats.callbackToRequest, 99));
+
+		uint64 cpu, resident, peak;
+		double transferred = ToMiB(s_stats.uploadPayload + s_stats.downloadPayload);
+		if (s_options.pid && m_amuled.GetCPUTime(cpu) && m_amuled.GetMemory(resident, peak)) {
+			printf("amuled: %.1f s CPU, %.2f ms per MiB transferred, %.1f MiB resident, at most %.1f MiB (%.1f MiB since its start)\n",
+				(cpu - m_startCPU) / 1000.0, transferred > 0 ? (cpu - m_startCPU) / transferred : 0.0,
+				resident / 1024.0, m_maxResident / 1024.0, peak / 1024.0);
+		} else if (s_options.pid) {
+			printf("amuled: no CPU time and memory of pid %u\n", s_options.pid);
+		}
+		if (m_self.GetCPUTime(cpu)) {
+			printf("load generator: %.1f s CPU\n", (cpu - m_selfCPU) / 1000.0);
+		}
+		printf("%u failed connects, %u connections closed, %u errors\n",
+			s_stats.connectFailures, s_stats.closed, s_stats.errors);
+	}
+
+	io_service&			m_service;
+	std::vector<CSyntheticFile*>	m_files;
+	CFakeServer			m_server;
+	std::vector<CLeecher*>		m_leechers;
+	std::vector<CSeeder*>		m_seeders;
+	deadline_timer			m_timer;
+	CProcessMonitor			m_amuled;
+	CProcessMonitor			m_self;
+
+	uint64				m_loginTime;
+	uint64				m_startTime;
+	std::vector<COfferedFile>	m_offered;
+	uint32				m_started;
+	uint32				m_nextFile;
+	uint32				m_ticks;
+
+	CBenchStats			m_last;
+	uint64				m_lastTime;
+	uint64				m_startCPU;
+	uint64				m_lastCPU;
+	uint64				m_selfCPU;
+	uint64				m_maxResident;
+};
+
+
+//! Reads the 'name=value' and 'flag' arguments.
+static bool ParseArguments(int argc, char** argv)
+{
+	for (int i = 1; i < argc; ++i) {
+		std::string arg(argv[i]);
+		std::string::size_type equals = arg.find('=');
+		std::string name = arg.substr(0, equals);
+		uint32 value = equals == std::string::npos ? 0 : strtoul(arg.c_str() + equals + 1, NULL, 10);
+
+		if (name == "obfuscate") {
+			s_options.obfuscate = true;
+		} else if (name == "compress") {
+			s_options.compress = true;
+		} else if (equals == std::string::npos) {
+			return false;
+		} else if (name == "pid") {
+			s_options.pid = value;
+		} else if (name == "leechers") {
+			s_options.leechers = std::min<uint32>(value, 250 * 256);
+		} else if (name == "seeders") {
+			s_options.seeders = std::min<uint32>(value, 250 * 256);
+		} else if (name == "files") {
+			s_options.files = std::max<uint32>(value, 1);
+		} else if (name == "size") {
+			s_options.size = std::max<uint32>(value, 1);
+		} else if (name == "seconds") {
+			s_options.seconds = std::max<uint32>(value, 1);
+		} else if (name == "port") {
+			s_options.port = value;
+		} else if (name == "clientport") {
+			s_options.clientPort = value;
+		} else if (name == "seed") {
+			s_options.seed = value;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+int main(int argc, char** argv)
+{
+	wxInitializer init;
+	if (!init.IsOk()) {
+		fprintf(stderr, "Failed to initialize wxWidgets\n");
+		return 1;
+	}
+
+	if (!ParseArguments(argc, argv)) {
+		fprintf(stderr, "Usage: %s [pid=<pid of amuled>] [leechers=100] [seeders=10] [files=2] [size=50]\n"
+			"\t[seconds=60] [port=4661] [clientport=14662] [seed=4711] [obfuscate] [compress]\n", argv[0]);
+		return 1;
+	}
+	s_random = Mix64(s_options.seed);
+
+	io_service service;
+	CLoadBench bench(service);
+	if (!bench.Init()) {
+		return 1;
+	}
+	service.run();
+
+	return 0;
+}
+
+#else
+
+int main()
+{
+	printf("Built without Boost.Asio, nothing to measure.\n");
+	return 0;
+}
+
+#endif
+// File_checked_for_headers
@@ -0,0 +1,102 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+//
+// Measures CGapList operations on a large, heavily fragmented download.
+//
+// Usage: GapListBench [size in MB]
+//
+// Blocks of EMBLOCKSIZE are filled at random positions, the way many
+// sources deliver them, while the block picker queries keep running.
+//
+
+#include <wx/init.h>
+#include <wx/stopwatch.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "Types.h"
+#include <protocol/ed2k/Constants.h>
+#include "GapList.h"
+
+
+static uint32 NextRandom(uint32& seed)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed;
+}
+
+
+int main(int argc, char** argv)
+{
+	wxInitializer init;
+	if (!init.IsOk()) {
+		return 1;
+	}
+
+	uint64 size = (uint64)((argc > 1) ? atoi(argv[1]) : 4000) * 1024 * 1024;
+	if (size < PARTSIZE) {
+		size = PARTSIZE;
+	}
+	const uint64 blocks = size / EMBLOCKSIZE;
+	const uint16 parts = (uint16)((size + PARTSIZE - 1) / PARTSIZE);
+
+	CGapList gaplist;
+	gaplist.Init(size, true);
+
+	uint32 seed = 4711;
+	uint32 maxGaps = 0;
+	uint64 checksum = 0;
+	wxStopWatch fillTime;
+	// Fill half of the blocks, and query each part after every fill
+	// like the block picker and the chunk bar do.
+	for (uint64 i = 0; i < blocks / 2; ++i) {
+		uint64 block = ((uint64)NextRandom(seed) << 16 ^ NextRandom(seed)) % blocks;
+		uint64 start = block * EMBLOCKSIZE;
+		gaplist.FillGap(start, start + EMBLOCKSIZE - 1);
+
+		uint16 part = (uint16)(start / PARTSIZE);
+		checksum += gaplist.GetGapSize(part);
+		checksum += gaplist.IsComplete(part);
+		CGapList::const_iterator it = gaplist.FindFirstGap((uint64)part * PARTSIZE);
+		if (it != gaplist.end()) {
+			checksum += it.start();
+		}
+
+		if (gaplist.size() > maxGaps) {
+			maxGaps = gaplist.size();
+		}
+	}
+	long elapsed = fillTime.Time();
+	printf("%llu fills with queries in %ld ms, up to %u gaps\n",
+		(unsigned long long)(blocks / 2), elapsed, maxGaps);
+
+	wxStopWatch scanTime;
+	for (int round = 0; round < 100; ++round) {
+		for (uint16 part = 0; part < parts; ++part) {
+			checksum += gaplist.GetGapSize(part);
+		}
+	}
+	printf("%u part sizes in %ld ms (checksum %llu)\n",
+		100u * parts, scanTime.Time(), (unsigned long long)checksum);
+
+	return 0;
+}
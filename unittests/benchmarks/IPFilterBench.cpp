@@ -0,0 +1,189 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+//
+// Measures CIPFilterTable lookups per second with concurrent readers.
+//
+// Usage: IPFilterBench [threads] [guardian.p2p]
+//
+// Without a file, a synthetic list of 300k ranges with a size distribution
+// similar to the PeerGuardian lists is used. With a file, its lines of the
+// form "description:a.b.c.d-e.f.g.h" are loaded.
+//
+
+#include <wx/init.h>
+#include <wx/thread.h>
+#include <wx/stopwatch.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Types.h"
+#include "RangeMap.h"
+#include "IPFilterTable.h"
+
+
+static const uint32 LookupsPerThread = 20000000;
+
+
+static uint32 NextRandom(uint32& seed)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed;
+}
+
+
+static void CreateSyntheticList(CRangeMap<void, uint32>& ranges)
+{
+	uint32 seed = 4711;
+	while (ranges.size() < 300000) {
+		uint32 start = NextRandom(seed) ^ (NextRandom(seed) >> 16);
+		uint32 length;
+		switch (NextRandom(seed) % 16) {
+			case 0:		length = 0x10000; break;	// a /16
+			case 1:
+			case 2:		length = 0x1000; break;		// a /20
+			case 3:
+			case 4:
+			case 5:		length = 0x100; break;		// a /24
+			default:	length = NextRandom(seed) % 64 + 1;
+		}
+		start &= ~(length - 1);
+		if (start + (length - 1) < start) {
+			continue;
+		}
+		ranges.insert(start, start + (length - 1));
+	}
+}
+
+
+static bool LoadGuardianList(const char* filename, CRangeMap<void, uint32>& ranges)
+{
+	FILE* file = fopen(filename, "r");
+	if (!file) {
+		return false;
+	}
+
+	char line[1024];
+	while (fgets(line, sizeof(line), file)) {
+		// The description may contain colons, the range follows the last one.
+		char* sep = strrchr(line, ':');
+		unsigned a[4], b[4];
+		if (sep && sscanf(sep + 1, "%u.%u.%u.%u-%u.%u.%u.%u", &a[0], &a[1], &a[2], &a[3], &b[0], &b[1], &b[2], &b[3]) == 8) {
+			uint32 start = (a[0] << 24) | (a[1] << 16) | (a[2] << 8) | a[3];
+			uint32 end = (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+			if (start <= end) {
+				ranges.insert(start, end);
+			}
+		}
+	}
+	fclose(file);
+
+	return true;
+}
+
+
+class CLookupThread : public wxThread
+{
+public:
+	CLookupThread(const CIPFilterTable& table, uint32 seed)
+		: wxThread(wxTHREAD_JOINABLE),
+		  m_table(table),
+		  m_seed(seed),
+		  m_hits(0)
+	{
+	}
+
+	uint32 GetHits() const { return m_hits; }
+
+private:
+	void* Entry()
+	{
+		for (uint32 i = 0; i < LookupsPerThread; ++i) {
+			if (m_table.Find(NextRandom(m_seed)) != CIPFilterTable::NotFound) {
+				m_hits++;
+			}
+		}
+		return NULL;
+	}
+
+	const CIPFilterTable& m_table;
+	uint32 m_seed;
+	uint32 m_hits;
+};
+
+
+int main(int argc, char** argv)
+{
+	wxInitializer init;
+	if (!init.IsOk()) {
+		return 1;
+	}
+
+	unsigned threads = (argc > 1) ? atoi(argv[1]) : wxThread::GetCPUCount();
+	if (threads < 1) {
+		threads = 1;
+	}
+
+	CRangeMap<void, uint32> ranges;
+	if (argc > 2) {
+		if (!LoadGuardianList(argv[2], ranges)) {
+			fprintf(stderr, "Failed to open %s\n", argv[2]);
+			return 1;
+		}
+	} else {
+		CreateSyntheticList(ranges);
+	}
+
+	wxStopWatch buildTime;
+	CIPFilterTable table;
+	CRangeMap<void, uint32>::const_iterator it = ranges.begin();
+	for (; it != ranges.end(); ++it) {
+		table.AddRange(it.keyStart(), it.keyEnd());
+	}
+	table.Finish();
+	printf("Built table of %u ranges in %ld ms\n", table.GetRangeCount(), buildTime.Time());
+
+	std::vector<CLookupThread*> workers;
+	for (unsigned i = 0; i < threads; ++i) {
+		workers.push_back(new CLookupThread(table, i * 7919 + 1));
+	}
+
+	wxStopWatch lookupTime;
+	for (unsigned i = 0; i < threads; ++i) {
+		workers[i]->Create();
+		workers[i]->Run();
+	}
+	uint64 hits = 0;
+	for (unsigned i = 0; i < threads; ++i) {
+		workers[i]->Wait();
+		hits += workers[i]->GetHits();
+		delete workers[i];
+	}
+	long elapsed = lookupTime.Time();
+
+	uint64 lookups = (uint64)LookupsPerThread * threads;
+	printf("%u threads: %llu lookups (%llu hits) in %ld ms, %.1f M lookups/s\n",
+		threads, (unsigned long long)lookups, (unsigned long long)hits, elapsed,
+		elapsed ? lookups / (elapsed * 1000.0) : 0.0);
+
+	return 0;
+}
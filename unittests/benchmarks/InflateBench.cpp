@@ -0,0 +1,213 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+//
+// Measures how fast compressed download blocks are unpacked.
+//
+// Usage: InflateBench [number of blocks]
+//
+// Every block of EMBLOCKSIZE is compressed into one zlib stream and sent
+// in 10 kB packets, like OP_COMPRESSEDPART. Each packet is unzipped and
+// copied once more, as into the write buffer of a part file. This is done
+// the way it used to be, with a new stream per block and a heap buffer per
+// packet that grows as needed, and with CInflatePool::Unzip, as used by
+// CUpDownClient, and CBufferPool.
+//
+// Linking against a zlib compatible library (for example zlib-ng built
+// with ZLIB_COMPAT, see configure --with-zlib) shows its gain here.
+//
+
+#include <wx/init.h>
+#include <wx/stopwatch.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <zlib.h>
+
+#include "Types.h"
+#include <protocol/ed2k/Constants.h>
+#include "BufferPool.h"
+#include "InflatePool.h"
+
+
+static const uint32 PacketSize = 10240;
+
+
+static uint32 NextRandom(uint32& seed)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+
+// Sums the data, so the compiler cannot drop the copies
+static uint32 Consume(const byte* data, uint32 length)
+{
+	uint32 sum = 0;
+	for (uint32 i = 0; i < length; i += 64) {
+		sum += data[i];
+	}
+	byte* copy = new byte[length];
+	memcpy(copy, data, length);
+	sum += copy[length - 1];
+	delete [] copy;
+	return sum;
+}
+
+
+// The old way: the output buffer is a guess, grown on demand
+static int OldUnzip(z_stream*& zS, uint32& total, const byte* zipped, uint32 lenZipped, byte** unzipped, uint32* lenUnzipped, int iRecursion = 0)
+{
+	int err;
+	if (zS == NULL) {
+		zS = new z_stream;
+		zS->zalloc = Z_NULL;
+		zS->zfree = Z_NULL;
+		zS->opaque = Z_NULL;
+		err = inflateInit(zS);
+		if (err != Z_OK) {
+			return err;
+		}
+	}
+
+	zS->next_in = const_cast<byte*>(zipped);
+	zS->avail_in = lenZipped;
+	if (iRecursion == 0) {
+		zS->next_out = *unzipped;
+		zS->avail_out = *lenUnzipped;
+	}
+
+	err = inflate(zS, Z_SYNC_FLUSH);
+	if (err == Z_STREAM_END) {
+		err = inflateEnd(zS);
+		*lenUnzipped = zS->total_out - total;
+		total = zS->total_out;
+	} else if (err == Z_OK && zS->avail_out == 0 && zS->avail_in != 0) {
+		uint32 newLength = (*lenUnzipped) * 2;
+		byte* temp = new byte[newLength];
+		memcpy(temp, *unzipped, zS->total_out - total);
+		delete [] *unzipped;
+		*unzipped = temp;
+		*lenUnzipped = newLength;
+		zS->next_out = *unzipped + (zS->total_out - total);
+		zS->avail_out = newLength - (zS->total_out - total);
+		err = OldUnzip(zS, total, zS->next_in, zS->avail_in, unzipped, lenUnzipped, iRecursion + 1);
+	} else if (err == Z_OK && zS->avail_in == 0) {
+		*lenUnzipped = zS->total_out - total;
+		total = zS->total_out;
+	}
+	return err;
+}
+
+
+int main(int argc, char** argv)
+{
+	wxInitializer init;
+	if (!init.IsOk()) {
+		return 1;
+	}
+
+	uint32 count = (argc > 1) ? atoi(argv[1]) : 2000;
+	if (count < 1) {
+		count = 1;
+	}
+
+	// Some distinct blocks, half text-like and half sparse binary
+	const uint32 distinct = 16;
+	std::vector<std::vector<byte> > zipped(distinct);
+	uint32 seed = 4711;
+	std::vector<byte> plain(EMBLOCKSIZE);
+	for (uint32 i = 0; i < distinct; ++i) {
+		for (uint32 j = 0; j < EMBLOCKSIZE; ++j) {
+			uint32 r = NextRandom(seed);
+			if (i % 2) {
+				plain[j] = (r % 8) ? 0 : (byte)(r >> 8);
+			} else {
+				plain[j] = (r % 5) ? (byte)('a' + (r >> 8) % 16) : ' ';
+			}
+		}
+		uLongf len = compressBound(EMBLOCKSIZE);
+		zipped[i].resize(len);
+		compress2(&zipped[i][0], &len, &plain[0], EMBLOCKSIZE, Z_DEFAULT_COMPRESSION);
+		zipped[i].resize(len);
+	}
+
+	uint64 zippedBytes = 0;
+	for (uint32 i = 0; i < count; ++i) {
+		zippedBytes += zipped[i % distinct].size();
+	}
+
+	wxStopWatch oldTime;
+	uint64 oldBytes = 0;
+	uint32 oldSum = 0;
+	for (uint32 i = 0; i < count; ++i) {
+		const std::vector<byte>& block = zipped[i % distinct];
+		z_stream* zS = NULL;
+		uint32 total = 0;
+		for (uint32 pos = 0; pos < block.size(); pos += PacketSize) {
+			uint32 size = std::min<uint32>(PacketSize, block.size() - pos);
+			uint32 lenUnzipped = std::min<uint32>(size * 2, BLOCKSIZE + 300);
+			byte* unzipped = new byte[lenUnzipped];
+			if (OldUnzip(zS, total, &block[pos], size, &unzipped, &lenUnzipped) == Z_OK && lenUnzipped) {
+				oldBytes += lenUnzipped;
+				oldSum += Consume(unzipped, lenUnzipped);
+			}
+			delete [] unzipped;
+		}
+		if (zS) {
+			inflateEnd(zS);
+			delete zS;
+		}
+	}
+	long oldMs = oldTime.Time();
+
+	wxStopWatch newTime;
+	uint64 newBytes = 0;
+	uint32 newSum = 0;
+	for (uint32 i = 0; i < count; ++i) {
+		const std::vector<byte>& block = zipped[i % distinct];
+		z_stream* zS = NULL;
+		uint32 total = 0;
+		for (uint32 pos = 0; pos < block.size(); pos += PacketSize) {
+			uint32 size = std::min<uint32>(PacketSize, block.size() - pos);
+			uint32 lenUnzipped = EMBLOCKSIZE - total + 1;
+			byte* unzipped = CBufferPool::Allocate(lenUnzipped);
+			if (CInflatePool::Unzip(zS, total, &block[pos], size, unzipped, &lenUnzipped) == Z_OK && lenUnzipped) {
+				newBytes += lenUnzipped;
+				newSum += Consume(unzipped, lenUnzipped);
+			}
+			CBufferPool::Free(unzipped);
+		}
+		CInflatePool::Release(zS);
+	}
+	long newMs = newTime.Time();
+
+	printf("zlib %s, %u blocks, %.1f MB compressed to %.1f MB\n", zlibVersion(), count,
+		zippedBytes / 1048576.0, (double)count * EMBLOCKSIZE / 1048576.0);
+	printf("stream and buffer per block:  %6ld ms, %8.1f MB/s unpacked\n", oldMs, oldBytes / 1048576.0 / (oldMs ? oldMs : 1) * 1000);
+	printf("pooled streams and buffers:   %6ld ms, %8.1f MB/s unpacked\n", newMs, newBytes / 1048576.0 / (newMs ? newMs : 1) * 1000);
+
+	const uint64 expected = (uint64)count * EMBLOCKSIZE;
+	return (oldBytes == expected && newBytes == expected && oldSum == newSum) ? 0 : 1;
+}
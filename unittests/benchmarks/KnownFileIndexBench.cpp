@@ -0,0 +1,188 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+//
+// Measures the lookups of a shared files reload in a large known file list.
+//
+// Usage: KnownFileIndexBench [number of known files]
+//
+// Every known file is looked up once by name, size and date, like the
+// shared files reload does, with the size index that used to be built
+// for each reload and with the CKnownFileIndex that is kept with the list.
+// One in twenty files was renamed and has its old entry on the list too.
+//
+
+#include <wx/init.h>
+#include <wx/string.h>
+#include <wx/stopwatch.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include "Types.h"
+#include "KnownFileIndex.h"
+
+
+class CBenchFile
+{
+public:
+	CBenchFile(const wxString& name, uint64 size, time_t date)
+		: m_name(name), m_size(size), m_date(date)
+	{
+	}
+
+	const wxString& GetFileName() const	{ return m_name; }
+	uint64 GetFileSize() const		{ return m_size; }
+	time_t GetLastChangeDatetime() const	{ return m_date; }
+
+private:
+	wxString	m_name;
+	uint64		m_size;
+	time_t		m_date;
+};
+
+
+static bool Matches(const CBenchFile* file, const wxString& name, time_t date, uint64 size)
+{
+	return (file->GetLastChangeDatetime() == date) && (file->GetFileSize() == size) && (file->GetFileName() == name);
+}
+
+
+class CBenchMatcher
+{
+public:
+	CBenchMatcher(const wxString& name, time_t date, uint64 size)
+		: m_name(name), m_date(date), m_size(size)
+	{
+	}
+
+	bool operator()(const CBenchFile* file) const
+	{
+		return Matches(file, m_name, m_date, m_size);
+	}
+
+private:
+	const wxString&	m_name;
+	time_t		m_date;
+	uint64		m_size;
+};
+
+
+static uint32 NextRandom(uint32& seed)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+
+int main(int argc, char** argv)
+{
+	wxInitializer init;
+	if (!init.IsOk()) {
+		return 1;
+	}
+
+	uint32 count = (argc > 1) ? atoi(argv[1]) : 500000;
+	if (count < 20) {
+		count = 20;
+	}
+
+	std::vector<CBenchFile*> files;
+	files.reserve(count);
+	uint32 seed = 4711;
+	for (uint32 i = 0; i < count; ++i) {
+		if (i % 20 == 19) {
+			// Renamed, same size and date as the old entry
+			const CBenchFile* old = files[i - 1];
+			files.push_back(new CBenchFile(old->GetFileName() + wxT(".renamed"), old->GetFileSize(), old->GetLastChangeDatetime()));
+		} else {
+			// Mostly media files, and many of them in a batch of the same day
+			uint64 size = ((uint64)NextRandom(seed) << 8) + NextRandom(seed) % 256;
+			time_t date = 1300000000 + NextRandom(seed) % 86400;
+			files.push_back(new CBenchFile(wxString::Format(wxT("Some Show S%02uE%04u - Title.mkv"), i % 40, i), size, date));
+		}
+	}
+
+	// The old way: an index by size, built for every reload
+	wxStopWatch oldTime;
+	typedef std::multimap<uint32, CBenchFile*> SizeMap;
+	SizeMap sizeMap;
+	for (uint32 i = 0; i < count; ++i) {
+		sizeMap.insert(std::make_pair((uint32)files[i]->GetFileSize(), files[i]));
+	}
+	long oldBuild = oldTime.Time();
+	uint32 oldFound = 0;
+	for (uint32 i = 0; i < count; ++i) {
+		const CBenchFile* file = files[i];
+		std::pair<SizeMap::const_iterator, SizeMap::const_iterator> p = sizeMap.equal_range((uint32)file->GetFileSize());
+		for (SizeMap::const_iterator it = p.first; it != p.second; ++it) {
+			if (Matches(it->second, file->GetFileName(), file->GetLastChangeDatetime(), file->GetFileSize())) {
+				oldFound++;
+				break;
+			}
+		}
+	}
+	long oldLookup = oldTime.Time() - oldBuild;
+
+	// The new way: the index is kept up to date when files are added
+	wxStopWatch newTime;
+	CKnownFileIndex<CBenchFile> index;
+	for (uint32 i = 0; i < count; ++i) {
+		index.Add(files[i]);
+	}
+	long newBuild = newTime.Time();
+	uint32 newFound = 0;
+	for (uint32 i = 0; i < count; ++i) {
+		const CBenchFile* file = files[i];
+		if (index.Find(file->GetFileSize(), file->GetLastChangeDatetime(),
+				CBenchMatcher(file->GetFileName(), file->GetLastChangeDatetime(), file->GetFileSize()))) {
+			newFound++;
+		}
+	}
+	long newLookup = newTime.Time() - newBuild;
+
+	// Without any index, like a lookup outside of a reload used to be
+	const uint32 scans = 100;
+	wxStopWatch scanTime;
+	uint32 scanFound = 0;
+	for (uint32 i = 0; i < scans; ++i) {
+		const CBenchFile* file = files[(uint64)i * count / scans];
+		for (uint32 j = 0; j < count; ++j) {
+			if (Matches(files[j], file->GetFileName(), file->GetLastChangeDatetime(), file->GetFileSize())) {
+				scanFound++;
+				break;
+			}
+		}
+	}
+	long scanLookup = scanTime.Time();
+
+	printf("%u known files\n", count);
+	printf("size index per reload:  %5ld ms to build, %5ld ms for %u lookups (%u found)\n", oldBuild, oldLookup, count, oldFound);
+	printf("CKnownFileIndex:        %5ld ms to build, %5ld ms for %u lookups (%u found)\n", newBuild, newLookup, count, newFound);
+	printf("no index:               %14s %5ld ms for %u lookups (%u found)\n", "", scanLookup, scans, scanFound);
+
+	for (uint32 i = 0; i < count; ++i) {
+		delete files[i];
+	}
+
+	return (oldFound == count && newFound == count) ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+//
+// Measures the bookkeeping of Kad lookups in CSearchCandidates.
+//
+// Usage: SearchCandidatesBench [number of lookups] [requests per lookup]
+//
+// Every lookup starts with the 50 contacts CSearch::Go() takes from the
+// routing table. Each request goes to the next untried contact, and its
+// answer brings KADEMLIA_FIND_VALUE new contacts. One request in four is
+// never answered and expires. There is no network, so this is the CPU
+// time of the candidate list, not the latency of the lookups.
+//
+
+#include <wx/init.h>
+#include <wx/stopwatch.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "Types.h"
+#include <protocol/kad/Constants.h>
+#include "kademlia/kademlia/SearchCandidates.h"
+
+using Kademlia::CUInt128;
+using Kademlia::CSearchCandidates;
+
+
+static uint32 NextRandom(uint32& seed)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+
+static CUInt128 RandomID(uint32& seed)
+{
+	CUInt128 id;
+	for (unsigned i = 0; i < 4; ++i) {
+		id.Set32BitChunk(i, (NextRandom(seed) << 16) ^ NextRandom(seed));
+	}
+	return id;
+}
+
+
+class CBenchContact
+{
+public:
+	CBenchContact(uint32 ip, uint32 rtt)
+		: m_ip(ip), m_rtt(rtt)
+	{
+	}
+
+	uint32_t GetIPAddress() const	{ return m_ip; }
+	uint16_t GetUDPPort() const	{ return 4672; }
+	uint32_t GetRTT() const		{ return m_rtt; }
+
+private:
+	uint32	m_ip;
+	uint32	m_rtt;
+};
+
+
+typedef CSearchCandidates<CBenchContact> Candidates;
+
+
+// Runs one lookup, returning the number of candidates it ended up with.
+static size_t RunLookup(uint32 requests, uint32& seed, std::vector<CBenchContact>& contacts)
+{
+	const uint32 initial = 50;
+	contacts.clear();
+	contacts.reserve(initial + requests * KADEMLIA_FIND_VALUE);
+
+	Candidates candidates;
+	uint32 now = 0;
+	for (uint32 i = 0; i < initial; ++i) {
+		contacts.push_back(CBenchContact(contacts.size() + 1, (i & 1) ? 20 + NextRandom(seed) % 400 : 0));
+		candidates.Add(RandomID(seed), &contacts.back());
+	}
+
+	for (uint32 i = 0; i < requests && candidates.HasPossible(); ++i) {
+		const Candidates::Candidate* next = candidates.GetNextUntried(ALPHA_QUERY);
+		if (next == NULL) {
+			candidates.RemoveFirstPossible();
+			continue;
+		}
+		CUInt128 distance(next->distance);
+		const CBenchContact* contact = next->contact;
+		candidates.SetTried(distance);
+		candidates.SetRequested(distance, now);
+
+		if ((NextRandom(seed) & 3) == 0) {
+			now += Candidates::GetTimeout(contact->GetRTT());
+			candidates.ExpireRequests(now);
+			continue;
+		}
+
+		// The answer is matched by address, like in CSearch::ProcessResponse()
+		now += contact->GetRTT() ? contact->GetRTT() : 100;
+		const Candidates::Candidate* from = candidates.FindTried(contact->GetIPAddress(), contact->GetUDPPort());
+		CUInt128 fromDistance(from->distance);
+		uint32_t rtt;
+		candidates.SetAnswered(fromDistance, now, rtt);
+
+		bool closer = false;
+		for (unsigned j = 0; j < KADEMLIA_FIND_VALUE; ++j) {
+			// Results get closer to the target as the lookup goes on
+			CUInt128 result(RandomID(seed));
+			result.Set32BitChunk(0, result.Get32BitChunk(0) >> std::min<uint32>(i / 4, 31));
+			if (candidates.IsKnown(result)) {
+				continue;
+			}
+			contacts.push_back(CBenchContact(contacts.size() + 1, 0));
+			candidates.Add(result, &contacts.back());
+			if (result < fromDistance) {
+				closer = true;
+				candidates.OfferBest(result, ALPHA_QUERY);
+			}
+		}
+		candidates.SetResponded(fromDistance, closer);
+		candidates.ExpireRequests(now);
+
+		const Candidates::Candidate* first = candidates.GetFirstPossible();
+		if (first != NULL && first->HasResponded()) {
+			candidates.RemoveFirstPossible();
+		}
+	}
+
+	return candidates.size();
+}
+
+
+int main(int argc, char** argv)
+{
+	wxInitializer init;
+	if (!init.IsOk()) {
+		return 1;
+	}
+
+	uint32 lookups = (argc > 1) ? atoi(argv[1]) : 20000;
+	uint32 requests = (argc > 2) ? atoi(argv[2]) : 40;
+
+	uint32 seed = 4711;
+	std::vector<CBenchContact> contacts;
+	uint64 total = 0;
+	wxStopWatch time;
+	for (uint32 i = 0; i < lookups; ++i) {
+		total += RunLookup(requests, seed, contacts);
+	}
+	long elapsed = time.Time();
+
+	printf("%u lookups of %u requests in %ld ms, %.1f us per lookup, %.1f candidates per lookup\n",
+		lookups, requests, elapsed, lookups ? elapsed * 1000.0 / lookups : 0.0,
+		lookups ? (double)total / lookups : 0.0);
+
+	return 0;
+}
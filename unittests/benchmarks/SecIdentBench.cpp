@@ -0,0 +1,216 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+//
+// Measures secure ident signature checks per second.
+//
+// Usage: SecIdentBench [threads] [clients]
+//
+// Simulates a reconnect storm: a set of clients with their own RSA keys
+// identify themselves over and over. The signatures are checked the old
+// way, decoding the public key every time, then through CRSAVerifierCache
+// on one thread and on several threads at once.
+//
+
+#include <wx/init.h>
+#include <wx/thread.h>
+#include <wx/stopwatch.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "Types.h"
+#include <protocol/ed2k/Constants.h>
+#include "CryptoPP_Inc.h"
+#include "RSAVerifierCache.h"
+
+
+static const uint32 IdentsPerThread = 20000;
+
+
+//! A client that has sent its public key and a signature.
+struct CIdent
+{
+	CMD4Hash	userHash;
+	byte		key[80];
+	uint8		keyLen;
+	byte		message[80 + 9];
+	uint8		messageLen;
+	byte		signature[200];
+	uint8		signatureLen;
+};
+
+
+static void CreateIdents(std::vector<CIdent>& idents, uint32 count)
+{
+	CryptoPP::AutoSeededX917RNG<CryptoPP::DES_EDE3> rng;
+
+	// Our own public key, which the clients sign
+	CryptoPP::RSASSA_PKCS1v15_SHA_Signer ourKey(rng, RSAKEYSIZE);
+	CryptoPP::RSASSA_PKCS1v15_SHA_Verifier ourPubKey(ourKey);
+	byte ourKeyData[80];
+	CryptoPP::ArraySink ourSink(ourKeyData, sizeof(ourKeyData));
+	ourPubKey.GetMaterial().Save(ourSink);
+	uint8 ourKeyLen = ourSink.TotalPutLength();
+
+	idents.resize(count);
+	for (uint32 i = 0; i < count; ++i) {
+		CIdent& ident = idents[i];
+		byte hash[16];
+		rng.GenerateBlock(hash, sizeof(hash));
+		ident.userHash = CMD4Hash(hash);
+
+		CryptoPP::RSASSA_PKCS1v15_SHA_Signer signer(rng, RSAKEYSIZE);
+		CryptoPP::RSASSA_PKCS1v15_SHA_Verifier verifier(signer);
+		CryptoPP::ArraySink keySink(ident.key, sizeof(ident.key));
+		verifier.GetMaterial().Save(keySink);
+		ident.keyLen = keySink.TotalPutLength();
+
+		// Our key, the challenge and the v2 IP part
+		memcpy(ident.message, ourKeyData, ourKeyLen);
+		rng.GenerateBlock(ident.message + ourKeyLen, 9);
+		ident.messageLen = ourKeyLen + 9;
+
+		ident.signatureLen = signer.SignatureLength();
+		signer.SignMessage(rng, ident.message, ident.messageLen, ident.signature);
+	}
+}
+
+
+static uint32 VerifyUncached(const std::vector<CIdent>& idents, uint32 count)
+{
+	uint32 valid = 0;
+	for (uint32 i = 0; i < count; ++i) {
+		const CIdent& ident = idents[i % idents.size()];
+		CryptoPP::StringSource source(ident.key, ident.keyLen, true, 0);
+		CryptoPP::RSASSA_PKCS1v15_SHA_Verifier verifier(source);
+		if (verifier.VerifyMessage(ident.message, ident.messageLen, ident.signature, ident.signatureLen)) {
+			valid++;
+		}
+	}
+	return valid;
+}
+
+
+class CVerifyThread : public wxThread
+{
+public:
+	CVerifyThread(const std::vector<CIdent>& idents, CRSAVerifierCache& cache, uint32 offset)
+		: wxThread(wxTHREAD_JOINABLE),
+		  m_idents(idents),
+		  m_cache(cache),
+		  m_offset(offset),
+		  m_valid(0)
+	{
+	}
+
+	uint32 GetValid() const { return m_valid; }
+
+	void* Entry()
+	{
+		for (uint32 i = 0; i < IdentsPerThread; ++i) {
+			const CIdent& ident = m_idents[(i + m_offset) % m_idents.size()];
+			if (m_cache.Verify(ident.userHash, ident.key, ident.keyLen, ident.message, ident.messageLen, ident.signature, ident.signatureLen)) {
+				m_valid++;
+			}
+		}
+		return NULL;
+	}
+
+private:
+	const std::vector<CIdent>& m_idents;
+	CRSAVerifierCache& m_cache;
+	uint32 m_offset;
+	uint32 m_valid;
+};
+
+
+static void Report(const char* what, uint32 idents, uint32 valid, long elapsed)
+{
+	printf("%s: %u idents (%u valid) in %ld ms, %.0f idents/s\n",
+		what, idents, valid, elapsed, elapsed ? idents * 1000.0 / elapsed : 0.0);
+}
+
+
+int main(int argc, char** argv)
+{
+	wxInitializer init;
+	if (!init.IsOk()) {
+		return 1;
+	}
+
+	int threads = (argc > 1) ? atoi(argv[1]) : wxThread::GetCPUCount();
+	if (threads < 1) {
+		threads = 1;
+	}
+	int clients = (argc > 2) ? atoi(argv[2]) : 500;
+	if (clients < 1) {
+		clients = 1;
+	}
+
+	wxStopWatch keyTime;
+	std::vector<CIdent> idents;
+	CreateIdents(idents, clients);
+	printf("Created %d client keys in %ld ms\n", clients, keyTime.Time());
+
+	wxStopWatch uncachedTime;
+	uint32 valid = VerifyUncached(idents, IdentsPerThread);
+	Report("Uncached, 1 thread", IdentsPerThread, valid, uncachedTime.Time());
+
+	{
+		CRSAVerifierCache cache;
+		CVerifyThread single(idents, cache, 0);
+		wxStopWatch cachedTime;
+		single.Entry();
+		Report("Cached, 1 thread", IdentsPerThread, single.GetValid(), cachedTime.Time());
+	}
+
+	CRSAVerifierCache cache;
+	std::vector<CVerifyThread*> workers;
+	for (int i = 0; i < threads; ++i) {
+		workers.push_back(new CVerifyThread(idents, cache, i * 7919));
+	}
+
+	wxStopWatch threadTime;
+	for (int i = 0; i < threads; ++i) {
+		workers[i]->Create();
+		workers[i]->Run();
+	}
+	valid = 0;
+	for (int i = 0; i < threads; ++i) {
+		workers[i]->Wait();
+		valid += workers[i]->GetValid();
+		delete workers[i];
+	}
+	long elapsed = threadTime.Time();
+
+	char what[64];
+	snprintf(what, sizeof(what), "Cached, %d threads", threads);
+	Report(what, IdentsPerThread * threads, valid, elapsed);
+
+	CRSAVerifierCache::Stats stats;
+	cache.GetStats(stats);
+	printf("Cache: %llu lookups, %llu hits, %llu keys\n",
+		(unsigned long long)stats.lookups, (unsigned long long)stats.hits,
+		(unsigned long long)stats.entries);
+
+	return 0;
+}
@@ -0,0 +1,148 @@
+#include <muleunit/test.h>
+#include "Types.h"
+#include "BitVector.h"
+
+#include <vector>
+
+using namespace muleunit;
+
+DECLARE_SIMPLE(BitVector)
+
+
+TEST(BitVector, UniformWithoutStorage)
+{
+	BitVector bits;
+	ASSERT_TRUE(bits.empty());
+	ASSERT_FALSE(bits.AllTrue());
+
+	bits.setsize(100, true);
+	ASSERT_EQUALS(100u, bits.size());
+	ASSERT_EQUALS(13u, bits.SizeBuffer());
+	ASSERT_EQUALS(0u, bits.GetAllocatedSize());
+	ASSERT_TRUE(bits.AllTrue());
+	for (uint32 i = 0; i < 100; ++i) {
+		ASSERT_TRUE(bits.get(i));
+	}
+
+	bits.setsize(100, false);
+	ASSERT_EQUALS(0u, bits.GetAllocatedSize());
+	ASSERT_FALSE(bits.AllTrue());
+	for (uint32 i = 0; i < 100; ++i) {
+		ASSERT_FALSE(bits.get(i));
+	}
+
+	// Setting a bit to the fill value allocates nothing
+	bits.set(42, false);
+	ASSERT_EQUALS(0u, bits.GetAllocatedSize());
+}
+
+
+TEST(BitVector, ClearOneOfAllTrue)
+{
+	BitVector bits;
+	bits.setsize(21, true);
+	bits.set(17, false);
+
+	ASSERT_EQUALS(3u, bits.GetAllocatedSize());
+	ASSERT_FALSE(bits.AllTrue());
+	for (uint32 i = 0; i < 21; ++i) {
+		ASSERT_EQUALS(i != 17, bits.get(i));
+	}
+
+	bits.set(17, true);
+	ASSERT_TRUE(bits.AllTrue());
+}
+
+
+TEST(BitVector, SetAllTrueAfterPartialSets)
+{
+	BitVector bits;
+	bits.setsize(19, false);
+	bits.set(0, true);
+	bits.set(9, true);
+	bits.set(18, true);
+	ASSERT_EQUALS(3u, bits.GetAllocatedSize());
+	ASSERT_FALSE(bits.AllTrue());
+
+	bits.SetAllTrue();
+	ASSERT_EQUALS(0u, bits.GetAllocatedSize());
+	ASSERT_TRUE(bits.AllTrue());
+	for (uint32 i = 0; i < 19; ++i) {
+		ASSERT_TRUE(bits.get(i));
+	}
+
+	// Storage comes back, filled with ones, on the next change
+	bits.set(5, false);
+	ASSERT_FALSE(bits.AllTrue());
+	for (uint32 i = 0; i < 19; ++i) {
+		ASSERT_EQUALS(i != 5, bits.get(i));
+	}
+}
+
+
+TEST(BitVector, SetAllTruePartialLastByte)
+{
+	BitVector bits;
+	bits.setsize(12, false);
+	for (uint32 i = 0; i < 12; ++i) {
+		bits.set(i, true);
+	}
+	// Only the used bits of the last byte count
+	ASSERT_TRUE(bits.AllTrue());
+}
+
+
+TEST(BitVector, UniformBuffer)
+{
+	BitVector bits;
+	bits.setsize(30, true);
+	const uint8* buffer = static_cast<const uint8*>(bits.GetBuffer());
+	for (uint32 i = 0; i < bits.SizeBuffer(); ++i) {
+		ASSERT_EQUALS(0xFF, buffer[i]);
+	}
+	ASSERT_EQUALS(0u, bits.GetAllocatedSize());
+
+	bits.setsize(30, false);
+	buffer = static_cast<const uint8*>(bits.GetBuffer());
+	for (uint32 i = 0; i < bits.SizeBuffer(); ++i) {
+		ASSERT_EQUALS(0, buffer[i]);
+	}
+	ASSERT_EQUALS(0u, bits.GetAllocatedSize());
+}
+
+
+TEST(BitVector, BufferRoundTrip)
+{
+	BitVector source;
+	source.setsize(37, false);
+	for (uint32 i = 0; i < 37; i += 3) {
+		source.set(i, true);
+	}
+
+	BitVector copy;
+	copy.setsize(37, false);
+	copy.SetBuffer(source.GetBuffer());
+	ASSERT_EQUALS(source.SizeBuffer(), copy.GetAllocatedSize());
+	ASSERT_FALSE(copy.AllTrue());
+	for (uint32 i = 0; i < 37; ++i) {
+		ASSERT_EQUALS(i % 3 == 0, copy.get(i));
+	}
+
+	// A uniform source round trips as well
+	BitVector full;
+	full.setsize(37, true);
+	BitVector fullCopy;
+	fullCopy.setsize(37, false);
+	fullCopy.SetBuffer(full.GetBuffer());
+	ASSERT_TRUE(fullCopy.AllTrue());
+	for (uint32 i = 0; i < 37; ++i) {
+		ASSERT_TRUE(fullCopy.get(i));
+	}
+
+	// An empty vector ignores the buffer
+	BitVector empty;
+	std::vector<uint8> ones(8, 0xFF);
+	empty.SetBuffer(&ones[0]);
+	ASSERT_EQUALS(0u, empty.GetAllocatedSize());
+	ASSERT_TRUE(empty.empty());
+}
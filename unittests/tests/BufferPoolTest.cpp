@@ -0,0 +1,86 @@
+#include <muleunit/test.h>
+#include "Types.h"
+#include "BufferPool.h"
+#include "MemFile.h"
+
+using namespace muleunit;
+
+DECLARE_SIMPLE(BufferPool)
+
+
+TEST(BufferPool, SizeClasses)
+{
+	byte* small = CBufferPool::Allocate(1);
+	ASSERT_EQUALS(256u, CBufferPool::GetCapacity(small));
+	byte* medium = CBufferPool::Allocate(10240 + 30);
+	ASSERT_EQUALS(16384u, CBufferPool::GetCapacity(medium));
+	byte* large = CBufferPool::Allocate(CBufferPool::MaxPooledSize + 1);
+	ASSERT_EQUALS(CBufferPool::MaxPooledSize + 1, CBufferPool::GetCapacity(large));
+
+	CBufferPool::Free(small);
+	CBufferPool::Free(medium);
+	CBufferPool::Free(large);
+	CBufferPool::Free(NULL);
+}
+
+
+TEST(BufferPool, Reuse)
+{
+	byte* first = CBufferPool::Allocate(1000);
+	CBufferPool::Free(first);
+
+	CBufferPool::Stats before;
+	CBufferPool::GetStats(before);
+	byte* second = CBufferPool::Allocate(600);
+	CBufferPool::Stats after;
+	CBufferPool::GetStats(after);
+
+	ASSERT_TRUE(first == second);
+	ASSERT_EQUALS(before.allocations + 1, after.allocations);
+	ASSERT_EQUALS(before.reused + 1, after.reused);
+	CBufferPool::Free(second);
+}
+
+
+TEST(BufferPool, Reallocate)
+{
+	byte* buffer = CBufferPool::Reallocate(NULL, 100, 0);
+	for (int i = 0; i < 100; ++i) {
+		buffer[i] = i;
+	}
+
+	// Fits, stays in place
+	ASSERT_TRUE(buffer == CBufferPool::Reallocate(buffer, 200, 100));
+
+	buffer = CBufferPool::Reallocate(buffer, 100000, 100);
+	ASSERT_TRUE(CBufferPool::GetCapacity(buffer) >= 100000u);
+	for (int i = 0; i < 100; ++i) {
+		ASSERT_EQUALS(i, buffer[i]);
+	}
+
+	CBufferPool::Free(buffer);
+}
+
+
+TEST(BufferPool, MemFileHeadroom)
+{
+	CMemFile file(16, 6);
+	ASSERT_EQUALS(6u, file.GetHeadroom());
+	for (uint32 i = 0; i < 1000; ++i) {
+		file.WriteUInt32(i);
+	}
+	ASSERT_EQUALS(4000u, file.GetLength());
+
+	byte* buffer = file.DetachBuffer();
+	ASSERT_EQUALS(0u, file.GetLength());
+	CMemFile data(buffer + 6, 4000);
+	for (uint32 i = 0; i < 1000; ++i) {
+		ASSERT_EQUALS(i, data.ReadUInt32());
+	}
+	CBufferPool::Free(buffer);
+
+	// Detaching an empty file still returns the headroom
+	buffer = file.DetachBuffer();
+	ASSERT_TRUE(CBufferPool::GetCapacity(buffer) >= 6u);
+	CBufferPool::Free(buffer);
+}
@@ -0,0 +1,90 @@
+#include <muleunit/test.h>
+#include "Types.h"
+#include "DeadlineQueue.h"
+
+#include <map>
+
+using namespace muleunit;
+
+DECLARE_SIMPLE(DeadlineQueue)
+
+
+TEST(DeadlineQueue, Order)
+{
+	CDeadlineQueue<uint64> queue;
+	ASSERT_TRUE(queue.empty());
+
+	queue.Set(1, 500);
+	queue.Set(2, 100);
+	queue.Set(3, 300);
+	queue.Set(4, 0);
+	ASSERT_EQUALS(4u, queue.size());
+	ASSERT_EQUALS(4u, queue.GetFirst());
+	ASSERT_EQUALS(0u, queue.GetFirstDeadline());
+
+	// Moving a deadline later and earlier
+	queue.Set(4, 1000);
+	ASSERT_EQUALS(2u, queue.GetFirst());
+	queue.Set(1, 50);
+	ASSERT_EQUALS(1u, queue.GetFirst());
+	ASSERT_EQUALS(4u, queue.size());
+
+	uint32 deadline = 0;
+	ASSERT_TRUE(queue.GetDeadline(3, deadline));
+	ASSERT_EQUALS(300u, deadline);
+	ASSERT_FALSE(queue.GetDeadline(5, deadline));
+
+	ASSERT_EQUALS(0u, queue.CountDue(49));
+	ASSERT_EQUALS(2u, queue.CountDue(100));
+	ASSERT_EQUALS(3u, queue.CountDue(999));
+	ASSERT_EQUALS(4u, queue.CountDue(1000));
+
+	ASSERT_TRUE(queue.Remove(1));
+	ASSERT_FALSE(queue.Remove(1));
+	ASSERT_EQUALS(2u, queue.GetFirst());
+	ASSERT_TRUE(queue.Remove(4));
+	ASSERT_TRUE(queue.Remove(2));
+	ASSERT_EQUALS(3u, queue.GetFirst());
+	ASSERT_TRUE(queue.Remove(3));
+	ASSERT_TRUE(queue.empty());
+	ASSERT_EQUALS(0u, queue.CountDue(1000));
+}
+
+
+TEST(DeadlineQueue, Random)
+{
+	CDeadlineQueue<uint64> queue;
+	std::map<uint64, uint32> deadlines;
+	uint32 seed = 4711;
+
+	for (uint32 i = 0; i < 50000; ++i) {
+		seed = seed * 1103515245 + 12345;
+		uint64 key = (seed >> 8) % 2000;
+		uint32 deadline = (seed >> 4) % 10000;
+		if (i % 5 == 4) {
+			ASSERT_EQUALS(deadlines.erase(key) > 0, queue.Remove(key));
+		} else {
+			queue.Set(key, deadline);
+			deadlines[key] = deadline;
+		}
+	}
+	ASSERT_EQUALS(deadlines.size(), queue.size());
+
+	size_t due = 0;
+	for (std::map<uint64, uint32>::iterator it = deadlines.begin(); it != deadlines.end(); ++it) {
+		due += it->second <= 5000;
+	}
+	ASSERT_EQUALS(due, queue.CountDue(5000));
+
+	// Everything comes out in order, with the deadline it was last set to
+	uint32 last = 0;
+	while (!queue.empty()) {
+		uint64 key = queue.GetFirst();
+		ASSERT_TRUE(queue.GetFirstDeadline() >= last);
+		last = queue.GetFirstDeadline();
+		ASSERT_EQUALS(deadlines[key], last);
+		deadlines.erase(key);
+		ASSERT_TRUE(queue.Remove(key));
+	}
+	ASSERT_TRUE(deadlines.empty());
+}
@@ -0,0 +1,198 @@
+#include <muleunit/test.h>
+#include <algorithm>
+#include <vector>
+#include "Types.h"
+#include <protocol/ed2k/Constants.h>
+#include "GapList.h"
+
+using namespace muleunit;
+
+DECLARE_SIMPLE(GapList)
+
+
+// A file of three full parts and a short last one
+static const uint64 FileSize = 3 * PARTSIZE + 12000;
+
+
+/**
+ * Checks that the gaps are sorted, do not touch and match the expected list.
+ */
+static void AssertGaps(const CGapList& list, const uint64* expected, uint32 count)
+{
+	ASSERT_EQUALS(count, list.size());
+
+	uint32 i = 0;
+	CGapList::const_iterator it = list.begin();
+	for (; it != list.end(); ++it, i += 2) {
+		ASSERT_EQUALS(expected[i], it.start());
+		ASSERT_EQUALS(expected[i + 1], it.end());
+	}
+}
+
+
+TEST(GapList, Init)
+{
+	CGapList list;
+	list.Init(FileSize, true);
+	const uint64 whole[] = { 0, FileSize - 1 };
+	AssertGaps(list, whole, 1);
+	ASSERT_EQUALS(FileSize, list.GetGapSize());
+	ASSERT_FALSE(list.IsComplete());
+
+	list.Init(FileSize, false);
+	ASSERT_TRUE(list.empty());
+	ASSERT_TRUE(list.IsComplete());
+	ASSERT_EQUALS(0u, list.GetGapSize());
+}
+
+
+TEST(GapList, AddGap)
+{
+	CGapList list;
+	list.Init(FileSize, false);
+
+	list.AddGap(1000, 1999);
+	list.AddGap(5000, 5999);
+	list.AddGap(3000, 3999);
+	const uint64 sorted[] = { 1000, 1999, 3000, 3999, 5000, 5999 };
+	AssertGaps(list, sorted, 3);
+
+	// Adjacent gaps are joined
+	list.AddGap(2000, 2999);
+	const uint64 joined[] = { 1000, 3999, 5000, 5999 };
+	AssertGaps(list, joined, 2);
+
+	// Overlapping several gaps
+	list.AddGap(500, 5500);
+	const uint64 merged[] = { 500, 5999 };
+	AssertGaps(list, merged, 1);
+
+	// Already inside
+	list.AddGap(600, 700);
+	AssertGaps(list, merged, 1);
+	ASSERT_EQUALS(5500u, list.GetGapSize());
+}
+
+
+TEST(GapList, FillGap)
+{
+	CGapList list;
+	list.Init(FileSize, false);
+	list.AddGap(1000, 1999);
+	list.AddGap(3000, 3999);
+	list.AddGap(5000, 5999);
+
+	// Head and tail of two gaps
+	list.FillGap(1500, 3499);
+	const uint64 shortened[] = { 1000, 1499, 3500, 3999, 5000, 5999 };
+	AssertGaps(list, shortened, 3);
+
+	// Split a gap in two
+	list.FillGap(5200, 5299);
+	const uint64 split[] = { 1000, 1499, 3500, 3999, 5000, 5199, 5300, 5999 };
+	AssertGaps(list, split, 4);
+
+	// Remove gaps in the middle
+	list.FillGap(1400, 5099);
+	const uint64 removed[] = { 1000, 1399, 5100, 5199, 5300, 5999 };
+	AssertGaps(list, removed, 3);
+
+	// Nothing to fill
+	list.FillGap(2000, 4000);
+	AssertGaps(list, removed, 3);
+
+	list.FillGap(0, FileSize - 1);
+	ASSERT_TRUE(list.IsComplete());
+}
+
+
+TEST(GapList, Parts)
+{
+	CGapList list;
+	list.Init(FileSize, true);
+
+	list.FillGap((uint16)1);
+	ASSERT_TRUE(list.IsComplete((uint16)1));
+	ASSERT_FALSE(list.IsComplete((uint16)0));
+	ASSERT_EQUALS(0u, list.GetGapSize(1));
+	ASSERT_EQUALS(PARTSIZE, (uint64)list.GetGapSize(0));
+	ASSERT_EQUALS(12000u, list.GetGapSize(3));
+
+	list.FillGap(PARTSIZE * 2 + 100, PARTSIZE * 2 + 199);
+	ASSERT_EQUALS(PARTSIZE - 100, (uint64)list.GetGapSize(2));
+	ASSERT_TRUE(list.IsComplete(PARTSIZE * 2 + 100, PARTSIZE * 2 + 199));
+	ASSERT_FALSE(list.IsComplete(PARTSIZE * 2 + 100, PARTSIZE * 2 + 200));
+
+	list.AddGap((uint16)1);
+	ASSERT_FALSE(list.IsComplete((uint16)1));
+	ASSERT_EQUALS(PARTSIZE, (uint64)list.GetGapSize(1));
+}
+
+
+TEST(GapList, FindFirstGap)
+{
+	CGapList list;
+	list.Init(FileSize, false);
+	list.AddGap(1000, 1999);
+	list.AddGap(3000, 3999);
+
+	ASSERT_EQUALS(1000u, list.FindFirstGap(0).start());
+	ASSERT_EQUALS(1000u, list.FindFirstGap(1999).start());
+	ASSERT_EQUALS(3000u, list.FindFirstGap(2000).start());
+	ASSERT_FALSE(list.FindFirstGap(4000) != list.end());
+}
+
+
+TEST(GapList, RandomOperations)
+{
+	// Compare against a model with a granularity of 1000 bytes.
+	const uint64 blocks = FileSize / 1000;
+	uint32 seed = 1;
+	for (int round = 0; round < 10; ++round) {
+		CGapList list;
+		list.Init(FileSize, round % 2 != 0);
+		std::vector<bool> model(blocks, round % 2 != 0);
+
+		for (int op = 0; op < 300; ++op) {
+			seed = seed * 1103515245 + 12345;
+			uint64 a = (seed >> 4) % blocks;
+			seed = seed * 1103515245 + 12345;
+			uint64 b = std::min<uint64>(a + (seed >> 4) % 40, blocks - 1);
+			bool add = ((seed >> 20) & 1) != 0;
+			if (add) {
+				list.AddGap(a * 1000, b * 1000 + 999);
+			} else {
+				list.FillGap(a * 1000, b * 1000 + 999);
+			}
+			for (uint64 i = a; i <= b; ++i) {
+				model[i] = add;
+			}
+
+			uint64 total = 0;
+			uint64 prevEnd = 0;
+			CGapList::const_iterator it = list.begin();
+			for (; it != list.end(); ++it) {
+				ASSERT_TRUE(it.start() <= it.end());
+				ASSERT_TRUE(total == 0 || it.start() > prevEnd + 1);
+				for (uint64 i = it.start() / 1000; i <= it.end() / 1000; ++i) {
+					ASSERT_TRUE(model[i]);
+				}
+				total += it.end() - it.start() + 1;
+				prevEnd = it.end();
+			}
+			ASSERT_EQUALS(total, list.GetGapSize());
+
+			bool complete = true;
+			for (uint64 i = a; i <= b; ++i) {
+				complete = complete && !model[i];
+			}
+			ASSERT_EQUALS(complete, list.IsComplete(a * 1000, b * 1000 + 999));
+		}
+
+		uint64 expected = 0;
+		for (uint64 i = 0; i < blocks; ++i) {
+			expected += model[i] ? 1000 : 0;
+		}
+		ASSERT_EQUALS(expected, list.GetGapSize());
+	}
+}
@@ -0,0 +1,180 @@
+#include <muleunit/test.h>
+#include "Types.h"
+#include "IPFilterTable.h"
+#include "MemFile.h"
+#include <common/MuleDebug.h>
+
+using namespace muleunit;
+
+DECLARE_SIMPLE(IPFilterTable)
+
+
+TEST(IPFilterTable, Empty)
+{
+	CIPFilterTable table;
+	table.Finish();
+
+	ASSERT_EQUALS(0u, table.GetRangeCount());
+	ASSERT_EQUALS(CIPFilterTable::NotFound, table.Find(0));
+	ASSERT_EQUALS(CIPFilterTable::NotFound, table.Find(0x7F000001));
+	ASSERT_EQUALS(CIPFilterTable::NotFound, table.Find(0xFFFFFFFF));
+}
+
+
+TEST(IPFilterTable, SingleBlock)
+{
+	CIPFilterTable table;
+	table.AddRange(0x0A000010, 0x0A000020);
+	table.AddRange(0x0A000030, 0x0A000030);
+	table.Finish();
+
+	ASSERT_EQUALS(2u, table.GetRangeCount());
+	ASSERT_EQUALS(CIPFilterTable::NotFound, table.Find(0x0A00000F));
+	ASSERT_TRUE(table.Find(0x0A000010) != CIPFilterTable::NotFound);
+	ASSERT_TRUE(table.Find(0x0A000018) != CIPFilterTable::NotFound);
+	ASSERT_TRUE(table.Find(0x0A000020) != CIPFilterTable::NotFound);
+	ASSERT_EQUALS(CIPFilterTable::NotFound, table.Find(0x0A000021));
+	ASSERT_EQUALS(CIPFilterTable::NotFound, table.Find(0x0A00002F));
+	ASSERT_TRUE(table.Find(0x0A000030) != CIPFilterTable::NotFound);
+	ASSERT_EQUALS(CIPFilterTable::NotFound, table.Find(0x0A000031));
+	// Same low bits, different /16
+	ASSERT_EQUALS(CIPFilterTable::NotFound, table.Find(0x0A010018));
+}
+
+
+TEST(IPFilterTable, SpanningBlocks)
+{
+	CIPFilterTable table;
+	table.AddRange(0x0000FFFF, 0x00030000);
+	table.AddRange(0xFFFFFF00, 0xFFFFFFFF);
+	table.Finish();
+
+	ASSERT_EQUALS(CIPFilterTable::NotFound, table.Find(0x0000FFFE));
+	ASSERT_TRUE(table.Find(0x0000FFFF) != CIPFilterTable::NotFound);
+	ASSERT_TRUE(table.Find(0x00010000) != CIPFilterTable::NotFound);
+	ASSERT_TRUE(table.Find(0x00028000) != CIPFilterTable::NotFound);
+	ASSERT_TRUE(table.Find(0x00030000) != CIPFilterTable::NotFound);
+	ASSERT_EQUALS(CIPFilterTable::NotFound, table.Find(0x00030001));
+	ASSERT_EQUALS(CIPFilterTable::NotFound, table.Find(0xFFFFFEFF));
+	ASSERT_TRUE(table.Find(0xFFFFFF00) != CIPFilterTable::NotFound);
+	ASSERT_TRUE(table.Find(0xFFFFFFFF) != CIPFilterTable::NotFound);
+}
+
+
+TEST(IPFilterTable, Everything)
+{
+	CIPFilterTable table;
+	table.AddRange(0, 0xFFFFFFFF);
+	table.Finish();
+
+	ASSERT_EQUALS(1u, table.GetRangeCount());
+	ASSERT_TRUE(table.Find(0) != CIPFilterTable::NotFound);
+	ASSERT_TRUE(table.Find(0x12345678) != CIPFilterTable::NotFound);
+	ASSERT_TRUE(table.Find(0xFFFFFFFF) != CIPFilterTable::NotFound);
+}
+
+
+TEST(IPFilterTable, Names)
+{
+	CIPFilterTable table(true);
+	table.AddRange(0x01000000, 0x0101FFFF, "first");
+	table.AddRange(0x02000000, 0x02000000, "second");
+	table.Finish();
+
+	ASSERT_TRUE(table.GetRangeName(table.Find(0x01000000)) == "first");
+	ASSERT_TRUE(table.GetRangeName(table.Find(0x01018000)) == "first");
+	ASSERT_TRUE(table.GetRangeName(table.Find(0x02000000)) == "second");
+	ASSERT_TRUE(table.GetRangeName(CIPFilterTable::NotFound).empty());
+
+	CIPFilterTable unnamed;
+	unnamed.AddRange(0x01000000, 0x0101FFFF, "first");
+	unnamed.Finish();
+	ASSERT_TRUE(unnamed.GetRangeName(unnamed.Find(0x01000000)).empty());
+}
+
+
+TEST(IPFilterTable, InvalidRanges)
+{
+	CIPFilterTable table;
+	ASSERT_RAISES(CInvalidParamsEx, table.AddRange(10, 9));
+
+	table.AddRange(0x01000000, 0x01000010);
+	// Overlapping
+	ASSERT_RAISES(CInvalidParamsEx, table.AddRange(0x01000010, 0x01000020));
+	// Out of order
+	ASSERT_RAISES(CInvalidParamsEx, table.AddRange(0x00000010, 0x00000020));
+	table.AddRange(0x01000011, 0x01000020);
+}
+
+
+TEST(IPFilterTable, RandomLookups)
+{
+	// Compare against a brute force search over the ranges.
+	std::vector<uint32> starts;
+	std::vector<uint32> ends;
+	CIPFilterTable table;
+	uint32 seed = 12345;
+	uint32 ip = 0;
+	for (int i = 0; i < 2000; ++i) {
+		seed = seed * 1103515245 + 12345;
+		ip += (seed >> 8) % 0x100000 + 1;
+		seed = seed * 1103515245 + 12345;
+		uint32 end = ip + (seed >> 8) % 0x28000;
+		starts.push_back(ip);
+		ends.push_back(end);
+		table.AddRange(ip, end);
+		ip = end + 1;
+	}
+	table.Finish();
+
+	for (size_t j = 0; j < starts.size(); ++j) {
+		ASSERT_EQUALS(CIPFilterTable::NotFound, table.Find(starts[j] - 1));
+		ASSERT_TRUE(table.Find(starts[j]) != CIPFilterTable::NotFound);
+		ASSERT_TRUE(table.Find(ends[j]) != CIPFilterTable::NotFound);
+	}
+
+	for (int i = 0; i < 20000; ++i) {
+		seed = seed * 1103515245 + 12345;
+		uint32 test = seed;
+		bool expected = false;
+		for (size_t j = 0; j < starts.size(); ++j) {
+			if (starts[j] <= test && test <= ends[j]) {
+				expected = true;
+				break;
+			}
+		}
+		ASSERT_EQUALS(expected, table.Find(test) != CIPFilterTable::NotFound);
+	}
+}
+
+
+TEST(IPFilterTable, WriteAndRead)
+{
+	CIPFilterTable table;
+	table.AddRange(0x0000FFFF, 0x00030000);
+	table.AddRange(0x0A000010, 0x0A000020);
+	table.AddRange(0xFFFFFF00, 0xFFFFFFFF);
+	table.Finish();
+
+	CMemFile file;
+	table.WriteTo(file);
+
+	CIPFilterTable loaded;
+	ASSERT_TRUE(loaded.ReadFrom(file.GetRawBuffer(), file.GetLength()));
+	ASSERT_EQUALS(3u, loaded.GetRangeCount());
+	ASSERT_EQUALS(CIPFilterTable::NotFound, loaded.Find(0x0000FFFE));
+	ASSERT_TRUE(loaded.Find(0x00020000) != CIPFilterTable::NotFound);
+	ASSERT_TRUE(loaded.Find(0x0A000015) != CIPFilterTable::NotFound);
+	ASSERT_EQUALS(CIPFilterTable::NotFound, loaded.Find(0x0A000021));
+	ASSERT_TRUE(loaded.Find(0xFFFFFFFF) != CIPFilterTable::NotFound);
+
+	// Truncated
+	CIPFilterTable truncated;
+	ASSERT_FALSE(truncated.ReadFrom(file.GetRawBuffer(), file.GetLength() - 4));
+
+	// Index pointing past the runs
+	file.Seek(8 + 4 * 0x8000, wxFromStart);
+	file.WriteUInt32(1000);
+	CIPFilterTable corrupt;
+	ASSERT_FALSE(corrupt.ReadFrom(file.GetRawBuffer(), file.GetLength()));
+}
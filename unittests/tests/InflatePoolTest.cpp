@@ -0,0 +1,96 @@
+#include <muleunit/test.h>
+#include "Types.h"
+#include "InflatePool.h"
+
+#include <zlib.h>
+#include <algorithm>
+#include <vector>
+
+using namespace muleunit;
+
+DECLARE_SIMPLE(InflatePool)
+
+
+namespace {
+
+// Compresses 'length' bytes into one zlib stream, like a block of OP_COMPRESSEDPART
+std::vector<byte> Compress(uint32 length)
+{
+	std::vector<byte> plain(length);
+	for (uint32 i = 0; i < length; ++i) {
+		plain[i] = (byte)(i % 251);
+	}
+
+	uLongf zippedLength = compressBound(length);
+	std::vector<byte> zipped(zippedLength);
+	compress(&zipped[0], &zippedLength, &plain[0], length);
+	zipped.resize(zippedLength);
+	return zipped;
+}
+
+}
+
+
+TEST(InflatePool, UnzipInPackets)
+{
+	const uint32 blockSize = 50000;
+	std::vector<byte> zipped = Compress(blockSize);
+	std::vector<byte> unzipped(blockSize + 1);
+
+	z_stream* stream = NULL;
+	uint32 total = 0;
+	for (uint32 pos = 0; pos < zipped.size(); pos += 100) {
+		uint32 length = std::min<uint32>(100, zipped.size() - pos);
+		uint32 lenUnzipped = blockSize - total + 1;
+		uint32 before = total;
+		ASSERT_EQUALS(Z_OK, CInflatePool::Unzip(stream, total, &zipped[pos], length, &unzipped[before], &lenUnzipped));
+		ASSERT_EQUALS(total - before, lenUnzipped);
+	}
+
+	ASSERT_EQUALS(blockSize, total);
+	// Released after the end of the stream
+	ASSERT_TRUE(stream == NULL);
+	for (uint32 i = 0; i < blockSize; ++i) {
+		ASSERT_EQUALS((byte)(i % 251), unzipped[i]);
+	}
+}
+
+
+TEST(InflatePool, UnzipPastBlock)
+{
+	// The packet holds more than the rest of the block
+	std::vector<byte> zipped = Compress(2000);
+	std::vector<byte> unzipped(1001);
+
+	z_stream* stream = NULL;
+	uint32 total = 0;
+	uint32 lenUnzipped = unzipped.size();
+	ASSERT_EQUALS(Z_BUF_ERROR, CInflatePool::Unzip(stream, total, &zipped[0], zipped.size(), &unzipped[0], &lenUnzipped));
+	ASSERT_EQUALS(0u, lenUnzipped);
+	ASSERT_EQUALS(0u, total);
+
+	// The stream stays with the caller
+	ASSERT_TRUE(stream != NULL);
+	CInflatePool::Release(stream);
+}
+
+
+TEST(InflatePool, UnzipAfterEnd)
+{
+	std::vector<byte> zipped = Compress(1000);
+	std::vector<byte> unzipped(1001);
+
+	z_stream* stream = NULL;
+	uint32 total = 0;
+	uint32 lenUnzipped = unzipped.size();
+	ASSERT_EQUALS(Z_OK, CInflatePool::Unzip(stream, total, &zipped[0], zipped.size(), &unzipped[0], &lenUnzipped));
+	ASSERT_EQUALS(1000u, lenUnzipped);
+	ASSERT_TRUE(stream == NULL);
+
+	// Another packet for the same block
+	lenUnzipped = unzipped.size();
+	ASSERT_EQUALS(Z_STREAM_ERROR, CInflatePool::Unzip(stream, total, &zipped[0], zipped.size(), &unzipped[0], &lenUnzipped));
+	ASSERT_EQUALS(0u, lenUnzipped);
+	ASSERT_EQUALS(1000u, total);
+	ASSERT_TRUE(stream == NULL);
+}
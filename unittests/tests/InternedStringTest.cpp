@@ -0,0 +1,61 @@
+#include <muleunit/test.h>
+#include "InternedString.h"
+
+using namespace muleunit;
+
+DECLARE_SIMPLE(InternedString)
+
+
+static CInternedString::Stats GetStats()
+{
+	CInternedString::Stats stats;
+	CInternedString::GetStats(stats);
+	return stats;
+}
+
+
+TEST(InternedString, Sharing)
+{
+	ASSERT_EQUALS(0u, GetStats().strings);
+	{
+		CInternedString a(wxT("eMule"));
+		CInternedString b;
+		b = wxString(wxT("eMule"));
+		CInternedString c(wxT("aMule"));
+
+		// Equal strings share their characters
+		ASSERT_TRUE(a == b);
+		ASSERT_TRUE(&a.Get() == &b.Get());
+		ASSERT_TRUE(a != c);
+		ASSERT_EQUALS(wxString(wxT("eMule")), a.Get());
+		ASSERT_EQUALS(2u, GetStats().strings);
+		ASSERT_EQUALS(3u, GetStats().references);
+
+		CInternedString d(a);
+		d = d;
+		ASSERT_EQUALS(4u, GetStats().references);
+		c = a;
+		ASSERT_EQUALS(1u, GetStats().strings);
+		ASSERT_EQUALS(4u, GetStats().references);
+	}
+	// The last holder removes the string
+	ASSERT_EQUALS(0u, GetStats().strings);
+	ASSERT_EQUALS(0u, GetStats().references);
+}
+
+
+TEST(InternedString, Empty)
+{
+	CInternedString a;
+	CInternedString b(wxEmptyString);
+	ASSERT_TRUE(a.IsEmpty());
+	ASSERT_TRUE(b.IsEmpty());
+	ASSERT_TRUE(a == b);
+	ASSERT_TRUE(a.Get().IsEmpty());
+
+	a = wxString(wxT("MLdonkey"));
+	ASSERT_FALSE(a.IsEmpty());
+	a = wxString();
+	ASSERT_TRUE(a.IsEmpty());
+	ASSERT_EQUALS(0u, GetStats().strings);
+}
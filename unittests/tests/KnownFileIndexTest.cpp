@@ -0,0 +1,80 @@
+#include <muleunit/test.h>
+#include "Types.h"
+#include "KnownFileIndex.h"
+
+using namespace muleunit;
+
+DECLARE_SIMPLE(KnownFileIndex)
+
+
+struct CTestFile
+{
+	CTestFile(int i, uint64 s, time_t d) : id(i), size(s), date(d) {}
+
+	uint64 GetFileSize() const		{ return size; }
+	time_t GetLastChangeDatetime() const	{ return date; }
+
+	int	id;
+	uint64	size;
+	time_t	date;
+};
+
+
+// Stands in for the name comparison of the known file list
+struct CMatchId
+{
+	CMatchId(int i) : id(i) {}
+	bool operator()(const CTestFile* file) const { return id < 0 || file->id == id; }
+	int id;
+};
+
+
+TEST(KnownFileIndex, AddFind)
+{
+	CKnownFileIndex<CTestFile> index;
+	CTestFile a(1, 1000, 5000), b(2, 2000, 5000), c(3, 1000, 6000);
+	index.Add(&a);
+	index.Add(&b);
+	index.Add(&c);
+	ASSERT_EQUALS(3u, index.size());
+
+	ASSERT_TRUE(index.Find(1000, 5000, CMatchId(-1)) == &a);
+	ASSERT_TRUE(index.Find(2000, 5000, CMatchId(-1)) == &b);
+	ASSERT_TRUE(index.Find(1000, 6000, CMatchId(-1)) == &c);
+	ASSERT_TRUE(index.Find(1000, 7000, CMatchId(-1)) == NULL);
+	ASSERT_TRUE(index.Find(1000, 5000, CMatchId(2)) == NULL);
+
+	// Sizes above 4 GB are told apart
+	CTestFile large(4, 1000 + (wxULL(1) << 32), 5000);
+	index.Add(&large);
+	ASSERT_TRUE(index.Find(1000 + (wxULL(1) << 32), 5000, CMatchId(-1)) == &large);
+	ASSERT_TRUE(index.Find(1000, 5000, CMatchId(-1)) == &a);
+}
+
+
+TEST(KnownFileIndex, SameKey)
+{
+	CKnownFileIndex<CTestFile> index;
+	CTestFile a(1, 1000, 5000), b(2, 1000, 5000), c(3, 1000, 5000);
+	index.Add(&a);
+	index.Add(&b);
+	index.Add(&c);
+
+	// The first file added wins, the others are found by the matcher
+	ASSERT_TRUE(index.Find(1000, 5000, CMatchId(-1)) == &a);
+	ASSERT_TRUE(index.Find(1000, 5000, CMatchId(2)) == &b);
+	ASSERT_TRUE(index.Find(1000, 5000, CMatchId(3)) == &c);
+
+	// Removing the first one moves up the next
+	ASSERT_TRUE(index.Remove(&a));
+	ASSERT_FALSE(index.Remove(&a));
+	ASSERT_TRUE(index.Find(1000, 5000, CMatchId(-1)) == &b);
+	ASSERT_TRUE(index.Find(1000, 5000, CMatchId(1)) == NULL);
+	ASSERT_TRUE(index.Find(1000, 5000, CMatchId(3)) == &c);
+
+	ASSERT_TRUE(index.Remove(&c));
+	ASSERT_TRUE(index.Find(1000, 5000, CMatchId(3)) == NULL);
+	ASSERT_TRUE(index.Remove(&b));
+	ASSERT_EQUALS(0u, index.size());
+	ASSERT_TRUE(index.Find(1000, 5000, CMatchId(-1)) == NULL);
+}
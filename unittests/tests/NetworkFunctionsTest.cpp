@@ -8,6 +8,7 @@ using namespace muleunit;
 // Needed for Boost-enabled build
 namespace MuleNotify {
 	void HandleNotificationAlways(const class CMuleNotiferBase&) {}
+	void HandleNotificationBatched(const class CMuleNotiferBase&) {}
 };
 
 DECLARE_SIMPLE(NetworkFunctions)
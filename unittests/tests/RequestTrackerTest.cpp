@@ -0,0 +1,152 @@
+#include <muleunit/test.h>
+#include "Types.h"
+#include "HashMap.h"
+#include "kademlia/net/RequestTracker.h"
+#include <common/Macros.h>
+
+using namespace muleunit;
+using namespace Kademlia;
+
+DECLARE_SIMPLE(HashMap)
+
+
+TEST(HashMap, InsertLookupErase)
+{
+	CHashMap<uint64, uint32> map;
+	ASSERT_TRUE(map.empty());
+
+	for (uint32 i = 0; i < 10000; ++i) {
+		map[i * 7919] = i;
+	}
+	ASSERT_EQUALS(10000u, map.size());
+
+	for (uint32 i = 0; i < 10000; ++i) {
+		const uint32* value = map.Lookup(i * 7919);
+		ASSERT_TRUE(value != NULL);
+		ASSERT_EQUALS(i, *value);
+	}
+	ASSERT_TRUE(map.Lookup(1) == NULL);
+
+	// Erase every other key, the others must stay reachable
+	for (uint32 i = 0; i < 10000; i += 2) {
+		ASSERT_TRUE(map.erase(i * 7919));
+	}
+	ASSERT_FALSE(map.erase(0));
+	ASSERT_EQUALS(5000u, map.size());
+	for (uint32 i = 0; i < 10000; ++i) {
+		ASSERT_EQUALS(i % 2 == 1, map.Lookup(i * 7919) != NULL);
+	}
+
+	for (uint32 i = 1; i < 10000; i += 2) {
+		ASSERT_TRUE(map.erase(i * 7919));
+	}
+	ASSERT_TRUE(map.empty());
+}
+
+
+TEST(HashMap, Clear)
+{
+	CHashMap<uint64, uint32> map;
+	for (uint32 i = 0; i < 1000; ++i) {
+		map[i] = i;
+	}
+	map.clear();
+	ASSERT_TRUE(map.empty());
+	for (uint32 i = 0; i < 1000; ++i) {
+		ASSERT_TRUE(map.Lookup(i) == NULL);
+	}
+
+	map[5] = 6;
+	ASSERT_EQUALS(1u, map.size());
+	ASSERT_EQUALS(6u, *map.Lookup(5));
+}
+
+
+DECLARE_SIMPLE(RequestTracker)
+
+
+TEST(RequestTracker, OutgoingRequests)
+{
+	COutRequestTracker tracker(SEC2MS(180));
+
+	tracker.Add(0x01020304, 0x21, 1000);
+	tracker.Add(0x01020304, 0x21, 2000);
+
+	// Other opcode or IP
+	ASSERT_FALSE(tracker.Check(0x01020304, 0x11, 3000, false));
+	ASSERT_FALSE(tracker.Check(0x01020305, 0x21, 3000, false));
+
+	// Two requests, two answers
+	ASSERT_TRUE(tracker.Check(0x01020304, 0x21, 3000, true));
+	ASSERT_TRUE(tracker.Check(0x01020304, 0x21, 3000, false));
+	ASSERT_TRUE(tracker.Check(0x01020304, 0x21, 3000, false));
+	ASSERT_FALSE(tracker.Check(0x01020304, 0x21, 3000, false));
+	ASSERT_EQUALS(0u, tracker.GetCount());
+
+	// Requests time out
+	tracker.Add(0x01020304, 0x21, 10000);
+	tracker.Add(0x01020304, 0x21, 20000);
+	ASSERT_TRUE(tracker.Check(0x01020304, 0x21, 10000 + SEC2MS(180), true));
+	ASSERT_TRUE(tracker.Check(0x01020304, 0x21, 10000 + SEC2MS(180), false));
+	ASSERT_FALSE(tracker.Check(0x01020304, 0x21, 10000 + SEC2MS(180), false));
+}
+
+
+TEST(RequestTracker, OutgoingExpiry)
+{
+	COutRequestTracker tracker(SEC2MS(180));
+
+	for (uint32 i = 0; i < 50000; ++i) {
+		tracker.Add(0x0a000000 + i, 0x21, i);
+	}
+	ASSERT_EQUALS(50000u, tracker.GetCount());
+
+	// Sending one more request drops all timed out ones
+	tracker.Add(0x0b000000, 0x21, 50000 + SEC2MS(180));
+	ASSERT_EQUALS(1u, tracker.GetCount());
+}
+
+
+TEST(RequestTracker, IncomingFlood)
+{
+	CInRequestTracker tracker;
+	const uint32 msPerPacket = SEC2MS(20);	// 3 packets per minute
+	const uint32 floodIPs = 20000;
+
+	// Every IP sends 20 requests within a few seconds
+	uint32 now = 1000;
+	for (uint32 round = 0; round < 20; ++round) {
+		for (uint32 ip = 0; ip < floodIPs; ++ip) {
+			CInRequestTracker::TrackedRequestIn_Struct& request = tracker.Add(0x0a000000 + ip, 0x33, now, msPerPacket);
+			ASSERT_EQUALS(round + 1, request.m_count);
+		}
+		now += 100;
+	}
+	ASSERT_EQUALS(floodIPs, tracker.GetCount());
+
+	// Another opcode is counted on its own
+	ASSERT_EQUALS(1u, tracker.Add(0x0a000000, 0x34, now, msPerPacket).m_count);
+
+	// The counters go down by one every 'msPerPacket'
+	now += 5 * msPerPacket;
+	ASSERT_EQUALS(16u, tracker.Add(0x0a000001, 0x33, now, msPerPacket).m_count);
+
+	// Once quiet, the IPs are forgotten
+	now += 25 * msPerPacket + MIN2MS(2);
+	tracker.Cleanup(now);
+	ASSERT_EQUALS(0u, tracker.GetCount());
+
+	ASSERT_EQUALS(1u, tracker.Add(0x0a000001, 0x33, now, msPerPacket).m_count);
+}
+
+
+TEST(RequestTracker, IncomingTickWrap)
+{
+	CInRequestTracker tracker;
+
+	uint32 now = 0xFFFFFFFF - SEC2MS(10);
+	tracker.Add(0x01020304, 0x33, now, SEC2MS(30));
+	ASSERT_EQUALS(2u, tracker.Add(0x01020304, 0x33, now + SEC2MS(20), SEC2MS(30)).m_count);
+	tracker.Cleanup(now + MIN2MS(3));
+	ASSERT_EQUALS(0u, tracker.GetCount());
+}
@@ -0,0 +1,148 @@
+#include <muleunit/test.h>
+#include "Types.h"
+#include "kademlia/kademlia/SearchCandidates.h"
+
+using namespace muleunit;
+using namespace Kademlia;
+
+DECLARE_SIMPLE(SearchCandidates)
+
+
+struct CTestContact
+{
+	CTestContact(uint32_t ip, uint32_t rtt = 0)
+		: m_ip(ip), m_rtt(rtt)
+	{}
+
+	uint32_t GetIPAddress() const	{ return m_ip; }
+	uint16_t GetUDPPort() const	{ return 4672; }
+	uint32_t GetRTT() const		{ return m_rtt; }
+
+	uint32_t	m_ip;
+	uint32_t	m_rtt;
+};
+
+typedef CSearchCandidates<CTestContact> CTestCandidates;
+
+
+TEST(SearchCandidates, Order)
+{
+	CTestCandidates candidates;
+	CTestContact a(1), b(2), c(3);
+
+	ASSERT_FALSE(candidates.HasPossible());
+	ASSERT_TRUE(candidates.Add(CUInt128(30u), &c));
+	ASSERT_TRUE(candidates.Add(CUInt128(10u), &a));
+	ASSERT_TRUE(candidates.Add(CUInt128(20u), &b));
+	ASSERT_FALSE(candidates.Add(CUInt128(20u), &c));
+	ASSERT_EQUALS(3u, candidates.size());
+
+	ASSERT_TRUE(candidates[0].contact == &a);
+	ASSERT_TRUE(candidates[1].contact == &b);
+	ASSERT_TRUE(candidates[2].contact == &c);
+	ASSERT_TRUE(candidates.Find(CUInt128(20u))->contact == &b);
+	ASSERT_TRUE(candidates.Find(CUInt128(25u)) == NULL);
+
+	// Done with the closest, it stays known
+	ASSERT_TRUE(candidates.GetFirstPossible()->contact == &a);
+	candidates.SetTried(CUInt128(10u));
+	candidates.RemoveFirstPossible();
+	ASSERT_TRUE(candidates.GetFirstPossible()->contact == &b);
+	ASSERT_TRUE(candidates.IsKnown(CUInt128(10u)));
+	ASSERT_TRUE(candidates.FindTried(1, 4672)->contact == &a);
+	ASSERT_TRUE(candidates.FindTried(2, 4672) == NULL);
+	ASSERT_EQUALS(1u, candidates.GetTriedCount());
+
+	candidates.ClearPossible();
+	ASSERT_FALSE(candidates.HasPossible());
+	ASSERT_TRUE(candidates.GetFirstPossible() == NULL);
+	ASSERT_TRUE(candidates.GetNextUntried(3) == NULL);
+}
+
+
+TEST(SearchCandidates, Requests)
+{
+	CTestCandidates candidates;
+	CTestContact fast(1, 100), unknown(2), slow(3, 2000);
+	candidates.Add(CUInt128(1u), &fast);
+	candidates.Add(CUInt128(2u), &unknown);
+	candidates.Add(CUInt128(3u), &slow);
+
+	candidates.SetRequested(CUInt128(1u), 1000);
+	candidates.SetRequested(CUInt128(2u), 1000);
+	candidates.SetRequested(CUInt128(3u), 1000);
+	ASSERT_EQUALS(3u, candidates.GetWaitingCount());
+
+	// Four round trips for known contacts, within the limits, and the
+	// lookup average for unknown ones
+	ASSERT_EQUALS(400u, candidates.Find(CUInt128(1u))->timeout);
+	ASSERT_EQUALS(0u, candidates.Find(CUInt128(2u))->timeout);
+	ASSERT_EQUALS((uint32_t)SEARCH_REQUEST_TIMEOUT, candidates.Find(CUInt128(3u))->timeout);
+	ASSERT_EQUALS((uint32_t)SEARCH_REQUEST_MIN_TIMEOUT, CTestCandidates::GetTimeout(10));
+
+	ASSERT_EQUALS(0u, candidates.ExpireRequests(1399));
+	ASSERT_EQUALS(1u, candidates.ExpireRequests(1400));
+	ASSERT_EQUALS(2u, candidates.GetWaitingCount());
+
+	uint32_t rtt = 0;
+	ASSERT_TRUE(candidates.SetAnswered(CUInt128(2u), 1250, rtt));
+	ASSERT_EQUALS(250u, rtt);
+	ASSERT_FALSE(candidates.SetAnswered(CUInt128(2u), 1300, rtt));
+	ASSERT_EQUALS(1u, candidates.GetWaitingCount());
+
+	// A late answer still measures the round trip
+	ASSERT_TRUE(candidates.SetAnswered(CUInt128(1u), 1900, rtt));
+	ASSERT_EQUALS(900u, rtt);
+	ASSERT_EQUALS(1u, candidates.GetWaitingCount());
+
+	candidates.SetResponded(CUInt128(2u), true);
+	ASSERT_TRUE(candidates.Find(CUInt128(2u))->HasResponded());
+	ASSERT_FALSE(candidates.Find(CUInt128(3u))->HasResponded());
+
+	ASSERT_EQUALS(1u, candidates.ExpireRequests(4000));
+	ASSERT_EQUALS(0u, candidates.GetWaitingCount());
+
+	// The tick wraps around
+	candidates.SetRequested(CUInt128(3u), 0xFFFFFF00);
+	ASSERT_EQUALS(0u, candidates.ExpireRequests(100));
+	ASSERT_EQUALS(1u, candidates.ExpireRequests(0xFFFFFF00 + SEARCH_REQUEST_TIMEOUT));
+}
+
+
+TEST(SearchCandidates, NextUntried)
+{
+	CTestCandidates candidates;
+	CTestContact c1(1), c2(2, 50), c3(3, 1000), c4(4, 10);
+	candidates.Add(CUInt128(1u), &c1);
+	candidates.Add(CUInt128(2u), &c2);
+	candidates.Add(CUInt128(3u), &c3);
+	candidates.Add(CUInt128(4u), &c4);
+
+	// The fastest of the closest, unknown ones count as SEARCH_UNKNOWN_RTT
+	ASSERT_TRUE(candidates.GetNextUntried(1)->contact == &c1);
+	ASSERT_TRUE(candidates.GetNextUntried(3)->contact == &c2);
+	candidates.SetTried(CUInt128(2u));
+	ASSERT_TRUE(candidates.GetNextUntried(3)->contact == &c4);
+	candidates.SetTried(CUInt128(4u));
+	ASSERT_TRUE(candidates.GetNextUntried(3)->contact == &c1);
+	candidates.SetTried(CUInt128(1u));
+	ASSERT_TRUE(candidates.GetNextUntried(3)->contact == &c3);
+	candidates.SetTried(CUInt128(3u));
+	ASSERT_TRUE(candidates.GetNextUntried(3) == NULL);
+	ASSERT_EQUALS(4u, candidates.GetTriedCount());
+}
+
+
+TEST(SearchCandidates, Best)
+{
+	CTestCandidates candidates;
+	ASSERT_TRUE(candidates.OfferBest(CUInt128(50u), 3));
+	ASSERT_TRUE(candidates.OfferBest(CUInt128(40u), 3));
+	ASSERT_TRUE(candidates.OfferBest(CUInt128(60u), 3));
+	ASSERT_FALSE(candidates.OfferBest(CUInt128(70u), 3));
+	ASSERT_TRUE(candidates.OfferBest(CUInt128(55u), 3));
+	// 60 was pushed out
+	ASSERT_FALSE(candidates.OfferBest(CUInt128(58u), 3));
+	ASSERT_TRUE(candidates.OfferBest(CUInt128(10u), 3));
+	ASSERT_FALSE(candidates.OfferBest(CUInt128(52u), 3));
+}
@@ -0,0 +1,135 @@
+#include <muleunit/test.h>
+#include <wx/string.h>
+#include "Types.h"
+#include "ServerIndex.h"
+
+using namespace muleunit;
+
+DECLARE_SIMPLE(ServerIndex)
+
+
+class CTestServer
+{
+public:
+	CTestServer(uint32 ecid, uint32 ip, const wxString& address, uint16 port, uint16 obfuscationPortUDP = 0)
+		: m_ecid(ecid), m_ip(ip), m_address(address), m_port(port), m_obfuscationPortUDP(obfuscationPortUDP)
+	{
+	}
+
+	uint32 ECID() const			{ return m_ecid; }
+	uint32 GetIP() const			{ return m_ip; }
+	const wxString& GetAddress() const	{ return m_address; }
+	uint16 GetPort() const			{ return m_port; }
+	uint16 GetObfuscationPortUDP() const	{ return m_obfuscationPortUDP; }
+
+	void SetID(uint32 ip)			{ m_ip = ip; }
+	void SetAddress(const wxString& address){ m_address = address; }
+	void SetPort(uint16 port)		{ m_port = port; }
+
+private:
+	uint32		m_ecid;
+	uint32		m_ip;
+	wxString	m_address;
+	uint16		m_port;
+	uint16		m_obfuscationPortUDP;
+};
+
+typedef CServerIndex<CTestServer> CTestIndex;
+
+
+TEST(ServerIndex, UDPPorts)
+{
+	CTestServer server(1, 0x01020304, wxT("4.3.2.1"), 4661, 5000);
+
+	ASSERT_TRUE(CTestIndex::IsUDPPortOf(&server, 4665, false));
+	ASSERT_TRUE(CTestIndex::IsUDPPortOf(&server, 4673, false));
+	ASSERT_FALSE(CTestIndex::IsUDPPortOf(&server, 4661, true));
+	ASSERT_FALSE(CTestIndex::IsUDPPortOf(&server, 4669, true));
+
+	// The obfuscation port only when asked for
+	ASSERT_TRUE(CTestIndex::IsUDPPortOf(&server, 5000, true));
+	ASSERT_FALSE(CTestIndex::IsUDPPortOf(&server, 5000, false));
+
+	// The offsets do not wrap around
+	CTestServer high(2, 0x01020304, wxT("4.3.2.1"), 65534);
+	ASSERT_FALSE(CTestIndex::IsUDPPortOf(&high, 2, false));
+	ASSERT_FALSE(CTestIndex::IsUDPPortOf(&high, 10, false));
+	CTestServer low(3, 0x01020304, wxT("4.3.2.1"), 0);
+	ASSERT_TRUE(CTestIndex::IsUDPPortOf(&low, 4, false));
+	ASSERT_FALSE(CTestIndex::IsUDPPortOf(&low, 0, false));
+}
+
+
+TEST(ServerIndex, Lookups)
+{
+	CTestIndex index;
+	CTestServer a(1, 0x01020304, wxT("4.3.2.1"), 4661, 5000);
+	// Same IP, other port
+	CTestServer b(2, 0x01020304, wxT("4.3.2.1"), 4242);
+	CTestServer c(3, 0x05060708, wxT("server.example.org"), 4661);
+	index.Add(&a);
+	index.Add(&b);
+	index.Add(&c);
+	ASSERT_EQUALS(3u, index.size());
+
+	ASSERT_TRUE(index.FindByIP(0x01020304) == &a);
+	ASSERT_TRUE(index.FindByIP(0x09090909) == NULL);
+	ASSERT_TRUE(index.FindByIPTCP(0x01020304, 4242) == &b);
+	ASSERT_TRUE(index.FindByIPTCP(0x05060708, 4242) == NULL);
+
+	ASSERT_TRUE(index.FindByIPUDP(0x01020304, 4665, false) == &a);
+	ASSERT_TRUE(index.FindByIPUDP(0x01020304, 4254, false) == &b);
+	ASSERT_TRUE(index.FindByIPUDP(0x01020304, 5000, true) == &a);
+	ASSERT_TRUE(index.FindByIPUDP(0x01020304, 5000, false) == NULL);
+	ASSERT_TRUE(index.FindByIPUDP(0x05060708, 4665, true) == &c);
+
+	ASSERT_TRUE(index.FindByAddress(wxT("server.example.org"), 4661) == &c);
+	ASSERT_TRUE(index.FindByAddress(wxT("server.example.org"), 4242) == NULL);
+	ASSERT_TRUE(index.FindByAddress(wxT("4.3.2.1"), 4242) == &b);
+
+	ASSERT_TRUE(index.FindByECID(2) == &b);
+	ASSERT_TRUE(index.FindByECID(4) == NULL);
+
+	// Ports are compared when looking up, and need no update
+	b.SetPort(4243);
+	ASSERT_TRUE(index.FindByIPTCP(0x01020304, 4243) == &b);
+	ASSERT_TRUE(index.FindByAddress(wxT("4.3.2.1"), 4243) == &b);
+}
+
+
+TEST(ServerIndex, Update)
+{
+	CTestIndex index;
+	CTestServer a(1, 0, wxT("server.example.org"), 4661);
+	CTestServer b(2, 0x01020304, wxT("4.3.2.1"), 4661);
+	index.Add(&a);
+	index.Add(&b);
+	ASSERT_TRUE(index.FindByIP(0) == &a);
+
+	// Resolved
+	a.SetID(0x05060708);
+	index.Update(&a);
+	ASSERT_TRUE(index.FindByIP(0) == NULL);
+	ASSERT_TRUE(index.FindByIPUDP(0x05060708, 4665, false) == &a);
+	ASSERT_TRUE(index.FindByAddress(wxT("server.example.org"), 4661) == &a);
+
+	// New dynamic IP
+	b.SetAddress(wxT("dyn.example.org"));
+	index.Update(&b);
+	ASSERT_TRUE(index.FindByAddress(wxT("4.3.2.1"), 4661) == NULL);
+	ASSERT_TRUE(index.FindByAddress(wxT("dyn.example.org"), 4661) == &b);
+
+	ASSERT_TRUE(index.Remove(&a));
+	ASSERT_FALSE(index.Remove(&a));
+	ASSERT_TRUE(index.FindByIP(0x05060708) == NULL);
+	ASSERT_TRUE(index.FindByECID(1) == NULL);
+	ASSERT_EQUALS(1u, index.size());
+
+	// Not indexed, nothing to update
+	index.Update(&a);
+	ASSERT_EQUALS(1u, index.size());
+
+	index.clear();
+	ASSERT_TRUE(index.FindByECID(2) == NULL);
+	ASSERT_TRUE(index.FindByIPTCP(0x01020304, 4661) == NULL);
+}
@@ -0,0 +1,129 @@
+#include <muleunit/test.h>
+#include "Types.h"
+#include "SharedFileTable.h"
+
+#include <vector>
+
+using namespace muleunit;
+
+DECLARE_SIMPLE(SharedFileTable)
+
+
+struct CTestFile
+{
+	CTestFile(uint32 i)
+	{
+		unsigned char raw[MD4HASH_LENGTH] = { 0 };
+		// Same first bytes for all, so the hash table has to probe
+		RawPokeUInt32(raw + 12, i);
+		hash.SetHash(raw);
+	}
+
+	const CMD4Hash& GetFileHash() const	{ return hash; }
+
+	CMD4Hash	hash;
+};
+
+
+TEST(SharedFileTable, AddFind)
+{
+	CSharedFileTable<CTestFile> table;
+	CTestFile a(1), b(2), c(3), a2(1);
+
+	ASSERT_TRUE(table.empty());
+	ASSERT_TRUE(table.Add(&a));
+	ASSERT_TRUE(table.Add(&b));
+	ASSERT_TRUE(table.Add(&c));
+	// Same hash
+	ASSERT_FALSE(table.Add(&a2));
+	ASSERT_EQUALS(3u, table.size());
+
+	ASSERT_TRUE(table.Find(a.GetFileHash()) == &a);
+	ASSERT_TRUE(table.Find(b.GetFileHash()) == &b);
+	ASSERT_TRUE(table.Find(c.GetFileHash()) == &c);
+	ASSERT_TRUE(table.Find(CTestFile(4).GetFileHash()) == NULL);
+
+	// Positions are in the order of adding
+	ASSERT_TRUE(table.GetAt(0) == &a);
+	ASSERT_TRUE(table.GetAt(1) == &b);
+	ASSERT_TRUE(table.GetAt(2) == &c);
+	ASSERT_TRUE(table.GetAt(3) == NULL);
+	ASSERT_EQUALS(2, table.GetPosition(c.GetFileHash()));
+	ASSERT_EQUALS(-1, table.GetPosition(CTestFile(4).GetFileHash()));
+}
+
+
+TEST(SharedFileTable, Remove)
+{
+	CSharedFileTable<CTestFile> table;
+	CTestFile a(1), b(2), c(3), d(4);
+	table.Add(&a);
+	table.Add(&b);
+	table.Add(&c);
+	table.Add(&d);
+	uint32 generation = table.GetGeneration();
+
+	// The last file takes the place of the removed one
+	ASSERT_TRUE(table.Remove(b.GetFileHash()) == &b);
+	ASSERT_TRUE(table.GetGeneration() != generation);
+	ASSERT_EQUALS(3u, table.size());
+	ASSERT_TRUE(table.GetAt(1) == &d);
+	ASSERT_EQUALS(1, table.GetPosition(d.GetFileHash()));
+	ASSERT_TRUE(table.Find(b.GetFileHash()) == NULL);
+	ASSERT_TRUE(table.Remove(b.GetFileHash()) == NULL);
+
+	// Removing the last one moves nothing
+	ASSERT_TRUE(table.Remove(c.GetFileHash()) == &c);
+	ASSERT_TRUE(table.GetAt(0) == &a);
+	ASSERT_TRUE(table.GetAt(1) == &d);
+	ASSERT_TRUE(table.GetAt(2) == NULL);
+
+	// Adding does not move anything
+	generation = table.GetGeneration();
+	table.Add(&b);
+	ASSERT_EQUALS(generation, table.GetGeneration());
+	ASSERT_TRUE(table.GetAt(2) == &b);
+
+	std::vector<CTestFile*> copy;
+	table.Copy(copy);
+	ASSERT_EQUALS(3u, copy.size());
+	ASSERT_TRUE(copy[0] == &a);
+	ASSERT_TRUE(copy[1] == &d);
+	ASSERT_TRUE(copy[2] == &b);
+
+	table.clear();
+	ASSERT_TRUE(table.empty());
+	ASSERT_TRUE(table.GetGeneration() != generation);
+	ASSERT_TRUE(table.Find(a.GetFileHash()) == NULL);
+}
+
+
+TEST(SharedFileTable, Many)
+{
+	const uint32 count = 20000;
+	std::vector<CTestFile*> files;
+	CSharedFileTable<CTestFile> table;
+	for (uint32 i = 0; i < count; ++i) {
+		files.push_back(new CTestFile(i));
+		ASSERT_TRUE(table.Add(files[i]));
+	}
+
+	// Remove every third file, the others must keep matching their positions
+	for (uint32 i = 0; i < count; i += 3) {
+		ASSERT_TRUE(table.Remove(files[i]->GetFileHash()) == files[i]);
+	}
+	ASSERT_EQUALS(count - (count + 2) / 3, table.size());
+	for (uint32 i = 0; i < count; ++i) {
+		int pos = table.GetPosition(files[i]->GetFileHash());
+		if (i % 3 == 0) {
+			ASSERT_EQUALS(-1, pos);
+		} else {
+			ASSERT_TRUE(pos >= 0);
+			ASSERT_TRUE(table.GetAt(pos) == files[i]);
+		}
+	}
+
+	for (uint32 i = 0; i < count; ++i) {
+		delete files[i];
+	}
+}